@@ -16,8 +16,9 @@ using namespace fl::events;
 using namespace fl::network;
 
 AcceptThread::AcceptThread(EPollWorkerGroup *workerGroup, Socket *listenTo,  WorkEventFactory *eventFactory,
-	uint32_t deferredAcceptTimeout, uint32_t defaultTimeout)
-	: _workerGroup(workerGroup), _listenTo(listenTo), _eventFactory(eventFactory), _defaultTimeout(defaultTimeout)
+	uint32_t deferredAcceptTimeout, uint32_t defaultTimeout, IpRateLimiter *rateLimiter)
+	: _workerGroup(workerGroup), _listenTo(listenTo), _eventFactory(eventFactory), _defaultTimeout(defaultTimeout),
+	_rateLimiter(rateLimiter)
 {
 	if (deferredAcceptTimeout) {
 		_listenTo->setDeferAccept(deferredAcceptTimeout);
@@ -30,15 +31,21 @@ AcceptThread::AcceptThread(EPollWorkerGroup *workerGroup, Socket *listenTo,  Wor
 
 void AcceptThread::run()
 {
+	// errors of a flood are logged as a few lines with the count of the suppressed ones
+	static const uint32_t ACCEPT_ERRORS_PER_SECOND = 10;
 	while (1) {
 		TIPv4 ip;
 		TEventDescriptor clientDescr = _listenTo->acceptDescriptor(ip);
 		if (clientDescr == INVALID_SOCKET) {
-			log::Error::L("AcceptThread: Connection accept error\n");
+			FL_LOG_RATE_LIMITED(log::Error, ACCEPT_ERRORS_PER_SECOND, "AcceptThread: Connection accept error\n");
 			continue;
 		};
+		if (_rateLimiter && !_rateLimiter->allow(ip)) {
+			close(clientDescr);
+			continue;
+		}
 		if (!Socket::setNonBlockIO(clientDescr)) {
-			log::Error::L("AcceptThread: cannot setNonBlockIO\n");
+			FL_LOG_RATE_LIMITED(log::Error, ACCEPT_ERRORS_PER_SECOND, "AcceptThread: cannot setNonBlockIO\n");
 			close(clientDescr);
 			continue;
 		}
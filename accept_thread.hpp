@@ -14,6 +14,7 @@
 #include "thread.hpp"
 #include "event_thread.hpp"
 #include "socket.hpp"
+#include "ip_rate_limiter.hpp"
 
 namespace fl {
 	namespace events {
@@ -26,13 +27,15 @@ namespace fl {
 			static const uint32_t DEFAULT_DEFFER_ACCEPT = 15;
 			static const uint32_t DEFAULT_ACCEPT_TIMEOUT = 15;
 			AcceptThread(EPollWorkerGroup *workerGroup, Socket *listenTo,  WorkEventFactory *eventFactory, 
-				uint32_t deferredAcceptTimeout = DEFAULT_DEFFER_ACCEPT, uint32_t defaultTimeout = DEFAULT_ACCEPT_TIMEOUT);
+				uint32_t deferredAcceptTimeout = DEFAULT_DEFFER_ACCEPT, uint32_t defaultTimeout = DEFAULT_ACCEPT_TIMEOUT,
+				IpRateLimiter *rateLimiter = NULL);
 		private:
 			virtual void run();
 			EPollWorkerGroup *_workerGroup;
 			Socket *_listenTo;
 			WorkEventFactory *_eventFactory;
 			uint32_t _defaultTimeout;
+			IpRateLimiter *_rateLimiter;
 		};
 	};
 };
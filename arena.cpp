@@ -0,0 +1,145 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Bump pointer arena for short living per request allocations
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "arena.hpp"
+
+using namespace fl::utils;
+
+__thread Arena *Arena::_current = NULL;
+
+Arena::Arena(const size_t blockSize, const size_t retainLimit)
+	: _blockSize(blockSize), _retainLimit(retainLimit), _blocks(NULL), _freeBlocks(NULL), _pos(NULL), _end(NULL),
+	_allocated(0), _reserved(0)
+{
+}
+
+Arena::~Arena()
+{
+	_release(_blocks);
+	_release(_freeBlocks);
+}
+
+void Arena::_release(Block *block)
+{
+	while (block) {
+		Block *next = block->next;
+		::free(block);
+		block = next;
+	}
+}
+
+void *Arena::_allocateFromNewBlock(const size_t size, const size_t align)
+{
+	size_t needed = size + align;
+	Block *block = NULL;
+	for (Block **prev = &_freeBlocks; *prev; prev = &(*prev)->next) {
+		if ((*prev)->size >= needed) {
+			block = *prev;
+			*prev = block->next;
+			break;
+		}
+	}
+	if (!block) {
+		size_t blockSize = (needed > _blockSize) ? needed : _blockSize;
+		block = static_cast<Block*>(malloc(sizeof(Block) + blockSize));
+		if (!block)
+			throw std::bad_alloc();
+		block->size = blockSize;
+		_reserved += blockSize;
+	}
+	block->next = _blocks;
+	_blocks = block;
+	_pos = block->data();
+	_end = _pos + block->size;
+	return allocate(size, align);
+}
+
+char *Arena::strdup(const char *str, const size_t size)
+{
+	char *copy = static_cast<char*>(allocate(size + 1, 1));
+	memcpy(copy, str, size);
+	copy[size] = 0;
+	return copy;
+}
+
+void Arena::reset()
+{
+	// the blocks are kept from the first taken ones, they are enough for the most of requests
+	size_t retained = 0;
+	Block *block = _freeBlocks;
+	_freeBlocks = NULL;
+	Block *tail = NULL;
+	while (_blocks) {
+		Block *next = _blocks->next;
+		_blocks->next = block;
+		block = _blocks;
+		_blocks = next;
+	}
+	while (block) {
+		Block *next = block->next;
+		if (retained + block->size <= _retainLimit) {
+			retained += block->size;
+			block->next = NULL;
+			if (tail)
+				tail->next = block;
+			else
+				_freeBlocks = block;
+			tail = block;
+		} else {
+			_reserved -= block->size;
+			::free(block);
+		}
+		block = next;
+	}
+	_pos = NULL;
+	_end = NULL;
+	_allocated = 0;
+}
+
+void *Arena::xmlAllocate(std::size_t size)
+{
+	return _current->allocate(size);
+}
+
+void Arena::xmlFree(void *data)
+{
+}
+
+ArenaPool::ArenaPool(const size_t blockSize, const uint32_t freeArenasLimit)
+	: _blockSize(blockSize), _freeArenasLimit(freeArenasLimit)
+{
+}
+
+ArenaPool::~ArenaPool()
+{
+	for (auto arena = _freeArenas.begin(); arena != _freeArenas.end(); arena++)
+		delete *arena;
+}
+
+Arena *ArenaPool::get()
+{
+	if (_freeArenas.empty())
+		return new Arena(_blockSize);
+	Arena *arena = _freeArenas.back();
+	_freeArenas.pop_back();
+	return arena;
+}
+
+void ArenaPool::free(Arena *arena)
+{
+	if (_freeArenas.size() >= _freeArenasLimit) {
+		delete arena;
+	} else {
+		arena->reset();
+		_freeArenas.push_back(arena);
+	}
+}
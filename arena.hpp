@@ -0,0 +1,186 @@
+#pragma once
+#ifndef __FL_ARENA_HPP
+#define	__FL_ARENA_HPP
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Bump pointer arena for short living per request allocations
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <utility>
+#include <new>
+
+namespace fl {
+	namespace utils {
+		// Memory is taken from blocks by moving a pointer and it is released by reset() only, destructors of objects
+		// created in the arena are not called. Blocks are kept by reset() up to retainLimit bytes, so a repeated
+		// request cycle allocates nothing from the heap after the first cycles
+		class Arena
+		{
+		public:
+			static const size_t DEFAULT_BLOCK_SIZE = 16 * 1024;
+			static const size_t DEFAULT_RETAIN_LIMIT = 256 * 1024;
+			Arena(const size_t blockSize = DEFAULT_BLOCK_SIZE, const size_t retainLimit = DEFAULT_RETAIN_LIMIT);
+			~Arena();
+			Arena(const Arena &) = delete;
+			Arena &operator=(const Arena &) = delete;
+
+			void *allocate(const size_t size, const size_t align = alignof(std::max_align_t))
+			{
+				char *pos = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(_pos) + align - 1) & ~(align - 1));
+				if (pos + size > _end)
+					return _allocateFromNewBlock(size, align);
+				_pos = pos + size;
+				_allocated += size;
+				return pos;
+			}
+			// the memory of the last allocation is reused, others are released by reset()
+			void free(void *data, const size_t size)
+			{
+				if (static_cast<char*>(data) + size == _pos) {
+					_pos = static_cast<char*>(data);
+					_allocated -= size;
+				}
+			}
+			template <class T, class... TArgs>
+			T *create(TArgs&&... args)
+			{
+				return new (allocate(sizeof(T), alignof(T))) T(std::forward<TArgs>(args)...);
+			}
+			// copies the string with 0 at the end
+			char *strdup(const char *str, const size_t size);
+			void reset();
+
+			// bytes given by allocate since the last reset
+			size_t allocated() const
+			{
+				return _allocated;
+			}
+			// bytes of the blocks taken from the heap
+			size_t reserved() const
+			{
+				return _reserved;
+			}
+
+			// arena of the request which is processed by the current thread, NULL if there is no such
+			static Arena *current()
+			{
+				return _current;
+			}
+			class Scope
+			{
+			public:
+				Scope(Arena *arena)
+					: _previous(_current)
+				{
+					_current = arena;
+				}
+				~Scope()
+				{
+					_current = _previous;
+				}
+			private:
+				Arena *_previous;
+			};
+			// rapidxml memory_pool::set_allocator functions, they use the current arena
+			static void *xmlAllocate(std::size_t size);
+			static void xmlFree(void *data);
+		private:
+			struct Block
+			{
+				Block *next;
+				size_t size;
+				char *data()
+				{
+					return reinterpret_cast<char*>(this + 1);
+				}
+			};
+			void *_allocateFromNewBlock(const size_t size, const size_t align);
+			static void _release(Block *block);
+
+			size_t _blockSize;
+			size_t _retainLimit;
+			Block *_blocks; // the current block is the first one
+			Block *_freeBlocks;
+			char *_pos;
+			char *_end;
+			size_t _allocated;
+			size_t _reserved;
+			static __thread Arena *_current;
+		};
+
+		template <class T>
+		class ArenaAllocator
+		{
+		public:
+			typedef T value_type;
+			ArenaAllocator(Arena *arena) noexcept
+				: _arena(arena)
+			{
+			}
+			template <class U>
+			ArenaAllocator(const ArenaAllocator<U> &other) noexcept
+				: _arena(other.arena())
+			{
+			}
+			T *allocate(const size_t count)
+			{
+				return static_cast<T*>(_arena->allocate(count * sizeof(T), alignof(T)));
+			}
+			void deallocate(T *data, const size_t count) noexcept
+			{
+				_arena->free(data, count * sizeof(T));
+			}
+			Arena *arena() const
+			{
+				return _arena;
+			}
+			template <class U>
+			bool operator==(const ArenaAllocator<U> &other) const
+			{
+				return _arena == other.arena();
+			}
+			template <class U>
+			bool operator!=(const ArenaAllocator<U> &other) const
+			{
+				return _arena != other.arena();
+			}
+		private:
+			Arena *_arena;
+		};
+
+		typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>> ArenaString;
+		template <class T>
+		using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+		// Per thread pool of arenas, arenas are reset when they are returned
+		class ArenaPool
+		{
+		public:
+			ArenaPool(const size_t blockSize = Arena::DEFAULT_BLOCK_SIZE, const uint32_t freeArenasLimit = 1024);
+			~ArenaPool();
+			ArenaPool(const ArenaPool &) = delete;
+			ArenaPool &operator=(const ArenaPool &) = delete;
+			Arena *get();
+			void free(Arena *arena);
+			size_t freeArenas() const
+			{
+				return _freeArenas.size();
+			}
+		private:
+			size_t _blockSize;
+			uint32_t _freeArenasLimit;
+			std::vector<Arena*> _freeArenas;
+		};
+	};
+};
+
+#endif	// __FL_ARENA_HPP
@@ -0,0 +1,265 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Asynchronous log target with per thread lock free rings
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <exception>
+#include <limits.h>
+#include <sched.h>
+#include <sys/uio.h>
+#include "async_log.hpp"
+
+using namespace fl::log;
+
+std::atomic<uint64_t> AsyncFileTarget::_lastId(0);
+__thread AsyncFileTarget::ThreadRing AsyncFileTarget::_threadRings[THREAD_RINGS_SIZE];
+
+AsyncFileTarget::Ring::Ring(const uint32_t size, const pthread_t owner)
+	: data(new char[size]), size(size), owner(owner), head(0), tail(0)
+{
+}
+
+AsyncFileTarget::Ring::~Ring()
+{
+	delete [] data;
+}
+
+AsyncFileTarget::AsyncFileTarget(const char *fileName, const EOverflow overflow, const uint32_t ringSize,
+	const uint32_t flushIntervalMs)
+	: _id(++_lastId), _dropped(0), _file(fileName), _overflow(overflow), _ringSize(2 * MAX_MESSAGE_SIZE),
+	_flushIntervalMs(flushIntervalMs), _written(0), _stop(false), _writer(this)
+{
+	while (_ringSize < ringSize)
+		_ringSize *= 2;
+	if (!_writer.create()) {
+		printf("Cannot create log writer thread\n");
+		throw std::exception();
+	}
+}
+
+AsyncFileTarget::~AsyncFileTarget()
+{
+	_stop.store(true);
+	_writer.waitMe();
+	flush();
+	for (auto ring = _rings.begin(); ring != _rings.end(); ring++)
+		delete *ring;
+}
+
+void AsyncFileTarget::WriterThread::run()
+{
+	// long intervals are slept in steps to see the stop of the target
+	static const uint32_t STOP_CHECK_MS = 50;
+	uint32_t sleptMs = _target->_flushIntervalMs;
+	while (!_target->_stop.load()) {
+		if (sleptMs >= _target->_flushIntervalMs) {
+			if (_target->_write())
+				continue;
+			sleptMs = 0;
+		}
+		uint32_t sleepMs = _target->_flushIntervalMs - sleptMs;
+		if (sleepMs > STOP_CHECK_MS)
+			sleepMs = STOP_CHECK_MS;
+		else if (sleepMs == 0)
+			sleepMs = 1;
+		struct timespec interval;
+		interval.tv_sec = 0;
+		interval.tv_nsec = sleepMs * 1000000;
+		nanosleep(&interval, NULL);
+		sleptMs += sleepMs;
+	}
+}
+
+AsyncFileTarget::Ring *AsyncFileTarget::_threadRing()
+{
+	ThreadRing &threadRing = _threadRings[_id % THREAD_RINGS_SIZE];
+	if (threadRing.targetId == _id)
+		return threadRing.ring;
+	pthread_t self = pthread_self();
+	Ring *ring = NULL;
+	_ringsSync.lock();
+	for (auto targetRing = _rings.begin(); targetRing != _rings.end(); targetRing++) {
+		// a ring of a finished thread is taken by a new thread with the same id
+		if (pthread_equal((*targetRing)->owner, self)) {
+			ring = *targetRing;
+			break;
+		}
+	}
+	if (!ring) {
+		ring = new Ring(_ringSize, self);
+		_rings.push_back(ring);
+	}
+	_ringsSync.unLock();
+	threadRing.targetId = _id;
+	threadRing.ring = ring;
+	return ring;
+}
+
+void AsyncFileTarget::_push(const int level, const char *message, uint32_t size)
+{
+	Ring *ring = _threadRing();
+	uint64_t head = ring->head.load(std::memory_order_relaxed);
+	while (head + size - ring->tail.load(std::memory_order_acquire) > ring->size) {
+		if (_overflow == DROP) {
+			_dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		sched_yield();
+	}
+	uint32_t pos = head & (ring->size - 1);
+	uint32_t first = ring->size - pos;
+	if (first >= size) {
+		memcpy(ring->data + pos, message, size);
+	} else {
+		memcpy(ring->data + pos, message, first);
+		memcpy(ring->data, message + first, size - first);
+	}
+	ring->head.store(head + size, std::memory_order_release);
+	if (level == ELogLevel::FATAL)
+		flush();
+}
+
+bool AsyncFileTarget::_write()
+{
+	_writeSync.lock();
+	_ringsSync.lock();
+	_writeRings = _rings;
+	_ringsSync.unLock();
+	_writePending.resize(_writeRings.size());
+
+	bool written = false;
+	struct iovec iov[IOV_MAX];
+	for (size_t ring = 0; ring < _writeRings.size(); ) {
+		int iovCount = 0;
+		size_t lastRing = ring;
+		size_t total = 0;
+		for (; (lastRing < _writeRings.size()) && (iovCount + 2 <= IOV_MAX); lastRing++) {
+			Ring *r = _writeRings[lastRing];
+			uint64_t tail = r->tail.load(std::memory_order_relaxed);
+			uint64_t pending = r->head.load(std::memory_order_acquire) - tail;
+			_writePending[lastRing] = pending;
+			if (!pending)
+				continue;
+			uint32_t pos = tail & (r->size - 1);
+			uint32_t first = r->size - pos;
+			iov[iovCount].iov_base = r->data + pos;
+			if (first >= pending) {
+				iov[iovCount++].iov_len = pending;
+			} else {
+				iov[iovCount++].iov_len = first;
+				iov[iovCount].iov_base = r->data;
+				iov[iovCount++].iov_len = pending - first;
+			}
+			total += pending;
+		}
+		if (!iovCount)
+			break;
+		ssize_t res = _file.writev(iov, iovCount);
+		// the messages are skipped on errors to not block the logging threads
+		size_t done = (res <= 0) ? total : res;
+		if (res > 0)
+			_written.fetch_add(res, std::memory_order_relaxed);
+		written = true;
+		// the tails are moved in the order of the iovecs, the rest of a partial write is taken by the next pass
+		for (; (ring < lastRing) && (done > 0); ring++) {
+			Ring *r = _writeRings[ring];
+			uint64_t tail = r->tail.load(std::memory_order_relaxed);
+			uint64_t pending = _writePending[ring]; // the head can be moved after the iovecs were taken
+			if (pending > done) {
+				r->tail.store(tail + done, std::memory_order_release);
+				done = 0;
+				break;
+			}
+			r->tail.store(tail + pending, std::memory_order_release);
+			done -= pending;
+		}
+	}
+	_writeSync.unLock();
+	return written;
+}
+
+void AsyncFileTarget::_writeDirect(const char *data, size_t size)
+{
+	_writeSync.lock();
+	ssize_t res = _file.write(data, size);
+	if (res > 0)
+		_written.fetch_add(res, std::memory_order_relaxed);
+	_writeSync.unLock();
+}
+
+void AsyncFileTarget::_writeHeader(const char *data, size_t size)
+{
+	_writeSync.lock();
+	_file.writeHeader(data, size);
+	_written.fetch_add(size, std::memory_order_relaxed);
+	_writeSync.unLock();
+}
+
+void AsyncFileTarget::setRotation(const uint64_t maxSize, const uint32_t intervalSeconds, const uint32_t keepFiles,
+	const bool compress)
+{
+	_writeSync.lock();
+	_file.setRotation(maxSize, intervalSeconds, keepFiles, compress);
+	_writeSync.unLock();
+}
+
+void AsyncFileTarget::rotate()
+{
+	_writeSync.lock();
+	_file.rotate();
+	_writeSync.unLock();
+}
+
+void AsyncFileTarget::flush()
+{
+	while (_write())
+		;
+}
+
+void AsyncFileTarget::log(
+	const int level,
+	const char *tag,
+	const time_t curTime,
+	struct tm *ct,
+	const char *fmt,
+	va_list args
+)
+{
+	char message[MAX_MESSAGE_SIZE];
+	int size = _prefix(message, level, tag, curTime, ct);
+	size += vsnprintf(message + size, sizeof(message) - size, fmt, args);
+	if (size >= static_cast<int>(sizeof(message))) {
+		size = sizeof(message);
+		message[size - 1] = '\n';
+	}
+	_push(level, message, size);
+}
+
+void AsyncFileTarget::log(
+	const int level,
+	const char *fileName,
+	const int lineNumber,
+	const char *tag,
+	const time_t curTime,
+	struct tm *ct,
+	const char *fmt,
+	va_list args
+)
+{
+	char message[MAX_MESSAGE_SIZE];
+	int size = _prefix(message, level, fileName, lineNumber, tag, curTime, ct);
+	size += vsnprintf(message + size, sizeof(message) - size, fmt, args);
+	if (size >= static_cast<int>(sizeof(message))) {
+		size = sizeof(message);
+		message[size - 1] = '\n';
+	}
+	_push(level, message, size);
+}
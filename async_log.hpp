@@ -0,0 +1,142 @@
+#pragma once
+#ifndef __FL_ASYNC_LOG_HPP
+#define	__FL_ASYNC_LOG_HPP
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Asynchronous log target with per thread lock free rings
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <atomic>
+#include <vector>
+#include <pthread.h>
+#include "log.hpp"
+#include "mutex.hpp"
+#include "thread.hpp"
+
+namespace fl {
+	namespace log {
+		using fl::threads::Mutex;
+		using fl::threads::Thread;
+
+		// Messages are formatted by the logging threads into their own single producer rings, a writer thread takes
+		// the rings of all threads every flush interval with one writev. FATAL messages and flush() return after
+		// all queued messages are written, the destructor writes the rest of the messages
+		class AsyncFileTarget : public Target
+		{
+		public:
+			enum EOverflow
+			{
+				DROP, // the message is counted by dropped()
+				BLOCK, // the logging thread waits for the writer
+			};
+			static const uint32_t MAX_MESSAGE_SIZE = 4096; // longer messages are truncated
+			static const uint32_t DEFAULT_RING_SIZE = 64 * 1024;
+
+			// ringSize is rounded up to a power of 2
+			AsyncFileTarget(const char *fileName, const EOverflow overflow = DROP,
+				const uint32_t ringSize = DEFAULT_RING_SIZE, const uint32_t flushIntervalMs = 10);
+			virtual ~AsyncFileTarget();
+			virtual void log(
+				const int level,
+				const char *tag,
+				const time_t curTime,
+				struct tm *ct,
+				const char *fmt,
+				va_list args
+			);
+			virtual void log(
+				const int level,
+				const char *fileName,
+				const int lineNumber,
+				const char *tag,
+				const time_t curTime,
+				struct tm *ct,
+				const char *fmt,
+				va_list args
+			);
+			virtual void flush();
+			// see LogFile::setRotation, the file is rotated and reopened by the writer thread
+			void setRotation(const uint64_t maxSize, const uint32_t intervalSeconds = 0, const uint32_t keepFiles = 0,
+				const bool compress = false);
+			void rotate();
+			uint64_t dropped() const
+			{
+				return _dropped.load(std::memory_order_relaxed);
+			}
+			// bytes written to the file
+			uint64_t written() const
+			{
+				return _written.load(std::memory_order_relaxed);
+			}
+		protected:
+			// copies a formatted message to the ring of the thread
+			void _push(const int level, const char *message, uint32_t size);
+			// writes the data to the file before the messages which are pushed after the call
+			void _writeDirect(const char *data, size_t size);
+			// writes the data like _writeDirect and to the start of each rotated file
+			void _writeHeader(const char *data, size_t size);
+			uint64_t _id;
+			std::atomic<uint64_t> _dropped;
+		private:
+			static const size_t CACHE_LINE_SIZE = 64;
+			struct Ring
+			{
+				Ring(const uint32_t size, const pthread_t owner);
+				~Ring();
+				char *data;
+				uint32_t size;
+				pthread_t owner;
+				// the padding keeps head and tail on their own cache lines, new doesn't align the rings
+				char headPadding[CACHE_LINE_SIZE];
+				std::atomic<uint64_t> head; // moved by the owner after a message is copied
+				char tailPadding[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+				std::atomic<uint64_t> tail; // moved by the writer
+				char endPadding[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+			};
+			class WriterThread : public Thread
+			{
+			public:
+				WriterThread(AsyncFileTarget *target)
+					: _target(target)
+				{
+				}
+			private:
+				virtual void run();
+				AsyncFileTarget *_target;
+			};
+			Ring *_threadRing();
+			bool _write();
+
+			LogFile _file;
+			EOverflow _overflow;
+			uint32_t _ringSize;
+			uint32_t _flushIntervalMs;
+			Mutex _ringsSync;
+			std::vector<Ring*> _rings;
+			Mutex _writeSync; // the rings are taken by the writer thread and by the flushing threads
+			std::vector<Ring*> _writeRings;
+			std::vector<uint64_t> _writePending;
+			std::atomic<uint64_t> _written;
+			std::atomic<bool> _stop;
+			WriterThread _writer;
+
+			static std::atomic<uint64_t> _lastId;
+			// rings of the thread by the target ids, a target takes the entry of its id modulo the size
+			static const uint32_t THREAD_RINGS_SIZE = 8;
+			struct ThreadRing
+			{
+				uint64_t targetId;
+				Ring *ring;
+			};
+			static __thread ThreadRing _threadRings[THREAD_RINGS_SIZE];
+		};
+	};
+};
+
+#endif	// __FL_ASYNC_LOG_HPP
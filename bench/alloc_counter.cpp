@@ -0,0 +1,49 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Heap allocations counter for the benchmarks
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include "alloc_counter.hpp"
+
+// glibc entry points, the wrappers below replace malloc family for the whole benchmark binary
+extern "C" {
+	void *__libc_malloc(size_t size);
+	void *__libc_calloc(size_t count, size_t size);
+	void *__libc_realloc(void *ptr, size_t size);
+};
+
+namespace
+{
+	__thread uint64_t allocations = 0;
+};
+
+uint64_t fl::bench::allocationsCount()
+{
+	return allocations;
+}
+
+extern "C" {
+	void *malloc(size_t size)
+	{
+		allocations++;
+		return __libc_malloc(size);
+	}
+
+	void *calloc(size_t count, size_t size)
+	{
+		allocations++;
+		return __libc_calloc(count, size);
+	}
+
+	void *realloc(void *ptr, size_t size)
+	{
+		allocations++;
+		return __libc_realloc(ptr, size);
+	}
+};
@@ -0,0 +1,24 @@
+#pragma once
+#ifndef __FL_BENCH_ALLOC_COUNTER_HPP
+#define	__FL_BENCH_ALLOC_COUNTER_HPP
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Heap allocations counter for the benchmarks
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+
+namespace fl {
+	namespace bench {
+		// count of malloc, calloc and realloc calls (operator new included) made by the calling thread
+		uint64_t allocationsCount();
+	};
+};
+
+#endif	// __FL_BENCH_ALLOC_COUNTER_HPP
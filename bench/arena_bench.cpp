@@ -0,0 +1,114 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Per request arena benchmarks against the heap
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+#include "bench.hpp"
+#include "arena.hpp"
+#include "rapidxml/rapidxml.hpp"
+
+using namespace fl::bench;
+using namespace fl::utils;
+
+namespace
+{
+	const char *QUERY = "folder=INBOX&sort=date&order=desc&offset=40&limit=20&fields=subject,from,date,size"
+		"&search=quarterly%20report&session=4f2c9a8e71d5b3064a1e";
+
+	// splits the query into the parameters like an interface does in parseURI
+	template <class TString, class TParams>
+	void parseQuery(const char *query, TParams &params, const TString &empty)
+	{
+		const char *end = query + strlen(query);
+		while (query < end) {
+			const char *paramEnd = static_cast<const char*>(memchr(query, '&', end - query));
+			if (!paramEnd)
+				paramEnd = end;
+			const char *value = static_cast<const char*>(memchr(query, '=', paramEnd - query));
+			if (!value)
+				value = paramEnd;
+			params.emplace_back(empty, empty);
+			params.back().first.assign(query, value - query);
+			if (value < paramEnd)
+				params.back().second.assign(value + 1, paramEnd - value - 1);
+			query = paramEnd + 1;
+		}
+	}
+
+	void requestHeap(State &state)
+	{
+		uint64_t found = 0;
+		const std::string empty;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			std::string fileName("/webdav/users/john.smith/mail/INBOX/messages/0001234.eml");
+			std::vector<std::pair<std::string, std::string>> params;
+			parseQuery(QUERY, params, empty);
+			found += params.size() + fileName.size();
+			doNotOptimize(params);
+		}
+		doNotOptimize(found);
+	}
+
+	void requestArena(State &state)
+	{
+		uint64_t found = 0;
+		Arena arena;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			{
+				ArenaString fileName("/webdav/users/john.smith/mail/INBOX/messages/0001234.eml", &arena);
+				ArenaVector<std::pair<ArenaString, ArenaString>> params(&arena);
+				parseQuery(QUERY, params, ArenaString(&arena));
+				found += params.size() + fileName.size();
+				doNotOptimize(params);
+			}
+			arena.reset();
+		}
+		doNotOptimize(found);
+	}
+
+	// PROPFIND of a big collection, the nodes don't fit the static pool of the document
+	const std::string &propFind()
+	{
+		static std::string xml;
+		if (xml.empty()) {
+			xml = "<?xml version=\"1.0\" encoding=\"utf-8\"?><propfind xmlns=\"DAV:\">";
+			for (int i = 0; i < 2000; i++)
+				xml.append("<prop><getcontentlength/><getlastmodified/><resourcetype/></prop>");
+			xml.append("</propfind>");
+		}
+		return xml;
+	}
+
+	template <bool useArena>
+	void xmlPropFind(State &state)
+	{
+		const std::string &xml = propFind();
+		std::vector<char> data(xml.size() + 1);
+		Arena arena(Arena::DEFAULT_BLOCK_SIZE, 1024 * 1024); // the dynamic pool blocks of the document are 64K
+		uint64_t nodes = 0;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			memcpy(data.data(), xml.c_str(), data.size());
+			Arena::Scope scope(&arena);
+			rapidxml::xml_document<> doc;
+			if (useArena)
+				doc.set_allocator(Arena::xmlAllocate, Arena::xmlFree);
+			doc.parse<rapidxml::parse_default>(data.data());
+			for (auto node = doc.first_node("propfind")->first_node(); node != NULL; node = node->next_sibling())
+				nodes++;
+			doc.clear();
+			arena.reset();
+		}
+		doNotOptimize(nodes);
+		state.setBytesProcessed(xml.size() * state.iterations());
+	}
+};
+
+FL_BENCH("arena/request/heap", requestHeap);
+FL_BENCH("arena/request/arena", requestArena);
+FL_BENCH("arena/xml/propfind/heap", xmlPropFind<false>);
+FL_BENCH("arena/xml/propfind/arena", xmlPropFind<true>);
@@ -0,0 +1,208 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Minimal benchmark harness with machine readable (JSON lines) output
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cstdlib>
+#include "bench.hpp"
+#include "alloc_counter.hpp"
+#include "program_option.hpp"
+#include "bstring.hpp"
+#include "log.hpp"
+
+using namespace fl::bench;
+using fl::strings::BString;
+using fl::utils::ProgramOption;
+
+State::State(const uint64_t iterations, const uint64_t minTimeMs, const TParamMap *params)
+	: _iterations(iterations), _minTimeMs(minTimeMs), _params(params), _bytesProcessed(0), _elapsedNs(0),
+	_allocations(0), _startAllocations(0), _running(false)
+{
+}
+
+std::string State::param(const char *name, const char *defaultValue) const
+{
+	if (_params) {
+		auto value = _params->find(name);
+		if (value != _params->end())
+			return value->second;
+	}
+	return defaultValue;
+}
+
+double State::param(const char *name, const double defaultValue) const
+{
+	if (_params) {
+		auto value = _params->find(name);
+		if (value != _params->end())
+			return strtod(value->second.c_str(), NULL);
+	}
+	return defaultValue;
+}
+
+void State::start()
+{
+	_elapsedNs = 0;
+	_allocations = 0;
+	_running = true;
+	_startAllocations = allocationsCount();
+	_startTime = TClock::now();
+}
+
+void State::stop()
+{
+	pauseTiming();
+}
+
+void State::pauseTiming()
+{
+	if (!_running)
+		return;
+	_elapsedNs += std::chrono::duration_cast<std::chrono::nanoseconds>(TClock::now() - _startTime).count();
+	_allocations += allocationsCount() - _startAllocations;
+	_running = false;
+}
+
+void State::resumeTiming()
+{
+	if (_running)
+		return;
+	_running = true;
+	_startAllocations = allocationsCount();
+	_startTime = TClock::now();
+}
+
+uint64_t State::elapsedNs() const
+{
+	return _elapsedNs;
+}
+
+void State::addCounter(const std::string &name, const double value)
+{
+	for (auto c = _counters.begin(); c != _counters.end(); c++) {
+		if (c->first == name) {
+			c->second = value;
+			return;
+		}
+	}
+	_counters.push_back(TCounter(name, value));
+}
+
+Registry &Registry::instance()
+{
+	static Registry registry;
+	return registry;
+}
+
+void Registry::add(const std::string &name, TBenchFunction func, const bool once)
+{
+	Bench bench = {name, func, once};
+	_benches.push_back(bench);
+}
+
+static void addJSONString(BString &out, const std::string &str)
+{
+	out << '"';
+	out.addJSONEscapedUTF8(str.c_str(), str.size());
+	out << '"';
+}
+
+int Registry::run(const int argc, const char * const argv[])
+{
+	std::string filter;
+	uint64_t minTimeMs = 200;
+	FILE *out = stdout;
+	ProgramOption options(argc, argv);
+	for (auto opt = options.options().begin(); opt != options.options().end(); opt++) {
+		switch (opt->name) {
+			case 'f':
+				filter = opt->value;
+			break;
+			case 't':
+				minTimeMs = strtoull(opt->value.c_str(), NULL, 10);
+			break;
+			case 'o':
+				out = fopen(opt->value.c_str(), "w");
+				if (!out) {
+					fprintf(stderr, "Cannot open %s\n", opt->value.c_str());
+					return 1;
+				}
+			break;
+			case 'p':
+			{
+				auto eq = opt->value.find('=');
+				if (eq == std::string::npos) {
+					fprintf(stderr, "Parameter should be name=value: %s\n", opt->value.c_str());
+					return 1;
+				}
+				_params[opt->value.substr(0, eq)] = opt->value.substr(eq + 1);
+			}
+			break;
+			case 'l':
+				for (auto b = _benches.begin(); b != _benches.end(); b++)
+					printf("%s\n", b->name.c_str());
+				return 0;
+			default:
+				fprintf(stderr, "Usage: %s [-f filter] [-t minTimeMs] [-o resultFile] [-p name=value] [-l]\n", argv[0]);
+				return 1;
+		}
+	}
+	
+	BString line;
+	for (auto b = _benches.begin(); b != _benches.end(); b++) {
+		if (!filter.empty() && (b->name.find(filter) == std::string::npos))
+			continue;
+		uint64_t iterations = 1;
+		while (true) {
+			State state(iterations, minTimeMs, &_params);
+			state.start();
+			b->func(state);
+			state.stop();
+			uint64_t elapsedNs = state.elapsedNs();
+			if (b->once || (elapsedNs >= minTimeMs * 1000000) || (iterations >= (1ULL << 40))) {
+				iterations = state.iterations() ? state.iterations() : 1;
+				double nsPerOp = static_cast<double>(elapsedNs) / iterations;
+				line.clear();
+				line << "{\"name\":";
+				addJSONString(line, b->name);
+				line.sprintfAdd(",\"iterations\":%llu,\"ns_per_op\":%.3f", (unsigned long long)iterations, nsPerOp);
+				if (state.bytesProcessed() && elapsedNs)
+					line.sprintfAdd(",\"mb_per_s\":%.3f", (state.bytesProcessed() * 1000.0) / elapsedNs);
+				if (!b->once)
+					line.sprintfAdd(",\"allocs_per_op\":%.3f", static_cast<double>(state.allocations()) / iterations);
+				for (auto c = state.counters().begin(); c != state.counters().end(); c++) {
+					line << ',';
+					addJSONString(line, c->first);
+					line.sprintfAdd(":%.6g", c->second);
+				}
+				line << "}\n";
+				fwrite(line.c_str(), line.size(), 1, out);
+				fflush(out);
+				fprintf(stderr, "%-48s %14.2f ns/op\n", b->name.c_str(), nsPerOp);
+				break;
+			}
+			// aim at the minimal time with a 40% margin, grow at most 100 times per step
+			uint64_t next = elapsedNs ? (minTimeMs * 1000000 * 14 / 10) * iterations / elapsedNs : iterations * 100;
+			if (next > iterations * 100)
+				next = iterations * 100;
+			if (next <= iterations)
+				next = iterations + 1;
+			iterations = next;
+		}
+	}
+	if (out != stdout)
+		fclose(out);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	fl::log::LogSystem::defaultLog().clearTargets();
+	return Registry::instance().run(argc, argv);
+}
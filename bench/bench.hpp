@@ -0,0 +1,148 @@
+#pragma once
+#ifndef __FL_BENCH_HPP
+#define	__FL_BENCH_HPP
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Minimal benchmark harness with machine readable (JSON lines) output
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <map>
+
+namespace fl {
+	namespace bench {
+		
+		typedef std::map<std::string, std::string> TParamMap;
+		
+		class State
+		{
+		public:
+			State(const uint64_t iterations, const uint64_t minTimeMs = 0, const TParamMap *params = NULL);
+			uint64_t iterations() const
+			{
+				return _iterations;
+			}
+			// benchmarks which are run once report the count of the done operations
+			void setIterations(const uint64_t iterations)
+			{
+				_iterations = iterations;
+			}
+			uint64_t minTimeMs() const
+			{
+				return _minTimeMs;
+			}
+			// parameters from the command line (-p name=value)
+			std::string param(const char *name, const char *defaultValue) const;
+			double param(const char *name, const double defaultValue) const;
+			void pauseTiming();
+			void resumeTiming();
+			void setBytesProcessed(const uint64_t bytes)
+			{
+				_bytesProcessed = bytes;
+			}
+			void addCounter(const std::string &name, const double value);
+			
+			typedef std::pair<std::string, double> TCounter;
+			typedef std::vector<TCounter> TCounterVector;
+			const TCounterVector &counters() const
+			{
+				return _counters;
+			}
+			uint64_t bytesProcessed() const
+			{
+				return _bytesProcessed;
+			}
+			uint64_t elapsedNs() const;
+			// heap allocations made by the benchmark thread while the timing was running
+			uint64_t allocations() const
+			{
+				return _allocations;
+			}
+			void start();
+			void stop();
+		private:
+			typedef std::chrono::steady_clock TClock;
+			uint64_t _iterations;
+			uint64_t _minTimeMs;
+			const TParamMap *_params;
+			uint64_t _bytesProcessed;
+			uint64_t _elapsedNs;
+			uint64_t _allocations;
+			uint64_t _startAllocations;
+			TClock::time_point _startTime;
+			bool _running;
+			TCounterVector _counters;
+		};
+		
+		typedef std::function<void(State &state)> TBenchFunction;
+		
+		class Registry
+		{
+		public:
+			static Registry &instance();
+			// once benchmarks are called a single time and size the work themselves
+			void add(const std::string &name, TBenchFunction func, const bool once = false);
+			int run(const int argc, const char * const argv[]);
+		private:
+			struct Bench
+			{
+				std::string name;
+				TBenchFunction func;
+				bool once;
+			};
+			std::vector<Bench> _benches;
+			TParamMap _params;
+		};
+		
+		class Registrar
+		{
+		public:
+			Registrar(const char *name, TBenchFunction func, const bool once = false)
+			{
+				Registry::instance().add(name, func, once);
+			}
+			Registrar(std::function<void()> registerFunc)
+			{
+				registerFunc();
+			}
+		};
+		
+		template <class T>
+		inline void doNotOptimize(T const &value)
+		{
+			asm volatile("" : : "r,m"(value) : "memory");
+		}
+		
+		inline void clobberMemory()
+		{
+			asm volatile("" : : : "memory");
+		}
+	};
+};
+
+#define FL_BENCH_CONCAT2(a, b) a##b
+#define FL_BENCH_CONCAT(a, b) FL_BENCH_CONCAT2(a, b)
+
+// registers void func(fl::bench::State &state) under the given name
+#define FL_BENCH(name, func) \
+	static fl::bench::Registrar FL_BENCH_CONCAT(_flBenchRegistrar, __LINE__)(name, func)
+
+// registers a benchmark which is run once and calls state.setIterations itself (load tests)
+#define FL_BENCH_ONCE(name, func) \
+	static fl::bench::Registrar FL_BENCH_CONCAT(_flBenchRegistrar, __LINE__)(name, func, true)
+
+// runs arbitrary registration code (parametrized benchmarks) during static initialization
+#define FL_BENCH_REGISTER(code) \
+	static fl::bench::Registrar FL_BENCH_CONCAT(_flBenchRegistrar, __LINE__)([]() { code; })
+
+#endif	// __FL_BENCH_HPP
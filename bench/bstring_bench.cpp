@@ -0,0 +1,219 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: BString and Buffer benchmarks on the mail processing corpus
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bench.hpp"
+#include "corpus.hpp"
+#include "bstring.hpp"
+#include "buffer.hpp"
+#include "format.hpp"
+#include "serialize.hpp"
+
+using namespace fl::bench;
+using fl::strings::BString;
+using fl::utils::Buffer;
+
+namespace
+{
+	// assembling of a mail header block from small pieces, a fresh string every time
+	void bstringBuildHeaders(State &state)
+	{
+		const Corpus &c = corpus(state);
+		uint64_t bytes = 0;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			BString headers;
+			headers << "Message-ID: <" << i << ".18236742@mail.example.com>\r\n";
+			headers << "Date: Mon, 14 Jul 2014 09:12:" << (int)(i % 60) << " +0300\r\n";
+			headers << "From: " << c.mimeHeaders[2] << "\r\n";
+			headers << "Subject: " << c.mimeHeaders[i % c.mimeHeaders.size()] << "\r\n";
+			headers << "Content-Type: text/html; charset=UTF-8\r\nContent-Length: " << c.html.size() << "\r\n\r\n";
+			doNotOptimize(headers);
+			bytes += headers.size();
+		}
+		state.setBytesProcessed(bytes);
+	}
+
+	void bstringSprintf(State &state)
+	{
+		BString result;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			result.clear();
+			result.sprintfAdd("%s=%u; %s=%llu; path=/; domain=.example.com", "session", (unsigned)i, "expires",
+				(unsigned long long)(1405328000 + i));
+			doNotOptimize(result);
+		}
+	}
+
+	// the same line as bstringSprintf
+	void bstringFormat(State &state)
+	{
+		BString result;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			result.clear();
+			FL_FORMAT_ADD(result, "{}={}; {}={}; path=/; domain=.example.com", "session", (unsigned)i, "expires",
+				(unsigned long long)(1405328000 + i));
+			doNotOptimize(result);
+		}
+	}
+
+	// Nomos request line
+	void bstringSprintfHex(State &state)
+	{
+		BString req;
+		std::string level("mail_index");
+		for (uint64_t i = 0; i < state.iterations(); i++)
+			req.sprintfSet("%s,G,%s,%llx,%llx,%u\n", "1", level.c_str(), 0x1234ULL + i, 0xDEADBEEF00ULL * i, 3600U);
+		doNotOptimize(req);
+	}
+
+	void bstringFormatHex(State &state)
+	{
+		BString req;
+		std::string level("mail_index");
+		for (uint64_t i = 0; i < state.iterations(); i++)
+			FL_FORMAT_SET(req, "{},G,{},{:x},{:x},{}\n", "1", level, 0x1234ULL + i, 0xDEADBEEF00ULL * i, 3600U);
+		doNotOptimize(req);
+	}
+
+	double benchDouble(const uint64_t i)
+	{
+		return (i % 1000) * 1.37 + 1.0 / (1 + (i & 0xFF));
+	}
+
+	// %.17g is the shortest printf format which always reads back into the same double
+	void bstringSprintfDouble(State &state)
+	{
+		BString result;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			result.clear();
+			result.sprintfAdd("%.17g", benchDouble(i));
+			doNotOptimize(result);
+		}
+	}
+
+	void bstringFormatDouble(State &state)
+	{
+		BString result;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			result.clear();
+			FL_FORMAT_ADD(result, "{}", benchDouble(i));
+			doNotOptimize(result);
+		}
+	}
+
+	void bstringIntegers(State &state)
+	{
+		BString result;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			result.clear();
+			result << (int)i << ' ' << -(int64_t)i << ' ' << (uint64_t)(i * 1000003) << ' ' << (unsigned)(i & 0xFFFF);
+			doNotOptimize(result);
+		}
+	}
+
+	void bstringCopyMail(State &state)
+	{
+		const Corpus &c = corpus(state);
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			BString copy;
+			copy.add(c.html.c_str(), c.html.size());
+			doNotOptimize(copy);
+		}
+		state.setBytesProcessed(c.html.size() * state.iterations());
+	}
+
+	// typical serialization of a mail index record
+	void bufferAddGet(State &state)
+	{
+		const Corpus &c = corpus(state);
+		static const std::string SUBJECT("Re: Quarterly report - Q2 figures & forecast");
+		uint64_t bytes = 0;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			Buffer buf;
+			buf.add<uint64_t>(i);
+			buf.add<uint32_t>(1405328000);
+			buf.add(SUBJECT);
+			buf.add(c.mimeHeaders[i % c.mimeHeaders.size()]);
+			buf.add<uint8_t>(1);
+			bytes += buf.writtenSize();
+			uint64_t id;
+			uint32_t date;
+			std::string subject;
+			BString from;
+			uint8_t flags;
+			buf.get(id);
+			buf.get(date);
+			buf.get(subject);
+			buf.get(from);
+			buf.get(flags);
+			doNotOptimize(from);
+		}
+		state.setBytesProcessed(bytes);
+		state.addCounter("bytes_per_record", static_cast<double>(bytes) / state.iterations());
+	}
+
+	struct IndexRecord
+	{
+		uint64_t id;
+		uint32_t date;
+		std::string subject;
+		BString from;
+		uint8_t flags;
+		template <class TArchive> void fields(TArchive &ar)
+		{
+			ar(1, id)(2, date)(3, subject)(4, from)(5, flags);
+		}
+	};
+
+	// the same index record through the serializer, compact or tagged
+	template <bool tagged>
+	void bufferSerialize(State &state)
+	{
+		const Corpus &c = corpus(state);
+		static const std::string SUBJECT("Re: Quarterly report - Q2 figures & forecast");
+		uint64_t bytes = 0;
+		IndexRecord record;
+		record.date = 1405328000;
+		record.subject = SUBJECT;
+		record.flags = 1;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			Buffer buf;
+			record.id = i;
+			const BString &from = c.mimeHeaders[i % c.mimeHeaders.size()];
+			record.from.clear();
+			record.from.add(from.c_str(), from.size());
+			if (tagged)
+				fl::utils::serialize::encodeTagged(buf, record);
+			else
+				fl::utils::serialize::encode(buf, record);
+			bytes += buf.writtenSize();
+			IndexRecord decoded;
+			if (tagged)
+				fl::utils::serialize::decodeTagged(buf, decoded);
+			else
+				fl::utils::serialize::decode(buf, decoded);
+			doNotOptimize(decoded.from);
+		}
+		state.setBytesProcessed(bytes);
+		state.addCounter("bytes_per_record", static_cast<double>(bytes) / state.iterations());
+	}
+};
+
+FL_BENCH("bstring/build_headers", bstringBuildHeaders);
+FL_BENCH("bstring/sprintf", bstringSprintf);
+FL_BENCH("bstring/format", bstringFormat);
+FL_BENCH("bstring/sprintf/hex", bstringSprintfHex);
+FL_BENCH("bstring/format/hex", bstringFormatHex);
+FL_BENCH("bstring/sprintf/double", bstringSprintfDouble);
+FL_BENCH("bstring/format/double", bstringFormatDouble);
+FL_BENCH("bstring/integers", bstringIntegers);
+FL_BENCH("bstring/copy/mail_html", bstringCopyMail);
+FL_BENCH("buffer/add_get/index_record", bufferAddGet);
+FL_BENCH("buffer/serialize/index_record", bufferSerialize<false>);
+FL_BENCH("buffer/serialize/tagged/index_record", bufferSerialize<true>);
@@ -0,0 +1,85 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Checked-in benchmark inputs (bench/corpus)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include "corpus.hpp"
+#include "file.hpp"
+
+#ifndef FL_BENCH_CORPUS_DIR
+#define FL_BENCH_CORPUS_DIR "bench/corpus"
+#endif
+
+using namespace fl::bench;
+using fl::fs::File;
+
+namespace
+{
+	void loadFile(const std::string &dir, const char *name, BString &data)
+	{
+		std::string path = dir + "/" + name;
+		File file;
+		if (!file.open(path.c_str(), O_RDONLY)) {
+			fprintf(stderr, "Cannot open corpus file %s, set the corpus directory with -p corpus=path\n", path.c_str());
+			exit(1);
+		}
+		ssize_t size = file.fileSize();
+		if ((size <= 0) || (file.read(data.reserveBuffer(size), size) != size)) {
+			fprintf(stderr, "Cannot read corpus file %s\n", path.c_str());
+			exit(1);
+		}
+	}
+
+	void splitLines(const BString &data, std::vector<std::string> &lines)
+	{
+		const char *start = data.c_str();
+		const char *end = start + data.size();
+		while (start < end) {
+			const char *eol = static_cast<const char*>(memchr(start, '\n', end - start));
+			if (!eol)
+				eol = end;
+			if (eol > start)
+				lines.push_back(std::string(start, eol - start));
+			start = eol + 1;
+		}
+	}
+};
+
+Corpus::Corpus(const std::string &dir)
+{
+	loadFile(dir, "mail.html", html);
+	loadFile(dir, "mail_qp.txt", quotedPrintable);
+	loadFile(dir, "text_ru.txt", textUtf8);
+	BString data;
+	loadFile(dir, "urls.txt", data);
+	splitLines(data, urls);
+	data.clear();
+	loadFile(dir, "mime_headers.txt", data);
+	std::vector<std::string> lines;
+	splitLines(data, lines);
+	for (auto line = lines.begin(); line != lines.end(); line++) {
+		auto colon = line->find(": ");
+		mimeHeaders.push_back(BString());
+		mimeHeaders.back() << line->substr(colon == std::string::npos ? 0 : colon + 2);
+	}
+}
+
+const Corpus &fl::bench::corpus(State &state)
+{
+	static Corpus *data = NULL;
+	if (!data) {
+		state.pauseTiming();
+		data = new Corpus(state.param("corpus", FL_BENCH_CORPUS_DIR));
+		state.resumeTiming();
+	}
+	return *data;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#ifndef __FL_BENCH_CORPUS_HPP
+#define	__FL_BENCH_CORPUS_HPP
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Checked-in benchmark inputs (bench/corpus)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <string>
+#include "bench.hpp"
+#include "bstring.hpp"
+
+namespace fl {
+	namespace bench {
+		using fl::strings::BString;
+
+		// inputs shaped as the real mail traffic: html letter, its quoted-printable body,
+		// MIME encoded headers, request urls and a cyrillic plain text part
+		struct Corpus
+		{
+			Corpus(const std::string &dir);
+			BString html;
+			BString quotedPrintable;
+			BString textUtf8;
+			std::vector<std::string> urls;
+			std::vector<BString> mimeHeaders; // header values without names
+		};
+
+		// loads the corpus on the first call, the directory can be changed with -p corpus=path
+		const Corpus &corpus(State &state);
+	};
+};
+
+#endif	// __FL_BENCH_CORPUS_HPP
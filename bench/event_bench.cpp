@@ -0,0 +1,307 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: EPoll, EPollWorkerThread and TimerEvent benchmarks
+///////////////////////////////////////////////////////////////////////////////
+
+#include <unistd.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <memory>
+#include "bench.hpp"
+#include "histogram.hpp"
+#include "event_queue.hpp"
+#include "event_thread.hpp"
+#include "timer_event.hpp"
+#include "thread.hpp"
+
+using namespace fl::bench;
+using namespace fl::events;
+
+namespace
+{
+	uint64_t nowNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// level triggered eventfd which stays active until it is read
+	class EventFdEvent : public Event
+	{
+	public:
+		EventFdEvent()
+			: Event(eventfd(0, EFD_NONBLOCK)), calls(0)
+		{
+			setWaitRead();
+		}
+		virtual ~EventFdEvent()
+		{
+			close(_descr);
+		}
+		void signal()
+		{
+			uint64_t value = 1;
+			if (write(_descr, &value, sizeof(value)) != sizeof(value))
+				abort();
+		}
+		void consume()
+		{
+			uint64_t value;
+			if (read(_descr, &value, sizeof(value)) != sizeof(value))
+				abort();
+		}
+		virtual const ECallResult call(const TEvents events)
+		{
+			calls++;
+			return SKIP;
+		}
+		uint64_t calls;
+	};
+
+	// dispatch + callActive cost per active event
+	void epollDispatch(State &state, const uint32_t eventsCount)
+	{
+		EPoll poll(eventsCount);
+		std::vector<std::unique_ptr<EventFdEvent>> events;
+		for (uint32_t i = 0; i < eventsCount; i++) {
+			events.emplace_back(new EventFdEvent());
+			events.back()->signal();
+			poll.ctrl(events.back().get());
+		}
+		EPoll::TEventVector changedEvents;
+		EPoll::TEventVector endedEvents;
+		uint64_t rounds = state.iterations() / eventsCount + 1;
+		for (uint64_t i = 0; i < rounds; i++) {
+			poll.dispatch(0);
+			poll.callActive(changedEvents, endedEvents);
+		}
+		state.setIterations(rounds * eventsCount);
+		if (events[0]->calls != rounds)
+			state.addCounter("errors", rounds - events[0]->calls);
+	}
+
+	void epollCtrlMod(State &state)
+	{
+		EPoll poll(1);
+		EventFdEvent event;
+		poll.ctrl(&event);
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			if (i & 1)
+				event.setWaitRead();
+			else
+				event.setWaitSend();
+			poll.ctrl(&event);
+		}
+	}
+
+	// signal, dispatch, call and consume of a single eventfd
+	void eventFdLoop(State &state)
+	{
+		EPoll poll(1);
+		EventFdEvent event;
+		poll.ctrl(&event);
+		EPoll::TEventVector changedEvents;
+		EPoll::TEventVector endedEvents;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			event.signal();
+			poll.dispatch(-1);
+			poll.callActive(changedEvents, endedEvents);
+			event.consume();
+		}
+	}
+
+	class PingPongEvent : public Event
+	{
+	public:
+		PingPongEvent(const TEventDescriptor descr, const uint64_t rounds, const bool starts)
+			: Event(descr), finished(false), _rounds(rounds), _done(0)
+		{
+			setWaitRead();
+			if (starts)
+				_send();
+		}
+		virtual const ECallResult call(const TEvents events)
+		{
+			char ch;
+			while (recv(_descr, &ch, 1, MSG_DONTWAIT) == 1) {
+				_done++;
+				if (_done >= _rounds) {
+					_send(); // let the peer finish its last round
+					finished = true;
+					return SKIP;
+				}
+				_send();
+			}
+			return SKIP;
+		}
+		bool finished;
+	private:
+		void _send()
+		{
+			char ch = 'p';
+			if (send(_descr, &ch, 1, MSG_NOSIGNAL) != 1)
+				finished = true;
+		}
+		uint64_t _rounds;
+		uint64_t _done;
+	};
+
+	class PingPongThread : public fl::threads::Thread
+	{
+	public:
+		PingPongThread(const TEventDescriptor descr, const uint64_t rounds, const bool starts)
+			: _poll(1), _event(descr, rounds, starts)
+		{
+			_poll.ctrl(&_event);
+		}
+		void loop()
+		{
+			EPoll::TEventVector changedEvents;
+			EPoll::TEventVector endedEvents;
+			while (!_event.finished) {
+				static const int WAIT_TIME = 1000; // ms
+				if (!_poll.dispatch(WAIT_TIME))
+					break;
+				_poll.callActive(changedEvents, endedEvents);
+			}
+		}
+	private:
+		virtual void run()
+		{
+			loop();
+		}
+		EPoll _poll;
+		PingPongEvent _event;
+	};
+
+	// round trip of one byte between two threads which wait in their own EPoll
+	void socketPairPingPong(State &state)
+	{
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+			abort();
+		{
+			PingPongThread peer(fds[1], state.iterations(), false);
+			PingPongThread self(fds[0], state.iterations(), true);
+			peer.create();
+			self.loop();
+			peer.waitMe();
+		}
+		close(fds[0]);
+		close(fds[1]);
+	}
+
+	class HandoffEvent : public WorkEvent
+	{
+	public:
+		HandoffEvent(std::atomic<uint64_t> *calledAt)
+			: WorkEvent(eventfd(1, EFD_NONBLOCK), time(NULL) + 60), _calledAt(calledAt)
+		{
+			setWaitRead();
+		}
+		virtual ~HandoffEvent()
+		{
+			close(_descr);
+		}
+		virtual const ECallResult call(const TEvents events)
+		{
+			_calledAt->store(nowNs());
+			return FINISHED;
+		}
+	private:
+		std::atomic<uint64_t> *_calledAt;
+	};
+
+	// time from EPollWorkerThread::addConnection to the first call of an already active event in the worker
+	void workerAddConnection(State &state)
+	{
+		static ThreadSpecificDataFactory factory;
+		static EPollWorkerGroup group(&factory, 1, 64);
+		EPollWorkerThread *worker = group.getThread(0);
+		std::atomic<uint64_t> calledAt(0);
+		LatencyHistogram latency;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			HandoffEvent *ev = new HandoffEvent(&calledAt);
+			calledAt.store(0);
+			uint64_t start = nowNs();
+			if (!worker->addConnection(ev, NULL)) {
+				delete ev;
+				state.addCounter("errors", 1);
+				return;
+			}
+			uint64_t called;
+			while (!(called = calledAt.load()))
+				sched_yield();
+			latency.record(called - start);
+		}
+		state.addCounter("p50_ns", latency.percentile(0.5));
+		state.addCounter("p99_ns", latency.percentile(0.99));
+		state.addCounter("max_ns", latency.max());
+	}
+
+	class JitterTimer : public TimerEventInterface
+	{
+	public:
+		JitterTimer(const uint64_t intervalNs)
+			: ticks(0), _intervalNs(intervalNs), _last(0)
+		{
+		}
+		virtual void timerCall(TimerEvent *te)
+		{
+			uint64_t now = nowNs();
+			if (_last) {
+				uint64_t passed = now - _last;
+				jitter.record(passed > _intervalNs ? passed - _intervalNs : _intervalNs - passed);
+			}
+			_last = now;
+			ticks++;
+		}
+		uint64_t ticks;
+		LatencyHistogram jitter;
+	private:
+		uint64_t _intervalNs;
+		uint64_t _last;
+	};
+
+	// deviation of the periodic TimerEvent calls from the interval
+	void timerJitter(State &state, const uint64_t intervalUs)
+	{
+		uint64_t durationMs = state.minTimeMs() > 500 ? state.minTimeMs() : 500;
+		JitterTimer jitter(intervalUs * 1000);
+		TimerEvent timer;
+		timer.setTimer(intervalUs / 1000000, (intervalUs % 1000000) * 1000, intervalUs / 1000000,
+			(intervalUs % 1000000) * 1000, &jitter);
+		EPoll poll(1);
+		poll.ctrl(&timer);
+		EPoll::TEventVector changedEvents;
+		EPoll::TEventVector endedEvents;
+		uint64_t end = nowNs() + durationMs * 1000000;
+		while (nowNs() < end) {
+			poll.dispatch(100);
+			poll.callActive(changedEvents, endedEvents);
+		}
+		timer.stop();
+		state.setIterations(jitter.ticks);
+		state.addCounter("expected_ticks", durationMs * 1000 / intervalUs);
+		state.addCounter("p50_jitter_us", jitter.jitter.percentile(0.5) / 1000.0);
+		state.addCounter("p99_jitter_us", jitter.jitter.percentile(0.99) / 1000.0);
+		state.addCounter("max_jitter_us", jitter.jitter.max() / 1000.0);
+	}
+};
+
+FL_BENCH("events/epoll/dispatch_call/events:1", [](State &state) { epollDispatch(state, 1); });
+FL_BENCH("events/epoll/dispatch_call/events:16", [](State &state) { epollDispatch(state, 16); });
+FL_BENCH("events/epoll/dispatch_call/events:256", [](State &state) { epollDispatch(state, 256); });
+FL_BENCH("events/epoll/ctrl_mod", epollCtrlMod);
+FL_BENCH("events/eventfd/signal_dispatch_consume", eventFdLoop);
+FL_BENCH("events/socketpair/ping_pong", socketPairPingPong);
+FL_BENCH("events/worker/add_connection_latency", workerAddConnection);
+FL_BENCH_ONCE("events/timer/jitter/interval_us:100", [](State &state) { timerJitter(state, 100); });
+FL_BENCH_ONCE("events/timer/jitter/interval_us:1000", [](State &state) { timerJitter(state, 1000); });
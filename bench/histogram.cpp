@@ -0,0 +1,69 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: HDR style log-linear latency histogram
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+#include <algorithm>
+#include "histogram.hpp"
+
+using namespace fl::bench;
+
+LatencyHistogram::LatencyHistogram()
+	: _counts(BUCKETS_COUNT, 0)
+{
+	clear();
+}
+
+void LatencyHistogram::clear()
+{
+	std::fill(_counts.begin(), _counts.end(), 0);
+	_count = 0;
+	_sum = 0;
+	_min = UINT64_MAX;
+	_max = 0;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &histogram)
+{
+	for (size_t i = 0; i < BUCKETS_COUNT; i++)
+		_counts[i] += histogram._counts[i];
+	_count += histogram._count;
+	_sum += histogram._sum;
+	if (histogram._min < _min)
+		_min = histogram._min;
+	if (histogram._max > _max)
+		_max = histogram._max;
+}
+
+uint64_t LatencyHistogram::_highestEquivalent(const size_t index)
+{
+	if (index < SUB_BUCKETS)
+		return index;
+	int shift = (index - SUB_BUCKETS) / HALF_SUB_BUCKETS + 1;
+	uint64_t top = (index - SUB_BUCKETS) % HALF_SUB_BUCKETS + HALF_SUB_BUCKETS;
+	return ((top + 1) << shift) - 1;
+}
+
+uint64_t LatencyHistogram::percentile(const double q) const
+{
+	if (!_count)
+		return 0;
+	uint64_t target = static_cast<uint64_t>(std::ceil(q * _count));
+	if (target < 1)
+		target = 1;
+	uint64_t seen = 0;
+	for (size_t i = 0; i < BUCKETS_COUNT; i++) {
+		seen += _counts[i];
+		if (seen >= target) {
+			uint64_t value = _highestEquivalent(i);
+			return value > _max ? _max : value;
+		}
+	}
+	return _max;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#ifndef __FL_BENCH_HISTOGRAM_HPP
+#define	__FL_BENCH_HISTOGRAM_HPP
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: HDR style log-linear latency histogram
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <vector>
+
+namespace fl {
+	namespace bench {
+		
+		// Values are kept with 1/64 relative precision in the whole uint64_t range. Each recording thread should have
+		// its own histogram, they are merged after the run
+		class LatencyHistogram
+		{
+		public:
+			LatencyHistogram();
+			void record(const uint64_t value)
+			{
+				_counts[_index(value)]++;
+				_count++;
+				_sum += value;
+				if (value < _min)
+					_min = value;
+				if (value > _max)
+					_max = value;
+			}
+			void merge(const LatencyHistogram &histogram);
+			void clear();
+			// q is in [0, 1], returns the highest value equivalent to the bucket which holds the q-th value
+			uint64_t percentile(const double q) const;
+			uint64_t count() const
+			{
+				return _count;
+			}
+			uint64_t min() const
+			{
+				return _count ? _min : 0;
+			}
+			uint64_t max() const
+			{
+				return _max;
+			}
+			double mean() const
+			{
+				return _count ? static_cast<double>(_sum) / _count : 0;
+			}
+		private:
+			static const int SUB_BUCKET_BITS = 7;
+			static const uint64_t SUB_BUCKETS = 1ULL << SUB_BUCKET_BITS;
+			static const uint64_t HALF_SUB_BUCKETS = SUB_BUCKETS / 2;
+			static const size_t BUCKETS_COUNT = SUB_BUCKETS + (64 - SUB_BUCKET_BITS) * HALF_SUB_BUCKETS;
+			static size_t _index(const uint64_t value)
+			{
+				if (value < SUB_BUCKETS)
+					return value;
+				int shift = (63 - __builtin_clzll(value)) - (SUB_BUCKET_BITS - 1);
+				return SUB_BUCKETS + (shift - 1) * HALF_SUB_BUCKETS + ((value >> shift) - HALF_SUB_BUCKETS);
+			}
+			static uint64_t _highestEquivalent(const size_t index);
+			std::vector<uint64_t> _counts;
+			uint64_t _count;
+			uint64_t _sum;
+			uint64_t _min;
+			uint64_t _max;
+		};
+	};
+};
+
+#endif	// __FL_BENCH_HISTOGRAM_HPP
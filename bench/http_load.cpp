@@ -0,0 +1,489 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Multi-threaded non-blocking http load generator
+///////////////////////////////////////////////////////////////////////////////
+
+#include <unistd.h>
+#include <time.h>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "http_load.hpp"
+#include "http_client.hpp"
+#include "event_queue.hpp"
+#include "timer_event.hpp"
+#include "network_buffer.hpp"
+#include "thread.hpp"
+
+using namespace fl::bench;
+using namespace fl::events;
+using fl::network::NetworkBuffer;
+using fl::network::Socket;
+using fl::http::HttpAnswerParser;
+using fl::http::HttpClientAnswer;
+
+namespace
+{
+	uint64_t nowNs()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+	}
+
+	double clockSeconds(const clockid_t clock)
+	{
+		struct timespec ts;
+		clock_gettime(clock, &ts);
+		return ts.tv_sec + ts.tv_nsec / 1e9;
+	}
+
+	double processCpuSeconds()
+	{
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+	}
+
+	class LoadThread;
+
+	class LoadConnection : public Event
+	{
+	public:
+		enum EState
+		{
+			ST_CLOSED,
+			ST_CONNECTING,
+			ST_READY,
+		};
+		LoadConnection(LoadThread *thread)
+			: Event(INVALID_EVENT), state(ST_CLOSED), closeSent(false), _thread(thread)
+		{
+		}
+		virtual ~LoadConnection()
+		{
+			close();
+		}
+		bool open(const HttpLoadConfig &config);
+		void close()
+		{
+			if (_descr != INVALID_EVENT) {
+				::close(_descr);
+				_descr = INVALID_EVENT;
+			}
+			state = ST_CLOSED;
+			closeSent = false;
+			_sendBuffer.clear();
+			_readBuffer.clear();
+			started.clear();
+		}
+		void send(const fl::strings::BString &request, const uint64_t startTime, const bool keepAlive);
+		virtual const ECallResult call(const TEvents events);
+		bool updateEvents(EPoll &poll);
+
+		EState state;
+		bool closeSent; // the last request was sent with Connection: close
+		std::deque<uint64_t> started; // start (or scheduled) times of the requests in flight
+	private:
+		bool _read();
+		LoadThread *_thread;
+		NetworkBuffer _sendBuffer;
+		NetworkBuffer _readBuffer;
+		HttpAnswerParser _parser;
+		HttpClientAnswer _answer;
+	};
+
+	class LoadThread : public fl::threads::Thread, public TimerEventInterface
+	{
+	public:
+		LoadThread(const HttpLoadConfig &config, const uint32_t connections, const double rate)
+			: requests(0), allRequests(0), errors(0), connects(0), cpuSeconds(0), _config(config), _rate(rate),
+			_poll(connections + 16), _keepAliveCredit(0), _nextScheduled(0), _nextConnection(0)
+		{
+			for (uint32_t i = 0; i < connections; i++)
+				_connections.push_back(new LoadConnection(this));
+			_keepAliveRequest << (config.bodySize ? "POST " : "GET ") << config.path.c_str()
+				<< " HTTP/1.1\r\nHost: bench\r\n";
+			_closeRequest << _keepAliveRequest << "Connection: close\r\n";
+			if (config.bodySize) {
+				fl::strings::BString body;
+				char *data = body.reserveBuffer(config.bodySize);
+				memset(data, 'x', config.bodySize);
+				_keepAliveRequest << "Content-Length: " << config.bodySize << "\r\n\r\n" << body;
+				_closeRequest << "Content-Length: " << config.bodySize << "\r\n\r\n" << body;
+			} else {
+				_keepAliveRequest << "\r\n";
+				_closeRequest << "\r\n";
+			}
+		}
+		virtual ~LoadThread()
+		{
+			for (auto connection = _connections.begin(); connection != _connections.end(); connection++)
+				delete *connection;
+		}
+		void start(const uint64_t startTime)
+		{
+			_startTime = startTime;
+			_measureFrom = startTime + _config.warmupMs * 1000000ULL;
+			_endTime = _measureFrom + _config.durationMs * 1000000ULL;
+			create();
+		}
+		void completed(LoadConnection *connection, const uint64_t startTime)
+		{
+			uint64_t now = nowNs();
+			allRequests++;
+			if ((startTime >= _measureFrom) && (now <= _endTime)) {
+				requests++;
+				latency.record(now - startTime);
+			}
+		}
+		void failed(LoadConnection *connection)
+		{
+			if (nowNs() < _endTime)
+				errors += connection->started.size() ? connection->started.size() : 1;
+		}
+		EPoll &poll()
+		{
+			return _poll;
+		}
+		virtual void timerCall(class TimerEvent *te)
+		{
+			_schedule();
+		}
+
+		uint64_t requests;
+		uint64_t allRequests;
+		uint64_t errors;
+		uint64_t connects;
+		double cpuSeconds;
+		LatencyHistogram latency;
+	private:
+		virtual void run();
+		bool _nextIsKeepAlive()
+		{
+			_keepAliveCredit += _config.keepAliveRatio;
+			if (_keepAliveCredit >= 1) {
+				_keepAliveCredit -= 1;
+				return true;
+			}
+			return false;
+		}
+		bool _issue(LoadConnection *connection, const uint64_t startTime, const bool keepAlive);
+		LoadConnection *_findConnection(const bool keepAlive);
+		void _fill(LoadConnection *connection);
+		void _schedule();
+		void _drainBacklog();
+
+		HttpLoadConfig _config;
+		double _rate;
+		EPoll _poll;
+		std::vector<LoadConnection*> _connections;
+		fl::strings::BString _keepAliveRequest;
+		fl::strings::BString _closeRequest;
+		double _keepAliveCredit;
+		uint64_t _startTime;
+		uint64_t _measureFrom;
+		uint64_t _endTime;
+		uint64_t _nextScheduled;
+		size_t _nextConnection;
+		struct Scheduled
+		{
+			uint64_t time;
+			bool keepAlive;
+		};
+		std::deque<Scheduled> _backlog; // scheduled requests waiting for a free connection
+	};
+
+	bool LoadConnection::open(const HttpLoadConfig &config)
+	{
+		close();
+		_descr = ::socket(AF_INET, SOCK_STREAM, 0);
+		if (_descr == INVALID_EVENT)
+			return false;
+		Socket::setNonBlockIO(_descr);
+		Socket::setNoDelay(_descr, 1);
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(config.ip);
+		addr.sin_port = htons(config.port);
+		if ((::connect(_descr, (sockaddr *)&addr, sizeof(addr)) != 0) && (errno != EINPROGRESS)) {
+			close();
+			return false;
+		}
+		state = ST_CONNECTING;
+		setOp(EPOLL_CTL_ADD);
+		setWaitSend();
+		return _thread->poll().ctrl(this);
+	}
+
+	void LoadConnection::send(const fl::strings::BString &request, const uint64_t startTime, const bool keepAlive)
+	{
+		if (started.empty())
+			_parser.reset(false);
+		started.push_back(startTime);
+		_sendBuffer.add(request.c_str(), request.size());
+		if (!keepAlive)
+			closeSent = true;
+	}
+
+	bool LoadConnection::updateEvents(EPoll &poll)
+	{
+		if (state == ST_CLOSED)
+			return false;
+		TEvents events = E_INPUT | E_ERROR | E_HUP;
+		if ((state == ST_CONNECTING) || (_sendBuffer.sended() < _sendBuffer.size()))
+			events |= E_OUTPUT;
+		if (events == _events)
+			return true;
+		_events = events;
+		return poll.ctrl(this);
+	}
+
+	bool LoadConnection::_read()
+	{
+		while (true) {
+			auto res = _readBuffer.read(_descr);
+			if (res == NetworkBuffer::IN_PROGRESS)
+				return true;
+			if (res != NetworkBuffer::OK)
+				return false;
+			size_t pos = 0;
+			while (!started.empty() && (pos < _readBuffer.size())) {
+				size_t consumed = 0;
+				auto parseRes = _parser.parse(_readBuffer.c_str() + pos, _readBuffer.size() - pos, consumed, _answer);
+				pos += consumed;
+				if (parseRes == HttpAnswerParser::NEED_MORE)
+					break;
+				if (parseRes == HttpAnswerParser::ERROR)
+					return false;
+				uint64_t startTime = started.front();
+				started.pop_front();
+				_thread->completed(this, startTime);
+				if (!_answer.keepAlive)
+					return false;
+			}
+			if (pos >= _readBuffer.size())
+				_readBuffer.clear();
+			else if (pos > 0) {
+				memmove(_readBuffer.data(), _readBuffer.c_str() + pos, _readBuffer.size() - pos);
+				_readBuffer.trim(_readBuffer.size() - pos);
+			}
+		}
+	}
+
+	const LoadConnection::ECallResult LoadConnection::call(const TEvents events)
+	{
+		if (state == ST_CLOSED)
+			return SKIP;
+		if (state == ST_CONNECTING) {
+			int error = 0;
+			socklen_t errorLength = sizeof(error);
+			if ((events & (E_ERROR | E_HUP)) || getsockopt(_descr, SOL_SOCKET, SO_ERROR, &error, &errorLength) || error) {
+				_thread->failed(this);
+				close();
+				return FINISHED;
+			}
+			state = ST_READY;
+			_thread->connects++;
+		}
+		if (_sendBuffer.sended() < _sendBuffer.size()) {
+			if (_sendBuffer.send(_descr) == NetworkBuffer::ERROR) {
+				_thread->failed(this);
+				close();
+				return FINISHED;
+			}
+			if (_sendBuffer.sended() >= _sendBuffer.size())
+				_sendBuffer.clear();
+		}
+		if (events & (E_INPUT | E_ERROR | E_HUP)) {
+			if (!_read()) {
+				bool expected = closeSent && started.empty();
+				if (!expected)
+					_thread->failed(this);
+				close();
+				return FINISHED;
+			}
+		}
+		return CHANGE;
+	}
+
+	LoadConnection *LoadThread::_findConnection(const bool keepAlive)
+	{
+		// round robin over connections to spread requests evenly
+		for (size_t i = 0; i < _connections.size(); i++) {
+			LoadConnection *connection = _connections[(_nextConnection + i) % _connections.size()];
+			bool free = false;
+			if (keepAlive)
+				free = (!connection->closeSent || connection->started.empty())
+					&& (connection->started.size() < _config.pipelineDepth);
+			else
+				free = connection->started.empty();
+			if (free) {
+				_nextConnection = (_nextConnection + i + 1) % _connections.size();
+				return connection;
+			}
+		}
+		return NULL;
+	}
+
+	bool LoadThread::_issue(LoadConnection *connection, const uint64_t startTime, const bool keepAlive)
+	{
+		if (connection->closeSent) // answered, but the server hasn't closed it yet
+			connection->close();
+		if (!keepAlive || (connection->state == LoadConnection::ST_CLOSED)) {
+			if (!connection->open(_config)) {
+				errors++;
+				return false;
+			}
+		}
+		connection->send(keepAlive ? _keepAliveRequest : _closeRequest, startTime, keepAlive);
+		if (!connection->updateEvents(_poll)) {
+			failed(connection);
+			connection->close();
+			return false;
+		}
+		return true;
+	}
+
+	void LoadThread::_fill(LoadConnection *connection)
+	{
+		uint64_t now = nowNs();
+		if ((now >= _endTime) || (!connection->started.empty() && connection->closeSent))
+			return;
+		if (connection->started.empty() && !_nextIsKeepAlive()) {
+			_issue(connection, now, false);
+			return;
+		}
+		while (connection->started.size() < _config.pipelineDepth) {
+			if (!_issue(connection, now, true))
+				return;
+		}
+	}
+
+	void LoadThread::_drainBacklog()
+	{
+		while (!_backlog.empty()) {
+			LoadConnection *connection = _findConnection(_backlog.front().keepAlive);
+			if (!connection)
+				return;
+			_issue(connection, _backlog.front().time, _backlog.front().keepAlive);
+			_backlog.pop_front();
+		}
+	}
+
+	void LoadThread::_schedule()
+	{
+		uint64_t now = nowNs();
+		uint64_t interval = static_cast<uint64_t>(1e9 / _rate);
+		if (!interval)
+			interval = 1;
+		while ((_nextScheduled <= now) && (_nextScheduled < _endTime)) {
+			Scheduled scheduled = {_nextScheduled, _nextIsKeepAlive()};
+			_backlog.push_back(scheduled);
+			_nextScheduled += interval;
+		}
+		_drainBacklog();
+	}
+
+	void LoadThread::run()
+	{
+		double cpuStart = clockSeconds(CLOCK_THREAD_CPUTIME_ID);
+		TimerEvent timer;
+		if (_config.openLoop) {
+			static const uint64_t MIN_TIMER_INTERVAL = 20 * 1000; // 20us, several requests are sent per tick
+			uint64_t interval = static_cast<uint64_t>(1e9 / _rate);
+			if (interval < MIN_TIMER_INTERVAL)
+				interval = MIN_TIMER_INTERVAL;
+			_nextScheduled = _startTime;
+			timer.setTimer(interval / 1000000000ULL, interval % 1000000000ULL, interval / 1000000000ULL,
+				interval % 1000000000ULL, this);
+			_poll.ctrl(&timer);
+		} else {
+			for (auto connection = _connections.begin(); connection != _connections.end(); connection++)
+				_fill(*connection);
+		}
+		EPoll::TEventVector changedEvents;
+		EPoll::TEventVector endedEvents;
+		while (nowNs() < _endTime) {
+			static const int WAIT_TIME = 100; // ms
+			_poll.dispatch(WAIT_TIME);
+			_poll.callActive(changedEvents, endedEvents);
+			for (auto ev = changedEvents.begin(); ev != changedEvents.end(); ev++) {
+				LoadConnection *connection = static_cast<LoadConnection*>(*ev);
+				if (!_config.openLoop)
+					_fill(connection);
+				connection->updateEvents(_poll);
+			}
+			for (auto ev = endedEvents.begin(); ev != endedEvents.end(); ev++) {
+				if (!_config.openLoop)
+					_fill(static_cast<LoadConnection*>(*ev)); // reopens the connection
+			}
+			if (_config.openLoop)
+				_drainBacklog();
+			changedEvents.clear();
+			endedEvents.clear();
+		}
+		timer.stop();
+		for (auto connection = _connections.begin(); connection != _connections.end(); connection++)
+			(*connection)->close();
+		cpuSeconds = clockSeconds(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+	}
+};
+
+HttpLoadConfig::HttpLoadConfig()
+	: ip(0), port(0), threads(1), connections(16), openLoop(false), rate(10000), warmupMs(200), durationMs(1000),
+	keepAliveRatio(1), pipelineDepth(1), bodySize(0), path("/")
+{
+}
+
+HttpLoadResult::HttpLoadResult()
+	: requests(0), allRequests(0), errors(0), connects(0), seconds(0), clientCpuSeconds(0), processCpuSeconds(0)
+{
+}
+
+HttpLoadGenerator::HttpLoadGenerator(const HttpLoadConfig &config)
+	: _config(config)
+{
+	if (!_config.threads)
+		_config.threads = 1;
+	if (_config.connections < _config.threads)
+		_config.connections = _config.threads;
+	if (!_config.pipelineDepth)
+		_config.pipelineDepth = 1;
+}
+
+void HttpLoadGenerator::run(HttpLoadResult &result)
+{
+	std::vector<LoadThread*> threads;
+	for (uint32_t i = 0; i < _config.threads; i++) {
+		uint32_t connections = _config.connections / _config.threads + (i < _config.connections % _config.threads);
+		threads.push_back(new LoadThread(_config, connections, _config.rate / _config.threads));
+	}
+	uint64_t startTime = nowNs();
+	double processCpuStart = processCpuSeconds();
+	for (auto thread = threads.begin(); thread != threads.end(); thread++)
+		(*thread)->start(startTime);
+	for (auto thread = threads.begin(); thread != threads.end(); thread++) {
+		(*thread)->waitMe();
+		result.requests += (*thread)->requests;
+		result.allRequests += (*thread)->allRequests;
+		result.errors += (*thread)->errors;
+		result.connects += (*thread)->connects;
+		result.clientCpuSeconds += (*thread)->cpuSeconds;
+		result.latency.merge((*thread)->latency);
+		delete *thread;
+	}
+	result.processCpuSeconds = processCpuSeconds() - processCpuStart;
+	result.seconds = _config.durationMs / 1000.0;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#ifndef __FL_BENCH_HTTP_LOAD_HPP
+#define	__FL_BENCH_HTTP_LOAD_HPP
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Multi-threaded non-blocking http load generator
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <string>
+#include "socket.hpp"
+#include "histogram.hpp"
+
+namespace fl {
+	namespace bench {
+		using fl::network::TIPv4;
+		using fl::network::TPort16;
+
+		struct HttpLoadConfig
+		{
+			HttpLoadConfig();
+			TIPv4 ip;
+			TPort16 port;
+			uint32_t threads;
+			uint32_t connections; // total for all threads
+			// closed loop keeps pipelineDepth requests in flight on every connection, open loop sends rate requests
+			// per second on schedule and measures latency from the scheduled time (no coordinated omission)
+			bool openLoop;
+			double rate;
+			uint32_t warmupMs;
+			uint32_t durationMs;
+			double keepAliveRatio; // part of requests sent on reused connections, others open a new connection
+			uint32_t pipelineDepth;
+			uint32_t bodySize; // POST body size, GET is sent if 0
+			std::string path;
+		};
+
+		struct HttpLoadResult
+		{
+			HttpLoadResult();
+			uint64_t requests; // completed during the measured interval
+			uint64_t allRequests; // including warm up
+			uint64_t errors;
+			uint64_t connects;
+			double seconds;
+			LatencyHistogram latency; // nanoseconds
+			double clientCpuSeconds; // load generator threads
+			double processCpuSeconds; // whole process, it includes in-process server
+		};
+
+		class HttpLoadGenerator
+		{
+		public:
+			HttpLoadGenerator(const HttpLoadConfig &config);
+			void run(HttpLoadResult &result);
+		private:
+			HttpLoadConfig _config;
+		};
+	};
+};
+
+#endif	// __FL_BENCH_HTTP_LOAD_HPP
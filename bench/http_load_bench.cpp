@@ -0,0 +1,236 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: End-to-end HttpEvent load benchmarks (throughput, latency percentiles and cpu per request)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdlib>
+#include <memory>
+#include "bench.hpp"
+#include "http_load.hpp"
+#include "http_event.hpp"
+#include "accept_thread.hpp"
+#include "socket.hpp"
+
+using namespace fl::bench;
+using namespace fl::events;
+using fl::network::Socket;
+using fl::network::NetworkBuffer;
+using fl::strings::BString;
+
+namespace
+{
+	// answers every request with answerSize bytes, honours keep-alive and consumes POST bodies
+	template <size_t answerSize>
+	class BenchHttpInterface : public HttpEventInterface
+	{
+	public:
+		BenchHttpInterface()
+		{
+			reset();
+		}
+		virtual bool parseURI(const char *cmdStart, const EHttpVersion::EHttpVersion version,
+			const std::string &host, const std::string &fileName, const std::string &query)
+		{
+			_isKeepAlive = (version == EHttpVersion::HTTP_1_1);
+			return true;
+		}
+		virtual bool parseHeader(const char *name, const size_t nameLength, const char *value, const size_t valueLen,
+			const char *pEndHeader)
+		{
+			if (!_parseKeepAlive(name, nameLength, value, _isKeepAlive))
+				_parseContentLength(name, nameLength, value, _contentLength);
+			return true;
+		}
+		virtual bool parsePOSTData(const uint32_t postStartPosition, NetworkBuffer &buf, bool &parseError)
+		{
+			return (buf.size() - postStartPosition) >= _contentLength;
+		}
+		virtual size_t segmentedBodySize()
+		{
+			return _contentLength;
+		}
+		virtual bool parseSegmentedPOSTData(SegmentedBuffer &body, bool &parseError)
+		{
+			return body.size() >= _contentLength;
+		}
+		virtual EFormResult formResult(BString &networkBuffer, class HttpEvent *http)
+		{
+			static const std::string BODY(answerSize, 'a');
+			networkBuffer << "HTTP/1.1 200 OK\r\nContent-Length: " << answerSize << "\r\n";
+			_addConnectionHeader(networkBuffer, _isKeepAlive);
+			networkBuffer << "\r\n" << BODY;
+			return _isKeepAlive ? RESULT_OK_KEEP_ALIVE : RESULT_OK_CLOSE;
+		}
+		virtual bool reset()
+		{
+			_isKeepAlive = false;
+			_contentLength = 0;
+			return true;
+		}
+	private:
+		bool _isKeepAlive;
+		size_t _contentLength;
+	};
+
+	template <class T>
+	class BenchHttpEventFactory : public WorkEventFactory
+	{
+	public:
+		virtual WorkEvent *create(const TEventDescriptor descr, const TIPv4 ip, const time_t timeOutTime,
+			Socket *acceptSocket)
+		{
+			return new HttpEvent(descr, timeOutTime, new T(), ip);
+		}
+	};
+
+	class BenchThreadSpecificDataFactory : public ThreadSpecificDataFactory
+	{
+	public:
+		BenchThreadSpecificDataFactory(const size_t segmentedBodyThreshold)
+			: _segmentedBodyThreshold(segmentedBodyThreshold)
+		{
+		}
+		virtual ThreadSpecificData *create()
+		{
+			HttpThreadSpecificData *data = new HttpThreadSpecificData();
+			data->segmentedBodyThreshold = _segmentedBodyThreshold;
+			return data;
+		}
+	private:
+		size_t _segmentedBodyThreshold;
+	};
+
+	// in-process HttpEvent server on the loopback interface
+	class BenchHttpServer
+	{
+	public:
+		BenchHttpServer(WorkEventFactory *factory, const uint32_t workers, const size_t segmentedBodyThreshold)
+			: _port(20000 + rand() % 20000), _dataFactory(segmentedBodyThreshold), _workerGroup(NULL),
+			_acceptThread(NULL)
+		{
+			while (!_listen.listen("127.0.0.1", _port))
+				_port++;
+			static const uint32_t QUEUE_LENGTH = 1024;
+			_workerGroup = new EPollWorkerGroup(&_dataFactory, workers, QUEUE_LENGTH);
+			_acceptThread = new AcceptThread(_workerGroup, &_listen, factory);
+		}
+		~BenchHttpServer()
+		{
+			_acceptThread->cancel();
+			_acceptThread->waitMe();
+			delete _acceptThread;
+			delete _workerGroup;
+		}
+		TPort16 port() const
+		{
+			return _port;
+		}
+	private:
+		Socket _listen;
+		TPort16 _port;
+		BenchThreadSpecificDataFactory _dataFactory;
+		EPollWorkerGroup *_workerGroup;
+		AcceptThread *_acceptThread;
+	};
+
+	void reportLoad(State &state, const HttpLoadResult &result)
+	{
+		state.setIterations(result.requests);
+		double requests = result.requests ? result.requests : 1;
+		state.addCounter("rps", result.requests / result.seconds);
+		state.addCounter("p50_us", result.latency.percentile(0.5) / 1000.0);
+		state.addCounter("p99_us", result.latency.percentile(0.99) / 1000.0);
+		state.addCounter("p999_us", result.latency.percentile(0.999) / 1000.0);
+		state.addCounter("max_us", result.latency.max() / 1000.0);
+		state.addCounter("cpu_us_per_req", result.processCpuSeconds * 1e6 / requests);
+		state.addCounter("client_cpu_us_per_req", result.clientCpuSeconds * 1e6 / requests);
+		state.addCounter("connects", result.connects);
+		state.addCounter("errors", result.errors);
+	}
+
+	// -p target=ip:port sends the load to an external server instead of the in-process one, pipeline > 1 is only
+	// meaningful for such targets as HttpEvent serves requests of a connection one by one. -p segmented=N receives
+	// bodies of N bytes and more into SegmentedBuffer
+	template <class T>
+	void httpLoad(State &state, HttpLoadConfig config, const size_t segmentedBodyThreshold = 0)
+	{
+		config.threads = state.param("threads", (double)config.threads);
+		config.connections = state.param("connections", (double)config.connections);
+		config.rate = state.param("rate", config.rate);
+		config.keepAliveRatio = state.param("keep_alive", config.keepAliveRatio);
+		config.pipelineDepth = state.param("pipeline", (double)config.pipelineDepth);
+		config.bodySize = state.param("body", (double)config.bodySize);
+		config.path = state.param("path", config.path.c_str());
+		config.warmupMs = state.param("warmup_ms", (double)config.warmupMs);
+		static const uint64_t MIN_DURATION_MS = 1000;
+		config.durationMs = state.param("duration_ms",
+			(double)(state.minTimeMs() > MIN_DURATION_MS ? state.minTimeMs() : MIN_DURATION_MS));
+
+		std::string target = state.param("target", "");
+		std::unique_ptr<BenchHttpEventFactory<T> > factory;
+		std::unique_ptr<BenchHttpServer> server;
+		if (target.empty()) {
+			factory.reset(new BenchHttpEventFactory<T>());
+			server.reset(new BenchHttpServer(factory.get(), state.param("workers", 2.0), state.param("segmented", (double)segmentedBodyThreshold)));
+			config.ip = Socket::ip2Long("127.0.0.1");
+			config.port = server->port();
+		} else {
+			auto colon = target.find(':');
+			config.ip = Socket::ip2Long(target.substr(0, colon).c_str());
+			config.port = (colon == std::string::npos) ? 80 : atoi(target.c_str() + colon + 1);
+		}
+		HttpLoadGenerator generator(config);
+		HttpLoadResult result;
+		generator.run(result);
+		reportLoad(state, result);
+	}
+
+	HttpLoadConfig closedLoop(const uint32_t connections, const double keepAliveRatio)
+	{
+		HttpLoadConfig config;
+		config.connections = connections;
+		config.threads = connections < 2 ? 1 : 2;
+		config.keepAliveRatio = keepAliveRatio;
+		return config;
+	}
+
+	HttpLoadConfig openLoop(const double rate)
+	{
+		HttpLoadConfig config;
+		config.openLoop = true;
+		config.rate = rate;
+		config.connections = 64;
+		config.threads = 2;
+		return config;
+	}
+
+	HttpLoadConfig post(const uint32_t bodySize)
+	{
+		HttpLoadConfig config = closedLoop(16, 1);
+		config.bodySize = bodySize;
+		return config;
+	}
+};
+
+FL_BENCH_ONCE("http_load/closed/keep_alive/c1", [](State &s) { httpLoad<BenchHttpInterface<64> >(s, closedLoop(1, 1)); });
+FL_BENCH_ONCE("http_load/closed/keep_alive/c16", [](State &s) { httpLoad<BenchHttpInterface<64> >(s, closedLoop(16, 1)); });
+FL_BENCH_ONCE("http_load/closed/keep_alive/c256",
+	[](State &s) { httpLoad<BenchHttpInterface<64> >(s, closedLoop(256, 1)); });
+FL_BENCH_ONCE("http_load/closed/new_connection/c16",
+	[](State &s) { httpLoad<BenchHttpInterface<64> >(s, closedLoop(16, 0)); });
+FL_BENCH_ONCE("http_load/closed/keep_alive:0.9/c16",
+	[](State &s) { httpLoad<BenchHttpInterface<64> >(s, closedLoop(16, 0.9)); });
+FL_BENCH_ONCE("http_load/closed/answer:64K/c16",
+	[](State &s) { httpLoad<BenchHttpInterface<64 * 1024> >(s, closedLoop(16, 1)); });
+FL_BENCH_ONCE("http_load/closed/post:4K/c16", [](State &s) { httpLoad<BenchHttpInterface<64> >(s, post(4 * 1024)); });
+FL_BENCH_ONCE("http_load/closed/post:256K/c16",
+	[](State &s) { httpLoad<BenchHttpInterface<64> >(s, post(256 * 1024)); });
+FL_BENCH_ONCE("http_load/closed/post:256K/segmented/c16",
+	[](State &s) { httpLoad<BenchHttpInterface<64> >(s, post(256 * 1024), 64 * 1024); });
+FL_BENCH_ONCE("http_load/open/rate:10000", [](State &s) { httpLoad<BenchHttpInterface<64> >(s, openLoop(10000)); });
+FL_BENCH_ONCE("http_load/open/rate:50000", [](State &s) { httpLoad<BenchHttpInterface<64> >(s, openLoop(50000)); });
@@ -0,0 +1,110 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: HttpRouter benchmarks
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+#include "bench.hpp"
+#include "http_router.hpp"
+
+using namespace fl::bench;
+using namespace fl::http;
+
+namespace
+{
+	const size_t ROUTES_COUNT = 500;
+	
+	struct RouterFixture
+	{
+		RouterFixture()
+		{
+			char buf[128];
+			for (size_t i = 0; i < ROUTES_COUNT; i++) {
+				snprintf(buf, sizeof(buf), "/api/v%u/service%u/resource%u/:id/action%u", 
+					(unsigned)(i % 3), (unsigned)(i % 17), (unsigned)(i / 17), (unsigned)i);
+				router.add(HttpRouter::M_GET | HttpRouter::M_HEAD, buf, i);
+				snprintf(buf, sizeof(buf), "/api/v%u/service%u/resource%u/%u/action%u", 
+					(unsigned)(i % 3), (unsigned)(i % 17), (unsigned)(i / 17), (unsigned)(i * 7), (unsigned)i);
+				paths.push_back(buf);
+				// the same paths for the linear strncmp chain which routers replace
+				snprintf(buf, sizeof(buf), "/api/v%u/service%u/resource%u/", 
+					(unsigned)(i % 3), (unsigned)(i % 17), (unsigned)(i / 17));
+				prefixes.push_back(buf);
+			}
+			router.compile();
+		}
+		HttpRouter router;
+		std::vector<std::string> paths;
+		std::vector<std::string> prefixes;
+	};
+	
+	RouterFixture &fixture()
+	{
+		static RouterFixture routerFixture;
+		return routerFixture;
+	}
+	
+	void resolve500(State &state)
+	{
+		RouterFixture &f = fixture();
+		HttpRouter::Match match;
+		uint64_t found = 0;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			const std::string &path = f.paths[i % ROUTES_COUNT];
+			found += f.router.resolve(HttpRouter::M_GET, path.c_str(), path.size(), match);
+			doNotOptimize(match);
+		}
+		if (found != state.iterations())
+			state.addCounter("errors", state.iterations() - found);
+	}
+	
+	void strncmpChain500(State &state)
+	{
+		RouterFixture &f = fixture();
+		uint64_t found = 0;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			const std::string &path = f.paths[i % ROUTES_COUNT];
+			for (size_t r = 0; r < ROUTES_COUNT; r++) {
+				if (!strncmp(path.c_str(), f.prefixes[r].c_str(), f.prefixes[r].size())) {
+					found++;
+					break;
+				}
+			}
+		}
+		doNotOptimize(found);
+	}
+	
+	void build500(State &state)
+	{
+		RouterFixture &f = fixture();
+		char buf[128];
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			HttpRouter router;
+			for (size_t r = 0; r < ROUTES_COUNT; r++) {
+				snprintf(buf, sizeof(buf), "%s:id/action%u", f.prefixes[r].c_str(), (unsigned)r);
+				router.add(HttpRouter::M_GET, buf, r);
+			}
+			router.compile();
+			doNotOptimize(router);
+		}
+	}
+	
+	void parseMethod(State &state)
+	{
+		static const char *COMMANDS[] = {"GET / HTTP/1.1", "POST / HTTP/1.1", "PROPFIND / HTTP/1.1", "HEAD / HTTP/1.1"};
+		uint32_t mask = 0;
+		for (uint64_t i = 0; i < state.iterations(); i++)
+			mask |= HttpRouter::parseMethod(COMMANDS[i & 3]);
+		doNotOptimize(mask);
+	}
+};
+
+FL_BENCH("http_router/resolve/routes:500", resolve500);
+FL_BENCH("http_router/strncmp_chain/routes:500", strncmpChain500);
+FL_BENCH("http_router/build/routes:500", build500);
+FL_BENCH("http_router/parse_method", parseMethod);
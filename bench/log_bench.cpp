@@ -0,0 +1,228 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Log call latency benchmarks of the targets, the disabled levels and the flood limits
+///////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "bench.hpp"
+#include "histogram.hpp"
+#include "async_log.hpp"
+#include "binary_log.hpp"
+
+using namespace fl::bench;
+using namespace fl::log;
+
+namespace
+{
+	const char * const BENCH_LOG_FILE = "/tmp/fl_log_bench.txt";
+
+	uint64_t nowNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	class BenchLogSystem
+	{
+	public:
+		static TagLevel tagLevel;
+		static bool log(
+			const size_t target,
+			const int level,
+			const time_t curTime,
+			struct tm *ct,
+			const char *fmt,
+			va_list args
+		)
+		{
+			return logSystem().log(target, level, "bench", curTime, ct, fmt, args);
+		}
+		static LogSystem &logSystem()
+		{
+			static LogSystem log;
+			return log;
+		}
+	};
+	TagLevel BenchLogSystem::tagLevel("bench", ELogLevel::INFO);
+	typedef Log<true, ELogLevel::ERROR, BenchLogSystem> BenchError;
+	typedef Log<true, ELogLevel::INFO, BenchLogSystem> BenchInfo;
+	typedef Log<false, ELogLevel::INFO, BenchLogSystem> BenchCompiledOut;
+
+	// an error burst of the worker threads, -p threads=N
+	void errorBurst(State &state, Target *target)
+	{
+		unlink(BENCH_LOG_FILE);
+		BenchLogSystem::logSystem().clearTargets();
+		BenchLogSystem::logSystem().addTarget(target);
+		size_t threadsCount = state.param("threads", 4.0);
+		uint64_t perThread = state.iterations() / threadsCount + 1;
+		std::vector<LatencyHistogram> latencies(threadsCount);
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < threadsCount; i++) {
+			threads.emplace_back([i, perThread, &latencies]() {
+				for (uint64_t call = 0; call < perThread; call++) {
+					uint64_t start = nowNs();
+					BenchError::L("epoll_ctl erorr %i for descriptor %u in thread %u\n", 9, call, i);
+					latencies[i].record(nowNs() - start);
+				}
+			});
+		}
+		for (auto thread = threads.begin(); thread != threads.end(); thread++)
+			thread->join();
+		LatencyHistogram latency;
+		for (auto threadLatency = latencies.begin(); threadLatency != latencies.end(); threadLatency++)
+			latency.merge(*threadLatency);
+		state.addCounter("p50_ns", latency.percentile(0.5));
+		state.addCounter("p99_ns", latency.percentile(0.99));
+		state.addCounter("max_ns", latency.max());
+		AsyncFileTarget *asyncTarget = dynamic_cast<AsyncFileTarget*>(target);
+		if (asyncTarget)
+			state.addCounter("dropped", asyncTarget->dropped());
+		BenchLogSystem::logSystem().clearTargets();
+		unlink(BENCH_LOG_FILE);
+	}
+
+	void fileTarget(State &state)
+	{
+		errorBurst(state, new FileTarget(BENCH_LOG_FILE));
+	}
+
+	void asyncDrop(State &state)
+	{
+		errorBurst(state, new AsyncFileTarget(BENCH_LOG_FILE, AsyncFileTarget::DROP));
+	}
+
+	void asyncBlock(State &state)
+	{
+		errorBurst(state, new AsyncFileTarget(BENCH_LOG_FILE, AsyncFileTarget::BLOCK));
+	}
+
+	// formats the prefix only to compare the time and prefix costs of a log call
+	class PrefixTarget : public Target
+	{
+	public:
+		virtual void log(const int level, const char *tag, const time_t curTime, struct tm *ct, const char *fmt,
+			va_list args)
+		{
+			doNotOptimize(_prefix(_buf, level, tag, curTime, ct));
+		}
+		virtual void log(const int level, const char *fileName, const int lineNumber, const char *tag,
+			const time_t curTime, struct tm *ct, const char *fmt, va_list args)
+		{
+		}
+		// the former way of the targets: time, localtime and the prefix by printf
+		void formatLocalTime(const int level, const char *tag)
+		{
+			time_t curTime = time(NULL);
+			struct tm *ct = localtime(&curTime);
+			static const char *LEVELS[] = {NULL, "F", "E", "W", " "};
+			doNotOptimize(snprintf(_buf, sizeof(_buf), "[%s/%u/%02i.%02i %02i:%02i:%02i/%s] ", tag, _process.pid,
+				ct->tm_mday, ct->tm_mon+1, ct->tm_hour, ct->tm_min, ct->tm_sec, LEVELS[level]));
+		}
+	private:
+		char _buf[MAX_PREFIX_SIZE];
+	};
+
+	void prefixLocalTime(State &state)
+	{
+		PrefixTarget target;
+		for (uint64_t i = 0; i < state.iterations(); i++)
+			target.formatLocalTime(ELogLevel::ERROR, "bench");
+	}
+
+	template <ETimePrecision::ETimePrecision precision>
+	void prefixCached(State &state)
+	{
+		BenchLogSystem::logSystem().clearTargets();
+		PrefixTarget *target = new PrefixTarget();
+		target->setTimePrecision(precision);
+		BenchLogSystem::logSystem().addTarget(target);
+		for (uint64_t i = 0; i < state.iterations(); i++)
+			BenchError::L("");
+		BenchLogSystem::logSystem().clearTargets();
+	}
+
+	// per query INFO line of Mysql::query
+	template <class TTarget>
+	void infoQuery(State &state)
+	{
+		unlink(BENCH_LOG_FILE);
+		BenchLogSystem::logSystem().clearTargets();
+		TTarget *target = new TTarget(BENCH_LOG_FILE, AsyncFileTarget::BLOCK, 1024 * 1024, 1);
+		BenchLogSystem::logSystem().addTarget(target);
+		const char *query = "SELECT id, subject, sender, size FROM messages WHERE folder_id = 1042 ORDER BY date DESC";
+		for (uint64_t i = 0; i < state.iterations(); i++)
+			BenchInfo::L("q: [%s], r: %u\n", query, i);
+		target->flush();
+		state.addCounter("bytes_per_message", static_cast<double>(target->written()) / state.iterations());
+		BenchLogSystem::logSystem().clearTargets();
+		unlink(BENCH_LOG_FILE);
+	}
+
+	// the cost of a disabled level: nothing for the compiled out one, one load and a branch at runtime
+	template <class TLog>
+	void disabled(State &state)
+	{
+		BenchLogSystem::tagLevel.set(ELogLevel::WARNING);
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			TLog::L("q: [%s], r: %u\n", "SELECT 1", i);
+			doNotOptimize(i);
+		}
+		BenchLogSystem::tagLevel.set(ELogLevel::INFO);
+	}
+
+	// an error flood of one call site through the synchronous file target
+	void floodFile(State &state)
+	{
+		unlink(BENCH_LOG_FILE);
+		BenchLogSystem::logSystem().clearTargets();
+		BenchLogSystem::logSystem().addTarget(new FileTarget(BENCH_LOG_FILE));
+		for (uint64_t i = 0; i < state.iterations(); i++)
+			BenchError::L("AcceptThread: Connection accept error %u\n", i);
+		BenchLogSystem::logSystem().clearTargets();
+		unlink(BENCH_LOG_FILE);
+	}
+
+	void floodRateLimited(State &state)
+	{
+		unlink(BENCH_LOG_FILE);
+		BenchLogSystem::logSystem().clearTargets();
+		BenchLogSystem::logSystem().addTarget(new FileTarget(BENCH_LOG_FILE));
+		for (uint64_t i = 0; i < state.iterations(); i++)
+			FL_LOG_RATE_LIMITED(BenchError, 10, "AcceptThread: Connection accept error %u\n", i);
+		BenchLogSystem::logSystem().clearTargets();
+		unlink(BENCH_LOG_FILE);
+	}
+
+	void floodSampled(State &state)
+	{
+		unlink(BENCH_LOG_FILE);
+		BenchLogSystem::logSystem().clearTargets();
+		BenchLogSystem::logSystem().addTarget(new FileTarget(BENCH_LOG_FILE));
+		for (uint64_t i = 0; i < state.iterations(); i++)
+			FL_LOG_SAMPLED(BenchError, 0.01, "AcceptThread: Connection accept error %u\n", i);
+		BenchLogSystem::logSystem().clearTargets();
+		unlink(BENCH_LOG_FILE);
+	}
+};
+
+FL_BENCH("log/error_burst/file", fileTarget);
+FL_BENCH("log/error_burst/async_drop", asyncDrop);
+FL_BENCH("log/error_burst/async_block", asyncBlock);
+FL_BENCH("log/prefix/localtime", prefixLocalTime);
+FL_BENCH("log/prefix/cached", prefixCached<ETimePrecision::SECONDS>);
+FL_BENCH("log/prefix/cached_us", prefixCached<ETimePrecision::MICROSECONDS>);
+FL_BENCH("log/info_query/text", infoQuery<AsyncFileTarget>);
+FL_BENCH("log/info_query/binary", infoQuery<BinaryLogTarget>);
+FL_BENCH("log/disabled/compile_time", disabled<BenchCompiledOut>);
+FL_BENCH("log/disabled/runtime", disabled<BenchInfo>);
+FL_BENCH("log/flood/file", floodFile);
+FL_BENCH("log/flood/rate_limited", floodRateLimited);
+FL_BENCH("log/flood/sampled", floodSampled);
@@ -0,0 +1,130 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Huge page region against heap segments benchmarks
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "bench.hpp"
+#include "memory_region.hpp"
+#include "segmented_buffer.hpp"
+
+using namespace fl::bench;
+using namespace fl::utils;
+using fl::network::SegmentPool;
+
+namespace
+{
+	// segments of a loaded worker, 64M of 16K segments is far over the reach of the 4K page dTLB entries
+	const size_t WORKING_SET = 64 * 1024 * 1024;
+
+	struct WorkingSet
+	{
+		WorkingSet(const bool useRegion)
+			: pool(SegmentPool::DEFAULT_SEGMENT_SIZE, WORKING_SET / SegmentPool::DEFAULT_SEGMENT_SIZE)
+		{
+			if (useRegion) {
+				region.reset(new MemoryRegion(WORKING_SET + MemoryRegion::HUGE_PAGE_SIZE,
+					sizeof(SegmentPool::Segment) + SegmentPool::DEFAULT_SEGMENT_SIZE));
+				pool.setRegion(region.get());
+			}
+			size_t count = WORKING_SET / SegmentPool::DEFAULT_SEGMENT_SIZE;
+			for (size_t i = 0; i < count; i++) {
+				segments.push_back(pool.get());
+				memset(segments.back()->data(), 0, pool.segmentSize());
+			}
+			// one random cycle over a cache line of each page of the segments, the loads depend on each other
+			std::vector<size_t *> lines;
+			for (auto segment = segments.begin(); segment != segments.end(); segment++) {
+				for (uint32_t offset = 0; offset < pool.segmentSize(); offset += 4096)
+					lines.push_back(reinterpret_cast<size_t*>((*segment)->data() + offset));
+			}
+			uint64_t seed = 88172645463325252ULL;
+			for (size_t i = lines.size() - 1; i > 0; i--) {
+				seed ^= seed << 13;
+				seed ^= seed >> 7;
+				seed ^= seed << 17;
+				std::swap(lines[i], lines[seed % (i + 1)]);
+			}
+			for (size_t i = 0; i < lines.size(); i++)
+				*lines[i] = reinterpret_cast<size_t>(lines[(i + 1) % lines.size()]);
+			start = lines[0];
+		}
+		~WorkingSet()
+		{
+			for (auto segment = segments.begin(); segment != segments.end(); segment++)
+				SegmentPool::release(*segment);
+		}
+		std::unique_ptr<MemoryRegion> region; // it outlives the pool
+		SegmentPool pool;
+		std::vector<SegmentPool::Segment*> segments;
+		size_t *start;
+	};
+
+	// data TLB misses of the thread, -1 if perf events are not permitted
+	class DTLBMisses
+	{
+	public:
+		DTLBMisses()
+		{
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HW_CACHE;
+			attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+				| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		}
+		~DTLBMisses()
+		{
+			if (_fd >= 0)
+				close(_fd);
+		}
+		int64_t read()
+		{
+			int64_t value;
+			if ((_fd < 0) || (::read(_fd, &value, sizeof(value)) != sizeof(value)))
+				return -1;
+			return value;
+		}
+	private:
+		int _fd;
+	};
+
+	template <bool useRegion>
+	void randomAccess(State &state)
+	{
+		static WorkingSet workingSet(useRegion);
+		DTLBMisses dtlbMisses;
+		int64_t startMisses = dtlbMisses.read();
+		size_t *line = workingSet.start;
+		for (uint64_t i = 0; i < state.iterations(); i++)
+			line = reinterpret_cast<size_t*>(*line);
+		int64_t misses = dtlbMisses.read();
+		doNotOptimize(line);
+		if ((startMisses >= 0) && (misses >= 0))
+			state.addCounter("dtlb_misses_per_op", static_cast<double>(misses - startMisses) / state.iterations());
+
+		if (workingSet.region.get()) {
+			MemoryRegion::Usage usage;
+			if (workingSet.region->usage(usage)) {
+				state.addCounter("rss_mb", static_cast<double>(usage.rss) / (1024 * 1024));
+				state.addCounter("huge_pages_pct", usage.rss ? 100.0 * usage.hugePages / usage.rss : 0);
+			}
+		}
+	}
+};
+
+FL_BENCH("memory_region/segments/random_access/heap", randomAccess<false>);
+FL_BENCH("memory_region/segments/random_access/region", randomAccess<true>);
@@ -0,0 +1,172 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: text_util and iconv benchmarks on the mail processing corpus
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bench.hpp"
+#include "corpus.hpp"
+#include "text_util.hpp"
+#include "iconv.hpp"
+
+using namespace fl::bench;
+using namespace fl::utils;
+using fl::strings::BString;
+
+namespace
+{
+	// encoded and converted forms of the corpus
+	struct DerivedCorpus
+	{
+		DerivedCorpus(const Corpus &c)
+		{
+			base64Encode(base64, c.html.c_str(), c.html.size());
+			fl::iconv::convert(c.textUtf8.c_str(), c.textUtf8.size(), textCp1251, fl::iconv::ECharset::UTF8,
+				fl::iconv::ECharset::WINDOWS1251);
+			strippedHtml.add(c.html.c_str(), c.html.size());
+			stripHtmlTags(strippedHtml);
+		}
+		BString base64;
+		BString textCp1251;
+		BString strippedHtml; // html without tags, entities are left to decode
+	};
+
+	const DerivedCorpus &derived(State &state)
+	{
+		const Corpus &c = corpus(state);
+		state.pauseTiming();
+		static DerivedCorpus data(c);
+		state.resumeTiming();
+		return data;
+	}
+
+	void base64EncodeMail(State &state)
+	{
+		const Corpus &c = corpus(state);
+		BString result;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			result.clear();
+			base64Encode(result, c.html.c_str(), c.html.size());
+			doNotOptimize(result);
+		}
+		state.setBytesProcessed(c.html.size() * state.iterations());
+	}
+
+	void base64DecodeMail(State &state)
+	{
+		const DerivedCorpus &d = derived(state);
+		BString result;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			result.clear();
+			base64Decode(result, d.base64.c_str(), d.base64.size());
+			doNotOptimize(result);
+		}
+		state.setBytesProcessed(d.base64.size() * state.iterations());
+	}
+
+	void quotedPrintableDecodeMail(State &state)
+	{
+		const Corpus &c = corpus(state);
+		BString result;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			result.clear();
+			quotedPrintableDecode(result, c.quotedPrintable.c_str(), c.quotedPrintable.size());
+			doNotOptimize(result);
+		}
+		state.setBytesProcessed(c.quotedPrintable.size() * state.iterations());
+	}
+
+	void stripHtmlTagsMail(State &state)
+	{
+		const Corpus &c = corpus(state);
+		BString result;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			result.clear();
+			stripHtmlTags(c.html.c_str(), c.html.size(), result);
+			doNotOptimize(result);
+		}
+		state.setBytesProcessed(c.html.size() * state.iterations());
+	}
+
+	void decodeHtmlEntitiesMail(State &state)
+	{
+		const DerivedCorpus &d = derived(state);
+		BString result;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			result.clear();
+			result.add(d.strippedHtml.c_str(), d.strippedHtml.size()); // decoding is in place
+			decodeHtmlEntities(result);
+			doNotOptimize(result);
+		}
+		state.setBytesProcessed(d.strippedHtml.size() * state.iterations());
+	}
+
+	void decodeUrls(State &state)
+	{
+		const Corpus &c = corpus(state);
+		BString result;
+		uint64_t bytes = 0;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			const std::string &url = c.urls[i % c.urls.size()];
+			result.clear();
+			decodeUrl(url, result);
+			doNotOptimize(result);
+			bytes += url.size();
+		}
+		state.setBytesProcessed(bytes);
+	}
+
+	void decodeMimeHeaders(State &state)
+	{
+		const Corpus &c = corpus(state);
+		BString result;
+		uint64_t bytes = 0;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			const BString &header = c.mimeHeaders[i % c.mimeHeaders.size()];
+			decodeMimeHeader(header, result, "", NULL);
+			doNotOptimize(result);
+			bytes += header.size();
+		}
+		state.setBytesProcessed(bytes);
+	}
+
+	void iconvUtf8ToCp1251(State &state)
+	{
+		const Corpus &c = corpus(state);
+		BString result;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			result.clear();
+			fl::iconv::convert(c.textUtf8.c_str(), c.textUtf8.size(), result, fl::iconv::ECharset::UTF8,
+				fl::iconv::ECharset::WINDOWS1251);
+			doNotOptimize(result);
+		}
+		state.setBytesProcessed(c.textUtf8.size() * state.iterations());
+	}
+
+	void iconvCp1251ToUtf8(State &state)
+	{
+		const DerivedCorpus &d = derived(state);
+		BString result;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			result.clear();
+			fl::iconv::convert(d.textCp1251.c_str(), d.textCp1251.size(), result, fl::iconv::ECharset::WINDOWS1251,
+				fl::iconv::ECharset::UTF8);
+			doNotOptimize(result);
+		}
+		state.setBytesProcessed(d.textCp1251.size() * state.iterations());
+	}
+};
+
+FL_BENCH("text/base64_encode/mail_html", base64EncodeMail);
+FL_BENCH("text/base64_decode/mail_html", base64DecodeMail);
+FL_BENCH("text/quoted_printable_decode/mail_html", quotedPrintableDecodeMail);
+FL_BENCH("text/strip_html_tags/mail_html", stripHtmlTagsMail);
+FL_BENCH("text/decode_html_entities/mail_text", decodeHtmlEntitiesMail);
+FL_BENCH("text/decode_url/urls", decodeUrls);
+FL_BENCH("text/decode_mime_header/headers", decodeMimeHeaders);
+FL_BENCH("iconv/utf8_to_cp1251/text_ru", iconvUtf8ToCp1251);
+FL_BENCH("iconv/cp1251_to_utf8/text_ru", iconvCp1251ToUtf8);
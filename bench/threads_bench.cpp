@@ -0,0 +1,580 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Mutex, ReadWriteLock, RcuPtr, SeqLock, CondMutex and WorkerThreadManager benchmarks
+///////////////////////////////////////////////////////////////////////////////
+
+#include <sched.h>
+#include <atomic>
+#include <memory>
+#include <map>
+#include "bench.hpp"
+#include "histogram.hpp"
+#include "thread.hpp"
+#include "mutex.hpp"
+#include "read_write_lock.hpp"
+#include "rcu.hpp"
+#include "seq_lock.hpp"
+#include "cond_mutex.hpp"
+#include "worker_thread.hpp"
+#include "network_buffer.hpp"
+
+using namespace fl::bench;
+using namespace fl::threads;
+using namespace fl::network;
+
+namespace
+{
+	const uint32_t THREAD_COUNTS[] = {1, 2, 4, 8, 16, 32, 64};
+
+	uint64_t nowNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	class FunctionThread : public Thread
+	{
+	public:
+		FunctionThread(std::function<void()> func)
+			: _func(func)
+		{
+		}
+	private:
+		virtual void run()
+		{
+			_func();
+		}
+		std::function<void()> _func;
+	};
+
+	// runs func(threadNumber, iterations) on count threads, the iterations of the state are divided between them
+	// and only the time between the simultaneous start and the end of the last thread is measured
+	void runThreads(State &state, const uint32_t count, std::function<void(const uint32_t, const uint64_t)> func)
+	{
+		state.pauseTiming();
+		std::atomic<uint32_t> ready(0);
+		std::atomic<bool> go(false);
+		std::vector<std::unique_ptr<FunctionThread>> threads;
+		for (uint32_t i = 0; i < count; i++) {
+			uint64_t iterations = state.iterations() / count + (i < (state.iterations() % count));
+			threads.emplace_back(new FunctionThread([&, i, iterations]() {
+				ready++;
+				while (!go.load())
+					sched_yield();
+				func(i, iterations);
+			}));
+			threads.back()->create();
+		}
+		while (ready.load() < count)
+			sched_yield();
+		state.resumeTiming();
+		go.store(true);
+		for (auto thread = threads.begin(); thread != threads.end(); thread++)
+			(*thread)->waitMe();
+	}
+
+	void mutexContended(State &state, const uint32_t threads)
+	{
+		Mutex sync;
+		uint64_t counter = 0;
+		runThreads(state, threads, [&](const uint32_t, const uint64_t iterations) {
+			for (uint64_t i = 0; i < iterations; i++) {
+				AutoMutex autoSync(&sync);
+				counter++;
+			}
+		});
+		doNotOptimize(counter);
+	}
+
+	// the same with the contention profiler on
+	void mutexProfiled(State &state, const uint32_t threads)
+	{
+		Mutex sync("bench::mutexProfiled");
+		uint64_t counter = 0;
+		MutexProfiler::enable(true);
+		runThreads(state, threads, [&](const uint32_t, const uint64_t iterations) {
+			for (uint64_t i = 0; i < iterations; i++) {
+				AutoMutex autoSync(&sync);
+				counter++;
+			}
+		});
+		MutexProfiler::enable(false);
+		doNotOptimize(counter);
+	}
+
+	void rwLockWrite(State &state, const uint32_t threads)
+	{
+		ReadWriteLock lock;
+		uint64_t counter = 0;
+		runThreads(state, threads, [&](const uint32_t, const uint64_t iterations) {
+			for (uint64_t i = 0; i < iterations; i++) {
+				AutoReadWriteLockWrite autoLock(&lock);
+				counter++;
+			}
+		});
+		doNotOptimize(counter);
+	}
+
+	// one write per 16 operations
+	void rwLockReadMostly(State &state, const uint32_t threads)
+	{
+		ReadWriteLock lock;
+		uint64_t counter = 0;
+		runThreads(state, threads, [&](const uint32_t, const uint64_t iterations) {
+			uint64_t sum = 0;
+			for (uint64_t i = 0; i < iterations; i++) {
+				if ((i & 15) == 15) {
+					AutoReadWriteLockWrite autoLock(&lock);
+					counter++;
+				} else {
+					AutoReadWriteLockRead autoLock(&lock);
+					sum += counter;
+				}
+			}
+			doNotOptimize(sum);
+		});
+	}
+
+	typedef std::map<uint32_t, uint32_t> TServerMap;
+	static const uint32_t SERVERS = 64;
+	static const uint64_t LOOKUPS_PER_CHANGE = 4096;
+
+	TServerMap *serverMap(const uint32_t version)
+	{
+		TServerMap *servers = new TServerMap();
+		for (uint32_t i = 0; i < SERVERS; i++)
+			(*servers)[i] = i + version;
+		return servers;
+	}
+
+	// lookups in a shared server map, the first thread changes it once per LOOKUPS_PER_CHANGE lookups
+	void readMostlyRwLock(State &state, const uint32_t threads)
+	{
+		ReadWriteLock lock;
+		std::unique_ptr<TServerMap> servers(serverMap(0));
+		runThreads(state, threads, [&](const uint32_t number, const uint64_t iterations) {
+			uint64_t sum = 0;
+			for (uint64_t i = 0; i < iterations; i++) {
+				if (!number && (i % LOOKUPS_PER_CHANGE == LOOKUPS_PER_CHANGE - 1)) {
+					TServerMap *changed = serverMap(i);
+					AutoReadWriteLockWrite autoLock(&lock);
+					servers.reset(changed);
+				} else {
+					AutoReadWriteLockRead autoLock(&lock);
+					sum += servers->find(i % SERVERS)->second;
+				}
+			}
+			doNotOptimize(sum);
+		});
+	}
+
+	// registered readers are the event and worker threads, they report a quiescent state per 64 lookups
+	void readMostlyRcu(State &state, const uint32_t threads, const bool registered)
+	{
+		RcuPtr<TServerMap> servers(serverMap(0));
+		runThreads(state, threads, [&](const uint32_t number, const uint64_t iterations) {
+			if (registered)
+				Rcu::registerThread();
+			uint64_t sum = 0;
+			for (uint64_t i = 0; i < iterations; i++) {
+				if (!number && (i % LOOKUPS_PER_CHANGE == LOOKUPS_PER_CHANGE - 1)) {
+					servers.update(serverMap(i));
+				} else if (registered) {
+					sum += servers->find(i % SERVERS)->second;
+					if ((i & 63) == 63)
+						Rcu::quiescent();
+				} else {
+					RcuReadLock readLock;
+					sum += servers->find(i % SERVERS)->second;
+				}
+			}
+			if (registered)
+				Rcu::unregisterThread();
+			doNotOptimize(sum);
+		});
+		Rcu::synchronize();
+	}
+
+	struct LimitsSnapshot
+	{
+		uint64_t rate;
+		uint64_t burst;
+		uint64_t timeout;
+	};
+
+	void readMostlySnapshotRwLock(State &state, const uint32_t threads)
+	{
+		ReadWriteLock lock;
+		LimitsSnapshot limits = {1, 1, 1};
+		runThreads(state, threads, [&](const uint32_t number, const uint64_t iterations) {
+			uint64_t sum = 0;
+			for (uint64_t i = 0; i < iterations; i++) {
+				if (!number && (i % LOOKUPS_PER_CHANGE == LOOKUPS_PER_CHANGE - 1)) {
+					AutoReadWriteLockWrite autoLock(&lock);
+					limits.rate = limits.burst = limits.timeout = i;
+				} else {
+					AutoReadWriteLockRead autoLock(&lock);
+					LimitsSnapshot snapshot = limits;
+					sum += snapshot.rate + snapshot.burst + snapshot.timeout;
+				}
+			}
+			doNotOptimize(sum);
+		});
+	}
+
+	void readMostlySnapshotSeqLock(State &state, const uint32_t threads)
+	{
+		LimitsSnapshot first = {1, 1, 1};
+		SeqLock<LimitsSnapshot> limits(first);
+		runThreads(state, threads, [&](const uint32_t number, const uint64_t iterations) {
+			uint64_t sum = 0;
+			for (uint64_t i = 0; i < iterations; i++) {
+				if (!number && (i % LOOKUPS_PER_CHANGE == LOOKUPS_PER_CHANGE - 1)) {
+					LimitsSnapshot next = {i, i, i};
+					limits.store(next);
+				} else {
+					LimitsSnapshot snapshot = limits.load();
+					sum += snapshot.rate + snapshot.burst + snapshot.timeout;
+				}
+			}
+			doNotOptimize(sum);
+		});
+	}
+
+	// cost of sendSignal with waiters parked on the CondMutex
+	void condMutexSignal(State &state, const uint32_t waiters)
+	{
+		state.pauseTiming();
+		CondMutex cond;
+		std::atomic<bool> stop(false);
+		std::atomic<uint32_t> exited(0);
+		std::atomic<uint64_t> wakeUps(0);
+		std::vector<std::unique_ptr<FunctionThread>> threads;
+		for (uint32_t i = 0; i < waiters; i++) {
+			threads.emplace_back(new FunctionThread([&]() {
+				while (!stop.load()) {
+					cond.waitSignal();
+					wakeUps++;
+				}
+				exited++;
+			}));
+			threads.back()->create();
+		}
+		state.resumeTiming();
+		for (uint64_t i = 0; i < state.iterations(); i++)
+			cond.sendSignal();
+		state.pauseTiming();
+		stop.store(true);
+		while (exited.load() < waiters) { // CondMutex has no predicate, repeat until every waiter has seen the stop
+			cond.broadcastSignalToAll();
+			sched_yield();
+		}
+		for (auto thread = threads.begin(); thread != threads.end(); thread++)
+			(*thread)->waitMe();
+		state.addCounter("wake_ups_per_signal", static_cast<double>(wakeUps.load()) / state.iterations());
+		state.resumeTiming();
+	}
+
+	class CountTask : public WorkerTaskInterface
+	{
+	public:
+		CountTask()
+			: done(NULL), addTime(0), doTime(0)
+		{
+		}
+		virtual void doTask()
+		{
+			doTime = nowNs();
+			(*done)++;
+		}
+		std::atomic<uint64_t> *done;
+		uint64_t addTime;
+		uint64_t doTime;
+	};
+
+	// the managers are shared by the benchmarks and they are never stopped
+	WorkerThreadManager &workerManager(const uint32_t workers)
+	{
+		static std::map<uint32_t, WorkerThreadManager*> managers;
+		auto manager = managers.find(workers);
+		if (manager == managers.end())
+			manager = managers.insert(std::make_pair(workers, new WorkerThreadManager(workers))).first;
+		return *manager->second;
+	}
+
+	// P producers push tasks to 4 workers, time until the last task is done
+	void workerHandoff(State &state, const uint32_t producers)
+	{
+		static const uint32_t WORKERS = 4;
+		WorkerThreadManager &manager = workerManager(WORKERS);
+		state.pauseTiming();
+		std::atomic<uint64_t> done(0);
+		std::vector<CountTask> tasks(state.iterations());
+		for (auto task = tasks.begin(); task != tasks.end(); task++)
+			task->done = &done;
+		state.resumeTiming();
+		runThreads(state, producers, [&](const uint32_t number, const uint64_t iterations) {
+			uint64_t first = (state.iterations() / producers) * number + std::min<uint64_t>(number,
+				state.iterations() % producers);
+			for (uint64_t i = 0; i < iterations; i++)
+				manager.add(&tasks[first + i]);
+		});
+		while (done.load() < state.iterations())
+			sched_yield();
+	}
+
+	// a single task at a time, latency from add to the start of doTask
+	void workerLatency(State &state)
+	{
+		WorkerThreadManager &manager = workerManager(4);
+		std::atomic<uint64_t> done(0);
+		CountTask task;
+		task.done = &done;
+		LatencyHistogram latency;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			task.addTime = nowNs();
+			manager.add(&task);
+			while (done.load() <= i)
+				sched_yield();
+			latency.record(task.doTime - task.addTime);
+		}
+		state.addCounter("p50_ns", latency.percentile(0.5));
+		state.addCounter("p99_ns", latency.percentile(0.99));
+		state.addCounter("max_ns", latency.max());
+	}
+
+	class ReleaseBufferTask : public WorkerTaskInterface
+	{
+	public:
+		ReleaseBufferTask()
+			: done(NULL), buf(NULL), busy(false)
+		{
+		}
+		virtual void doTask()
+		{
+			NetworkBufferPool::release(buf);
+			busy.store(false);
+			(*done)++;
+		}
+		std::atomic<uint64_t> *done;
+		NetworkBuffer *buf;
+		std::atomic<bool> busy;
+	};
+
+	// async handlers answer from the workers, the buffers of the event thread pool are freed there
+	void workerBufferRelease(State &state, const bool useDepot)
+	{
+		WorkerThreadManager &manager = workerManager(4);
+		static const uint32_t IN_FLIGHT = 64;
+		NetworkBufferDepot depot(32 * 1024);
+		NetworkBufferPool pool(32 * 1024, 1024);
+		if (useDepot)
+			pool.setDepot(&depot);
+		std::atomic<uint64_t> done(0);
+		std::vector<ReleaseBufferTask> tasks(IN_FLIGHT);
+		for (auto task = tasks.begin(); task != tasks.end(); task++)
+			task->done = &done;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			ReleaseBufferTask &task = tasks[i % IN_FLIGHT];
+			while (task.busy.load())
+				sched_yield();
+			task.busy.store(true);
+			task.buf = pool.get();
+			task.buf->add("HTTP/1.1 200 OK\r\n", 17);
+			manager.add(&task);
+		}
+		while (done.load() < state.iterations())
+			sched_yield();
+		if (useDepot) {
+			state.addCounter("remote_frees", depot.stats(0).remoteFrees);
+			state.addCounter("remote_returns", pool.stats(0).remoteReturns);
+		}
+		state.addCounter("pool_misses", pool.stats(0).misses);
+	}
+
+	// a short task which adds its children from the worker, e.g. the parts of a batch job
+	class SpawnTask : public WorkerTaskInterface
+	{
+	public:
+		SpawnTask()
+			: manager(NULL), done(NULL), children(NULL), childrenCount(0)
+		{
+		}
+		virtual void doTask()
+		{
+			uint64_t sum = 0;
+			for (uint32_t i = 0; i < WORK; i++)
+				sum += i * i;
+			doNotOptimize(sum);
+			for (uint32_t i = 0; i < childrenCount; i++)
+				manager->add(&children[i]);
+			(*done)++;
+		}
+		static const uint32_t WORK = 64;
+		WorkerThreadManager *manager;
+		std::atomic<uint64_t> *done;
+		SpawnTask *children;
+		uint32_t childrenCount;
+	};
+
+	// N workers, one producer adds the root tasks and each root task adds 15 children from its worker
+	void workerScaling(State &state, const uint32_t workers)
+	{
+		static const uint32_t CHILDREN = 15;
+		WorkerThreadManager &manager = workerManager(workers);
+		state.pauseTiming();
+		uint64_t roots = state.iterations() / (CHILDREN + 1) + 1;
+		std::atomic<uint64_t> done(0);
+		std::vector<SpawnTask> tasks(roots * (CHILDREN + 1));
+		for (uint64_t i = 0; i < tasks.size(); i++) {
+			tasks[i].manager = &manager;
+			tasks[i].done = &done;
+		}
+		for (uint64_t i = 0; i < roots; i++) {
+			tasks[i].children = &tasks[roots + i * CHILDREN];
+			tasks[i].childrenCount = CHILDREN;
+		}
+		state.resumeTiming();
+		for (uint64_t i = 0; i < roots; i++)
+			manager.add(&tasks[i]);
+		while (done.load() < tasks.size())
+			sched_yield();
+	}
+
+	class BackgroundTask : public WorkerTaskInterface
+	{
+	public:
+		BackgroundTask()
+			: done(NULL)
+		{
+		}
+		virtual void doTask()
+		{
+			uint64_t end = nowNs() + 20000;
+			while (nowNs() < end)
+				;
+			(*done)++;
+		}
+		std::atomic<uint64_t> *done;
+	};
+
+	// latency of a request task added after a burst of background tasks, either all of them are NORMAL or the
+	// background is LOW and the request is HIGH
+	void workerPriorityLatency(State &state, const bool usePriorities)
+	{
+		static const uint32_t BURST = 256;
+		WorkerThreadManager &manager = workerManager(4);
+		std::atomic<uint64_t> backgroundDone(0);
+		std::vector<BackgroundTask> background(BURST);
+		for (auto task = background.begin(); task != background.end(); task++)
+			task->done = &backgroundDone;
+		std::atomic<uint64_t> done(0);
+		CountTask task;
+		task.done = &done;
+		LatencyHistogram latency;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			for (auto backgroundTask = background.begin(); backgroundTask != background.end(); backgroundTask++)
+				manager.add(&*backgroundTask, usePriorities ? ETaskPriority::LOW : ETaskPriority::NORMAL);
+			task.addTime = nowNs();
+			manager.add(&task, usePriorities ? ETaskPriority::HIGH : ETaskPriority::NORMAL);
+			while (done.load() <= i)
+				sched_yield();
+			latency.record(task.doTime - task.addTime);
+			while (backgroundDone.load() < (i + 1) * BURST)
+				sched_yield();
+		}
+		state.addCounter("p50_ns", latency.percentile(0.5));
+		state.addCounter("p99_ns", latency.percentile(0.99));
+	}
+
+	// a burst of tasks from an external thread, addBatch wakes a worker once for the whole burst
+	void workerBurst(State &state, const bool batch)
+	{
+		static const uint32_t BURST = 64;
+		WorkerThreadManager &manager = workerManager(4);
+		state.pauseTiming();
+		std::atomic<uint64_t> done(0);
+		std::vector<CountTask> tasks(BURST);
+		std::vector<WorkerTaskInterface*> burst(BURST);
+		for (uint32_t i = 0; i < BURST; i++) {
+			tasks[i].done = &done;
+			burst[i] = &tasks[i];
+		}
+		state.resumeTiming();
+		uint64_t expected = 0;
+		for (uint64_t i = 0; i < state.iterations(); i += BURST) {
+			if (batch) {
+				manager.addBatch(&burst[0], BURST);
+			} else {
+				for (uint32_t task = 0; task < BURST; task++)
+					manager.add(burst[task]);
+			}
+			expected += BURST;
+			while (done.load() < expected)
+				sched_yield();
+		}
+	}
+
+	// sum of an array split to the chunks of grain elements
+	void parallelSum(State &state, const size_t grain)
+	{
+		static const size_t SIZE = 1 << 20;
+		WorkerThreadManager &manager = workerManager(4);
+		state.pauseTiming();
+		std::vector<uint32_t> values(SIZE, 1);
+		state.resumeTiming();
+		uint64_t sum = 0;
+		for (uint64_t i = 0; i < state.iterations(); i++) {
+			sum += manager.parallelReduce<uint64_t>(0, SIZE, grain, 0,
+				[&values](const size_t from, const size_t to) {
+					uint64_t chunkSum = 0;
+					for (size_t element = from; element < to; element++)
+						chunkSum += values[element];
+					return chunkSum;
+				},
+				[](const uint64_t left, const uint64_t right) { return left + right; });
+		}
+		doNotOptimize(sum);
+		state.addCounter("elements_per_iteration", SIZE);
+	}
+
+	void registerScalability(const char *name, void (*func)(State &, const uint32_t), const char *countName)
+	{
+		for (size_t i = 0; i < sizeof(THREAD_COUNTS) / sizeof(THREAD_COUNTS[0]); i++) {
+			uint32_t count = THREAD_COUNTS[i];
+			Registry::instance().add(std::string(name) + "/" + countName + ":" + std::to_string(count),
+				[func, count](State &state) { func(state, count); });
+		}
+	}
+};
+
+FL_BENCH_REGISTER(registerScalability("threads/mutex/contended", mutexContended, "threads"));
+FL_BENCH_REGISTER(registerScalability("threads/mutex/profiled", mutexProfiled, "threads"));
+FL_BENCH_REGISTER(registerScalability("threads/rw_lock/write", rwLockWrite, "threads"));
+FL_BENCH_REGISTER(registerScalability("threads/rw_lock/read_mostly", rwLockReadMostly, "threads"));
+FL_BENCH_REGISTER(registerScalability("threads/read_mostly/map/rw_lock", readMostlyRwLock, "threads"));
+FL_BENCH_REGISTER(registerScalability("threads/read_mostly/map/rcu_read_lock",
+	[](State &state, const uint32_t threads) { readMostlyRcu(state, threads, false); }, "threads"));
+FL_BENCH_REGISTER(registerScalability("threads/read_mostly/map/rcu_registered",
+	[](State &state, const uint32_t threads) { readMostlyRcu(state, threads, true); }, "threads"));
+FL_BENCH_REGISTER(registerScalability("threads/read_mostly/snapshot/rw_lock", readMostlySnapshotRwLock, "threads"));
+FL_BENCH_REGISTER(registerScalability("threads/read_mostly/snapshot/seq_lock", readMostlySnapshotSeqLock, "threads"));
+FL_BENCH_REGISTER(registerScalability("threads/cond_mutex/send_signal", condMutexSignal, "waiters"));
+FL_BENCH_REGISTER(registerScalability("threads/worker_manager/handoff", workerHandoff, "producers"));
+FL_BENCH_REGISTER(registerScalability("threads/worker_manager/spawn", workerScaling, "workers"));
+FL_BENCH("threads/worker_manager/add_to_do_task_latency", workerLatency);
+FL_BENCH("threads/worker_manager/request_after_background/fifo",
+	[](State &state) { workerPriorityLatency(state, false); });
+FL_BENCH("threads/worker_manager/request_after_background/priorities",
+	[](State &state) { workerPriorityLatency(state, true); });
+FL_BENCH("threads/worker_manager/burst/add", [](State &state) { workerBurst(state, false); });
+FL_BENCH("threads/worker_manager/burst/add_batch", [](State &state) { workerBurst(state, true); });
+FL_BENCH("threads/worker_manager/parallel_reduce/grain:1024", [](State &state) { parallelSum(state, 1024); });
+FL_BENCH("threads/worker_manager/parallel_reduce/grain:65536", [](State &state) { parallelSum(state, 65536); });
+FL_BENCH("threads/worker_manager/buffer_release/delete", [](State &state) { workerBufferRelease(state, false); });
+FL_BENCH("threads/worker_manager/buffer_release/depot", [](State &state) { workerBufferRelease(state, true); });
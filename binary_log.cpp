@@ -0,0 +1,501 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Binary log target with deferred formatting and its decoder
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <cwchar>
+#include <unistd.h>
+#include "binary_log.hpp"
+#include "serialize.hpp"
+
+using namespace fl::log;
+using fl::utils::serialize::writeVarint;
+using fl::utils::serialize::varintSize;
+using fl::utils::serialize::zigzag;
+using fl::utils::serialize::unzigzag;
+
+namespace
+{
+	template <class T>
+	void appendFormatted(std::string &text, const std::string &format, const int *stars, const uint8_t starsCount,
+		const T value)
+	{
+		char buf[256];
+		int size;
+		for (char *out = buf, *outEnd = buf + sizeof(buf); ; ) {
+			if (starsCount == 0)
+				size = snprintf(out, outEnd - out, format.c_str(), value);
+			else if (starsCount == 1)
+				size = snprintf(out, outEnd - out, format.c_str(), stars[0], value);
+			else
+				size = snprintf(out, outEnd - out, format.c_str(), stars[0], stars[1], value);
+			if ((size < 0) || (size < outEnd - out)) {
+				if (size > 0)
+					text.append(out, size);
+				if (out != buf)
+					delete [] out;
+				return;
+			}
+			out = new char[size + 1];
+			outEnd = out + size + 1;
+		}
+	}
+};
+
+bool FormatConversion::next(const char *&fmt)
+{
+	while (*fmt && (*fmt != '%'))
+		fmt++;
+	if (!*fmt)
+		return false;
+	begin = fmt++;
+	stars = 0;
+	argument = NONE;
+	while (*fmt && strchr("-+ #0'I", *fmt))
+		fmt++;
+	if (*fmt == '*') {
+		stars++;
+		fmt++;
+	} else {
+		while ((*fmt >= '0') && (*fmt <= '9'))
+			fmt++;
+	}
+	if (*fmt == '.') {
+		fmt++;
+		if (*fmt == '*') {
+			stars++;
+			fmt++;
+		} else {
+			while ((*fmt >= '0') && (*fmt <= '9'))
+				fmt++;
+		}
+	}
+	int longs = 0;
+	bool longDouble = false;
+	for (; ; fmt++) {
+		if ((*fmt == 'l') || (*fmt == 'q'))
+			longs++;
+		else if ((*fmt == 'j') || (*fmt == 'z') || (*fmt == 't'))
+			longs = 2;
+		else if (*fmt == 'L')
+			longDouble = true;
+		else if (*fmt != 'h')
+			break;
+	}
+	char conversion = *fmt;
+	if (conversion)
+		fmt++;
+	end = fmt;
+	switch (conversion)
+	{
+	case 'd':
+	case 'i':
+		argument = longs ? LONG : INT;
+		break;
+	case 'u':
+	case 'o':
+	case 'x':
+	case 'X':
+		argument = longs ? ULONG : UINT;
+		break;
+	case 'c':
+		argument = longs ? WIDE : INT;
+		break;
+	case 'f':
+	case 'F':
+	case 'e':
+	case 'E':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		argument = longDouble ? LONG_DOUBLE : DOUBLE;
+		break;
+	case 's':
+		argument = longs ? WIDE : STRING;
+		break;
+	case 'C':
+	case 'S':
+		argument = WIDE;
+		break;
+	case 'p':
+		argument = POINTER;
+		break;
+	case 'm':
+		argument = ERRNO;
+		break;
+	case 'n':
+		argument = IGNORED;
+		break;
+	};
+	return true;
+}
+
+const char BinaryLogTarget::SESSION_MAGIC[] = "FLBLOG1\n";
+const size_t BinaryLogTarget::SESSION_MAGIC_SIZE;
+__thread BinaryLogTarget::CachedString BinaryLogTarget::_stringCache[BinaryLogTarget::STRING_CACHE_SIZE];
+
+BinaryLogTarget::BinaryLogTarget(const char *fileName, const EOverflow overflow, const uint32_t ringSize,
+	const uint32_t flushIntervalMs)
+	: AsyncFileTarget(fileName, overflow, ringSize, flushIntervalMs)
+{
+	uint8_t session[SESSION_MAGIC_SIZE + 10];
+	memcpy(session, SESSION_MAGIC, SESSION_MAGIC_SIZE);
+	uint8_t *end = writeVarint(session + SESSION_MAGIC_SIZE, _process.pid);
+	_writeHeader(reinterpret_cast<char*>(session), end - session);
+}
+
+uint32_t BinaryLogTarget::_defineString(const char *str, const char *&defined)
+{
+	_stringsSync.lock();
+	auto res = _stringIds.emplace(str, _stringIds.size());
+	if (res.second) {
+		// the definition is written before any thread gets the id, the rotated files start with all definitions
+		size_t size = strlen(str);
+		std::string definition(1, EBinaryLogRecord::DEFINITION);
+		uint8_t numbers[20];
+		uint8_t *end = writeVarint(writeVarint(numbers, res.first->second), size);
+		definition.append(reinterpret_cast<char*>(numbers), end - numbers);
+		definition.append(str, size);
+		_writeHeader(definition.c_str(), definition.size());
+	}
+	defined = res.first->first.c_str();
+	uint32_t id = res.first->second;
+	_stringsSync.unLock();
+	return id;
+}
+
+uint32_t BinaryLogTarget::_stringId(const char *str)
+{
+	// two ways sets, a tag and a format of one call can be in one set
+	CachedString *set = _stringCache + ((reinterpret_cast<uintptr_t>(str) * 0x9E3779B97F4A7C15ULL) >> 59) * 2;
+	for (int way = 0; way < 2; way++) {
+		if ((set[way].targetId == _id) && (set[way].str == str) && !strcmp(str, set[way].defined))
+			return set[way].id;
+	}
+	set[1] = set[0];
+	set[0].id = _defineString(str, set[0].defined);
+	set[0].targetId = _id;
+	set[0].str = str;
+	return set[0].id;
+}
+
+void BinaryLogTarget::_log(const EBinaryLogRecord::EBinaryLogRecord record, const int level, const char *fileName,
+	const int lineNumber, const char *tag, const time_t curTime, const char *fmt, va_list args)
+{
+	const int savedErrno = errno;
+	// numbers of a conversion, the strings are cut to leave this space for each of the next conversions
+	static const size_t CONVERSION_SPACE = 32;
+	static const size_t STRINGS_RESERVE = 512;
+	static const size_t HEADER_SPACE = 6; // the record type and the size
+	uint8_t message[MAX_MESSAGE_SIZE];
+	uint8_t *pos = message + HEADER_SPACE;
+	uint8_t *end = message + sizeof(message);
+	*pos++ = level;
+	pos = writeVarint(pos, _stringId(tag));
+	if (record == EBinaryLogRecord::LOCATION) {
+		pos = writeVarint(pos, _stringId(fileName));
+		pos = writeVarint(pos, lineNumber);
+	}
+	pos = writeVarint(pos, _stringId(fmt));
+	pos = writeVarint(pos, curTime);
+	pos = writeVarint(pos, (curTime == LogTime::seconds()) ? LogTime::nanoseconds() : 0);
+
+	FormatConversion conversion;
+	while (conversion.next(fmt)) {
+		if (static_cast<size_t>(end - pos) < CONVERSION_SPACE) {
+			_dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		int stars[2];
+		for (uint8_t star = 0; star < conversion.stars; star++) {
+			stars[star] = va_arg(args, int);
+			pos = writeVarint(pos, zigzag(stars[star]));
+		}
+		const char *str = NULL;
+		char text[256];
+		switch (conversion.argument)
+		{
+		case FormatConversion::NONE:
+			break;
+		case FormatConversion::IGNORED:
+			va_arg(args, void*);
+			break;
+		case FormatConversion::INT:
+			pos = writeVarint(pos, zigzag(va_arg(args, int)));
+			break;
+		case FormatConversion::UINT:
+			pos = writeVarint(pos, va_arg(args, unsigned int));
+			break;
+		case FormatConversion::LONG:
+			pos = writeVarint(pos, zigzag(va_arg(args, long long)));
+			break;
+		case FormatConversion::ULONG:
+			pos = writeVarint(pos, va_arg(args, unsigned long long));
+			break;
+		case FormatConversion::DOUBLE:
+		case FormatConversion::LONG_DOUBLE:
+		{
+			double value = (conversion.argument == FormatConversion::DOUBLE) ? va_arg(args, double)
+				: static_cast<double>(va_arg(args, long double));
+			memcpy(pos, &value, sizeof(value));
+			pos += sizeof(value);
+			break;
+		}
+		case FormatConversion::POINTER:
+			pos = writeVarint(pos, reinterpret_cast<uintptr_t>(va_arg(args, void*)));
+			break;
+		case FormatConversion::STRING:
+			str = va_arg(args, const char*);
+			if (!str)
+				str = "(null)";
+			break;
+		case FormatConversion::ERRNO:
+			str = strerror_r(savedErrno, text, sizeof(text));
+			break;
+		case FormatConversion::WIDE:
+		{
+			std::string wide;
+			std::string wideFormat(conversion.begin, conversion.end - conversion.begin);
+			if ((conversion.end[-1] == 'c') || (conversion.end[-1] == 'C'))
+				appendFormatted(wide, wideFormat, stars, conversion.stars, va_arg(args, wint_t));
+			else
+				appendFormatted(wide, wideFormat, stars, conversion.stars, va_arg(args, const wchar_t*));
+			snprintf(text, sizeof(text), "%s", wide.c_str());
+			str = text;
+			break;
+		}
+		};
+		if (str) {
+			size_t size = strlen(str);
+			size_t space = end - pos;
+			space = (space > STRINGS_RESERVE + CONVERSION_SPACE) ? space - STRINGS_RESERVE : CONVERSION_SPACE / 2;
+			if (size > space)
+				size = space;
+			pos = writeVarint(pos, size);
+			memcpy(pos, str, size);
+			pos += size;
+		}
+	}
+	size_t size = pos - (message + HEADER_SPACE);
+	uint8_t *start = message + HEADER_SPACE - 1 - varintSize(size);
+	*start = record;
+	writeVarint(start + 1, size);
+	_push(level, reinterpret_cast<char*>(start), pos - start);
+}
+
+void BinaryLogTarget::log(
+	const int level,
+	const char *tag,
+	const time_t curTime,
+	struct tm *ct,
+	const char *fmt,
+	va_list args
+)
+{
+	_log(EBinaryLogRecord::MESSAGE, level, NULL, 0, tag, curTime, fmt, args);
+}
+
+void BinaryLogTarget::log(
+	const int level,
+	const char *fileName,
+	const int lineNumber,
+	const char *tag,
+	const time_t curTime,
+	struct tm *ct,
+	const char *fmt,
+	va_list args
+)
+{
+	_log(EBinaryLogRecord::LOCATION, level, fileName, lineNumber, tag, curTime, fmt, args);
+}
+
+namespace
+{
+	bool readVarint(const uint8_t *&pos, const uint8_t *end, uint64_t &value)
+	{
+		value = 0;
+		for (int shift = 0; (pos < end) && (shift < 64); shift += 7) {
+			uint8_t byte = *pos++;
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if (byte < 0x80)
+				return true;
+		}
+		return false;
+	}
+
+	uint64_t getVarint(const uint8_t *&pos, const uint8_t *end)
+	{
+		uint64_t value;
+		if (!readVarint(pos, end, value))
+			throw BinaryLogDecoder::Error("Truncated binary log message");
+		return value;
+	}
+
+};
+
+BinaryLogDecoder::BinaryLogDecoder(const ETimePrecision::ETimePrecision timePrecision)
+	: _timePrecision(timePrecision)
+{
+}
+
+const std::string &BinaryLogDecoder::_string(const uint64_t id) const
+{
+	if (id >= _strings.size())
+		throw Error("Unknown binary log string id");
+	return _strings[id];
+}
+
+size_t BinaryLogDecoder::decode(const char *data, const size_t size, std::string &text)
+{
+	const uint8_t *pos = reinterpret_cast<const uint8_t*>(data);
+	const uint8_t *end = pos + size;
+	const uint8_t *decoded = pos;
+	while (pos < end) {
+		uint64_t value;
+		if (*pos == BinaryLogTarget::SESSION_MAGIC[0]) {
+			if (static_cast<size_t>(end - pos) < BinaryLogTarget::SESSION_MAGIC_SIZE)
+				break;
+			if (memcmp(pos, BinaryLogTarget::SESSION_MAGIC, BinaryLogTarget::SESSION_MAGIC_SIZE))
+				throw Error("Bad binary log session");
+			pos += BinaryLogTarget::SESSION_MAGIC_SIZE;
+			if (!readVarint(pos, end, value))
+				break;
+			_pid = std::to_string(value);
+			_strings.clear();
+		} else if (*pos == EBinaryLogRecord::DEFINITION) {
+			pos++;
+			uint64_t id, stringSize;
+			if (!readVarint(pos, end, id) || !readVarint(pos, end, stringSize)
+				|| (static_cast<uint64_t>(end - pos) < stringSize))
+				break;
+			if (id >= _strings.size())
+				_strings.resize(id + 1);
+			_strings[id].assign(reinterpret_cast<const char*>(pos), stringSize);
+			pos += stringSize;
+		} else if ((*pos == EBinaryLogRecord::MESSAGE) || (*pos == EBinaryLogRecord::LOCATION)) {
+			EBinaryLogRecord::EBinaryLogRecord record = static_cast<EBinaryLogRecord::EBinaryLogRecord>(*pos++);
+			if (!readVarint(pos, end, value) || (static_cast<uint64_t>(end - pos) < value))
+				break;
+			_decodeMessage(record, pos, pos + value, text);
+			pos += value;
+		} else {
+			throw Error("Unknown binary log record");
+		}
+		decoded = pos;
+	}
+	return decoded - reinterpret_cast<const uint8_t*>(data);
+}
+
+void BinaryLogDecoder::_decodeMessage(const EBinaryLogRecord::EBinaryLogRecord record, const uint8_t *pos,
+	const uint8_t *end, std::string &text)
+{
+	if (pos >= end)
+		throw Error("Truncated binary log message");
+	int level = *pos++;
+	text.push_back('[');
+	text.append(_string(getVarint(pos, end)));
+	if (record == EBinaryLogRecord::LOCATION) {
+		text.push_back(':');
+		text.append(_string(getVarint(pos, end)));
+		text.push_back(':');
+		text.append(std::to_string(getVarint(pos, end)));
+	}
+	const std::string &format = _string(getVarint(pos, end));
+	time_t seconds = getVarint(pos, end);
+	uint32_t nanoseconds = getVarint(pos, end);
+	struct tm ct;
+	localtime_r(&seconds, &ct);
+	char date[64];
+	int dateSize = snprintf(date, sizeof(date), "/%s/%02i.%02i %02i:%02i:%02i", _pid.c_str(), ct.tm_mday, ct.tm_mon + 1,
+		ct.tm_hour, ct.tm_min, ct.tm_sec);
+	if (_timePrecision == ETimePrecision::MILLISECONDS)
+		dateSize += snprintf(date + dateSize, sizeof(date) - dateSize, ".%03u", nanoseconds / 1000000);
+	else if (_timePrecision == ETimePrecision::MICROSECONDS)
+		dateSize += snprintf(date + dateSize, sizeof(date) - dateSize, ".%06u", nanoseconds / 1000);
+	text.append(date, dateSize);
+	text.push_back('/');
+	text.append(levelName(level));
+	text.append("] ");
+
+	const char *fmt = format.c_str();
+	const char *literal = fmt;
+	FormatConversion conversion;
+	std::string conversionFormat;
+	while (conversion.next(fmt)) {
+		text.append(literal, conversion.begin - literal);
+		literal = conversion.end;
+		int stars[2];
+		for (uint8_t star = 0; star < conversion.stars; star++)
+			stars[star] = unzigzag(getVarint(pos, end));
+		conversionFormat.assign(conversion.begin, conversion.end - conversion.begin);
+		switch (conversion.argument)
+		{
+		case FormatConversion::NONE:
+			if (conversionFormat == "%%")
+				text.push_back('%');
+			else
+				text.append(conversionFormat);
+			break;
+		case FormatConversion::IGNORED:
+			break;
+		case FormatConversion::INT:
+			appendFormatted(text, conversionFormat, stars, conversion.stars,
+				static_cast<int>(unzigzag(getVarint(pos, end))));
+			break;
+		case FormatConversion::UINT:
+			appendFormatted(text, conversionFormat, stars, conversion.stars,
+				static_cast<unsigned int>(getVarint(pos, end)));
+			break;
+		case FormatConversion::LONG:
+			appendFormatted(text, conversionFormat, stars, conversion.stars,
+				static_cast<long long>(unzigzag(getVarint(pos, end))));
+			break;
+		case FormatConversion::ULONG:
+			appendFormatted(text, conversionFormat, stars, conversion.stars,
+				static_cast<unsigned long long>(getVarint(pos, end)));
+			break;
+		case FormatConversion::DOUBLE:
+		case FormatConversion::LONG_DOUBLE:
+		{
+			double value;
+			if (static_cast<size_t>(end - pos) < sizeof(value))
+				throw Error("Truncated binary log message");
+			memcpy(&value, pos, sizeof(value));
+			pos += sizeof(value);
+			if (conversion.argument == FormatConversion::DOUBLE)
+				appendFormatted(text, conversionFormat, stars, conversion.stars, value);
+			else
+				appendFormatted(text, conversionFormat, stars, conversion.stars, static_cast<long double>(value));
+			break;
+		}
+		case FormatConversion::POINTER:
+			appendFormatted(text, conversionFormat, stars, conversion.stars,
+				reinterpret_cast<void*>(static_cast<uintptr_t>(getVarint(pos, end))));
+			break;
+		case FormatConversion::STRING:
+		case FormatConversion::ERRNO:
+		case FormatConversion::WIDE:
+		{
+			uint64_t size = getVarint(pos, end);
+			if (static_cast<uint64_t>(end - pos) < size)
+				throw Error("Truncated binary log message");
+			std::string value(reinterpret_cast<const char*>(pos), size);
+			pos += size;
+			if (conversion.argument == FormatConversion::STRING)
+				appendFormatted(text, conversionFormat, stars, conversion.stars, value.c_str());
+			else
+				text.append(value); // it was formatted by the log call
+			break;
+		}
+		};
+	}
+	text.append(literal);
+}
@@ -0,0 +1,143 @@
+#pragma once
+#ifndef __FL_BINARY_LOG_HPP
+#define	__FL_BINARY_LOG_HPP
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Binary log target with deferred formatting and its decoder
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include "async_log.hpp"
+#include "exception.hpp"
+
+namespace fl {
+	namespace log {
+		// Stream of the binary log, all numbers are varints:
+		//   session    "FLBLOG1\n" pid - ids of the strings are valid till the next session
+		//   definition 'D' id size bytes - a format string, a tag or a file name
+		//   message    'M' size level tagId formatId seconds nanoseconds arguments
+		//   location   'L' size level tagId fileId line formatId seconds nanoseconds arguments
+		// Arguments are stored in the order of the printf conversions of the format: integers (zigzag for the signed
+		// ones), doubles as 8 bytes, strings and %m as size and bytes
+		namespace EBinaryLogRecord {
+			enum EBinaryLogRecord : uint8_t
+			{
+				DEFINITION = 'D',
+				MESSAGE = 'M',
+				LOCATION = 'L',
+			};
+		};
+
+		// printf conversions of a format string
+		class FormatConversion
+		{
+		public:
+			enum EArgument : uint8_t
+			{
+				NONE, // %% and unknown conversions
+				IGNORED, // %n, the pointer argument is skipped
+				INT,
+				UINT,
+				LONG, // l, ll, j, z, t, q
+				ULONG,
+				DOUBLE,
+				LONG_DOUBLE,
+				STRING,
+				POINTER,
+				ERRNO, // %m
+				WIDE, // %lc and %ls, they are formatted at the log call
+			};
+			// finds the next conversion from fmt, returns false at the end of the format
+			bool next(const char *&fmt);
+			const char *begin; // '%'
+			const char *end; // after the conversion character
+			EArgument argument;
+			uint8_t stars; // * width and precision are int arguments before the value
+		};
+
+		// Messages are not formatted by the logging threads, the format string, the tag and the file name are written
+		// once as definitions and the messages keep their ids with the raw arguments. Formats are identified by their
+		// contents, so a format which isn't a literal stays correct
+		class BinaryLogTarget : public AsyncFileTarget
+		{
+		public:
+			static const char SESSION_MAGIC[];
+			static const size_t SESSION_MAGIC_SIZE = 8;
+
+			BinaryLogTarget(const char *fileName, const EOverflow overflow = DROP,
+				const uint32_t ringSize = DEFAULT_RING_SIZE, const uint32_t flushIntervalMs = 10);
+			virtual void log(
+				const int level,
+				const char *tag,
+				const time_t curTime,
+				struct tm *ct,
+				const char *fmt,
+				va_list args
+			);
+			virtual void log(
+				const int level,
+				const char *fileName,
+				const int lineNumber,
+				const char *tag,
+				const time_t curTime,
+				struct tm *ct,
+				const char *fmt,
+				va_list args
+			);
+		private:
+			uint32_t _stringId(const char *str);
+			uint32_t _defineString(const char *str, const char *&defined);
+			void _log(const EBinaryLogRecord::EBinaryLogRecord record, const int level, const char *fileName,
+				const int lineNumber, const char *tag, const time_t curTime, const char *fmt, va_list args);
+
+			Mutex _stringsSync;
+			typedef std::unordered_map<std::string, uint32_t> TStringIdMap;
+			TStringIdMap _stringIds;
+
+			struct CachedString
+			{
+				uint64_t targetId;
+				const char *str;
+				const char *defined; // the copy in _stringIds, a reused buffer of str doesn't match it
+				uint32_t id;
+			};
+			static const size_t STRING_CACHE_SIZE = 64;
+			static __thread CachedString _stringCache[STRING_CACHE_SIZE];
+		};
+
+		// Renders the binary log as the text log
+		class BinaryLogDecoder
+		{
+		public:
+			class Error : public fl::exceptions::Error
+			{
+			public:
+				Error(const char *what)
+					: fl::exceptions::Error(what)
+				{
+				}
+			};
+			BinaryLogDecoder(const ETimePrecision::ETimePrecision timePrecision = ETimePrecision::SECONDS);
+			// appends the lines of the whole records to text, returns the size of the decoded data, the rest
+			// of the data is the beginning of a record which must be passed again with the following data
+			size_t decode(const char *data, const size_t size, std::string &text);
+		private:
+			void _decodeMessage(const EBinaryLogRecord::EBinaryLogRecord record, const uint8_t *pos, const uint8_t *end,
+				std::string &text);
+			const std::string &_string(const uint64_t id) const;
+
+			ETimePrecision::ETimePrecision _timePrecision;
+			std::string _pid;
+			std::vector<std::string> _strings;
+		};
+	};
+};
+
+#endif	// __FL_BINARY_LOG_HPP
@@ -14,77 +14,151 @@
 
 #include "bstring.hpp"
 #include "buffer.hpp"
+#include "format.hpp"
 using namespace fl::strings;
 
+BString::TCapacityPolicy BString::_capacityPolicy = BString::geometricCapacity;
+
+BString::TSize BString::geometricCapacity(const TSize reserved, const TSize required)
+{
+	// doubling keeps appending of N small pieces linear, large strings grow by 1.5
+	static const TSize DOUBLE_GROWTH_LIMIT = 1024 * 1024;
+	static const TSize MIN_HEAP_CAPACITY = 64;
+	TSize capacity = (reserved < DOUBLE_GROWTH_LIMIT) ? reserved * 2 : reserved + reserved / 2;
+	if (capacity < MIN_HEAP_CAPACITY)
+		capacity = MIN_HEAP_CAPACITY;
+	if (capacity < required)
+		capacity = required;
+	return capacity;
+}
+
+BString::TSize BString::exactCapacity(const TSize reserved, const TSize required)
+{
+	return required;
+}
+
+void BString::setCapacityPolicy(TCapacityPolicy policy)
+{
+	_capacityPolicy = policy ? policy : geometricCapacity;
+}
+
+void BString::_setInline()
+{
+	_data = _inline;
+	_reserved = INLINE_CAPACITY;
+	_size = 0;
+	_inline[0] = 0;
+}
+
 void BString::reserve(const TSize newSize)
 {
 	if (newSize == 0) {
+		if (!_isInline())
+			free(_data);
+		_setInline();
+	} else if (newSize <= INLINE_CAPACITY) {
+		if (_isInline()) {
+			if (_size > newSize) {
+				_size = newSize;
+				_data[_size] = 0;
+			}
+			return;
+		}
+		TSize size = (_size > newSize) ? newSize : _size;
+		memcpy(_inline, _data, size);
 		free(_data);
-		_data = NULL;
-		_reserved = 0;
-		_size = 0;
+		_data = _inline;
+		_reserved = INLINE_CAPACITY;
+		_size = size;
+		_data[_size] = 0;
 	} else {
-		TDataPtr newData = static_cast<TDataPtr>(malloc(newSize + 1));
+		TDataPtr newData;
+		if (_isInline()) {
+			newData = static_cast<TDataPtr>(malloc(newSize + 1));
+			if (newData)
+				memcpy(newData, _inline, _size);
+		} else {
+			newData = static_cast<TDataPtr>(realloc(_data, newSize + 1));
+		}
 		if (!newData)
 			throw BString::Error("malloc failed");
-		if (_size > 0) // need copy
-		{
-			if (_size > newSize)
-				_size = newSize;
-			memcpy(newData, _data, _size);
-		}
-		free(_data);
 		_data = newData;
 		_reserved = newSize;
+		if (_size > newSize)
+			_size = newSize;
 		_data[_size] = 0;
 	}
 }
 
-inline void BString::_fit(const TSize size)
-{
-	if (_size + size < _reserved)
-		return;
-	reserve(_size + size + 1);
-}
-
 BString::BString(const TSize reserved)
-	: _size(0), _reserved(reserved), _data(NULL)
 {
-	reserve(_reserved);
+	_setInline();
+	if (reserved > INLINE_CAPACITY)
+		reserve(reserved);
 }
 
 BString::BString(const char *str)
-	: _size(0), _reserved(0), _data(NULL)
 {
+	_setInline();
 	add(str, strlen(str));
 }
 
 BString::~BString()
 {
-	free(_data);
+	if (!_isInline())
+		free(_data);
 }
 
 BString::BString(BString &&moveFrom) noexcept
-	: _size(moveFrom._size), _reserved(moveFrom._reserved), _data(moveFrom._data)
 {
-	moveFrom._data = NULL;
-	moveFrom._reserved = 0;
-	moveFrom._size = 0;
+	_setInline();
+	_swap(moveFrom);
 }
 
 BString& BString::operator=(BString &&moveFrom) noexcept
 {
-	std::swap(moveFrom._size, _size);
-	std::swap(moveFrom._reserved, _reserved);
-	std::swap(moveFrom._data, _data);
+	_swap(moveFrom);
 	return *this;
 }
 
+void BString::_swap(BString &str)
+{
+	if (this == &str)
+		return;
+	bool isInline = _isInline();
+	bool isStrInline = str._isInline();
+	TDataPtr data = _data;
+	TDataPtr strData = str._data;
+	if (isInline && isStrInline) {
+		char tmp[INLINE_SIZE];
+		memcpy(tmp, _inline, _size + 1);
+		memcpy(_inline, str._inline, str._size + 1);
+		memcpy(str._inline, tmp, _size + 1);
+	} else if (isInline) {
+		memcpy(str._inline, _inline, _size + 1);
+	} else if (isStrInline) {
+		memcpy(_inline, str._inline, str._size + 1);
+	}
+	_data = isStrInline ? _inline : strData;
+	str._data = isInline ? str._inline : data;
+	std::swap(_size, str._size);
+	std::swap(_reserved, str._reserved);
+}
+
 BString& BString::operator=(fl::utils::Buffer &&moveFrom) noexcept
 {
-	_size = moveFrom.writtenSize();
-	_reserved = moveFrom.reserved();
-	_data = (TDataPtr)moveFrom.release();
+	TSize size = moveFrom.writtenSize();
+	TSize reserved = moveFrom.reserved();
+	TDataPtr data = (TDataPtr)moveFrom.release();
+	if (!_isInline())
+		free(_data);
+	if (data) {
+		_data = data;
+		_reserved = reserved;
+		_size = size;
+		_data[_size] = 0;
+	} else
+		_setInline();
 	return *this;
 }
 
@@ -100,12 +174,10 @@ inline bool BString::_reserveForSprintf(const int sprintfRes, const TSize leftSp
 	if ((sprintfRes >= 0) && (static_cast<TSize>(sprintfRes) < leftSpace))
 		return true;
 
-	int newReservedSize = _reserved;
 	if (sprintfRes > 0) // vsnprintf returned how many symbols it needed
-		newReservedSize += (sprintfRes + 1);	
+		reserve(growCapacity(_reserved, _size + sprintfRes + 1));
 	else
-		newReservedSize *= 2;
-	reserve(newReservedSize);
+		reserve(_reserved * 2);
 	return false;
 }
 
@@ -189,32 +261,46 @@ BString &BString::operator<<(const char *str)
 
 BString &BString::operator<<(const unsigned int num)
 {
-	sprintfAdd("%u", num);
+	_addUnsigned(num);
 	return *this;
 }
 
 
 BString &BString::operator<<(const uint64_t num)
 {
-	sprintfAdd("%llu", num);
+	_addUnsigned(num);
 	return *this;	
 }
 
 BString &BString::operator<<(const int64_t num)
 {
-	sprintfAdd("%lld", num);
+	if (num < 0) {
+		TSize size = fl::strings::format::unsignedSize(0 - static_cast<uint64_t>(num)) + 1;
+		fl::strings::format::writeSigned(reserveBuffer(size), num);
+		_data[_size] = 0;
+	} else {
+		_addUnsigned(num);
+	}
 	return *this;	
 }
 
 
 BString &BString::operator<<(const int num)
 {
-	sprintfAdd("%d", num);
+	*this << static_cast<int64_t>(num);
 	return *this;
 }
 
+void BString::_addUnsigned(const uint64_t num)
+{
+	TSize size = fl::strings::format::unsignedSize(num);
+	fl::strings::format::writeUnsigned(reserveBuffer(size), num, size);
+	_data[_size] = 0;
+}
+
 BString &BString::operator<<(const double num)
 {
+	// keeps the fixed %f output, FL_FORMAT_ADD writes a round-trip representation
 	sprintfAdd("%f", num);
 	return *this;
 }
@@ -349,8 +435,12 @@ void BString::trimLastSpaces()
 BString::TDataPtr BString::release()
 {
 	TDataPtr data = _data;
-	_data = NULL;
-	_reserved = 0;
-	_size = 0;
+	if (_isInline()) {
+		data = static_cast<TDataPtr>(malloc(INLINE_SIZE));
+		if (!data)
+			throw BString::Error("malloc failed");
+		memcpy(data, _inline, _size + 1);
+	}
+	_setInline();
 	return data;
 }
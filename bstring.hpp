@@ -40,6 +40,20 @@ namespace fl {
 			typedef uint32_t TSize;
 			typedef char *TDataPtr;
 			static const TSize DEFAULT_RESERVED_SIZE = 0;
+			// short strings are kept in the object itself without a heap allocation
+			static const TSize INLINE_SIZE = 24;
+			static const TSize INLINE_CAPACITY = INLINE_SIZE - 1;
+			
+			// returns a new capacity for a string of reserved capacity which needs at least required bytes
+			typedef TSize (*TCapacityPolicy)(const TSize reserved, const TSize required);
+			static TSize geometricCapacity(const TSize reserved, const TSize required);
+			static TSize exactCapacity(const TSize reserved, const TSize required);
+			// process wide policy for BString and Buffer growth, geometricCapacity by default
+			static void setCapacityPolicy(TCapacityPolicy policy);
+			static TSize growCapacity(const TSize reserved, const TSize required)
+			{
+				return _capacityPolicy(reserved, required);
+			}
 			
 			BString(const TSize reserved = DEFAULT_RESERVED_SIZE);
 			BString(const char *str);
@@ -83,8 +97,7 @@ namespace fl {
 			void clear()
 			{
 				_size = 0;
-				if (_data)
-					_data[0] = 0;
+				_data[0] = 0;
 			}
 			const TSize size() const
 			{
@@ -113,14 +126,29 @@ namespace fl {
 			void trimLast();
 			void trimLastSpaces();
 			void reserve(const TSize newReservedSize);
+			// returns malloc'ed data of reserved() + 1 bytes, the string becomes empty
 			TDataPtr release();
 		protected:
 			bool _sprintfAdd(const char *fmt, TSize &charsAdded, va_list args);
 			bool _reserveForSprintf(const int sprintfRes, const TSize leftSpace);
-			void _fit(const TSize size);
+			void _fit(const TSize size)
+			{
+				if (_size + size < _reserved)
+					return;
+				reserve(growCapacity(_reserved, _size + size + 1));
+			}
+			bool _isInline() const
+			{
+				return _data == _inline;
+			}
+			void _setInline();
+			void _swap(BString &str);
+			void _addUnsigned(const uint64_t num);
 			TSize _size;
 			TSize _reserved;
-			TDataPtr _data;
+			TDataPtr _data; // _inline or a heap buffer of _reserved + 1 bytes
+			char _inline[INLINE_SIZE];
+			static TCapacityPolicy _capacityPolicy;
 		};
 	};
 };
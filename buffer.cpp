@@ -67,22 +67,15 @@ void Buffer::reserve(const TSize newSize)
 		_readPos = NULL;
 		_writePos = NULL;
 	} else {
-		TDataPtr newData = static_cast<TDataPtr>(malloc(newSize + 1));
-		if (!newData)
-			throw Error("malloc failed");
-		TSize writtenSize = 0;
-		if (_writePos > _begin) // need copy
-		{
-			writtenSize = _writePos - _begin;
-			if (writtenSize > newSize)
-				writtenSize = newSize;
-			memcpy(newData, _begin, writtenSize);
-		}
+		TSize writtenSize = _writePos - _begin;
+		if (writtenSize > newSize)
+			writtenSize = newSize;
 		TSize readed = readPos();
-		if (readed > writtenSize) {
+		if (readed > writtenSize)
 			readed = writtenSize;
-		}
-		free(_begin);
+		TDataPtr newData = static_cast<TDataPtr>(realloc(_begin, newSize + 1));
+		if (!newData)
+			throw Error("malloc failed");
 		_begin = newData;
 		_end = _begin + newSize;
 		_readPos = _begin + readed;
@@ -94,8 +87,7 @@ void Buffer::_fit(const TSize size)
 {
 	if ((_writePos + size) < _end)
 		return;
-	TSize newSize = (_end - _begin) + size + 1;
-	reserve(newSize);
+	reserve(BString::growCapacity(_end - _begin, (_writePos - _begin) + size + 1));
 }
 
 
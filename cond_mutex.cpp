@@ -40,3 +40,18 @@ void CondMutex::broadcastSignalToAll()
 {
 	pthread_cond_broadcast(&_cond);
 }			
+
+void CondMutex::lock()
+{
+	pthread_mutex_lock(&_mutex);
+}
+
+void CondMutex::unLock()
+{
+	pthread_mutex_unlock(&_mutex);
+}
+
+void CondMutex::wait()
+{
+	pthread_cond_wait(&_cond, &_mutex);
+}
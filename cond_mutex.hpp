@@ -24,6 +24,11 @@ namespace fl {
 			void waitSignal();
 			void sendSignal();
 			void broadcastSignalToAll();
+			// the state of a predicate is guarded by lock / unLock, wait is called with the mutex locked,
+			// it releases the mutex while it sleeps and locks it again before the return
+			void lock();
+			void unLock();
+			void wait();
 		private:
 			pthread_mutex_t _mutex;
 			pthread_cond_t _cond;
@@ -0,0 +1,15 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Db's log customization class
+///////////////////////////////////////////////////////////////////////////////
+
+#include "db_log.hpp"
+
+using namespace fl::db::log;
+
+TagLevel DbLogSystem::tagLevel("DB");
@@ -21,9 +21,12 @@ namespace fl {
 			using fl::log::TTargetList;
 			using fl::log::LogSystem;
 			
+			using fl::log::TagLevel;
+
 			class DbLogSystem
 			{
 			public:
+				static TagLevel tagLevel;
 				static bool log(const size_t target, const int level, const time_t curTime, struct tm *ct, const char *fmt, 
 					va_list args)
 				{
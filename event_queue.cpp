@@ -66,7 +66,10 @@ bool EPoll::ctrl(Event *event)
 	
 	if (epoll_ctl(_eventFD, event->op(), event->descr(), &ev) == -1)
 	{
-		log::Error::L("epoll_ctl erorr %d - %s - %d - %d (%d)\n", errno, strerror(errno), _eventFD, event->descr(), event->op());
+		static const uint32_t CTRL_ERRORS_PER_SECOND = 10;
+		int error = errno; // the line of the suppressed errors can change errno
+		FL_LOG_RATE_LIMITED(log::Error, CTRL_ERRORS_PER_SECOND, "epoll_ctl erorr %d - %s - %d - %d (%d)\n", error,
+			strerror(error), _eventFD, event->descr(), event->op());
 		return false;
 	}
 
@@ -12,6 +12,7 @@
 
 #include "event_thread.hpp"
 #include "exception.hpp"
+#include "rcu.hpp"
 
 
 using namespace fl::events;
@@ -23,7 +24,8 @@ EPollWorkerThread::EPollWorkerThread(
 	class ThreadSpecificData* threadSpecificData, 
 	const uint32_t stackSize
 )
-	: _poll(queueLength), _threadSpecificData(threadSpecificData), _finished(false)
+	: _poll(queueLength), _threadSpecificData(threadSpecificData), _eventsSync("EPollWorkerThread::_eventsSync"),
+	_finished(false)
 {
 	setStackSize(stackSize);
 	if (!create())
@@ -56,6 +58,21 @@ bool EPollWorkerThread::addEvent(class WorkEvent *ev, fl::threads::WeekAutoMutex
 	return true;	
 }
 
+bool EPollWorkerThread::addEventNL(class WorkEvent *ev)
+{
+	if (!ctrl(ev))
+		return false;
+	
+	ev->setThread(this);
+	_addEvent(ev);
+	return true;
+}
+
+void EPollWorkerThread::updateTimeoutNL(class WorkEvent *ev)
+{
+	_events.erase(ev->listPosition());
+	_addEvent(ev);
+}
 
 bool EPollWorkerThread::tryAddConnection(WorkEvent* ev, class Socket *acceptSocket)
 {
@@ -115,10 +132,16 @@ void EPollWorkerThread::run()
 	EPoll::TEventVector changedEvents;
 	EPoll::TEventVector endedEvents;
 	time_t lastCheckTime = 0;
+	// the events read the RcuPtr objects without locks, the thread is quiescent while it waits for the events
+	Rcu::registerThread();
+	if (_threadSpecificData)
+		_threadSpecificData->threadStarted();
 	while (1)
 	{
 		static const int EVENT_WAIT_TIME = 1 * 1000; // wait 1 second in milliseconds
+		Rcu::offline();
 		_poll.dispatch(EVENT_WAIT_TIME);
+		Rcu::online();
 		_eventsSync.lock();
 		if (_finished) {
 			_eventsSync.unLock();
@@ -146,6 +169,8 @@ void EPollWorkerThread::run()
 		}
 		if (lastCheckTime != EPollWorkerGroup::curTime.unix()) {
 			lastCheckTime = EPollWorkerGroup::curTime.unix();
+			if (_threadSpecificData)
+				_threadSpecificData->periodicCall(lastCheckTime);
 			
 			for (auto eventIter = _events.begin(); eventIter != _events.end(); )  {
 				if ((*eventIter)->timeOutTime() > lastCheckTime) // only new events left
@@ -162,6 +187,7 @@ void EPollWorkerThread::run()
 		}
 		_eventsSync.unLock();
 	}
+	Rcu::unregisterThread();
 }
 
 EPollWorkerGroup::EPollWorkerGroup(
@@ -92,6 +92,9 @@ namespace fl {
 			void addToDeletedNL(class Event *ev);
 			bool unAttachNL(class WorkEvent* ev);
 			bool addEvent(class WorkEvent *ev, fl::threads::WeekAutoMutex &autoSync);
+			// NL variants are for the code which is already run under worker's lock (from an event call)
+			bool addEventNL(class WorkEvent *ev);
+			void updateTimeoutNL(class WorkEvent *ev);
 		private:
 			virtual void run();
 			EPoll _poll;
@@ -141,6 +144,10 @@ namespace fl {
 		{
 		public:
 			virtual ~ThreadSpecificData() {};
+			// is called by the worker thread before the first event, e.g. to take the memory of its NUMA node
+			virtual void threadStarted() {};
+			// is called by the worker thread under its lock about once a second
+			virtual void periodicCall(const time_t curTime) {};
 		};
 		
 		class ThreadSpecificDataFactory 
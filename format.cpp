@@ -0,0 +1,518 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Type safe formatting into BString without vsnprintf
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+#include "format.hpp"
+
+using namespace fl::strings;
+using namespace fl::strings::format;
+
+namespace
+{
+	const char DIGIT_PAIRS[] =
+		"00010203040506070809"
+		"10111213141516171819"
+		"20212223242526272829"
+		"30313233343536373839"
+		"40414243444546474849"
+		"50515253545556575859"
+		"60616263646566676869"
+		"70717273747576777879"
+		"80818283848586878889"
+		"90919293949596979899";
+
+	// Grisu2 by Florian Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with Integers". The digits
+	// always read back into the same double, but unlike Grisu3 they aren't guaranteed to be the shortest ones
+	struct DiyFp
+	{
+		DiyFp(const uint64_t f, const int e)
+			: f(f), e(e)
+		{
+		}
+		DiyFp operator-(const DiyFp &rhs) const
+		{
+			return DiyFp(f - rhs.f, e);
+		}
+		DiyFp operator*(const DiyFp &rhs) const
+		{
+			unsigned __int128 product = static_cast<unsigned __int128>(f) * rhs.f;
+			uint64_t h = product >> 64;
+			uint64_t l = static_cast<uint64_t>(product);
+			if (l & (1ULL << 63)) // rounding
+				h++;
+			return DiyFp(h, e + rhs.e + 64);
+		}
+		DiyFp normalize() const
+		{
+			int shift = __builtin_clzll(f);
+			return DiyFp(f << shift, e - shift);
+		}
+		uint64_t f;
+		int e;
+	};
+
+	const int SIGNIFICAND_SIZE = 52;
+	const int EXPONENT_BIAS = 0x3FF + SIGNIFICAND_SIZE;
+	const uint64_t HIDDEN_BIT = 1ULL << SIGNIFICAND_SIZE;
+	const uint64_t SIGNIFICAND_MASK = HIDDEN_BIT - 1;
+	const uint64_t EXPONENT_MASK = 0x7FF0000000000000ULL;
+
+	DiyFp toDiyFp(const double value)
+	{
+		uint64_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		int biasedExponent = (bits & EXPONENT_MASK) >> SIGNIFICAND_SIZE;
+		uint64_t significand = bits & SIGNIFICAND_MASK;
+		if (biasedExponent)
+			return DiyFp(significand + HIDDEN_BIT, biasedExponent - EXPONENT_BIAS);
+		else
+			return DiyFp(significand, 1 - EXPONENT_BIAS);
+	}
+
+	// m- and m+ boundaries of v with the same exponent
+	void normalizedBoundaries(const DiyFp &v, DiyFp &minus, DiyFp &plus)
+	{
+		plus = DiyFp((v.f << 1) + 1, v.e - 1).normalize();
+		if (v.f == HIDDEN_BIT)
+			minus = DiyFp((v.f << 2) - 1, v.e - 2);
+		else
+			minus = DiyFp((v.f << 1) - 1, v.e - 1);
+		minus.f <<= minus.e - plus.e;
+		minus.e = plus.e;
+	}
+
+	// normalized 10^k for k = -348, -340, ..., 340
+	const uint64_t CACHED_POWERS_F[] = {
+		0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+		0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+		0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+		0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+		0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+		0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+		0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+		0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+		0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+		0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+		0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+		0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+		0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+		0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+		0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+		0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+		0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+		0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+		0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+		0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+		0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+		0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+		0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+		0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+		0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+		0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+		0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+		0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+		0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+	};
+	const int16_t CACHED_POWERS_E[] = {
+		-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+		-901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+		-582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+		-263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+		56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+		375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+		694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+		1013, 1039, 1066,
+	};
+
+	// c = 10^-k which brings the exponent of e into [-60, -32]
+	DiyFp cachedPower(const int e, int &k)
+	{
+		double dk = (-61 - e) * 0.30102999566398114 + 347; // 1 / log2(10)
+		int ik = static_cast<int>(dk);
+		if (dk - ik > 0.0)
+			ik++;
+		unsigned index = static_cast<unsigned>((ik >> 3) + 1);
+		k = -(-348 + static_cast<int>(index << 3));
+		return DiyFp(CACHED_POWERS_F[index], CACHED_POWERS_E[index]);
+	}
+
+	const uint64_t POW10[] = {
+		1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL,
+		10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL, 100000000000000ULL,
+		1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL, 1000000000000000000ULL,
+		10000000000000000000ULL
+	};
+
+	void grisuRound(char *buf, const int length, const uint64_t delta, uint64_t rest, const uint64_t tenKappa,
+		const uint64_t wpW)
+	{
+		while ((rest < wpW) && ((delta - rest) >= tenKappa) &&
+			(((rest + tenKappa) < wpW) || ((wpW - rest) > (rest + tenKappa - wpW)))) {
+			buf[length - 1]--;
+			rest += tenKappa;
+		}
+	}
+
+	void digitGen(const DiyFp &w, const DiyFp &mp, uint64_t delta, char *buf, int &length, int &k)
+	{
+		const DiyFp one(1ULL << -mp.e, mp.e);
+		const DiyFp wpW = mp - w;
+		uint32_t p1 = static_cast<uint32_t>(mp.f >> -one.e);
+		uint64_t p2 = mp.f & (one.f - 1);
+		int kappa = unsignedSize(p1);
+		length = 0;
+		while (kappa > 0) {
+			uint32_t d = p1 / POW10[kappa - 1];
+			p1 %= POW10[kappa - 1];
+			if (d || length)
+				buf[length++] = '0' + d;
+			kappa--;
+			uint64_t rest = (static_cast<uint64_t>(p1) << -one.e) + p2;
+			if (rest <= delta) {
+				k += kappa;
+				grisuRound(buf, length, delta, rest, POW10[kappa] << -one.e, wpW.f);
+				return;
+			}
+		}
+		while (true) {
+			p2 *= 10;
+			delta *= 10;
+			char d = static_cast<char>(p2 >> -one.e);
+			if (d || length)
+				buf[length++] = '0' + d;
+			p2 &= one.f - 1;
+			kappa--;
+			if (p2 < delta) {
+				k += kappa;
+				grisuRound(buf, length, delta, p2, one.f, wpW.f * POW10[-kappa]);
+				return;
+			}
+		}
+	}
+
+	// digits of a positive v and its decimal exponent k, v = digits * 10^k
+	void grisu2(const double value, char *buf, int &length, int &k)
+	{
+		DiyFp v = toDiyFp(value);
+		DiyFp minus(0, 0);
+		DiyFp plus(0, 0);
+		normalizedBoundaries(v, minus, plus);
+		DiyFp c = cachedPower(plus.e, k);
+		DiyFp w = v.normalize() * c;
+		DiyFp wPlus = plus * c;
+		DiyFp wMinus = minus * c;
+		wMinus.f++;
+		wPlus.f--;
+		digitGen(w, wPlus, wPlus.f - wMinus.f, buf, length, k);
+	}
+
+	char *writeExponent(char *buf, int exponent)
+	{
+		*buf++ = 'e';
+		if (exponent < 0) {
+			*buf++ = '-';
+			exponent = -exponent;
+		} else {
+			*buf++ = '+';
+		}
+		if (exponent >= 100) {
+			*buf++ = '0' + exponent / 100;
+			exponent %= 100;
+		}
+		memcpy(buf, DIGIT_PAIRS + exponent * 2, 2);
+		return buf + 2;
+	}
+
+	// places the decimal point, the same layout as %g has but without a precision limit
+	char *prettify(char *buf, const int length, const int k)
+	{
+		static const int MAX_FIXED_EXPONENT = 21;
+		const int kk = length + k; // 10^(kk - 1) <= v < 10^kk
+		if ((k >= 0) && (kk <= MAX_FIXED_EXPONENT)) { // 1234e7 -> 12340000000
+			memset(buf + length, '0', k);
+			return buf + kk;
+		} else if ((kk > 0) && (kk <= MAX_FIXED_EXPONENT)) { // 1234e-2 -> 12.34
+			memmove(buf + kk + 1, buf + kk, length - kk);
+			buf[kk] = '.';
+			return buf + length + 1;
+		} else if ((kk > -6) && (kk <= 0)) { // 1234e-6 -> 0.001234
+			const int offset = 2 - kk;
+			memmove(buf + offset, buf, length);
+			buf[0] = '0';
+			buf[1] = '.';
+			memset(buf + 2, '0', offset - 2);
+			return buf + length + offset;
+		} else if (length == 1) { // 1e30
+			return writeExponent(buf + 1, kk - 1);
+		} else { // 1234e30 -> 1.234e+33
+			memmove(buf + 2, buf + 1, length - 1);
+			buf[1] = '.';
+			return writeExponent(buf + length + 1, kk - 1);
+		}
+	}
+};
+
+TSize fl::strings::format::unsignedSize(uint64_t value)
+{
+	TSize size = 1;
+	while (value >= 10000) {
+		value /= 10000;
+		size += 4;
+	}
+	if (value >= 1000)
+		return size + 3;
+	else if (value >= 100)
+		return size + 2;
+	else if (value >= 10)
+		return size + 1;
+	else
+		return size;
+}
+
+TSize fl::strings::format::hexSize(uint64_t value)
+{
+	return (64 - __builtin_clzll(value | 1) + 3) / 4;
+}
+
+char *fl::strings::format::writeUnsigned(char *buf, uint64_t value, const TSize size)
+{
+	char *end = buf + size;
+	char *pos = end;
+	while (value >= 100) {
+		const char *pair = DIGIT_PAIRS + (value % 100) * 2;
+		value /= 100;
+		pos -= 2;
+		pos[0] = pair[0];
+		pos[1] = pair[1];
+	}
+	if (value >= 10) {
+		pos -= 2;
+		pos[0] = DIGIT_PAIRS[value * 2];
+		pos[1] = DIGIT_PAIRS[value * 2 + 1];
+	} else {
+		*(--pos) = '0' + value;
+	}
+	return end;
+}
+
+char *fl::strings::format::writeUnsigned(char *buf, const uint64_t value)
+{
+	return writeUnsigned(buf, value, unsignedSize(value));
+}
+
+char *fl::strings::format::writeSigned(char *buf, const int64_t value)
+{
+	uint64_t absValue = value;
+	if (value < 0) {
+		*buf++ = '-';
+		absValue = 0 - absValue;
+	}
+	return writeUnsigned(buf, absValue);
+}
+
+char *fl::strings::format::writeHex(char *buf, uint64_t value, const TSize size, const bool upperCase)
+{
+	const char *digits = upperCase ? "0123456789ABCDEF" : "0123456789abcdef";
+	char *end = buf + size;
+	char *pos = end;
+	do {
+		*(--pos) = digits[value & 0xF];
+		value >>= 4;
+	} while (pos > buf);
+	return end;
+}
+
+char *fl::strings::format::writeDouble(char *buf, const double value)
+{
+	if (std::isnan(value)) {
+		memcpy(buf, "nan", 3);
+		return buf + 3;
+	}
+	if (std::signbit(value))
+		*buf++ = '-';
+	if (std::isinf(value)) {
+		memcpy(buf, "inf", 3);
+		return buf + 3;
+	}
+	if (value == 0) {
+		*buf = '0';
+		return buf + 1;
+	}
+	int length = 0;
+	int k = 0;
+	grisu2(std::fabs(value), buf, length, k);
+	return prettify(buf, length, k);
+}
+
+TSize Arg::prepare(const Spec &spec)
+{
+	switch (_type) {
+	case STRING:
+		break;
+	case CHAR:
+		_length = 1;
+		break;
+	case SIGNED:
+		if (spec.hex)
+			_length = hexSize(_signed);
+		else if (_signed < 0)
+			_length = unsignedSize(0 - static_cast<uint64_t>(_signed)) + 1;
+		else
+			_length = unsignedSize(_signed);
+		break;
+	case UNSIGNED:
+		_length = spec.hex ? hexSize(_unsigned) : unsignedSize(_unsigned);
+		break;
+	case DOUBLE:
+		_length = writeDouble(_buf, _double) - _buf;
+		break;
+	case POINTER:
+		_length = hexSize(_unsigned) + 2;
+		break;
+	};
+	_padding = (spec.width > _length) ? spec.width - _length : 0;
+	return _length + _padding;
+}
+
+char *Arg::write(char *buf, const Spec &spec) const
+{
+	TSize length = _length;
+	if (_padding) {
+		if (spec.zeroPad && (_type == SIGNED) && (_signed < 0) && !spec.hex) {
+			*buf++ = '-'; // -0042
+			length--;
+		}
+		else if (spec.zeroPad && (_type == POINTER)) {
+			*buf++ = '0'; // 0x00ff
+			*buf++ = 'x';
+			length -= 2;
+		}
+		memset(buf, (spec.zeroPad && (_type != STRING)) ? '0' : ' ', _padding);
+		buf += _padding;
+	}
+	switch (_type) {
+	case STRING:
+		memcpy(buf, _str, length);
+		return buf + length;
+	case CHAR:
+		*buf = _char;
+		return buf + 1;
+	case SIGNED:
+		if (spec.hex)
+			return writeHex(buf, _signed, length, spec.upperCase);
+		if (_signed < 0) {
+			if (length == _length) {
+				*buf++ = '-';
+				length--;
+			}
+			return writeUnsigned(buf, 0 - static_cast<uint64_t>(_signed), length);
+		}
+		return writeUnsigned(buf, _signed, length);
+	case UNSIGNED:
+		if (spec.hex)
+			return writeHex(buf, _unsigned, length, spec.upperCase);
+		return writeUnsigned(buf, _unsigned, length);
+	case DOUBLE:
+		memcpy(buf, _buf, length);
+		return buf + length;
+	case POINTER:
+		if (length == _length) {
+			*buf++ = '0';
+			*buf++ = 'x';
+			length -= 2;
+		}
+		return writeHex(buf, _unsigned, length, spec.upperCase);
+	};
+	return buf;
+}
+
+namespace
+{
+	// the end of a literal text
+	const char *literalEnd(const char *fmt)
+	{
+		while (*fmt && (*fmt != '{') && (*fmt != '}'))
+			fmt++;
+		return fmt;
+	}
+
+	// fmt is after {, returns the position after }
+	const char *parseSpec(const char *fmt, Spec &spec)
+	{
+		spec = Spec();
+		if (*fmt == ':') {
+			fmt++;
+			if (*fmt == '0') {
+				spec.zeroPad = true;
+				fmt++;
+			}
+			while ((*fmt >= '0') && (*fmt <= '9')) {
+				spec.width = spec.width * 10 + (*fmt - '0');
+				if (spec.width > MAX_WIDTH)
+					throw Error("Too large width in the format string");
+				fmt++;
+			}
+			if ((*fmt == 'x') || (*fmt == 'X')) {
+				spec.hex = true;
+				spec.upperCase = (*fmt == 'X');
+				fmt++;
+			}
+		}
+		if (*fmt != '}')
+			throw Error("Wrong placeholder in the format string");
+		return fmt + 1;
+	}
+};
+
+TSize fl::strings::format::vformatAdd(BString &str, const char *fmt, Arg *args, const size_t count)
+{
+	Spec spec;
+	TSize size = 0;
+	size_t argNumber = 0;
+	const char *pos = fmt;
+	while (*pos) {
+		const char *end = literalEnd(pos);
+		size += end - pos;
+		if (*end == 0)
+			break;
+		if (end[0] == end[1]) { // {{ or }}
+			size++;
+			pos = end + 2;
+		} else if (*end == '}') {
+			throw Error("Unmatched } in the format string");
+		} else {
+			pos = parseSpec(end + 1, spec);
+			if (argNumber >= count)
+				throw Error("Not enough arguments for the format string");
+			size += args[argNumber++].prepare(spec);
+		}
+	}
+	if (argNumber != count)
+		throw Error("Too many arguments for the format string");
+
+	char *out = str.reserveBuffer(size);
+	argNumber = 0;
+	pos = fmt;
+	while (*pos) {
+		const char *end = literalEnd(pos);
+		memcpy(out, pos, end - pos);
+		out += end - pos;
+		if (*end == 0)
+			break;
+		if (end[0] == end[1]) {
+			*out++ = *end;
+			pos = end + 2;
+		} else {
+			pos = parseSpec(end + 1, spec);
+			out = args[argNumber++].write(out, spec);
+		}
+	}
+	*out = 0; // reserveBuffer leaves a place for the terminating 0
+	return size;
+}
@@ -0,0 +1,191 @@
+#pragma once
+#ifndef __FL_FORMAT_HPP
+#define	__FL_FORMAT_HPP
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Type safe formatting into BString without vsnprintf
+///////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include "bstring.hpp"
+
+namespace fl {
+	namespace strings {
+		namespace format {
+			using fl::strings::BString;
+			typedef BString::TSize TSize;
+
+			static const TSize MAX_INTEGER_SIZE = 20; // 18446744073709551615
+			static const TSize MAX_DOUBLE_SIZE = 32; // -0.0000012345678901234567 or -1.2345678901234567e-308
+			static const TSize MAX_WIDTH = 64;
+
+			TSize unsignedSize(uint64_t value);
+			TSize hexSize(uint64_t value);
+			// all write functions return the end of the written text and don't add 0
+			char *writeUnsigned(char *buf, uint64_t value, const TSize size);
+			char *writeUnsigned(char *buf, const uint64_t value);
+			char *writeSigned(char *buf, const int64_t value);
+			char *writeHex(char *buf, uint64_t value, const TSize size, const bool upperCase);
+			// a round-trip representation, strtod reads it back into the same double (Grisu2). It is the shortest
+			// one for most of the values, a few get an extra digit. Integral values have no fraction: 1e+21, 100,
+			// 0.5, 1.25e-07, nan, -inf
+			char *writeDouble(char *buf, const double value);
+
+			// {} - the value, {:x} / {:X} - hex, {:8} - width, {:08x} - zero padded width, {{ and }} - braces
+			class Spec
+			{
+			public:
+				Spec()
+					: width(0), zeroPad(false), hex(false), upperCase(false)
+				{
+				}
+				TSize width;
+				bool zeroPad;
+				bool hex;
+				bool upperCase;
+			};
+
+			class Arg
+			{
+			public:
+				Arg(const char *value)
+					: _type(STRING), _str(value), _length(strlen(value))
+				{
+				}
+				Arg(const std::string &value)
+					: _type(STRING), _str(value.c_str()), _length(value.size())
+				{
+				}
+				Arg(const BString &value)
+					: _type(STRING), _str(value.c_str()), _length(value.size())
+				{
+				}
+				Arg(const char value)
+					: _type(CHAR), _char(value)
+				{
+				}
+				Arg(const bool value)
+					: _type(STRING), _str(value ? "true" : "false"), _length(value ? 4 : 5)
+				{
+				}
+				Arg(const int value)
+					: _type(SIGNED), _signed(value)
+				{
+				}
+				Arg(const long value)
+					: _type(SIGNED), _signed(value)
+				{
+				}
+				Arg(const long long value)
+					: _type(SIGNED), _signed(value)
+				{
+				}
+				Arg(const unsigned int value)
+					: _type(UNSIGNED), _unsigned(value)
+				{
+				}
+				Arg(const unsigned long value)
+					: _type(UNSIGNED), _unsigned(value)
+				{
+				}
+				Arg(const unsigned long long value)
+					: _type(UNSIGNED), _unsigned(value)
+				{
+				}
+				Arg(const double value)
+					: _type(DOUBLE), _double(value)
+				{
+				}
+				// the other pointers are printed as 0x and the hex address instead of the bool conversion
+				Arg(const void *value)
+					: _type(POINTER), _unsigned(reinterpret_cast<uintptr_t>(value))
+				{
+				}
+				// formats the value into the internal buffer, returns the exact size of the text
+				TSize prepare(const Spec &spec);
+				char *write(char *buf, const Spec &spec) const;
+			private:
+				enum EType : uint8_t
+				{
+					STRING,
+					CHAR,
+					SIGNED,
+					UNSIGNED,
+					DOUBLE,
+					POINTER,
+				};
+				EType _type;
+				union
+				{
+					const char *_str;
+					char _char;
+					int64_t _signed;
+					uint64_t _unsigned;
+					double _double;
+				};
+				TSize _length;
+				TSize _padding;
+				char _buf[MAX_DOUBLE_SIZE];
+			};
+
+			class Error : public fl::exceptions::Error
+			{
+			public:
+				Error(const char *what)
+					: fl::exceptions::Error(what)
+				{
+				}
+			};
+
+			constexpr const char *_placeholderEnd(const char *fmt)
+			{
+				return (*fmt == '}') ? fmt + 1
+					: (*fmt == 0 || *fmt == '{') ? throw Error("Unmatched { in the format string")
+					: _placeholderEnd(fmt + 1);
+			}
+
+			// counts {} placeholders, a broken format string is a compile time error when it is called in
+			// a constant expression (FL_FORMAT_ADD and FL_FORMAT_SET)
+			constexpr size_t placeholders(const char *fmt, const size_t count = 0)
+			{
+				return (*fmt == 0) ? count
+					: (*fmt == '{' && fmt[1] == '{') ? placeholders(fmt + 2, count)
+					: (*fmt == '}' && fmt[1] == '}') ? placeholders(fmt + 2, count)
+					: (*fmt == '}') ? throw Error("Unmatched } in the format string")
+					: (*fmt == '{') ? placeholders(_placeholderEnd(fmt + 1), count + 1)
+					: placeholders(fmt + 1, count);
+			}
+
+			TSize vformatAdd(BString &str, const char *fmt, Arg *args, const size_t count);
+		};
+
+		// appends the formatted text to str with one reservation of the exact size, returns the added size
+		template <size_t placeholders, class... TArgs>
+		BString::TSize formatAdd(BString &str, const char *fmt, const TArgs&... args)
+		{
+			static_assert(placeholders == sizeof...(TArgs), "Placeholders count doesn't match the arguments count");
+			format::Arg formatArgs[sizeof...(TArgs) + 1] = {format::Arg(args)..., format::Arg("")};
+			return format::vformatAdd(str, fmt, formatArgs, sizeof...(TArgs));
+		}
+
+		template <size_t placeholders, class... TArgs>
+		BString::TSize formatSet(BString &str, const char *fmt, const TArgs&... args)
+		{
+			str.clear();
+			return formatAdd<placeholders>(str, fmt, args...);
+		}
+	};
+};
+
+// fmt must be a string literal, its placeholders are checked against the arguments at compile time
+#define FL_FORMAT_ADD(str, fmt, ...) \
+	fl::strings::formatAdd<fl::strings::format::placeholders(fmt)>(str, fmt, ##__VA_ARGS__)
+#define FL_FORMAT_SET(str, fmt, ...) \
+	fl::strings::formatSet<fl::strings::format::placeholders(fmt)>(str, fmt, ##__VA_ARGS__)
+
+#endif	// __FL_FORMAT_HPP
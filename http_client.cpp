@@ -0,0 +1,733 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Non-blocking http client working on EPollWorkerThread
+///////////////////////////////////////////////////////////////////////////////
+
+#include <unistd.h>
+#include <strings.h>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <algorithm>
+
+#include "http_client.hpp"
+#include "log.hpp"
+
+using namespace fl::http;
+using fl::network::Socket;
+
+const size_t HttpAnswerParser::MAX_HEADERS_SIZE;
+const size_t HttpClient::DEFAULT_MAX_CONNECTIONS_PER_HOST;
+const size_t HttpClient::DEFAULT_MAX_PIPELINE_DEPTH;
+const uint32_t HttpClient::DEFAULT_KEEP_ALIVE_TIMEOUT;
+
+HttpClientAnswer::HttpClientAnswer()
+	: status(0), keepAlive(false)
+{
+}
+
+void HttpClientAnswer::clear()
+{
+	status = 0;
+	keepAlive = false;
+	headers.clear();
+	body.clear();
+}
+
+bool HttpClientAnswer::header(const char *name, const char *&value, size_t &valueLength) const
+{
+	if (headers.empty())
+		return false;
+	size_t nameLength = strlen(name);
+	const char *cur = strstr(headers.c_str(), "\r\n");
+	const char *end = headers.c_str() + headers.size();
+	while (cur && (cur + 2 < end)) {
+		cur += 2;
+		const char *lineEnd = strstr(cur, "\r\n");
+		if (!lineEnd || lineEnd == cur)
+			break;
+		if ((static_cast<size_t>(lineEnd - cur) > nameLength) && (cur[nameLength] == ':')
+			&& !strncasecmp(cur, name, nameLength)) {
+			value = cur + nameLength + 1;
+			while ((value < lineEnd) && (*value == ' ' || *value == '\t'))
+				value++;
+			valueLength = lineEnd - value;
+			return true;
+		}
+		cur = lineEnd;
+	}
+	return false;
+}
+
+HttpAnswerParser::HttpAnswerParser()
+{
+	reset(false);
+}
+
+void HttpAnswerParser::reset(const bool isHead)
+{
+	_state = ST_HEADERS;
+	_isHead = isHead;
+	_scanned = 0;
+	_left = 0;
+}
+
+static bool headerIs(const char *line, const size_t lineLength, const char *name, const size_t nameLength,
+	const char *&value, const char *lineEnd)
+{
+	if ((lineLength <= nameLength) || (line[nameLength] != ':') || strncasecmp(line, name, nameLength))
+		return false;
+	value = line + nameLength + 1;
+	while ((value < lineEnd) && (*value == ' ' || *value == '\t'))
+		value++;
+	return true;
+}
+
+static bool valueContains(const char *value, const char *end, const char *token)
+{
+	size_t tokenLength = strlen(token);
+	while (value + tokenLength <= end) {
+		if (!strncasecmp(value, token, tokenLength))
+			return true;
+		value++;
+	}
+	return false;
+}
+
+bool HttpAnswerParser::_parseHeaders(const char *data, const size_t size, HttpClientAnswer &answer)
+{
+	static const char HTTP_VERSION_PREFIX[] = "HTTP/1.";
+	static const size_t STATUS_LINE_MIN_LENGTH = sizeof("HTTP/1.1 200") - 1;
+	if ((size < STATUS_LINE_MIN_LENGTH) || strncmp(data, HTTP_VERSION_PREFIX, sizeof(HTTP_VERSION_PREFIX) - 1))
+		return false;
+	const char *statusStart = data + sizeof(HTTP_VERSION_PREFIX) + 1;
+	uint16_t status = 0;
+	for (int i = 0; i < 3; i++) {
+		if (statusStart[i] < '0' || statusStart[i] > '9')
+			return false;
+		status = status * 10 + (statusStart[i] - '0');
+	}
+	answer.status = status;
+	answer.keepAlive = (data[sizeof(HTTP_VERSION_PREFIX) - 1] != '0');
+
+	bool chunked = false;
+	bool hasLength = false;
+	uint64_t contentLength = 0;
+	const char *end = data + size;
+	const char *line = static_cast<const char*>(memchr(data, '\n', size));
+	while (line && (++line < end)) {
+		const char *lineEnd = static_cast<const char*>(memchr(line, '\n', end - line));
+		if (!lineEnd)
+			break;
+		const char *valueEnd = lineEnd;
+		if ((valueEnd > line) && (*(valueEnd - 1) == '\r'))
+			valueEnd--;
+		size_t lineLength = valueEnd - line;
+		if (!lineLength)
+			break;
+		const char *value;
+		if (headerIs(line, lineLength, "Content-Length", sizeof("Content-Length") - 1, value, valueEnd)) {
+			hasLength = true;
+			contentLength = 0;
+			for (; value < valueEnd && *value >= '0' && *value <= '9'; value++)
+				contentLength = contentLength * 10 + (*value - '0');
+		} else if (headerIs(line, lineLength, "Transfer-Encoding", sizeof("Transfer-Encoding") - 1, value, valueEnd)) {
+			chunked = valueContains(value, valueEnd, "chunked");
+		} else if (headerIs(line, lineLength, "Connection", sizeof("Connection") - 1, value, valueEnd)) {
+			if (valueContains(value, valueEnd, "close"))
+				answer.keepAlive = false;
+			else if (valueContains(value, valueEnd, "keep-alive"))
+				answer.keepAlive = true;
+		}
+		line = lineEnd;
+	}
+
+	if (_isHead || (status == 204) || (status == 304) || (status >= 100 && status < 200))
+		_state = ST_HEADERS; // no body
+	else if (chunked)
+		_state = ST_CHUNK_SIZE;
+	else if (hasLength) {
+		static const uint64_t MAX_BODY_PRERESERVE = 16 * 1024 * 1024;
+		_left = contentLength;
+		_state = contentLength ? ST_BODY_LENGTH : ST_HEADERS;
+		if (contentLength && contentLength <= MAX_BODY_PRERESERVE)
+			answer.body.reserve(contentLength + 1);
+	} else {
+		answer.keepAlive = false;
+		_state = ST_BODY_UNTIL_CLOSE;
+	}
+	return true;
+}
+
+HttpAnswerParser::EResult HttpAnswerParser::_parseChunkSize(const char *data, const size_t size, size_t &consumed)
+{
+	static const size_t MAX_CHUNK_LINE_LENGTH = 1024;
+	static const int MAX_CHUNK_SIZE_DIGITS = 15;
+	const char *lineEnd = static_cast<const char*>(memchr(data, '\n', size));
+	if (!lineEnd)
+		return (size > MAX_CHUNK_LINE_LENGTH) ? ERROR : NEED_MORE;
+	uint64_t chunkSize = 0;
+	int digits = 0;
+	for (const char *cur = data; cur < lineEnd; cur++, digits++) {
+		char ch = *cur;
+		if (ch >= '0' && ch <= '9')
+			chunkSize = (chunkSize << 4) | (ch - '0');
+		else if (ch >= 'a' && ch <= 'f')
+			chunkSize = (chunkSize << 4) | (ch - 'a' + 10);
+		else if (ch >= 'A' && ch <= 'F')
+			chunkSize = (chunkSize << 4) | (ch - 'A' + 10);
+		else
+			break;
+	}
+	if (!digits || digits > MAX_CHUNK_SIZE_DIGITS)
+		return ERROR;
+	consumed = lineEnd - data + 1;
+	if (chunkSize) {
+		_left = chunkSize;
+		_state = ST_CHUNK_DATA;
+	}
+	else
+		_state = ST_TRAILERS;
+	return DONE;
+}
+
+HttpAnswerParser::EResult HttpAnswerParser::parse(const char *data, const size_t size, size_t &consumed,
+	HttpClientAnswer &answer)
+{
+	consumed = 0;
+	while (true) {
+		const char *cur = data + consumed;
+		size_t left = size - consumed;
+		switch (_state) {
+			case ST_HEADERS:
+			{
+				size_t from = (_scanned > 3) ? _scanned - 3 : 0;
+				if (left < from + 4) {
+					if (left > MAX_HEADERS_SIZE)
+						return ERROR;
+					return NEED_MORE;
+				}
+				const char *headersEnd = static_cast<const char*>(memmem(cur + from, left - from, "\r\n\r\n", 4));
+				if (!headersEnd) {
+					_scanned = left;
+					if (left > MAX_HEADERS_SIZE)
+						return ERROR;
+					return NEED_MORE;
+				}
+				size_t headersLength = headersEnd - cur + 4;
+				_scanned = 0;
+				answer.clear();
+				if (!_parseHeaders(cur, headersLength, answer))
+					return ERROR;
+				consumed += headersLength;
+				if (answer.status >= 100 && answer.status < 200 && answer.status != 101) {
+					answer.clear(); // skip interim answer
+					continue;
+				}
+				answer.headers.add(cur, headersLength);
+				if (_state == ST_HEADERS)
+					return DONE;
+				break;
+			}
+			case ST_BODY_LENGTH:
+			case ST_CHUNK_DATA:
+			{
+				if (!left)
+					return NEED_MORE;
+				size_t add = (_left < left) ? _left : left;
+				answer.body.add(cur, add);
+				consumed += add;
+				_left -= add;
+				if (_left)
+					return NEED_MORE;
+				if (_state == ST_BODY_LENGTH) {
+					_state = ST_HEADERS;
+					return DONE;
+				}
+				_state = ST_CHUNK_DATA_END;
+				break;
+			}
+			case ST_BODY_UNTIL_CLOSE:
+				answer.body.add(cur, left);
+				consumed += left;
+				return NEED_MORE;
+			case ST_CHUNK_SIZE:
+			{
+				size_t lineLength = 0;
+				EResult res = _parseChunkSize(cur, left, lineLength);
+				if (res != DONE)
+					return res;
+				consumed += lineLength;
+				break;
+			}
+			case ST_CHUNK_DATA_END:
+				if (left < 2)
+					return NEED_MORE;
+				if (cur[0] != '\r' || cur[1] != '\n')
+					return ERROR;
+				consumed += 2;
+				_state = ST_CHUNK_SIZE;
+				break;
+			case ST_TRAILERS:
+			{
+				const char *lineEnd = static_cast<const char*>(memchr(cur, '\n', left));
+				if (!lineEnd) {
+					if (left > MAX_HEADERS_SIZE)
+						return ERROR;
+					return NEED_MORE;
+				}
+				consumed += lineEnd - cur + 1;
+				if ((lineEnd == cur) || ((lineEnd == cur + 1) && (*cur == '\r'))) {
+					_state = ST_HEADERS;
+					return DONE;
+				}
+				break;
+			}
+		};
+	}
+}
+
+HttpAnswerParser::EResult HttpAnswerParser::finish(HttpClientAnswer &answer)
+{
+	if (_state == ST_BODY_UNTIL_CLOSE) {
+		_state = ST_HEADERS;
+		return DONE;
+	}
+	return ERROR;
+}
+
+HttpClient::HttpClient(EPollWorkerThread *thread, const size_t maxConnectionsPerHost, const size_t maxPipelineDepth,
+	const uint32_t keepAliveTimeout)
+	: _thread(thread), _maxConnectionsPerHost(maxConnectionsPerHost ? maxConnectionsPerHost : 1),
+	_maxPipelineDepth(maxPipelineDepth ? maxPipelineDepth : 1), _keepAliveTimeout(keepAliveTimeout)
+{
+}
+
+HttpClient::~HttpClient()
+{
+	for (auto host = _hosts.begin(); host != _hosts.end(); host++) {
+		TConnectionVector connections;
+		connections.swap(host->second.connections);
+		for (auto connection = connections.begin(); connection != connections.end(); connection++) {
+			// the connection is deleted by the worker on the next hang up event
+			(*connection)->_client = NULL;
+			(*connection)->_state = HttpClientConnection::ST_CLOSED;
+			(*connection)->_failAll(HttpClientHandler::CANCELED);
+			::shutdown((*connection)->descr(), SHUT_RDWR);
+		}
+		TRequestDeque waiting;
+		waiting.swap(host->second.waiting);
+		for (auto request = waiting.begin(); request != waiting.end(); request++)
+			_fail(*request, HttpClientHandler::CANCELED);
+	}
+}
+
+void HttpClient::_fail(Request &request, const HttpClientHandler::EResult result)
+{
+	if (request.handler) {
+		HttpClientAnswer answer;
+		request.handler->httpAnswer(result, answer);
+	}
+}
+
+bool HttpClient::request(const TIPv4 ip, const TPort16 port, const char *request, const size_t requestLength,
+	const uint32_t timeout, HttpClientHandler *handler, const bool isHead)
+{
+	Host &host = _hosts[_hostKey(ip, port)];
+	host.ip = ip;
+	host.port = port;
+	Request req;
+	req.handler = handler;
+	req.deadline = EPollWorkerGroup::curTime.unix() + timeout;
+	req.isHead = isHead;
+	if (host.waiting.empty()) {
+		HttpClientConnection *connection = _choose(host);
+		if (connection) {
+			connection->_add(std::move(req), request, requestLength);
+			return true;
+		}
+		if (host.connections.empty())
+			return false;
+	}
+	req.data.assign(request, requestLength);
+	host.waiting.push_back(std::move(req));
+	return true;
+}
+
+HttpClientConnection *HttpClient::_choose(Host &host)
+{
+	HttpClientConnection *leastLoaded = NULL;
+	for (auto connection = host.connections.begin(); connection != host.connections.end(); connection++) {
+		if ((*connection)->idle())
+			return *connection;
+		if (!(*connection)->usable())
+			continue;
+		if (!leastLoaded || (*connection)->pending() < leastLoaded->pending())
+			leastLoaded = *connection;
+	}
+	if (host.connections.size() < _maxConnectionsPerHost) {
+		HttpClientConnection *connection = _connect(host);
+		if (connection)
+			return connection;
+	}
+	if (leastLoaded && (leastLoaded->pending() < _maxPipelineDepth))
+		return leastLoaded;
+	return NULL;
+}
+
+HttpClientConnection *HttpClient::_connect(Host &host)
+{
+	TDescriptor descr = ::socket(AF_INET, SOCK_STREAM, 0);
+	if (descr == INVALID_SOCKET) {
+		log::Error::L("HttpClient: cannot create socket (%i)\n", errno);
+		return NULL;
+	}
+	Socket::setNoDelay(descr, 1);
+	sockaddr_in addr;
+	bzero(&addr, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(host.ip);
+	addr.sin_port = htons(host.port);
+	if (!Socket::setNonBlockIO(descr) 
+		|| ((::connect(descr, (sockaddr *)&addr, sizeof(addr)) != 0) && (errno != EINPROGRESS))) {
+		log::Warning::L("HttpClient: cannot connect to %s:%u (%i)\n", Socket::ip2String(host.ip).c_str(), host.port, errno);
+		::close(descr);
+		return NULL;
+	}
+	HttpClientConnection *connection = new HttpClientConnection(descr, this, _hostKey(host.ip, host.port));
+	connection->_setTimeout();
+	if (!_thread->addEventNL(connection)) {
+		connection->_client = NULL;
+		delete connection;
+		return NULL;
+	}
+	host.connections.push_back(connection);
+	return connection;
+}
+
+void HttpClient::_dispatchWaiting(Host &host)
+{
+	time_t curTime = EPollWorkerGroup::curTime.unix();
+	while (!host.waiting.empty()) {
+		Request &request = host.waiting.front();
+		if (request.deadline < curTime) {
+			Request expired = std::move(request);
+			host.waiting.pop_front();
+			_fail(expired, HttpClientHandler::TIMEOUT);
+			continue;
+		}
+		HttpClientConnection *connection = _choose(host);
+		if (!connection) {
+			if (!host.connections.empty())
+				return;
+			Request failed = std::move(request);
+			host.waiting.pop_front();
+			_fail(failed, HttpClientHandler::CONNECT_ERROR);
+			continue;
+		}
+		Request next = std::move(request);
+		host.waiting.pop_front();
+		std::string data;
+		data.swap(next.data);
+		connection->_add(std::move(next), data.c_str(), data.size());
+	}
+}
+
+void HttpClient::_connectionFree(HttpClientConnection *connection)
+{
+	auto host = _hosts.find(connection->_hostKey);
+	if (host != _hosts.end() && !host->second.waiting.empty())
+		_dispatchWaiting(host->second);
+}
+
+void HttpClient::_connectionClosed(HttpClientConnection *connection, const bool dispatch)
+{
+	auto host = _hosts.find(connection->_hostKey);
+	if (host == _hosts.end())
+		return;
+	TConnectionVector &connections = host->second.connections;
+	auto found = std::find(connections.begin(), connections.end(), connection);
+	if (found != connections.end())
+		connections.erase(found);
+	if (dispatch && !host->second.waiting.empty())
+		_dispatchWaiting(host->second);
+}
+
+void HttpClient::cancel(HttpClientHandler *handler)
+{
+	for (auto host = _hosts.begin(); host != _hosts.end(); host++) {
+		TRequestDeque &waiting = host->second.waiting;
+		for (auto request = waiting.begin(); request != waiting.end(); ) {
+			if (request->handler == handler)
+				request = waiting.erase(request);
+			else
+				request++;
+		}
+		TConnectionVector &connections = host->second.connections;
+		for (auto connection = connections.begin(); connection != connections.end(); connection++) {
+			TRequestDeque &requests = (*connection)->_requests;
+			for (auto request = requests.begin(); request != requests.end(); request++) {
+				if (request->handler == handler)
+					request->handler = NULL; // answer still has to be read out of the connection
+			}
+		}
+	}
+}
+
+size_t HttpClient::connectionsCount() const
+{
+	size_t count = 0;
+	for (auto host = _hosts.begin(); host != _hosts.end(); host++)
+		count += host->second.connections.size();
+	return count;
+}
+
+size_t HttpClient::idleConnectionsCount() const
+{
+	size_t count = 0;
+	for (auto host = _hosts.begin(); host != _hosts.end(); host++) {
+		const TConnectionVector &connections = host->second.connections;
+		for (auto connection = connections.begin(); connection != connections.end(); connection++) {
+			if ((*connection)->idle())
+				count++;
+		}
+	}
+	return count;
+}
+
+HttpClientConnection::HttpClientConnection(const TEventDescriptor descr, HttpClient *client,
+	const HttpClient::THostKey hostKey)
+	: WorkEvent(descr, 0), _state(ST_CONNECTING), _client(client), _hostKey(hostKey), _sendBuffer(0), _readBuffer(0),
+	_inCall(false)
+{
+	setWaitSend();
+}
+
+HttpClientConnection::~HttpClientConnection()
+{
+	_detach(false);
+	_failAll(HttpClientHandler::CANCELED);
+	if (_descr != INVALID_SOCKET)
+		::close(_descr);
+}
+
+void HttpClientConnection::_detach(const bool dispatch)
+{
+	if (_client) {
+		HttpClient *client = _client;
+		_client = NULL;
+		client->_connectionClosed(this, dispatch);
+	}
+}
+
+void HttpClientConnection::_failAll(const HttpClientHandler::EResult result)
+{
+	HttpClient::TRequestDeque requests;
+	requests.swap(_requests);
+	for (auto request = requests.begin(); request != requests.end(); request++)
+		HttpClient::_fail(*request, result);
+}
+
+void HttpClientConnection::_setTimeout()
+{
+	if (_requests.empty()) {
+		_timeOutTime = EPollWorkerGroup::curTime.unix() + (_client ? _client->_keepAliveTimeout : 0);
+		return;
+	}
+	time_t deadline = _requests.front().deadline;
+	for (auto request = _requests.begin(); request != _requests.end(); request++) {
+		if (request->deadline < deadline)
+			deadline = request->deadline;
+	}
+	_timeOutTime = deadline;
+}
+
+void HttpClientConnection::_add(HttpClient::Request &&request, const char *data, const size_t size)
+{
+	if (_requests.empty())
+		_parser.reset(request.isHead);
+	_requests.push_back(std::move(request));
+	_sendBuffer.add(data, size);
+	if (!_inCall && !_update()) {
+		// epoll can't fail on modification of the registered descriptor, but if it does the worker will
+		// time out the connection
+		log::Error::L("HttpClient: cannot update connection events\n");
+	}
+}
+
+bool HttpClientConnection::_update()
+{
+	TEvents events = E_INPUT | E_ERROR | E_HUP;
+	if (_state == ST_CONNECTING)
+		events = E_OUTPUT | E_ERROR | E_HUP;
+	else if (_sendBuffer.sended() < _sendBuffer.size())
+		events |= E_OUTPUT;
+	_setTimeout();
+	bool res = true;
+	if (events != _events) {
+		_events = events;
+		res = _thread->ctrl(this);
+	}
+	if (!_inCall)
+		_thread->updateTimeoutNL(this);
+	return res;
+}
+
+bool HttpClientConnection::_send()
+{
+	if (_sendBuffer.sended() >= _sendBuffer.size())
+		return true;
+	auto res = _sendBuffer.send(_descr);
+	if (res == NetworkBuffer::ERROR) {
+		_detach(true);
+		_failAll(HttpClientHandler::SEND_ERROR);
+		return false;
+	}
+	if (_sendBuffer.sended() >= _sendBuffer.size())
+		_sendBuffer.clear();
+	return true;
+}
+
+void HttpClientConnection::_complete(const HttpClientHandler::EResult result)
+{
+	HttpClient::Request request = std::move(_requests.front());
+	_requests.pop_front();
+	if (!_requests.empty())
+		_parser.reset(_requests.front().isHead);
+	if (!_answer.keepAlive)
+		_state = ST_CLOSING; // don't give this connection to new requests
+	if (request.handler)
+		request.handler->httpAnswer(result, _answer);
+	_answer.clear();
+}
+
+bool HttpClientConnection::_read(bool &closed)
+{
+	closed = false;
+	while (true) {
+		auto res = _readBuffer.read(_descr);
+		if (res == NetworkBuffer::IN_PROGRESS)
+			return true;
+		if (res == NetworkBuffer::ERROR) {
+			_detach(true);
+			_failAll(HttpClientHandler::READ_ERROR);
+			return false;
+		}
+		size_t pos = 0;
+		while (!_requests.empty() && (pos < _readBuffer.size() || res == NetworkBuffer::CONNECTION_CLOSE)) {
+			size_t consumed = 0;
+			auto parseRes = _parser.parse(_readBuffer.c_str() + pos, _readBuffer.size() - pos, consumed, _answer);
+			pos += consumed;
+			if (parseRes == HttpAnswerParser::NEED_MORE) {
+				if ((res == NetworkBuffer::CONNECTION_CLOSE) && (_parser.finish(_answer) == HttpAnswerParser::DONE))
+					_complete(HttpClientHandler::OK);
+				break;
+			}
+			if (parseRes == HttpAnswerParser::ERROR) {
+				_detach(true);
+				_failAll(HttpClientHandler::PARSE_ERROR);
+				return false;
+			}
+			_complete(HttpClientHandler::OK);
+			if (_state != ST_READY)
+				break;
+		}
+		if (pos >= _readBuffer.size())
+			_readBuffer.clear();
+		else if (pos > 0) {
+			memmove(_readBuffer.data(), _readBuffer.c_str() + pos, _readBuffer.size() - pos);
+			_readBuffer.trim(_readBuffer.size() - pos);
+		}
+
+		if ((_state != ST_READY) || (res == NetworkBuffer::CONNECTION_CLOSE)) {
+			_detach(true);
+			_failAll(HttpClientHandler::READ_ERROR); // pipelined requests which weren't answered
+			closed = true;
+			return true;
+		}
+		if (_requests.empty() && _readBuffer.size()) {
+			log::Warning::L("HttpClient: unexpected data from server\n");
+			_detach(true);
+			return false;
+		}
+	}
+}
+
+const HttpClientConnection::ECallResult HttpClientConnection::call(const TEvents events)
+{
+	if (_state == ST_CLOSED)
+		return FINISHED;
+	_inCall = true;
+	if (_state == ST_CONNECTING) {
+		int error = 0;
+		socklen_t errorLength = sizeof(error);
+		if ((events & (E_ERROR | E_HUP)) || getsockopt(_descr, SOL_SOCKET, SO_ERROR, &error, &errorLength) || error) {
+			_state = ST_CLOSED;
+			_detach(true);
+			_failAll(HttpClientHandler::CONNECT_ERROR);
+			return FINISHED;
+		}
+		_state = ST_READY;
+	}
+	if (!_send()) {
+		_state = ST_CLOSED;
+		return FINISHED;
+	}
+	if (events & (E_INPUT | E_ERROR | E_HUP)) {
+		size_t wasPending = _requests.size();
+		bool closed = false;
+		if (!_read(closed) || closed) {
+			_state = ST_CLOSED;
+			return FINISHED;
+		}
+		if (_client && (_requests.size() < wasPending))
+			_client->_connectionFree(this);
+		if (!_send()) { // new requests could be added by handlers
+			_state = ST_CLOSED;
+			return FINISHED;
+		}
+	}
+	bool updated = _update();
+	_inCall = false;
+	if (!updated) {
+		_state = ST_CLOSED;
+		_detach(true);
+		_failAll(HttpClientHandler::READ_ERROR);
+		return FINISHED;
+	}
+	return CHANGE;
+}
+
+bool HttpClientConnection::isFinished()
+{
+	if (_state == ST_CLOSED)
+		return true;
+	time_t curTime = EPollWorkerGroup::curTime.unix();
+	if (_requests.empty()) {
+		if (_timeOutTime > curTime)
+			return false;
+		_state = ST_CLOSED;
+		_detach(false);
+		return true;
+	}
+	bool expired = false;
+	for (auto request = _requests.begin(); request != _requests.end(); request++) {
+		if (request->deadline <= curTime) {
+			expired = true;
+			break;
+		}
+	}
+	if (!expired)
+		return false;
+	// the answer stream position is lost, so pipelined requests fail together with the expired one
+	_state = ST_CLOSED;
+	_detach(true);
+	_failAll(HttpClientHandler::TIMEOUT);
+	return true;
+}
@@ -0,0 +1,222 @@
+#pragma once
+#ifndef __FL_HTTP_CLIENT_HPP
+#define	__FL_HTTP_CLIENT_HPP
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Non-blocking http client working on EPollWorkerThread
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include "bstring.hpp"
+#include "socket.hpp"
+#include "event_thread.hpp"
+#include "network_buffer.hpp"
+
+namespace fl {
+	namespace http {
+		using fl::strings::BString;
+		using namespace fl::events;
+		using fl::network::NetworkBuffer;
+
+		class HttpClientAnswer
+		{
+		public:
+			HttpClientAnswer();
+			void clear();
+			bool header(const char *name, const char *&value, size_t &valueLength) const;
+
+			uint16_t status;
+			bool keepAlive;
+			BString headers; // status line and headers including final \r\n\r\n
+			BString body; // dechunked body
+		};
+
+		// Incremental parser of http answers, it doesn't rescan already checked data
+		class HttpAnswerParser
+		{
+		public:
+			enum EResult
+			{
+				NEED_MORE,
+				DONE,
+				ERROR
+			};
+			static const size_t MAX_HEADERS_SIZE = 64 * 1024;
+
+			HttpAnswerParser();
+			void reset(const bool isHead);
+			// consumed is set to the count of bytes processed from data, the caller must drop them before the next call
+			EResult parse(const char *data, const size_t size, size_t &consumed, HttpClientAnswer &answer);
+			// should be called when connection was closed by the server, completes answers without Content-Length
+			EResult finish(HttpClientAnswer &answer);
+		private:
+			bool _parseHeaders(const char *data, const size_t size, HttpClientAnswer &answer);
+			EResult _parseChunkSize(const char *data, const size_t size, size_t &consumed);
+
+			enum EState
+			{
+				ST_HEADERS,
+				ST_BODY_LENGTH,
+				ST_BODY_UNTIL_CLOSE,
+				ST_CHUNK_SIZE,
+				ST_CHUNK_DATA,
+				ST_CHUNK_DATA_END,
+				ST_TRAILERS,
+			};
+			EState _state;
+			bool _isHead;
+			size_t _scanned;
+			uint64_t _left;
+		};
+
+		class HttpClientHandler
+		{
+		public:
+			enum EResult
+			{
+				OK,
+				CONNECT_ERROR,
+				SEND_ERROR,
+				READ_ERROR,
+				PARSE_ERROR,
+				TIMEOUT,
+				CANCELED,
+			};
+			// answer is valid only during the call, it can be moved out. The handler can add new requests to the client
+			virtual void httpAnswer(const EResult result, HttpClientAnswer &answer) = 0;
+			virtual ~HttpClientHandler() {};
+		};
+
+		// HttpClient belongs to one EPollWorkerThread and must be used only from that thread's event calls
+		// (they are made under worker's lock), it should be destroyed there too or after the worker is finished.
+		// Connections to each host are kept alive and reused, requests are pipelined when all
+		// connections to the host are busy and the maximum of connections is reached.
+		class HttpClient
+		{
+		public:
+			static const size_t DEFAULT_MAX_CONNECTIONS_PER_HOST = 8;
+			static const size_t DEFAULT_MAX_PIPELINE_DEPTH = 4;
+			static const uint32_t DEFAULT_KEEP_ALIVE_TIMEOUT = 30;
+
+			HttpClient(
+				EPollWorkerThread *thread,
+				const size_t maxConnectionsPerHost = DEFAULT_MAX_CONNECTIONS_PER_HOST,
+				const size_t maxPipelineDepth = DEFAULT_MAX_PIPELINE_DEPTH,
+				const uint32_t keepAliveTimeout = DEFAULT_KEEP_ALIVE_TIMEOUT
+			);
+			~HttpClient();
+
+			// request should be a complete http request, timeout is in seconds and is checked by worker's time
+			// loop, so it has one second precision. Returns false if the request can't be started
+			bool request(const TIPv4 ip, const TPort16 port, const char *request, const size_t requestLength,
+				const uint32_t timeout, HttpClientHandler *handler, const bool isHead = false);
+			bool request(const TIPv4 ip, const TPort16 port, const BString &request,
+				const uint32_t timeout, HttpClientHandler *handler, const bool isHead = false)
+			{
+				return this->request(ip, port, request.c_str(), request.size(), timeout, handler, isHead);
+			}
+			// callbacks to the handler won't be called anymore
+			void cancel(HttpClientHandler *handler);
+
+			size_t connectionsCount() const;
+			size_t idleConnectionsCount() const;
+		private:
+			friend class HttpClientConnection;
+			struct Request
+			{
+				HttpClientHandler *handler;
+				time_t deadline;
+				bool isHead;
+				std::string data; // used only while the request waits for a connection
+			};
+			typedef std::deque<Request> TRequestDeque;
+			typedef std::vector<class HttpClientConnection*> TConnectionVector;
+			struct Host
+			{
+				TIPv4 ip;
+				TPort16 port;
+				TConnectionVector connections;
+				TRequestDeque waiting;
+			};
+			typedef uint64_t THostKey;
+			static THostKey _hostKey(const TIPv4 ip, const TPort16 port)
+			{
+				return (static_cast<uint64_t>(ip) << 16) | port;
+			}
+			typedef std::unordered_map<THostKey, Host> THostMap;
+
+			class HttpClientConnection *_connect(Host &host);
+			class HttpClientConnection *_choose(Host &host);
+			void _connectionFree(class HttpClientConnection *connection);
+			void _connectionClosed(class HttpClientConnection *connection, const bool dispatch);
+			void _dispatchWaiting(Host &host);
+			static void _fail(Request &request, const HttpClientHandler::EResult result);
+
+			EPollWorkerThread *_thread;
+			size_t _maxConnectionsPerHost;
+			size_t _maxPipelineDepth;
+			uint32_t _keepAliveTimeout;
+			THostMap _hosts;
+		};
+
+		class HttpClientConnection : public WorkEvent
+		{
+		public:
+			HttpClientConnection(const TEventDescriptor descr, HttpClient *client, const HttpClient::THostKey hostKey);
+			virtual ~HttpClientConnection();
+			virtual const ECallResult call(const TEvents events);
+			virtual bool isFinished();
+
+			size_t pending() const
+			{
+				return _requests.size();
+			}
+			bool usable() const
+			{
+				return (_state == ST_CONNECTING) || (_state == ST_READY);
+			}
+			bool idle() const
+			{
+				return _requests.empty() && (_state == ST_READY);
+			}
+		private:
+			friend class HttpClient;
+			void _add(HttpClient::Request &&request, const char *data, const size_t size);
+			bool _update();
+			bool _send();
+			bool _read(bool &closed);
+			void _failAll(const HttpClientHandler::EResult result);
+			void _complete(const HttpClientHandler::EResult result);
+			void _detach(const bool dispatch);
+			void _setTimeout();
+
+			enum EState
+			{
+				ST_CONNECTING,
+				ST_READY,
+				ST_CLOSING, // server answered with Connection: close
+				ST_CLOSED,
+			};
+			EState _state;
+			HttpClient *_client;
+			HttpClient::THostKey _hostKey;
+			HttpClient::TRequestDeque _requests;
+			NetworkBuffer _sendBuffer;
+			NetworkBuffer _readBuffer;
+			HttpAnswerParser _parser;
+			HttpClientAnswer _answer;
+			bool _inCall;
+		};
+	};
+};
+
+#endif	// __FL_HTTP_CLIENT_HPP
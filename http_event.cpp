@@ -9,6 +9,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <unistd.h>
+#include <netinet/in.h>
 #include "socket.hpp"
 #include "http_event.hpp"
 #include "log.hpp"
@@ -18,9 +19,12 @@
 using namespace fl::events;
 
 
-HttpEvent::HttpEvent(const TEventDescriptor descr, const time_t timeOutTime, HttpEventInterface *interface)
-	: WorkEvent(descr, timeOutTime), _interface(interface), _networkBuffer(NULL), _headerStartPosition(0),
-		_state(EHttpState::ST_WAIT_REQUEST), _chunkNumber(0), _status(0)
+HttpEvent::HttpEvent(const TEventDescriptor descr, const time_t timeOutTime, HttpEventInterface *interface,
+	const TIPv4 ip)
+	: WorkEvent(descr, timeOutTime), _interface(interface), _networkBuffer(NULL), _body(NULL), _bodyLeft(0),
+		_arena(NULL),
+		_headerStartPosition(0),
+		_state(EHttpState::ST_WAIT_REQUEST), _chunkNumber(0), _status(0), _peerIp(ip), _ip(ip)
 {
 	setWaitRead();
 }
@@ -34,9 +38,12 @@ bool HttpEvent::_reset()
 			threadSpecData->bufferPool.free(_networkBuffer);
 			_networkBuffer = NULL;
 		}
+		_freeBody();
+		_freeArena();
 		_headerStartPosition = 0;
 		_chunkNumber = 0;
 		_status = 0;
+		_ip = _peerIp;
 		setWaitRead();
 		if (!_thread->ctrl(this))
 			return false;
@@ -57,6 +64,7 @@ void HttpEvent::_endWork()
 	_state = EHttpState::ST_FINISHED;
 	_timeOutTime = 0;
 	if (_descr != 0) {
+		_shutdown();
 		close(_descr);
 		_descr = 0;
 	}
@@ -65,6 +73,56 @@ void HttpEvent::_endWork()
 		threadSpecData->bufferPool.free(_networkBuffer);
 		_networkBuffer = NULL;
 	}
+	_freeBody();
+	_freeArena();
+}
+
+void HttpEvent::_freeBody()
+{
+	delete _body;
+	_body = NULL;
+	_bodyLeft = 0;
+}
+
+void HttpEvent::_freeArena()
+{
+	if (_arena) {
+		auto threadSpecData = static_cast<HttpThreadSpecificData*>(_thread->threadSpecificData());
+		threadSpecData->arenaPool.free(_arena);
+		_arena = NULL;
+	}
+}
+
+Arena &HttpEvent::arena()
+{
+	if (!_arena) {
+		auto threadSpecData = static_cast<HttpThreadSpecificData*>(_thread->threadSpecificData());
+		_arena = threadSpecData->arenaPool.get();
+	}
+	return *_arena;
+}
+
+NetworkBuffer::EResult HttpEvent::_recv()
+{
+	return _networkBuffer->read(_descr);
+}
+
+NetworkBuffer::EResult HttpEvent::_send()
+{
+	return _networkBuffer->send(_descr);
+}
+
+NetworkBuffer::EResult HttpEvent::_recvBody()
+{
+	return _body->read(_descr, _bodyLeft);
+}
+
+bool HttpEvent::_setWaitInProgress(const bool sending)
+{
+	if (!sending) // the event waits for the input already
+		return false;
+	setWaitSend();
+	return true;
 }
 
 void HttpEvent::freeBuf() {
@@ -121,7 +179,9 @@ bool HttpEvent::_parseURI(const char *beginURI, const char *endURI)
 	else if (!strncasecmp(beginURI, PROTOCOL_HTTPS.c_str(), PROTOCOL_HTTPS.size()))
 		skipedCharacters = PROTOCOL_HTTPS.size();
 
-	std::string hostName;
+	auto threadSpecData = static_cast<HttpThreadSpecificData*>(_thread->threadSpecificData());
+	std::string &hostName = threadSpecData->uriHost;
+	hostName.clear();
 	if (skipedCharacters > 0)	{
 		beginURI += skipedCharacters;
 		const char *pBeginHost = beginURI;
@@ -149,15 +209,19 @@ bool HttpEvent::_parseURI(const char *beginURI, const char *endURI)
 		pQuery++;
 	}
 
-	std::string query;
+	std::string &query = threadSpecData->uriQuery;
 	int queryLen = endURL - pQuery;
 	if (queryLen > 1)
 		query.assign(pQuery + 1, queryLen - 1); // skip '?'
+	else
+		query.clear();
 
-	std::string fileName;
+	std::string &fileName = threadSpecData->uriFileName;
 	int fileNameLen = pQuery - beginURI;
 	if (fileNameLen > 0)
 		fileName.assign(beginURI, fileNameLen);
+	else
+		fileName.clear();
 	return _interface->parseURI(cmdStart, version, hostName, fileName, query);
 }
 
@@ -195,6 +259,9 @@ bool HttpEvent::_parseHeader(const char *pStartHeader, const char *pEndHeader)
 			int valueLen = pEndHeader - pStartHeader;
 			if (valueLen <= 0)
 				return true;
+			auto threadSpecData = static_cast<HttpThreadSpecificData*>(_thread->threadSpecificData());
+			if (threadSpecData->trustXRealIP && threadSpecData->requestRateLimiter)
+				_parseXRealIP(pBeginName, nameLength, pStartHeader, valueLen);
 			if (_checkExpect(pBeginName, nameLength, pStartHeader, valueLen)) {
 				return _interface->canContinue();
 			}
@@ -215,11 +282,11 @@ bool HttpEvent::_readRequest()
 	}
 
 	auto lastChecked = _networkBuffer->size();
-	auto res = _networkBuffer->read(_descr);
+	auto res = _recv();
 	if ((res == NetworkBuffer::ERROR) || (res == NetworkBuffer::CONNECTION_CLOSE))
 		return false;
 	else if (res == NetworkBuffer::IN_PROGRESS)
-		return true;
+		return !_setWaitInProgress(false) || _thread->ctrl(this);
 
 	_chunkNumber++;
 	if (_chunkNumber > threadSpecData->maxChunkCount) {
@@ -231,6 +298,8 @@ bool HttpEvent::_readRequest()
 			_networkBuffer->size());
 		return false;
 	}
+	// the arena is taken with the first received data of the request, it isn't needed for the idle connections
+	Arena::Scope arenaScope(&arena());
 	static const NetworkBuffer::TSize MIN_HTTP_REQUEST = sizeof("GET / HTTP/1.0\r\n\r\n") - 2;
 	if (_networkBuffer->size() > MIN_HTTP_REQUEST)	{
 		if (lastChecked > 0) // skip one char because it might be '\r' before '\n'
@@ -264,6 +333,16 @@ bool HttpEvent::_readRequest()
 				pBuffer++;
 		}
 		if (fullRequestFound) { // end query was found
+			if (threadSpecData->requestRateLimiter && !threadSpecData->requestRateLimiter->allow(_ip)) {
+				_status |= ST_RATE_LIMITED;
+				_state = EHttpState::ST_REQUEST_RECEIVED;
+				return true;
+			}
+			if (threadSpecData->segmentedBodyThreshold) {
+				size_t bodySize = _interface->segmentedBodySize();
+				if (bodySize >= threadSpecData->segmentedBodyThreshold)
+					return _startSegmentedBody(threadSpecData, bodySize);
+			}
 			bool parseError = false;
 			if (_interface->parsePOSTData(_headerStartPosition, *_networkBuffer, parseError)) {
 				_state = EHttpState::ST_REQUEST_RECEIVED;
@@ -293,9 +372,9 @@ HttpEvent::ECallResult HttpEvent::_sendPartialAnswer()
 	_state = EHttpState::ST_SEND;
 	_status |= ST_CHECK_AFTER_SEND;
 	for (uint32_t i = 0; i < threadSpecData->maxSequenceSends; i++) {
-		auto res = _networkBuffer->send(_descr);
+		auto res = _send();
 		if (res == NetworkBuffer::IN_PROGRESS) {
-			setWaitSend();
+			_setWaitInProgress(true);
 			if (_thread->ctrl(this)) {
 				_updateTimeout();
 				return CHANGE;
@@ -304,7 +383,11 @@ HttpEvent::ECallResult HttpEvent::_sendPartialAnswer()
 			}
 		} else if (res == NetworkBuffer::OK) {
 			_networkBuffer->clear();
-			auto moreDataResult = _interface->getMoreDataToSend(*_networkBuffer, this);
+			HttpEventInterface::EFormResult moreDataResult;
+			{
+				Arena::Scope arenaScope(&arena());
+				moreDataResult = _interface->getMoreDataToSend(*_networkBuffer, this);
+			}
 			if (moreDataResult != HttpEventInterface::RESULT_OK_PARTIAL_SEND) {
 				return sendAnswer(moreDataResult);
 			}
@@ -323,9 +406,9 @@ HttpEvent::ECallResult HttpEvent::_sendPartialAnswer()
 
 HttpEvent::ECallResult HttpEvent::_sendAnswer()
 {
-	auto res = _networkBuffer->send(_descr);
+	auto res = _send();
 	if (res == NetworkBuffer::IN_PROGRESS) {
-		setWaitSend();
+		_setWaitInProgress(true);
 		if (_thread->ctrl(this)) {
 			_updateTimeout();
 			return CHANGE;
@@ -335,7 +418,12 @@ HttpEvent::ECallResult HttpEvent::_sendAnswer()
 	} else if (res == NetworkBuffer::OK) {
 		if (_status & ST_CHECK_AFTER_SEND) {
 			_networkBuffer->clear();
-			return sendAnswer(_interface->getMoreDataToSend(*_networkBuffer, this));
+			HttpEventInterface::EFormResult moreDataResult;
+			{
+				Arena::Scope arenaScope(&arena());
+				moreDataResult = _interface->getMoreDataToSend(*_networkBuffer, this);
+			}
+			return sendAnswer(moreDataResult);
 		}
 		if (_status & ST_KEEP_ALIVE) {
 			if (_reset()) {
@@ -360,19 +448,78 @@ HttpEvent::ECallResult HttpEvent::_sendError()
 	_state = ST_SEND;
 	_status &= ~(ST_KEEP_ALIVE);
 	_networkBuffer->clear();
-	if (!_interface->formError(*_networkBuffer, this))
+	bool formed;
+	{
+		Arena::Scope arenaScope(&arena());
+		formed = _interface->formError(*_networkBuffer, this);
+	}
+	if (!formed)
 		_networkBuffer->sprintfSet("HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n");
 	return _sendAnswer();
 }
 
+void HttpEvent::_parseXRealIP(const char *name, const size_t nameLength, const char *value, const size_t valueLen)
+{
+	static const size_t X_REAL_IP_HEADER_LENGTH = sizeof("X-Real-IP") - 1;
+	static const size_t MAX_IP_LENGTH = sizeof("255.255.255.255") - 1;
+	if ((nameLength != X_REAL_IP_HEADER_LENGTH) || (valueLen > MAX_IP_LENGTH))
+		return;
+	char ipValue[MAX_IP_LENGTH + 1]; // header value isn't null terminated
+	memcpy(ipValue, value, valueLen);
+	ipValue[valueLen] = 0;
+	TIPv4 ip = 0;
+	if (HttpEventInterface::_parseXRealIP(name, nameLength, ipValue, ip) && (ip != INADDR_NONE))
+		_ip = ip;
+}
+
+HttpEvent::ECallResult HttpEvent::_sendRateLimited()
+{
+	auto threadSpecData = static_cast<HttpThreadSpecificData*>(_thread->threadSpecificData());
+	_state = ST_SEND;
+	_status &= ~(ST_KEEP_ALIVE | ST_EXPECT_100);
+	_networkBuffer->clear();
+	*_networkBuffer << threadSpecData->requestRateLimiter->rejectAnswer();
+	return _sendAnswer();
+}
+
+bool HttpEvent::_startSegmentedBody(HttpThreadSpecificData *threadSpecData, const size_t bodySize)
+{
+	// the received part of the body is moved to the segments, the rest is read directly into them
+	_body = new SegmentedBuffer(&threadSpecData->segmentPool);
+	_body->add(_networkBuffer->c_str() + _headerStartPosition, _networkBuffer->size() - _headerStartPosition);
+	_networkBuffer->trim(_headerStartPosition);
+	_bodyLeft = (bodySize > _body->size()) ? bodySize - _body->size() : 0;
+	return _parseSegmentedBody();
+}
+
+bool HttpEvent::_parseSegmentedBody()
+{
+	bool parseError = false;
+	if (_interface->parseSegmentedPOSTData(*_body, parseError))
+		_state = EHttpState::ST_REQUEST_RECEIVED;
+	else if (parseError)
+		return false;
+	else
+		_state = EHttpState::ST_WAIT_ADDITIONAL_DATA;
+	return true;
+}
+
 bool HttpEvent::_readPostData()
 {
-	auto res = _networkBuffer->read(_descr);
+	size_t bodySize = _body ? _body->size() : 0;
+	auto res = _body ? _recvBody() : _recv();
+	if (_body) { // the interface can consume the received body, so the rest is counted here
+		size_t received = _body->size() - bodySize;
+		_bodyLeft = (_bodyLeft > received) ? _bodyLeft - received : 0;
+	}
 	if ((res == NetworkBuffer::ERROR) || (res == NetworkBuffer::CONNECTION_CLOSE))
 		return false;
 	else if (res == NetworkBuffer::IN_PROGRESS)
-		return true;
+		return !_setWaitInProgress(false) || _thread->ctrl(this);
 
+	Arena::Scope arenaScope(&arena());
+	if (_body)
+		return _parseSegmentedBody();
 	bool parseError = false;
 	if (_interface->parsePOSTData(_headerStartPosition, *_networkBuffer, parseError)) {
 		_state = EHttpState::ST_REQUEST_RECEIVED;
@@ -388,9 +535,15 @@ bool HttpEvent::attachAndSendAnswer(const HttpEventInterface::EFormResult result
 	fl::threads::WeekAutoMutex autoSync;
 	_updateTimeout();
 	if (!_thread->addEvent(this, autoSync)) {
-		// free buffer to prevent race condition on NetworkBufferPool
-		delete _networkBuffer;
+		// the buffer goes to the depot of the pool to prevent race condition on NetworkBufferPool
+		if (_networkBuffer)
+			NetworkBufferPool::release(_networkBuffer);
 		_networkBuffer = NULL;
+		// ArenaPool isn't thread safe and the event is out of its thread here, so the arena is freed to the heap
+		delete _arena;
+		_arena = NULL;
+		if (_body)
+			_body->detachPool();
 		return false;
 	}
 	sendAnswer(result);
@@ -403,9 +556,15 @@ bool HttpEvent::attachAndWaitSend()
 	_updateTimeout();
 	setWaitSend();
 	if (!_thread->addEvent(this, autoSync)) {
-		// free buffer to prevent race condition on NetworkBufferPool
-		delete _networkBuffer;
+		// the buffer goes to the depot of the pool to prevent race condition on NetworkBufferPool
+		if (_networkBuffer)
+			NetworkBufferPool::release(_networkBuffer);
 		_networkBuffer = NULL;
+		// ArenaPool isn't thread safe and the event is out of its thread here, so the arena is freed to the heap
+		delete _arena;
+		_arena = NULL;
+		if (_body)
+			_body->detachPool();
 		return false;
 	}
 	return true;
@@ -413,7 +572,8 @@ bool HttpEvent::attachAndWaitSend()
 
 void HttpEvent::setBuffer(NetworkBuffer *networkBuffer)
 {
-	delete _networkBuffer;
+	if (_networkBuffer)
+		NetworkBufferPool::release(_networkBuffer);
 	_networkBuffer = networkBuffer;
 }
 
@@ -506,8 +666,15 @@ const HttpEvent::ECallResult HttpEvent::call(const TEvents events)
 			}
 		}
 		if (_state == EHttpState::ST_REQUEST_RECEIVED) {
+			if (_status & ST_RATE_LIMITED)
+				return _sendRateLimited();
 			_networkBuffer->clear();
-			return sendAnswer(_interface->formResult(*_networkBuffer, this));
+			HttpEventInterface::EFormResult result;
+			{
+				Arena::Scope arenaScope(&arena());
+				result = _interface->formResult(*_networkBuffer, this);
+			}
+			return sendAnswer(result);
 		} else {
 			_updateTimeout();
 			return CHANGE;
@@ -531,10 +698,31 @@ HttpThreadSpecificData::HttpThreadSpecificData(const NetworkBuffer::TSize maxReq
 	const uint32_t maxSequenceSends)
 	: maxRequestSize(maxRequestSize), maxChunkCount(maxChunkCount), bufferPool(bufferSize, maxFreeBuffers),
 	operationTimeout(operationTimeout), firstRequstTimeout(firstRequstTimeout), keepAlive(keepAlive),
-	maxSequenceSends(maxSequenceSends)
+	maxSequenceSends(maxSequenceSends), requestRateLimiter(NULL), trustXRealIP(false), bufferTrimInterval(10),
+	segmentRegionSize(0), segmentedBodyThreshold(64 * 1024), _lastBufferTrim(0)
 {
 }
 
+void HttpThreadSpecificData::threadStarted()
+{
+	if (!segmentRegionSize)
+		return;
+	try {
+		segmentRegion.reset(new MemoryRegion(segmentRegionSize, sizeof(SegmentPool::Segment) + segmentPool.segmentSize()));
+		segmentPool.setRegion(segmentRegion.get());
+	} catch (MemoryRegion::Error &error) {
+		log::Warning::L("Segments of the worker are taken from the heap: %s\n", error.what());
+	}
+}
+
+void HttpThreadSpecificData::periodicCall(const time_t curTime)
+{
+	if (curTime >= _lastBufferTrim + bufferTrimInterval) {
+		_lastBufferTrim = curTime;
+		bufferPool.trim();
+	}
+}
+
 
 bool HttpEventInterface::_parseIfModifiedSince(const char *name, const size_t nameLength,
 	const char *value, const size_t valueLen, time_t &ifModifiedSince)
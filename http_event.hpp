@@ -13,14 +13,23 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <cstdint>
+#include <memory>
 #include "event_thread.hpp"
 #include "network_buffer.hpp"
+#include "segmented_buffer.hpp"
+#include "arena.hpp"
 #include "bstring.hpp"
+#include "ip_rate_limiter.hpp"
 
 namespace fl {
 	namespace events {
 		using fl::network::NetworkBufferPool;
+		using fl::network::SegmentPool;
+		using fl::network::SegmentedBuffer;
 		using fl::strings::BString;
+		using fl::utils::Arena;
+		using fl::utils::ArenaPool;
+		using fl::utils::MemoryRegion;
 		
 		namespace EHttpVersion
 		{
@@ -48,6 +57,17 @@ namespace fl {
 			{
 				return true;
 			}
+			// bodies of at least HttpThreadSpecificData::segmentedBodyThreshold bytes are received into SegmentedBuffer
+			// instead of the growing network buffer if the interface returns their size here (Content-Length)
+			virtual size_t segmentedBodySize()
+			{
+				return 0;
+			}
+			// it is called instead of parsePOSTData for segmented bodies, the network buffer keeps the headers only
+			virtual bool parseSegmentedPOSTData(SegmentedBuffer &body, bool &parseError)
+			{
+				return true;
+			}
 			virtual bool formError(class BString &result, class HttpEvent *http)
 			{
 				return false;
@@ -120,28 +140,38 @@ namespace fl {
 			static void _addConnectionHeader(BString &networkBuffer, const bool isKeepAlive);
 			
 			static const std::string _ERROR_STRINGS[ERROR_MAX];
-
+			friend class HttpEvent;
 		};
 		
 		class HttpEvent : public WorkEvent
 		{
 		public:
-			HttpEvent(const TEventDescriptor descr, const time_t timeOutTime, HttpEventInterface *interface);
+			HttpEvent(const TEventDescriptor descr, const time_t timeOutTime, HttpEventInterface *interface,
+				const TIPv4 ip = 0);
 			virtual ~HttpEvent();
 			virtual const ECallResult call(const TEvents events);
 			NetworkBuffer *networkBuffer()
 			{
 				return _networkBuffer;
 			}
+			// the received request body if it was received into segments, NULL otherwise
+			SegmentedBuffer *segmentedBody()
+			{
+				return _body;
+			}
 			HttpEventInterface *interface()
 			{
 				return _interface;
 			}
+			// arena of the current request, it is taken from the pool on the first use and is returned when the request
+			// is finished, the interface calls which handle the request are made with Arena::current() set to it
+			Arena &arena();
 			HttpEvent::ECallResult sendAnswer(const HttpEventInterface::EFormResult result);
 			typedef uint8_t TStatus;
 			static const TStatus ST_KEEP_ALIVE = 0x1;
 			static const TStatus ST_CHECK_AFTER_SEND = 0x2;
 			static const TStatus ST_EXPECT_100 = 0x4;
+			static const TStatus ST_RATE_LIMITED = 0x8;
 			
 			void setKeepAlive()
 			{
@@ -156,23 +186,46 @@ namespace fl {
 			bool attachAndWaitSend();
 			void setBuffer(NetworkBuffer *networkBuffer);
 			void freeBuf();
+			TIPv4 ip() const
+			{
+				return _ip;
+			}
+		protected:
+			virtual NetworkBuffer::EResult _recv();
+			virtual NetworkBuffer::EResult _send();
+			virtual NetworkBuffer::EResult _recvBody();
+			// sets the events to wait for after IN_PROGRESS of the socket operation, returns true if they have been
+			// changed and have to be passed to the thread
+			virtual bool _setWaitInProgress(const bool sending);
+			virtual void _shutdown() 
+			{
+			}
+			void _updateTimeout();
 		private:
 			bool _readRequest();
 			bool _parseURI(const char *beginURI, const char *endURI);
 			bool _parseHeader(const char *pStartHeader, const char *pEndHeader);
 			void _endWork();
 			bool _readPostData();
+			bool _startSegmentedBody(class HttpThreadSpecificData *threadSpecData, const size_t bodySize);
+			bool _parseSegmentedBody();
+			void _freeBody();
+			void _freeArena();
 			ECallResult _send100Continue();
 			ECallResult _sendAnswer();
 			ECallResult _sendPartialAnswer();
 			ECallResult _sendError();
-			void _updateTimeout();
 			bool _reset();
 			const ECallResult _setWaitExternalEvent();
 			bool _checkExpect(const char *name, const size_t nameLength, const char *value, const size_t valueLen);
+			ECallResult _sendRateLimited();
+			void _parseXRealIP(const char *name, const size_t nameLength, const char *value, const size_t valueLen);
 			
 			HttpEventInterface *_interface;
 			NetworkBuffer *_networkBuffer;
+			SegmentedBuffer *_body;
+			size_t _bodyLeft; // the bytes of the segmented body which haven't been received yet
+			Arena *_arena;
 			uint32_t _headerStartPosition;
 			enum EHttpState : uint8_t
 			{
@@ -187,6 +240,8 @@ namespace fl {
 			EHttpState _state;
 			uint8_t _chunkNumber;
 			TStatus _status;
+			TIPv4 _peerIp;
+			TIPv4 _ip; // peer ip or X-Real-IP value if it is trusted
 		};
 
 		class HttpThreadSpecificData : public ThreadSpecificData
@@ -197,13 +252,31 @@ namespace fl {
 				const uint32_t operationTimeout = 60, const uint32_t firstRequstTimeout = 15, const uint32_t keepAlive = 60, 
 				const uint32_t maxSequenceSends = 50);
 			virtual ~HttpThreadSpecificData() {}
+			virtual void threadStarted();
+			virtual void periodicCall(const time_t curTime);
 			NetworkBuffer::TSize maxRequestSize;
 			uint8_t maxChunkCount;
-			NetworkBufferPool bufferPool;
+			NetworkBufferPool bufferPool; // bufferPool.setDepot shares the free buffers of the threads
 			uint32_t operationTimeout;
 			uint32_t firstRequstTimeout;
 			uint32_t keepAlive;
 			uint32_t maxSequenceSends;
+			IpRateLimiter *requestRateLimiter; // requests limit per client ip, NULL if disabled
+			bool trustXRealIP; // use X-Real-IP header as client ip (behind a balancer)
+			uint32_t bufferTrimInterval; // seconds between releases of idle pooled buffers
+			// the huge page region of the segments is created by the worker thread if the size isn't 0, so its pages
+			// are taken from the NUMA node of the worker, the segments are taken from the heap when it is exhausted
+			size_t segmentRegionSize;
+			std::unique_ptr<MemoryRegion> segmentRegion; // it outlives segmentPool
+			SegmentPool segmentPool;
+			size_t segmentedBodyThreshold; // 64 KB by default, 0 disables segmented bodies
+			ArenaPool arenaPool;
+			// URI parts which are passed to HttpEventInterface::parseURI, they are reused by the requests of the thread
+			std::string uriHost;
+			std::string uriFileName;
+			std::string uriQuery;
+		private:
+			time_t _lastBufferTrim;
 		};
 
 	};
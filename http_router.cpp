@@ -0,0 +1,300 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Radix tree URL router for HttpEventInterface dispatching
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+#include <strings.h>
+#include "http_router.hpp"
+
+using namespace fl::http;
+
+const HttpRouter::THandlerId HttpRouter::NOT_FOUND;
+const HttpRouter::TMethodMask HttpRouter::M_UNKNOWN;
+const HttpRouter::TMethodMask HttpRouter::M_GET;
+const HttpRouter::TMethodMask HttpRouter::M_HEAD;
+const HttpRouter::TMethodMask HttpRouter::M_POST;
+const HttpRouter::TMethodMask HttpRouter::M_PUT;
+const HttpRouter::TMethodMask HttpRouter::M_DELETE;
+const HttpRouter::TMethodMask HttpRouter::M_OPTIONS;
+const HttpRouter::TMethodMask HttpRouter::M_PROPFIND;
+const HttpRouter::TMethodMask HttpRouter::M_MKCOL;
+const HttpRouter::TMethodMask HttpRouter::M_ANY;
+const size_t HttpRouter::MAX_PARAMS;
+
+HttpRouter::HttpRouter()
+	: _root(new BuildNode()), _routesCount(0), _compiled(false)
+{
+}
+
+HttpRouter::~HttpRouter()
+{
+	delete _root;
+}
+
+void HttpRouter::add(const TMethodMask methods, const char *pattern, const THandlerId handler)
+{
+	if (handler == NOT_FOUND)
+		throw Error("Handler id is reserved");
+	BuildNode *node = _root;
+	const char *pos = pattern;
+	while (*pos) {
+		if (*pos == '/') {
+			pos++;
+			continue;
+		}
+		const char *segEnd = strchr(pos, '/');
+		if (!segEnd)
+			segEnd = pos + strlen(pos);
+		if (*pos == ':') {
+			if (!node->param)
+				node->param.reset(new BuildNode());
+			node = node->param.get();
+		} else if (*pos == '*') {
+			if (*segEnd)
+				throw Error("Wildcard has to be the last segment of a route");
+			if (!node->wildcard)
+				node->wildcard.reset(new BuildNode());
+			node = node->wildcard.get();
+		} else {
+			std::unique_ptr<BuildNode> &child = node->children[std::string(pos, segEnd - pos)];
+			if (!child)
+				child.reset(new BuildNode());
+			node = child.get();
+		}
+		pos = segEnd;
+	}
+	for (auto r = node->routes.begin(); r != node->routes.end(); r++) {
+		if (r->methods & methods)
+			throw Error("Route conflicts with an existing one");
+	}
+	Route route = {methods, handler};
+	node->routes.push_back(route);
+	_routesCount++;
+	_compiled = false;
+}
+
+void HttpRouter::compile()
+{
+	_nodes.clear();
+	_children.clear();
+	_routes.clear();
+	_labels.clear();
+	_flatten(_root, std::string());
+	_compiled = true;
+}
+
+uint32_t HttpRouter::_flatten(BuildNode *node, const std::string &label)
+{
+	std::string fullLabel(label);
+	if (!label.empty()) { // compress chains of static segments without routes
+		while (node->routes.empty() && !node->param && !node->wildcard && (node->children.size() == 1)) {
+			fullLabel.push_back('/');
+			fullLabel.append(node->children.begin()->first);
+			node = node->children.begin()->second.get();
+		}
+	}
+	uint32_t nodeId = _nodes.size();
+	Node flat;
+	flat.labelStart = _labels.size();
+	flat.labelLength = fullLabel.size();
+	flat.firstSegmentLength = label.size();
+	flat.routesStart = _routes.size();
+	flat.routesCount = node->routes.size();
+	flat.param = NO_NODE;
+	flat.wildcard = NO_NODE;
+	_labels.append(fullLabel);
+	_routes.insert(_routes.end(), node->routes.begin(), node->routes.end());
+	_nodes.push_back(flat);
+	
+	std::vector<uint32_t> children;
+	for (auto c = node->children.begin(); c != node->children.end(); c++) {
+		children.push_back(_flatten(c->second.get(), c->first));
+	}
+	uint32_t param = NO_NODE;
+	if (node->param)
+		param = _flatten(node->param.get(), std::string());
+	uint32_t wildcard = NO_NODE;
+	if (node->wildcard)
+		wildcard = _flatten(node->wildcard.get(), std::string());
+	
+	Node &res = _nodes[nodeId];
+	res.childrenStart = _children.size();
+	res.childrenCount = children.size();
+	res.param = param;
+	res.wildcard = wildcard;
+	_children.insert(_children.end(), children.begin(), children.end());
+	return nodeId;
+}
+
+uint32_t HttpRouter::_findChild(const Node &node, const char *segment, const size_t segmentLength) const
+{
+	const uint32_t *children = _children.data() + node.childrenStart;
+	size_t left = 0;
+	size_t right = node.childrenCount;
+	while (left < right) {
+		size_t middle = (left + right) / 2;
+		const Node &child = _nodes[children[middle]];
+		size_t cmpLength = child.firstSegmentLength < segmentLength ? child.firstSegmentLength : segmentLength;
+		int cmp = memcmp(_labels.data() + child.labelStart, segment, cmpLength);
+		if (cmp == 0) {
+			if (child.firstSegmentLength == segmentLength)
+				return children[middle];
+			cmp = child.firstSegmentLength < segmentLength ? -1 : 1;
+		}
+		if (cmp < 0)
+			left = middle + 1;
+		else
+			right = middle;
+	}
+	return NO_NODE;
+}
+
+bool HttpRouter::_matchRoutes(const Node &node, const TMethodMask method, Match &match) const
+{
+	const Route *route = _routes.data() + node.routesStart;
+	const Route *routeEnd = route + node.routesCount;
+	for (; route < routeEnd; route++) {
+		if (route->methods & method) {
+			match.handler = route->handler;
+			return true;
+		}
+	}
+	if (node.routesCount > 0)
+		match.methodNotAllowed = true;
+	return false;
+}
+
+bool HttpRouter::_resolve(const uint32_t nodeId, const TMethodMask method, const char *path, const char *pos, 
+	const char *end, Match &match) const
+{
+	const Node &node = _nodes[nodeId];
+	while ((pos < end) && (*pos == '/'))
+		pos++;
+	if (pos == end)
+		return _matchRoutes(node, method, match);
+	
+	const char *segEnd = static_cast<const char*>(memchr(pos, '/', end - pos));
+	if (!segEnd)
+		segEnd = end;
+	const size_t segmentLength = segEnd - pos;
+	
+	uint32_t childId = _findChild(node, pos, segmentLength);
+	if (childId != NO_NODE) {
+		const Node &child = _nodes[childId];
+		const char *labelEnd = pos + child.labelLength;
+		if ((labelEnd <= end) && ((labelEnd == end) || (*labelEnd == '/'))
+			&& !memcmp(_labels.data() + child.labelStart, pos, child.labelLength)) {
+			if (_resolve(childId, method, path, labelEnd, end, match))
+				return true;
+		}
+	}
+	if (match.paramsCount < MAX_PARAMS) {
+		Param &param = match.params[match.paramsCount];
+		if (node.param != NO_NODE) {
+			param.start = pos - path;
+			param.length = segmentLength;
+			match.paramsCount++;
+			if (_resolve(node.param, method, path, segEnd, end, match))
+				return true;
+			match.paramsCount--;
+		}
+		if (node.wildcard != NO_NODE) {
+			param.start = pos - path;
+			param.length = end - pos;
+			match.paramsCount++;
+			if (_matchRoutes(_nodes[node.wildcard], method, match))
+				return true;
+			match.paramsCount--;
+		}
+	}
+	return false;
+}
+
+bool HttpRouter::resolve(const TMethodMask method, const char *path, const size_t pathLength, Match &match) const
+{
+	match.handler = NOT_FOUND;
+	match.methodNotAllowed = false;
+	match.paramsCount = 0;
+	if (!_compiled)
+		return false;
+	return _resolve(0, method, path, path, path + pathLength, match);
+}
+
+HttpRouter::TMethodMask HttpRouter::parseMethod(const char *cmdStart)
+{
+	struct Method
+	{
+		const char *name;
+		size_t length;
+		TMethodMask mask;
+	};
+	static const Method METHODS[] = {
+		{"GET ", 4, M_GET},
+		{"HEAD ", 5, M_HEAD},
+		{"POST ", 5, M_POST},
+		{"PUT ", 4, M_PUT},
+		{"DELETE ", 7, M_DELETE},
+		{"OPTIONS ", 8, M_OPTIONS},
+		{"PROPFIND ", 9, M_PROPFIND},
+		{"MKCOL ", 6, M_MKCOL},
+	};
+	const char firstChar = toupper(*cmdStart);
+	for (size_t i = 0; i < sizeof(METHODS) / sizeof(METHODS[0]); i++) {
+		if ((METHODS[i].name[0] == firstChar) && !strncasecmp(cmdStart, METHODS[i].name, METHODS[i].length))
+			return METHODS[i].mask;
+	}
+	return M_UNKNOWN;
+}
+
+RoutedHttpEventInterface::RoutedHttpEventInterface(const HttpRouter *router)
+	: _router(router), _method(HttpRouter::M_UNKNOWN)
+{
+}
+
+bool RoutedHttpEventInterface::parseURI(const char *cmdStart, const EHttpVersion::EHttpVersion version,
+	const std::string &host, const std::string &fileName, const std::string &query)
+{
+	_method = HttpRouter::parseMethod(cmdStart);
+	_router->resolve(_method, fileName.c_str(), fileName.size(), _match);
+	// fileName is reused by the next requests of the thread, only the captured segments are kept
+	_paramValues.clear();
+	for (uint8_t i = 0; i < _match.paramsCount; i++) {
+		HttpRouter::Param &param = _match.params[i];
+		uint32_t start = _paramValues.size();
+		_paramValues.append(fileName.c_str() + param.start, param.length);
+		param.start = start;
+	}
+	return true;
+}
+
+HttpEventInterface::EFormResult RoutedHttpEventInterface::formResult(BString &networkBuffer, class HttpEvent *http)
+{
+	if (_match.handler == HttpRouter::NOT_FOUND)
+		return formNotRouted(networkBuffer, http);
+	return formRouteResult(_match.handler, networkBuffer, http);
+}
+
+HttpEventInterface::EFormResult RoutedHttpEventInterface::formNotRouted(BString &networkBuffer, 
+	class HttpEvent *http)
+{
+	networkBuffer << getErorrByCode(_match.methodNotAllowed ? ERROR_405_METHOD_NOT_ALLOWED : ERROR_404_NOT_FOUND);
+	networkBuffer << "Content-Length: 0\r\n";
+	_addConnectionHeader(networkBuffer, false);
+	networkBuffer << "\r\n";
+	return RESULT_OK_CLOSE;
+}
+
+bool RoutedHttpEventInterface::_param(const size_t index, const char *&value, size_t &valueLength) const
+{
+	if (index >= _match.paramsCount)
+		return false;
+	value = _paramValues.c_str() + _match.params[index].start;
+	valueLength = _match.params[index].length;
+	return true;
+}
@@ -0,0 +1,157 @@
+#pragma once
+#ifndef __FL_HTTP_ROUTER_HPP
+#define	__FL_HTTP_ROUTER_HPP
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Radix tree URL router for HttpEventInterface dispatching
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include "exception.hpp"
+#include "http_event.hpp"
+
+namespace fl {
+	namespace http {
+		using namespace fl::events;
+		
+		// Routes are added at startup and compiled into a flat radix tree over path segments. A compiled router is
+		// read only and can be shared between all worker threads. Pattern segments:
+		//   "name"  - static segment
+		//   ":name" - captures one segment
+		//   "*"     - captures the rest of the path (last segment only)
+		class HttpRouter
+		{
+		public:
+			class Error : public fl::exceptions::Error
+			{
+			public:
+				Error(const char *what)
+					: fl::exceptions::Error(what)
+				{
+				}
+			};
+			
+			typedef uint32_t THandlerId;
+			static const THandlerId NOT_FOUND = static_cast<THandlerId>(-1);
+			
+			typedef uint16_t TMethodMask;
+			static const TMethodMask M_UNKNOWN = 0;
+			static const TMethodMask M_GET = 0x1;
+			static const TMethodMask M_HEAD = 0x2;
+			static const TMethodMask M_POST = 0x4;
+			static const TMethodMask M_PUT = 0x8;
+			static const TMethodMask M_DELETE = 0x10;
+			static const TMethodMask M_OPTIONS = 0x20;
+			static const TMethodMask M_PROPFIND = 0x40;
+			static const TMethodMask M_MKCOL = 0x80;
+			static const TMethodMask M_ANY = 0xFFFF;
+			static TMethodMask parseMethod(const char *cmdStart);
+			
+			static const size_t MAX_PARAMS = 8;
+			struct Param
+			{
+				uint32_t start; // offset from the path beginning
+				uint32_t length;
+			};
+			struct Match
+			{
+				Match()
+					: handler(NOT_FOUND), methodNotAllowed(false), paramsCount(0)
+				{
+				}
+				THandlerId handler;
+				bool methodNotAllowed;
+				uint8_t paramsCount;
+				Param params[MAX_PARAMS];
+			};
+			
+			HttpRouter();
+			~HttpRouter();
+			HttpRouter(const HttpRouter &) = delete;
+			HttpRouter &operator=(const HttpRouter &) = delete;
+			
+			void add(const TMethodMask methods, const char *pattern, const THandlerId handler);
+			void compile();
+			bool resolve(const TMethodMask method, const char *path, const size_t pathLength, Match &match) const;
+			size_t size() const
+			{
+				return _routesCount;
+			}
+		private:
+			struct Route
+			{
+				TMethodMask methods;
+				THandlerId handler;
+			};
+			typedef std::vector<Route> TRouteVector;
+			
+			struct BuildNode
+			{
+				typedef std::map<std::string, std::unique_ptr<BuildNode>> TChildMap;
+				TChildMap children;
+				std::unique_ptr<BuildNode> param;
+				std::unique_ptr<BuildNode> wildcard;
+				TRouteVector routes;
+			};
+			BuildNode *_root;
+			size_t _routesCount;
+			
+			static const uint32_t NO_NODE = static_cast<uint32_t>(-1);
+			struct Node
+			{
+				uint32_t labelStart; // label is one or several static segments separated by '/'
+				uint32_t labelLength;
+				uint32_t firstSegmentLength;
+				uint32_t childrenStart; // static children are sorted by the first segment
+				uint32_t childrenCount;
+				uint32_t param;
+				uint32_t wildcard;
+				uint32_t routesStart;
+				uint32_t routesCount;
+			};
+			std::vector<Node> _nodes;
+			std::vector<uint32_t> _children;
+			TRouteVector _routes;
+			std::string _labels;
+			bool _compiled;
+			
+			uint32_t _flatten(BuildNode *node, const std::string &label);
+			bool _resolve(const uint32_t nodeId, const TMethodMask method, const char *path, const char *pos, 
+				const char *end, Match &match) const;
+			bool _matchRoutes(const Node &node, const TMethodMask method, Match &match) const;
+			uint32_t _findChild(const Node &node, const char *segment, const size_t segmentLength) const;
+		};
+		
+		// Base interface which resolves a request on parseURI and dispatches formResult by the handler id
+		class RoutedHttpEventInterface : public HttpEventInterface
+		{
+		public:
+			RoutedHttpEventInterface(const HttpRouter *router);
+			virtual ~RoutedHttpEventInterface() {};
+			virtual bool parseURI(const char *cmdStart, const EHttpVersion::EHttpVersion version,
+				const std::string &host, const std::string &fileName, const std::string &query);
+			virtual EFormResult formResult(BString &networkBuffer, class HttpEvent *http);
+			virtual EFormResult formRouteResult(const HttpRouter::THandlerId handler, BString &networkBuffer, 
+				class HttpEvent *http) = 0;
+			virtual EFormResult formNotRouted(BString &networkBuffer, class HttpEvent *http);
+		protected:
+			bool _param(const size_t index, const char *&value, size_t &valueLength) const;
+			const HttpRouter *_router;
+			HttpRouter::TMethodMask _method;
+			HttpRouter::Match _match; // the parameters are offsets in _paramValues
+			std::string _paramValues;
+		};
+	};
+};
+
+#endif	// __FL_HTTP_ROUTER_HPP
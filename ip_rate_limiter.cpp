@@ -0,0 +1,89 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Per IP token bucket rate limiter
+///////////////////////////////////////////////////////////////////////////////
+
+#include <ctime>
+#include "ip_rate_limiter.hpp"
+#include "bstring.hpp"
+
+using namespace fl::network;
+using fl::threads::AutoMutex;
+
+static const int64_t TOKEN = 1000;
+
+IpRateLimiter::IpRateLimiter(const uint32_t ratePerSecond, const uint32_t burst, const uint32_t idleTimeout, 
+	const size_t shardsCount)
+	: _ratePerSecond(ratePerSecond), _capacity(static_cast<int64_t>(burst ? burst : 1) * TOKEN), 
+	_idleTimeoutMs(static_cast<uint64_t>(idleTimeout) * 1000), _shards(shardsCount ? shardsCount : 1), _rejected(0)
+{
+	uint32_t retryAfter = ratePerSecond ? 1 : 60;
+	BString answer;
+	answer.sprintfSet("HTTP/1.1 503 Service Unavailable\r\nRetry-After: %u\r\nContent-Length: 0\r\n"
+		"Connection: Close\r\n\r\n", retryAfter);
+	_rejectAnswer.assign(answer.c_str(), answer.size());
+}
+
+uint64_t IpRateLimiter::_nowMs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+bool IpRateLimiter::allow(const TIPv4 ip)
+{
+	uint64_t now = _nowMs();
+	Shard &shard = _shards[(ip * 2654435761U) % _shards.size()];
+	AutoMutex autoSync(&shard.sync);
+	auto res = shard.buckets.insert(TBucketMap::value_type(ip, Bucket()));
+	Bucket &bucket = res.first->second;
+	if (res.second) {
+		bucket.tokens = _capacity;
+	} else if (now > bucket.lastUpdate) {
+		bucket.tokens += static_cast<int64_t>(now - bucket.lastUpdate) * _ratePerSecond;
+		if (bucket.tokens > _capacity)
+			bucket.tokens = _capacity;
+	}
+	bucket.lastUpdate = now;
+	if (bucket.tokens >= TOKEN) {
+		bucket.tokens -= TOKEN;
+		return true;
+	}
+	autoSync.unLock();
+	_rejected.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+
+size_t IpRateLimiter::sweep()
+{
+	uint64_t now = _nowMs();
+	size_t removed = 0;
+	for (auto shard = _shards.begin(); shard != _shards.end(); shard++) {
+		AutoMutex autoSync(&shard->sync);
+		for (auto b = shard->buckets.begin(); b != shard->buckets.end(); ) {
+			if (now - b->second.lastUpdate >= _idleTimeoutMs) {
+				b = shard->buckets.erase(b);
+				removed++;
+			} else {
+				b++;
+			}
+		}
+	}
+	return removed;
+}
+
+size_t IpRateLimiter::size()
+{
+	size_t count = 0;
+	for (auto shard = _shards.begin(); shard != _shards.end(); shard++) {
+		AutoMutex autoSync(&shard->sync);
+		count += shard->buckets.size();
+	}
+	return count;
+}
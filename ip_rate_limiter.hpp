@@ -0,0 +1,81 @@
+#pragma once
+#ifndef __FL_IP_RATE_LIMITER_HPP
+#define	__FL_IP_RATE_LIMITER_HPP
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Per IP token bucket rate limiter
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include "socket.hpp"
+#include "mutex.hpp"
+#include "timer_event.hpp"
+
+namespace fl {
+	namespace network {
+		using fl::threads::Mutex;
+		using fl::events::TimerEventInterface;
+		using fl::events::TimerEvent;
+		
+		// The table is split into shards by ip to keep lock contention low. Idle buckets are removed by sweep(), which 
+		// can be called from a TimerEvent (the limiter is a TimerEventInterface).
+		class IpRateLimiter : public TimerEventInterface
+		{
+		public:
+			static const uint32_t DEFAULT_IDLE_TIMEOUT = 60; // seconds
+			static const size_t DEFAULT_SHARDS_COUNT = 64;
+			IpRateLimiter(const uint32_t ratePerSecond, const uint32_t burst, 
+				const uint32_t idleTimeout = DEFAULT_IDLE_TIMEOUT, const size_t shardsCount = DEFAULT_SHARDS_COUNT);
+			IpRateLimiter(const IpRateLimiter &) = delete;
+			IpRateLimiter &operator=(const IpRateLimiter &) = delete;
+			
+			bool allow(const TIPv4 ip);
+			size_t sweep();
+			virtual void timerCall(TimerEvent *te)
+			{
+				sweep();
+			}
+			size_t size();
+			uint64_t rejected() const
+			{
+				return _rejected.load(std::memory_order_relaxed);
+			}
+			// pre-rendered "503 Service Unavailable" answer with Retry-After header
+			const std::string &rejectAnswer() const
+			{
+				return _rejectAnswer;
+			}
+		private:
+			static uint64_t _nowMs();
+			struct Bucket
+			{
+				int64_t tokens; // 1/1000 of a token
+				uint64_t lastUpdate; // ms
+			};
+			typedef std::unordered_map<TIPv4, Bucket> TBucketMap;
+			struct Shard
+			{
+				Mutex sync;
+				TBucketMap buckets;
+			};
+			int64_t _ratePerSecond;
+			int64_t _capacity;
+			uint64_t _idleTimeoutMs;
+			std::vector<Shard> _shards;
+			std::atomic<uint64_t> _rejected;
+			std::string _rejectAnswer;
+		};
+	};
+};
+
+#endif	// __FL_IP_RATE_LIMITER_HPP
@@ -8,17 +8,65 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <strings.h>
 #include <unistd.h>
 #include <exception>
 #include "log.hpp"
 
 using namespace fl::log;
 
+namespace
+{
+	// the strings are cut at end, the fixed parts of the prefixes are after it
+	char *addString(char *pos, const char *end, const char *str)
+	{
+		while (*str && (pos < end))
+			*pos++ = *str++;
+		return pos;
+	}
+
+	char *addNumber(char *pos, uint32_t number, const int digits)
+	{
+		for (int i = digits - 1; i >= 0; i--) {
+			pos[i] = '0' + number % 10;
+			number /= 10;
+		}
+		return pos + digits;
+	}
+
+	const size_t PREFIX_TAIL_SPACE = 64; // pid, time and level
+}
+
+__thread struct timespec LogTime::_now;
+__thread time_t LogTime::_second = -1;
+__thread struct tm LogTime::_localTime;
+__thread char LogTime::_date[LogTime::DATE_SIZE + 1];
+
+void LogTime::_updateSecond()
+{
+	_second = _now.tv_sec;
+	localtime_r(&_second, &_localTime);
+	char *pos = addNumber(_date, _localTime.tm_mday, 2);
+	*pos++ = '.';
+	pos = addNumber(pos, _localTime.tm_mon + 1, 2);
+	*pos++ = ' ';
+	pos = addNumber(pos, _localTime.tm_hour, 2);
+	*pos++ = ':';
+	pos = addNumber(pos, _localTime.tm_min, 2);
+	*pos++ = ':';
+	pos = addNumber(pos, _localTime.tm_sec, 2);
+	*pos = 0;
+}
+
 Target::ProcessInfo Target::_process;
 
 Target::ProcessInfo::ProcessInfo()
 {
 	pid = getpid();
+	pidSize = snprintf(pidStr, sizeof(pidStr), "%u", pid);
 }
 
 const char *ErrorLevelTable[ELogLevel::MAX_LOG_LEVEL] =
@@ -30,6 +78,138 @@ const char *ErrorLevelTable[ELogLevel::MAX_LOG_LEVEL] =
 	" ", // INFO
 };
 
+const char *fl::log::levelName(const int level)
+{
+	if ((level <= 0) || (level >= ELogLevel::MAX_LOG_LEVEL))
+		return "?";
+	return ErrorLevelTable[level];
+}
+
+TagLevel *TagLevel::_first = NULL;
+
+TagLevel::TagLevel(const char *tag, const int level)
+	: _tag(tag), _level(level), _next(_first)
+{
+	_first = this;
+}
+
+bool TagLevel::set(const char *tag, const int level)
+{
+	bool found = false;
+	for (TagLevel *tagLevel = _first; tagLevel; tagLevel = tagLevel->_next) {
+		if (!strcmp(tagLevel->_tag, tag)) {
+			tagLevel->set(level);
+			found = true;
+		}
+	}
+	return found;
+}
+
+void TagLevel::setAll(const int level)
+{
+	for (TagLevel *tagLevel = _first; tagLevel; tagLevel = tagLevel->_next)
+		tagLevel->set(level);
+}
+
+bool TagLevel::configure(const char *levels)
+{
+	static const char *LEVEL_NAMES[ELogLevel::MAX_LOG_LEVEL] = {NULL, "FATAL", "ERROR", "WARNING", "INFO"};
+	bool res = true;
+	while (*levels) {
+		const char *end = strchr(levels, ',');
+		if (!end)
+			end = levels + strlen(levels);
+		const char *equal = static_cast<const char*>(memchr(levels, '=', end - levels));
+		if (!equal) {
+			res = false;
+		} else {
+			std::string tag(levels, equal - levels);
+			std::string levelName(equal + 1, end - equal - 1);
+			int level = 0;
+			for (int i = ELogLevel::FATAL; i < ELogLevel::MAX_LOG_LEVEL; i++) {
+				if (!strcasecmp(levelName.c_str(), LEVEL_NAMES[i]))
+					level = i;
+			}
+			if (!level && !levelName.empty() && (strspn(levelName.c_str(), "0123456789") == levelName.size()))
+				level = atoi(levelName.c_str());
+			if (!level)
+				res = false;
+			else if (tag == "*")
+				setAll(level);
+			else if (!set(tag.c_str(), level))
+				res = false;
+		}
+		levels = *end ? end + 1 : end;
+	}
+	return res;
+}
+
+__thread uint64_t LogSampler::_random = 0;
+
+void LogSampler::_seed()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	_random = (now.tv_sec * UINT64_C(1000000000) + now.tv_nsec) ^ reinterpret_cast<uintptr_t>(&now);
+	_random = _random * UINT64_C(0x9E3779B97F4A7C15) | 1;
+}
+
+TagLevel LibLogSystem::tagLevel("fLib");
+
+size_t Target::_addTime(char *buf, const time_t curTime, struct tm *ct) const
+{
+	if ((curTime != LogTime::seconds()) || (ct != LogTime::localTime())) // not from Log::L
+		return sprintf(buf, "%02i.%02i %02i:%02i:%02i", ct->tm_mday, ct->tm_mon+1, ct->tm_hour, ct->tm_min, ct->tm_sec);
+	memcpy(buf, LogTime::date(), LogTime::DATE_SIZE);
+	char *pos = buf + LogTime::DATE_SIZE;
+	if (_timePrecision == ETimePrecision::MILLISECONDS) {
+		*pos++ = '.';
+		pos = addNumber(pos, LogTime::nanoseconds() / 1000000, 3);
+	} else if (_timePrecision == ETimePrecision::MICROSECONDS) {
+		*pos++ = '.';
+		pos = addNumber(pos, LogTime::nanoseconds() / 1000, 6);
+	}
+	return pos - buf;
+}
+
+size_t Target::_prefix(char *buf, const int level, const char *tag, const time_t curTime, struct tm *ct) const
+{
+	char *pos = buf;
+	*pos++ = '[';
+	pos = addString(pos, buf + MAX_PREFIX_SIZE - PREFIX_TAIL_SPACE, tag);
+	*pos++ = '/';
+	memcpy(pos, _process.pidStr, _process.pidSize);
+	pos += _process.pidSize;
+	*pos++ = '/';
+	pos += _addTime(pos, curTime, ct);
+	*pos++ = '/';
+	*pos++ = ErrorLevelTable[level][0];
+	*pos++ = ']';
+	*pos++ = ' ';
+	return pos - buf;
+}
+
+size_t Target::_prefix(char *buf, const int level, const char *fileName, const int lineNumber, const char *tag,
+	const time_t curTime, struct tm *ct) const
+{
+	char *pos = buf;
+	const char *end = buf + MAX_PREFIX_SIZE - PREFIX_TAIL_SPACE;
+	*pos++ = '[';
+	pos = addString(pos, end, tag);
+	*pos++ = ':';
+	pos = addString(pos, end, fileName);
+	pos += sprintf(pos, ":%u/", lineNumber);
+	memcpy(pos, _process.pidStr, _process.pidSize);
+	pos += _process.pidSize;
+	*pos++ = '/';
+	pos += _addTime(pos, curTime, ct);
+	*pos++ = '/';
+	*pos++ = ErrorLevelTable[level][0];
+	*pos++ = ']';
+	*pos++ = ' ';
+	return pos - buf;
+}
+
 void StdErrorTarget::log(
 	const int level, 
 	const char *tag, 
@@ -37,7 +217,8 @@ void StdErrorTarget::log(
 	struct tm *ct, 
 	const char *fmt, va_list args
 ) {
-	fprintf(stderr, "[%s/%u/%02i.%02i %02i:%02i:%02i/%s] ", tag, _process.pid, ct->tm_mday, ct->tm_mon+1, ct->tm_hour, ct->tm_min, ct->tm_sec, ErrorLevelTable[level]);
+	char prefix[MAX_PREFIX_SIZE];
+	fwrite(prefix, 1, _prefix(prefix, level, tag, curTime, ct), stderr);
 	vfprintf(stderr, fmt, args);
 }
 
@@ -52,8 +233,8 @@ void StdErrorTarget::log(
 	va_list args
 )
 {
-	fprintf(stderr, "[%s:%s:%u/%u/%02i.%02i %02i:%02i:%02i/%s] ", tag, fileName, lineNumber, _process.pid, 
-		ct->tm_mday, ct->tm_mon+1, ct->tm_hour, ct->tm_min, ct->tm_sec, ErrorLevelTable[level]);
+	char prefix[MAX_PREFIX_SIZE];
+	fwrite(prefix, 1, _prefix(prefix, level, fileName, lineNumber, tag, curTime, ct), stderr);
 	vfprintf(stderr, fmt, args);
 }
 
@@ -64,7 +245,8 @@ void ScreenTarget::log(
 	struct tm *ct, 
 	const char *fmt, va_list args
 ) {
-	printf("[%s/%u/%02i.%02i %02i:%02i:%02i/%s] ", tag, _process.pid, ct->tm_mday, ct->tm_mon+1, ct->tm_hour, ct->tm_min, ct->tm_sec, ErrorLevelTable[level]);
+	char prefix[MAX_PREFIX_SIZE];
+	fwrite(prefix, 1, _prefix(prefix, level, tag, curTime, ct), stdout);
 	vprintf(fmt, args);	
 }
 
@@ -79,23 +261,55 @@ void ScreenTarget::log(
 	va_list args
 )
 {
-	printf("[%s:%s:%u/%u/%02i.%02i %02i:%02i:%02i/%s] ", tag, fileName, lineNumber, _process.pid, 
-		ct->tm_mday, ct->tm_mon+1, ct->tm_hour, ct->tm_min, ct->tm_sec, ErrorLevelTable[level]);
+	char prefix[MAX_PREFIX_SIZE];
+	fwrite(prefix, 1, _prefix(prefix, level, fileName, lineNumber, tag, curTime, ct), stdout);
 	vprintf(fmt, args);		
 }
 
 FileTarget::FileTarget(const char *fileName) 
+	: _file(fileName)
 {
-	_fd = fopen(fileName, "a+");
-	if (!_fd) {
-		printf("Cannot open log file: %s\n", fileName);
-		throw std::exception();
-	}
 }
 
 FileTarget::~FileTarget()
 {
-	fclose(_fd);
+}
+
+void FileTarget::setRotation(const uint64_t maxSize, const uint32_t intervalSeconds, const uint32_t keepFiles,
+	const bool compress)
+{
+	_sync.lock();
+	_file.setRotation(maxSize, intervalSeconds, keepFiles, compress);
+	_sync.unLock();
+}
+
+void FileTarget::rotate()
+{
+	_sync.lock();
+	_file.rotate();
+	_sync.unLock();
+}
+
+void FileTarget::_write(char *buf, size_t size, const char *fmt, va_list args)
+{
+	// the message is formatted after the prefix in buf of BUFFER_SIZE bytes
+	va_list longArgs;
+	va_copy(longArgs, args);
+	int messageSize = vsnprintf(buf + size, BUFFER_SIZE - size, fmt, args);
+	std::string longMessage;
+	if (messageSize < 0) {
+		messageSize = 0;
+	} else if (size + messageSize >= BUFFER_SIZE) {
+		longMessage.assign(buf, size);
+		longMessage.resize(size + messageSize + 1);
+		vsnprintf(&longMessage[size], messageSize + 1, fmt, longArgs);
+		buf = &longMessage[0];
+	}
+	va_end(longArgs);
+	size += messageSize;
+	_sync.lock();
+	_file.write(buf, size);
+	_sync.unLock();
 }
 
 void FileTarget::log(
@@ -106,10 +320,8 @@ void FileTarget::log(
 	const char *fmt, 
 	va_list args
 ) {
-	fprintf(_fd, "[%s/%u/%02i.%02i %02i:%02i:%02i/%s] ", tag, _process.pid, 
-					ct->tm_mday, ct->tm_mon+1, ct->tm_hour, ct->tm_min, ct->tm_sec, ErrorLevelTable[level]);
-	vfprintf(_fd, fmt, args);
-	fflush(_fd);
+	char buf[BUFFER_SIZE];
+	_write(buf, _prefix(buf, level, tag, curTime, ct), fmt, args);
 }
 
 void FileTarget::log(
@@ -123,10 +335,8 @@ void FileTarget::log(
 	va_list args
 )
 {
-	fprintf(_fd, "[%s:%s:%u/%u/%02i.%02i %02i:%02i:%02i/%s] ", tag, fileName, lineNumber, _process.pid, 
-		ct->tm_mday, ct->tm_mon+1, ct->tm_hour, ct->tm_min, ct->tm_sec, ErrorLevelTable[level]);
-	vfprintf(_fd, fmt, args);
-	fflush(_fd);		
+	char buf[BUFFER_SIZE];
+	_write(buf, _prefix(buf, level, fileName, lineNumber, tag, curTime, ct), fmt, args);
 }
 
 LogSystem LogSystem::_defaultLog;
@@ -181,11 +391,17 @@ void LogSystem::addTarget(Target *target)
 
 void LogSystem::clearTargets()
 {
-	for (TTargetList::iterator target = _targets.begin(); target != _targets.begin(); target++)
+	for (TTargetList::iterator target = _targets.begin(); target != _targets.end(); target++)
 		delete *target;
 	_targets.clear();
 }
 
+void LogSystem::flush()
+{
+	for (TTargetList::iterator target = _targets.begin(); target != _targets.end(); target++)
+		(*target)->flush();
+}
+
 void LogSystem::setStdErrorOnly()
 {
 	clearTargets();
@@ -15,11 +15,21 @@
 #define FL_LOG_LEVEL 2
 #endif
 
+// initial runtime level of the tags, by default only FL_LOG_LEVEL of the calling code filters the messages
+// till the levels are configured
+#ifndef FL_LOG_RUNTIME_LEVEL
+#define FL_LOG_RUNTIME_LEVEL fl::log::ELogLevel::INFO
+#endif
+
+#include <atomic>
 #include <cstdarg>
+#include <cstdint>
 #include <ctime>
 #include <cstdio>
 #include <vector>
 #include <unistd.h>
+#include "log_file.hpp"
+#include "mutex.hpp"
 
 namespace fl {
 	namespace log {
@@ -35,9 +45,150 @@ namespace fl {
 			};
 		};
 		
+		// Time of the log calls of the thread, it is taken from clock_gettime and localtime_r is called only once
+		// per second of the thread with the formatted date of the second kept for the prefixes
+		class LogTime
+		{
+		public:
+			static void update()
+			{
+				clock_gettime(CLOCK_REALTIME, &_now);
+				if (_now.tv_sec != _second)
+					_updateSecond();
+			}
+			static time_t seconds()
+			{
+				return _now.tv_sec;
+			}
+			static uint32_t nanoseconds()
+			{
+				return _now.tv_nsec;
+			}
+			static struct tm *localTime()
+			{
+				return &_localTime;
+			}
+			// "dd.mm HH:MM:SS" of the last update
+			static const char *date()
+			{
+				return _date;
+			}
+			static const size_t DATE_SIZE = 14;
+		private:
+			static void _updateSecond();
+			static __thread struct timespec _now;
+			static __thread time_t _second;
+			static __thread struct tm _localTime;
+			static __thread char _date[DATE_SIZE + 1];
+		};
+
+		// one character name of the level in the prefixes
+		const char *levelName(const int level);
+
+		// Runtime level of a log tag, the messages of the levels above it are skipped by Log::L with one load.
+		// The tag levels are static objects of the log systems, they are registered before main
+		class TagLevel
+		{
+		public:
+			TagLevel(const char *tag, const int level = FL_LOG_RUNTIME_LEVEL);
+			bool enabled(const int level) const
+			{
+				return level <= _level.load(std::memory_order_relaxed);
+			}
+			int get() const
+			{
+				return _level.load(std::memory_order_relaxed);
+			}
+			void set(const int level)
+			{
+				_level.store(level, std::memory_order_relaxed);
+			}
+			const char *tag() const
+			{
+				return _tag;
+			}
+			// sets the level of the tag, returns false if there is no such tag
+			static bool set(const char *tag, const int level);
+			static void setAll(const int level);
+			// "tag=level,tag=level", a level is a number or FATAL, ERROR, WARNING, INFO, the tag "*" is all tags
+			static bool configure(const char *levels);
+		private:
+			const char *_tag;
+			std::atomic<int> _level;
+			TagLevel *_next;
+			static TagLevel *_first;
+		};
+
+		// Limits the messages of a call site to perSecond, see FL_LOG_RATE_LIMITED
+		class RateLimiter
+		{
+		public:
+			constexpr RateLimiter(const uint32_t perSecond)
+				: _perSecond(perSecond), _second(0), _count(0), _suppressed(0)
+			{
+			}
+			// returns true if the message can be logged, suppressed is the count of the messages skipped
+			// since the previous allowed one
+			bool allow(uint32_t &suppressed)
+			{
+				time_t now = time(NULL);
+				time_t second = _second.load(std::memory_order_relaxed);
+				if ((second != now) && _second.compare_exchange_strong(second, now, std::memory_order_relaxed))
+					_count.store(0, std::memory_order_relaxed);
+				if (_count.fetch_add(1, std::memory_order_relaxed) < _perSecond) {
+					suppressed = _suppressed.exchange(0, std::memory_order_relaxed);
+					return true;
+				}
+				_suppressed.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+		private:
+			const uint32_t _perSecond;
+			std::atomic<time_t> _second;
+			std::atomic<uint32_t> _count;
+			std::atomic<uint32_t> _suppressed;
+		};
+
+		// Probabilistic sampling of the log calls with a random generator of the thread
+		class LogSampler
+		{
+		public:
+			// returns true with the probability from 0 to 1
+			static bool sample(const double probability)
+			{
+				if (!_random)
+					_seed();
+				_random ^= _random << 13;
+				_random ^= _random >> 7;
+				_random ^= _random << 17;
+				return (_random >> 11) * (1.0 / (UINT64_C(1) << 53)) < probability;
+			}
+		private:
+			static void _seed();
+			static __thread uint64_t _random;
+		};
+
+		namespace ETimePrecision {
+			enum ETimePrecision
+			{
+				SECONDS,
+				MILLISECONDS,
+				MICROSECONDS,
+			};
+		};
+
 		class Target
 		{
 		public:
+			Target()
+				: _timePrecision(ETimePrecision::SECONDS)
+			{
+			}
+			// fraction of the second in the prefixes, it is taken from the time of the Log::L call
+			void setTimePrecision(const ETimePrecision::ETimePrecision timePrecision)
+			{
+				_timePrecision = timePrecision;
+			}
 			virtual void log(
 				const int level, 
 				const char *tag, 
@@ -57,14 +208,31 @@ namespace fl {
 				const char *fmt, 
 				va_list args
 			) = 0;
+			// writes the buffered messages
+			virtual void flush()
+			{
+			}
 			virtual ~Target() {};
 		protected:
+			static const size_t MAX_PREFIX_SIZE = 512;
+			// "[tag/pid/dd.mm HH:MM:SS/L] " into buf of MAX_PREFIX_SIZE bytes, returns the length. The date of
+			// the thread LogTime is copied if curTime is its time, it is formatted from ct otherwise
+			size_t _prefix(char *buf, const int level, const char *tag, const time_t curTime, struct tm *ct) const;
+			// "[tag:fileName:lineNumber/pid/dd.mm HH:MM:SS/L] "
+			size_t _prefix(char *buf, const int level, const char *fileName, const int lineNumber, const char *tag,
+				const time_t curTime, struct tm *ct) const;
+
 			struct ProcessInfo
 			{
 				ProcessInfo();
 				pid_t pid;
+				char pidStr[16];
+				size_t pidSize;
 			};
 			static ProcessInfo _process;
+		private:
+			size_t _addTime(char *buf, const time_t curTime, struct tm *ct) const;
+			ETimePrecision::ETimePrecision _timePrecision;
 		};
 		
 		typedef std::vector<Target*> TTargetList;
@@ -115,11 +283,16 @@ namespace fl {
 			);
 		};
 		
+		// Writes each message with one write call to the file opened with O_APPEND, see LogFile for the rotation
 		class FileTarget : public Target
 		{
 		public:
 			FileTarget(const char *fileName);
 			virtual ~FileTarget();
+			// see LogFile::setRotation
+			void setRotation(const uint64_t maxSize, const uint32_t intervalSeconds = 0, const uint32_t keepFiles = 0,
+				const bool compress = false);
+			void rotate();
 			virtual void log(
 				const int level, 
 				const char *tag, 
@@ -139,7 +312,10 @@ namespace fl {
 				va_list args
 			);
 		private:
-			FILE *_fd;
+			static const size_t BUFFER_SIZE = 4096; // the longer messages are formatted into the heap
+			void _write(char *buf, size_t size, const char *fmt, va_list args);
+			fl::threads::Mutex _sync;
+			LogFile _file;
 		};
 		
 		class LogSystem
@@ -181,6 +357,8 @@ namespace fl {
 			);
 			void addTarget(Target *target);
 			void clearTargets();
+			// flushes the asynchronous targets, it is called before the shutdown
+			void flush();
 			void setStdErrorOnly();
 			static LogSystem &defaultLog()
 			{
@@ -195,6 +373,7 @@ namespace fl {
 		{
 		public:
 			LibLogSystem();
+			static TagLevel tagLevel;
 			static bool log(
 				const size_t target, 
 				const int level, 
@@ -217,6 +396,28 @@ namespace fl {
 			};
 		};
 		
+		// runtime level check of the log systems with a static TagLevel tagLevel, the other ones log everything
+		template<class TLogSystem>
+		class TagLevelOf
+		{
+		public:
+			static bool enabled(const int level)
+			{
+				return _enabled<TLogSystem>(level, 0);
+			}
+		private:
+			template<class T>
+			static auto _enabled(const int level, int) -> decltype(T::tagLevel.enabled(level))
+			{
+				return T::tagLevel.enabled(level);
+			}
+			template<class T>
+			static bool _enabled(const int level, long)
+			{
+				return true;
+			}
+		};
+
 		template<bool needLogging, int level, class TLogSystem>
 		class Log
 		{
@@ -226,16 +427,21 @@ namespace fl {
 		class Log<true, level, TLogSystem>
 		{
 		public:
+			static inline bool enabled()
+			{
+				return TagLevelOf<TLogSystem>::enabled(level);
+			}
 			static inline void L(const char *fmt, ...)
 			{
-				time_t curTime = time(NULL);
-				struct tm *ct = localtime(&curTime);
+				if (!enabled())
+					return;
+				LogTime::update();
 				
 				va_list args;
 				for (int target = 0; ; target++)
 				{
 					va_start(args, fmt);
-					bool res = TLogSystem::log(target, level, curTime, ct, fmt, args);
+					bool res = TLogSystem::log(target, level, LogTime::seconds(), LogTime::localTime(), fmt, args);
 					va_end(args);
 					
 					if (!res)
@@ -248,6 +454,10 @@ namespace fl {
 		class Log<false, level, TLogSystem>
 		{
 		public:
+			static inline bool enabled()
+			{
+				return false;
+			}
 			static inline void L(const char *fmt, ...)
 			{
 				 
@@ -261,4 +471,26 @@ namespace fl {
 	};
 };
 
+// Logs at most perSecond messages per second of the call site, the count of the skipped messages is logged
+// before the next allowed message: FL_LOG_RATE_LIMITED(log::Error, 10, "accept error %d\n", errno)
+#define FL_LOG_RATE_LIMITED(TLog, perSecond, ...) \
+	do { \
+		if (TLog::enabled()) { \
+			static fl::log::RateLimiter _flLogRateLimiter(perSecond); \
+			uint32_t _flLogSuppressed; \
+			if (_flLogRateLimiter.allow(_flLogSuppressed)) { \
+				if (_flLogSuppressed) \
+					TLog::L("%u messages of %s:%d were suppressed\n", _flLogSuppressed, __FILE__, __LINE__); \
+				TLog::L(__VA_ARGS__); \
+			} \
+		} \
+	} while (0)
+
+// Logs the message with the probability from 0 to 1: FL_LOG_SAMPLED(log::Info, 0.01, "q: [%s]\n", query)
+#define FL_LOG_SAMPLED(TLog, probability, ...) \
+	do { \
+		if (TLog::enabled() && fl::log::LogSampler::sample(probability)) \
+			TLog::L(__VA_ARGS__); \
+	} while (0)
+
 #endif //__FL_LOG_HPP__
@@ -0,0 +1,325 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Log file with rotation, reopen on SIGHUP and background compression
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#ifndef NO_ZLIB
+#include <zlib.h>
+#endif
+#include "log_file.hpp"
+#include "dir.hpp"
+
+using namespace fl::log;
+using fl::fs::Directory;
+
+std::atomic<uint32_t> LogFile::_reopenRequests(0);
+std::atomic<bool> LogFile::Archiver::_started(false);
+
+namespace
+{
+	bool fileExists(const std::string &fileName)
+	{
+		struct stat st;
+		return stat(fileName.c_str(), &st) == 0;
+	}
+
+	void sigHupHandler(int)
+	{
+		LogFile::reopenAll();
+	}
+};
+
+LogFile::LogFile(const char *fileName)
+	: _fileName(fileName), _fd(-1), _size(0), _maxSize(0), _intervalSeconds(0), _nextRotation(0), _keepFiles(0),
+	_compress(false), _rotateRequested(false), _reopened(_reopenRequests.load())
+{
+	if (!_open()) {
+		printf("Cannot open log file: %s\n", fileName);
+		throw Error("Cannot open log file");
+	}
+}
+
+LogFile::~LogFile()
+{
+	close(_fd);
+}
+
+void LogFile::setRotation(const uint64_t maxSize, const uint32_t intervalSeconds, const uint32_t keepFiles,
+	const bool compress)
+{
+	_maxSize = maxSize;
+	_intervalSeconds = intervalSeconds;
+	_nextRotation = intervalSeconds ? (time(NULL) / intervalSeconds + 1) * intervalSeconds : 0;
+	_keepFiles = keepFiles;
+	_compress = compress;
+}
+
+bool LogFile::_open()
+{
+	int fd = open(_fileName.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return false;
+	if (_fd >= 0)
+		close(_fd);
+	_fd = fd;
+	struct stat st;
+	_size = (fstat(_fd, &st) == 0) ? st.st_size : 0;
+	if (!_size && !_header.empty())
+		_writeAll(_header.c_str(), _header.size());
+	return true;
+}
+
+void LogFile::_switch(const size_t size)
+{
+	uint32_t reopenRequests = _reopenRequests.load(std::memory_order_relaxed);
+	if (_reopened != reopenRequests) {
+		_reopened = reopenRequests;
+		_open(); // the current file is kept if the log can't be opened
+	}
+	time_t now = time(NULL);
+	bool expired = _intervalSeconds && (now >= _nextRotation);
+	if (_rotateRequested || expired || (_maxSize && _size && (_size + size > _maxSize))) {
+		_rotateRequested = false;
+		if (expired)
+			_nextRotation = (now / _intervalSeconds + 1) * _intervalSeconds;
+		if (_size > _header.size()) // the files without messages aren't rotated
+			_rotate(now);
+	}
+}
+
+void LogFile::_rotate(const time_t now)
+{
+	struct tm ct;
+	localtime_r(&now, &ct);
+	char suffix[32];
+	strftime(suffix, sizeof(suffix), ".%Y%m%d-%H%M%S", &ct);
+	std::string stamped = _fileName + suffix;
+	std::string rotated = stamped;
+	for (int i = 1; fileExists(rotated) || fileExists(rotated + ".gz"); i++)
+		rotated = stamped + "." + std::to_string(i);
+	if (rename(_fileName.c_str(), rotated.c_str()))
+		return;
+	if (!_open()) // the renamed file is written till the log can be created
+		return;
+	if (_compress || _keepFiles)
+		Archiver::add(Archiver::Task{rotated, _fileName, _keepFiles, _compress});
+}
+
+void LogFile::_writeAll(const char *data, size_t size)
+{
+	while (size > 0) {
+		ssize_t res = ::write(_fd, data, size);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		_size += res;
+		data += res;
+		size -= res;
+	}
+}
+
+void LogFile::writeHeader(const char *data, const size_t size)
+{
+	_check(size);
+	_header.append(data, size);
+	_writeAll(data, size);
+}
+
+ssize_t LogFile::write(const char *data, const size_t size)
+{
+	_check(size);
+	uint64_t startSize = _size;
+	_writeAll(data, size);
+	if ((_size == startSize) && size)
+		return -1;
+	return _size - startSize;
+}
+
+ssize_t LogFile::writev(const struct iovec *iov, const int count)
+{
+	size_t total = 0;
+	for (int i = 0; i < count; i++)
+		total += iov[i].iov_len;
+	_check(total);
+	ssize_t res;
+	do {
+		res = ::writev(_fd, iov, count);
+	} while ((res < 0) && (errno == EINTR));
+	if (res > 0)
+		_size += res;
+	return res;
+}
+
+void LogFile::reopenOnSigHup()
+{
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = sigHupHandler;
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = SA_RESTART;
+	sigaction(SIGHUP, &action, NULL);
+}
+
+void LogFile::waitArchive()
+{
+	Archiver::wait();
+}
+
+bool LogFile::canCompress()
+{
+#ifdef NO_ZLIB
+	return false;
+#else
+	return true;
+#endif
+}
+
+LogFile::Archiver::Archiver()
+	: _busy(false)
+{
+	if (!create())
+		throw Error("Cannot create log archiver thread");
+}
+
+LogFile::Archiver &LogFile::Archiver::_archiver()
+{
+	static Archiver *archiver = new Archiver();
+	_started.store(true);
+	return *archiver;
+}
+
+void LogFile::Archiver::add(const Task &task)
+{
+	Archiver &archiver = _archiver();
+	archiver._sync.lock();
+	archiver._tasks.push_back(task);
+	archiver._sync.broadcastSignalToAll(); // the threads in wait share the signal with the archiver
+	archiver._sync.unLock();
+}
+
+void LogFile::Archiver::wait()
+{
+	if (!_started.load())
+		return;
+	Archiver &archiver = _archiver();
+	archiver._sync.lock();
+	while (!archiver._tasks.empty() || archiver._busy)
+		archiver._sync.wait();
+	archiver._sync.unLock();
+}
+
+void LogFile::Archiver::run()
+{
+	while (true) {
+		_sync.lock();
+		while (_tasks.empty())
+			_sync.wait();
+		Task task = _tasks.front();
+		_tasks.pop_front();
+		_busy = true;
+		_sync.unLock();
+
+		if (task.compress)
+			_compress(task.fileName);
+		if (task.keepFiles)
+			_removeOld(task.logName, task.keepFiles);
+
+		_sync.lock();
+		_busy = false;
+		if (_tasks.empty())
+			_sync.broadcastSignalToAll();
+		_sync.unLock();
+	}
+}
+
+bool LogFile::Archiver::_compress(const std::string &fileName)
+{
+#ifdef NO_ZLIB
+	return false;
+#else
+	int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	std::string gzName = fileName + ".gz";
+	gzFile gz = gzopen(gzName.c_str(), "wb");
+	if (!gz) {
+		close(fd);
+		return false;
+	}
+	static const size_t BUFFER_SIZE = 64 * 1024;
+	std::vector<char> buf(BUFFER_SIZE);
+	bool res = true;
+	while (true) {
+		ssize_t size = read(fd, &buf[0], buf.size());
+		if (size < 0) {
+			if (errno == EINTR)
+				continue;
+			res = false;
+			break;
+		}
+		if (size == 0)
+			break;
+		if (gzwrite(gz, &buf[0], size) != size) {
+			res = false;
+			break;
+		}
+	}
+	close(fd);
+	if (gzclose(gz) != Z_OK)
+		res = false;
+	unlink(res ? fileName.c_str() : gzName.c_str());
+	return res;
+#endif
+}
+
+void LogFile::Archiver::_removeOld(const std::string &logName, const uint32_t keepFiles)
+{
+	std::string::size_type slash = logName.rfind('/');
+	std::string dirName = (slash == std::string::npos) ? "" : logName.substr(0, slash + 1);
+	std::string prefix = ((slash == std::string::npos) ? logName : logName.substr(slash + 1)) + ".";
+	// the files of one second differ by the numbers, so they are ordered by their modification time
+	typedef std::pair<struct timespec, std::string> TRotatedFile;
+	std::vector<TRotatedFile> rotated;
+	try {
+		Directory dir(dirName.empty() ? "." : dirName.c_str());
+		while (dir.next()) {
+			const char *name = dir.name();
+			// the names of the rotated files start with the date
+			if (strncmp(name, prefix.c_str(), prefix.size()) || (name[prefix.size()] < '0')
+				|| (name[prefix.size()] > '9'))
+				continue;
+			std::string fileName = dirName + name;
+			struct stat st;
+			if (stat(fileName.c_str(), &st) == 0)
+				rotated.push_back(TRotatedFile(st.st_mtim, fileName));
+		}
+	} catch (Directory::Error &error) {
+		return;
+	}
+	if (rotated.size() <= keepFiles)
+		return;
+	std::sort(rotated.begin(), rotated.end(), [](const TRotatedFile &a, const TRotatedFile &b) {
+		if (a.first.tv_sec != b.first.tv_sec)
+			return a.first.tv_sec < b.first.tv_sec;
+		if (a.first.tv_nsec != b.first.tv_nsec)
+			return a.first.tv_nsec < b.first.tv_nsec;
+		return a.second < b.second;
+	});
+	for (size_t i = 0; i < rotated.size() - keepFiles; i++)
+		unlink(rotated[i].second.c_str());
+}
@@ -0,0 +1,133 @@
+#pragma once
+#ifndef __FL_LOG_FILE_HPP
+#define	__FL_LOG_FILE_HPP
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Log file with rotation, reopen on SIGHUP and background compression
+///////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <string>
+#include <sys/uio.h>
+#include "exception.hpp"
+#include "cond_mutex.hpp"
+#include "thread.hpp"
+
+namespace fl {
+	namespace log {
+		// File of a log target, it is opened with O_APPEND and each write is one system call. The file is rotated
+		// by its size or its age and it is reopened before the next write after reopenAll, e.g. from SIGHUP after
+		// an external rotation. The rotated files are renamed to "fileName.YYYYMMDD-HHMMSS", they are compressed
+		// and the oldest ones are removed by a background thread. The calls are serialized by the owner target
+		class LogFile
+		{
+		public:
+			class Error : public fl::exceptions::Error
+			{
+			public:
+				Error(const char *what)
+					: fl::exceptions::Error(what)
+				{
+				}
+			};
+			LogFile(const char *fileName);
+			~LogFile();
+			// rotates the file when a write would make it bigger than maxSize bytes and every intervalSeconds
+			// aligned to the epoch, 0 turns a limit off. keepFiles is the count of the rotated files which are
+			// kept, 0 keeps all of them. The files are compressed with gzip if compress is set and zlib is there
+			void setRotation(const uint64_t maxSize, const uint32_t intervalSeconds = 0, const uint32_t keepFiles = 0,
+				const bool compress = false);
+			// writes the data and starts each following file with it, e.g. the definitions of the binary log
+			void writeHeader(const char *data, const size_t size);
+			// returns the written size or -1 on errors
+			ssize_t write(const char *data, const size_t size);
+			ssize_t writev(const struct iovec *iov, const int count);
+			// rotates the file before the next write
+			void rotate()
+			{
+				_rotateRequested = true;
+			}
+			const std::string &fileName() const
+			{
+				return _fileName;
+			}
+			uint64_t size() const
+			{
+				return _size;
+			}
+
+			// the log files are reopened before their next writes, it is async signal safe
+			static void reopenAll()
+			{
+				_reopenRequests.fetch_add(1, std::memory_order_relaxed);
+			}
+			// sets the SIGHUP handler to reopenAll
+			static void reopenOnSigHup();
+			// waits for the compression and the removal of the rotated files
+			static void waitArchive();
+			static bool canCompress();
+		private:
+			void _check(const size_t size)
+			{
+				if ((_reopened != _reopenRequests.load(std::memory_order_relaxed)) || _rotateRequested
+					|| (_maxSize && _size && (_size + size > _maxSize))
+					|| (_intervalSeconds && (time(NULL) >= _nextRotation)))
+					_switch(size);
+			}
+			void _switch(const size_t size);
+			bool _open();
+			void _rotate(const time_t now);
+			void _writeAll(const char *data, size_t size);
+
+			class Archiver : public fl::threads::Thread
+			{
+			public:
+				struct Task
+				{
+					std::string fileName; // the rotated file
+					std::string logName; // the file of the log
+					uint32_t keepFiles;
+					bool compress;
+				};
+				static void add(const Task &task);
+				static void wait();
+			private:
+				Archiver();
+				virtual void run();
+				// the thread is started by the first rotation and it isn't stopped
+				static Archiver &_archiver();
+				static bool _compress(const std::string &fileName);
+				static void _removeOld(const std::string &logName, const uint32_t keepFiles);
+
+				fl::threads::CondMutex _sync; // signaled on new tasks and when the tasks are done
+				std::deque<Task> _tasks;
+				bool _busy;
+				static std::atomic<bool> _started;
+			};
+
+			std::string _fileName;
+			int _fd;
+			uint64_t _size;
+			uint64_t _maxSize;
+			uint32_t _intervalSeconds;
+			time_t _nextRotation;
+			uint32_t _keepFiles;
+			bool _compress;
+			bool _rotateRequested;
+			uint32_t _reopened;
+			std::string _header;
+
+			static std::atomic<uint32_t> _reopenRequests;
+		};
+	};
+};
+
+#endif	// __FL_LOG_FILE_HPP
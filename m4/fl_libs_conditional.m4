@@ -6,3 +6,5 @@ AM_CONDITIONAL(NEED_PHONENUMBER, test x$found_phonenumber = xyes)
 AM_CONDITIONAL(NEED_RABBITMQ, test x$found_rabbitmq = xyes)
 AC_CHECK_FUNC(lseek64, [], [CXXFLAGS+=' -DNO_LSEEK64'])
 AC_CHECK_HEADER(sys/prctl.h, [], [CXXFLAGS+=' -DNO_SYS_PRCTL'])
+AC_CHECK_HEADER(zlib.h, [AC_CHECK_LIB(z, gzopen, [LIBS+=' -lz'], [CXXFLAGS+=' -DNO_ZLIB'])],
+	[CXXFLAGS+=' -DNO_ZLIB'])
@@ -0,0 +1,101 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Huge page backed mmap region of fixed size chunks for buffer pools
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include "memory_region.hpp"
+
+using namespace fl::utils;
+
+const size_t MemoryRegion::HUGE_PAGE_SIZE;
+const size_t MemoryRegion::CHUNK_ALIGN;
+
+MemoryRegion::MemoryRegion(const size_t size, const size_t chunkSize, const bool hugePages)
+	: _map(NULL), _mapSize(0), _begin(NULL), _end(NULL), _pos(NULL),
+	_chunkSize((chunkSize + CHUNK_ALIGN - 1) & ~(CHUNK_ALIGN - 1)), _usedChunks(0), _freeChunks(NULL),
+	_remoteChunks(NULL), _hugePages(false)
+{
+	size_t regionSize = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+	if ((regionSize == 0) || (_chunkSize > regionSize))
+		throw Error("Bad memory region size");
+	// one more huge page to align the region, MAP_NORESERVE doesn't take the memory before the first touch
+	_mapSize = regionSize + HUGE_PAGE_SIZE;
+	void *map = mmap(NULL, _mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (map == MAP_FAILED)
+		throw Error("Cannot map memory region");
+	_map = static_cast<char*>(map);
+	_begin = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(_map) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+	_end = _begin + regionSize;
+	_pos = _begin;
+#ifdef MADV_HUGEPAGE
+	if (hugePages)
+		_hugePages = (madvise(_begin, regionSize, MADV_HUGEPAGE) == 0);
+#endif
+}
+
+MemoryRegion::~MemoryRegion()
+{
+	munmap(_map, _mapSize);
+}
+
+void *MemoryRegion::_getSlow()
+{
+	FreeChunk *chunk = _remoteChunks.exchange(NULL, std::memory_order_acquire);
+	if (chunk) {
+		_freeChunks = chunk->next;
+		for (FreeChunk *remote = _freeChunks; remote; remote = remote->next)
+			_usedChunks--; // the first one is given again
+		return chunk;
+	}
+	if (_pos + _chunkSize > _end)
+		return NULL;
+	void *data = _pos;
+	_pos += _chunkSize;
+	_usedChunks++;
+	return data;
+}
+
+void MemoryRegion::freeRemote(void *chunk)
+{
+	FreeChunk *freeChunk = static_cast<FreeChunk*>(chunk);
+	FreeChunk *head = _remoteChunks.load(std::memory_order_relaxed);
+	do {
+		freeChunk->next = head;
+	} while (!_remoteChunks.compare_exchange_weak(head, freeChunk, std::memory_order_release,
+		std::memory_order_relaxed));
+}
+
+bool MemoryRegion::usage(Usage &usage) const
+{
+	FILE *smaps = fopen("/proc/self/smaps", "r");
+	if (!smaps)
+		return false;
+	usage.rss = 0;
+	usage.hugePages = 0;
+	char line[512];
+	bool inRegion = false;
+	while (fgets(line, sizeof(line), smaps)) {
+		unsigned long start, end;
+		if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+			// the mapping can be merged with the neighbours if it has the same flags
+			inRegion = (start < reinterpret_cast<uintptr_t>(_end)) && (end > reinterpret_cast<uintptr_t>(_begin));
+			continue;
+		}
+		if (!inRegion)
+			continue;
+		size_t kb;
+		if (sscanf(line, "Rss: %zu kB", &kb) == 1)
+			usage.rss += kb * 1024;
+		else if (sscanf(line, "AnonHugePages: %zu kB", &kb) == 1)
+			usage.hugePages += kb * 1024;
+	}
+	fclose(smaps);
+	return true;
+}
@@ -0,0 +1,121 @@
+#pragma once
+#ifndef __FL_MEMORY_REGION_HPP
+#define	__FL_MEMORY_REGION_HPP
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Huge page backed mmap region of fixed size chunks for buffer pools
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include "exception.hpp"
+
+namespace fl {
+	namespace utils {
+		// Address space of the region is reserved by one mmap aligned to the huge page size and it is advised
+		// with MADV_HUGEPAGE, so a pool working set of many chunks is covered by a few TLB entries. Pages are taken
+		// by the first write to a chunk, a region which is used by one worker thread gets the memory of the NUMA node
+		// of the worker. get and free are for the owner thread, chunks are returned from other threads by freeRemote
+		class MemoryRegion
+		{
+		public:
+			class Error : public fl::exceptions::Error
+			{
+			public:
+				Error(const char *what)
+					: fl::exceptions::Error(what)
+				{
+				}
+			};
+			static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+			static const size_t CHUNK_ALIGN = 64;
+
+			// size is rounded up to the huge page size and chunkSize to CHUNK_ALIGN
+			MemoryRegion(const size_t size, const size_t chunkSize, const bool hugePages = true);
+			~MemoryRegion();
+			MemoryRegion(const MemoryRegion &) = delete;
+			MemoryRegion &operator=(const MemoryRegion &) = delete;
+
+			// returns NULL when all chunks are used
+			void *get()
+			{
+				if (_freeChunks) {
+					FreeChunk *chunk = _freeChunks;
+					_freeChunks = chunk->next;
+					_usedChunks++;
+					return chunk;
+				}
+				return _getSlow();
+			}
+			void free(void *chunk)
+			{
+				FreeChunk *freeChunk = static_cast<FreeChunk*>(chunk);
+				freeChunk->next = _freeChunks;
+				_freeChunks = freeChunk;
+				_usedChunks--;
+			}
+			// chunk freed out of the owner thread, it is taken back by get when the free list runs out
+			void freeRemote(void *chunk);
+			bool contains(const void *ptr) const
+			{
+				return (ptr >= _begin) && (ptr < _end);
+			}
+
+			size_t chunkSize() const
+			{
+				return _chunkSize;
+			}
+			size_t chunksCount() const
+			{
+				return (_end - _begin) / _chunkSize;
+			}
+			// chunks given by get and not returned to the owner yet
+			size_t usedChunks() const
+			{
+				return _usedChunks;
+			}
+			size_t size() const
+			{
+				return _end - _begin;
+			}
+			// false if MADV_HUGEPAGE was refused (transparent huge pages are disabled)
+			bool hugePages() const
+			{
+				return _hugePages;
+			}
+
+			struct Usage
+			{
+				size_t rss; // resident bytes of the region
+				size_t hugePages; // resident bytes in huge pages
+			};
+			// reads /proc/self/smaps, returns false if it is not available
+			bool usage(Usage &usage) const;
+		private:
+			struct FreeChunk
+			{
+				FreeChunk *next;
+			};
+			void *_getSlow();
+
+			char *_map;
+			size_t _mapSize;
+			char *_begin;
+			char *_end;
+			char *_pos; // chunks from _pos to _end were never used, their pages are not touched yet
+			size_t _chunkSize;
+			size_t _usedChunks;
+			FreeChunk *_freeChunks;
+			std::atomic<FreeChunk*> _remoteChunks;
+			bool _hugePages;
+		};
+	};
+};
+
+#endif	// __FL_MEMORY_REGION_HPP
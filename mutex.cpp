@@ -4,39 +4,274 @@
 // Distributed under BSD (3-Clause) License (See
 // accompanying file LICENSE)
 //
-// Description: Mutex primitive wrapper class
+// Description: Adaptive futex mutex and its contention profiler implementation
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include "mutex.hpp"
 
 using namespace fl::threads;
 
+namespace
+{
+	void futexWait(std::atomic<uint32_t> *futex, const uint32_t value)
+	{
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(futex), FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+	}
+
+	void futexWake(std::atomic<uint32_t> *futex, const int count)
+	{
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(futex), FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+	}
+
+	inline void cpuRelax()
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#endif
+	}
+
+	uint64_t nowNs()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+	}
+
+	// the lock holder can't release the lock while the waiter spins on the only cpu
+	const bool SPINNING = (sysconf(_SC_NPROCESSORS_ONLN) > 1);
+	const uint32_t MAX_SPINS = 1000;
+
+	struct Counter
+	{
+		std::atomic<uint64_t> waits;
+		std::atomic<uint64_t> sleeps;
+		std::atomic<uint64_t> waitNs;
+		std::atomic<uint64_t> maxWaitNs;
+	};
+
+	struct ThreadCounters
+	{
+		ThreadCounters()
+		{
+			for (size_t i = 0; i < MutexProfiler::MAX_NAMED_MUTEXES; i++) {
+				Counter &counter = counters[i];
+				counter.waits.store(0);
+				counter.sleeps.store(0);
+				counter.waitNs.store(0);
+				counter.maxWaitNs.store(0);
+			}
+		}
+		Counter counters[MutexProfiler::MAX_NAMED_MUTEXES];
+	};
+
+	// the names and the counters of all of the threads, it isn't destroyed as the threads can exit after
+	// the static destructors
+	struct Profiles
+	{
+		static Profiles &instance()
+		{
+			static Profiles *profiles = new Profiles();
+			return *profiles;
+		}
+		Mutex sync; // isn't named
+		std::vector<std::string> names; // by the ids from 1
+		std::vector<ThreadCounters*> threads;
+		ThreadCounters finished; // the counters of the finished threads
+	};
+
+	void addCounter(Counter &to, const Counter &from)
+	{
+		to.waits.fetch_add(from.waits.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		to.sleeps.fetch_add(from.sleeps.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		to.waitNs.fetch_add(from.waitNs.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		uint64_t maxWaitNs = from.maxWaitNs.load(std::memory_order_relaxed);
+		if (maxWaitNs > to.maxWaitNs.load(std::memory_order_relaxed))
+			to.maxWaitNs.store(maxWaitNs, std::memory_order_relaxed);
+	}
+
+	// the counters of the thread are created by its first profiled wait and they are moved to the finished
+	// ones at the exit of the thread
+	class ThreadProfile
+	{
+	public:
+		ThreadProfile()
+			: _counters(NULL)
+		{
+		}
+		~ThreadProfile()
+		{
+			if (!_counters)
+				return;
+			Profiles &profiles = Profiles::instance();
+			AutoMutex autoSync(&profiles.sync);
+			for (size_t i = 0; i < MutexProfiler::MAX_NAMED_MUTEXES; i++)
+				addCounter(profiles.finished.counters[i], _counters->counters[i]);
+			profiles.threads.erase(std::find(profiles.threads.begin(), profiles.threads.end(), _counters));
+			delete _counters;
+		}
+		ThreadCounters &counters()
+		{
+			if (!_counters) {
+				_counters = new ThreadCounters();
+				Profiles &profiles = Profiles::instance();
+				AutoMutex autoSync(&profiles.sync);
+				profiles.threads.push_back(_counters);
+			}
+			return *_counters;
+		}
+	private:
+		ThreadCounters *_counters;
+	};
+	thread_local ThreadProfile threadProfile;
+};
+
 Mutex::Mutex()
+	: _state(UNLOCKED), _spins(0), _profileId(0)
 {
-	pthread_mutex_init(&_mutex, NULL);
 }
 
-Mutex::~Mutex()
+Mutex::Mutex(const char *name)
+	: _state(UNLOCKED), _spins(0), _profileId(MutexProfiler::_register(name))
 {
-	pthread_mutex_destroy(&_mutex);
 }
 
-void Mutex::lock()
+Mutex::~Mutex()
 {
-	pthread_mutex_lock(&_mutex);
 }
 
-bool Mutex::tryLock()
+bool Mutex::_spin()
 {
-	if (pthread_mutex_trylock(&_mutex)) // mute busy
+	if (!SPINNING)
 		return false;
-	return true;
+	uint32_t spins = _spins.load(std::memory_order_relaxed);
+	uint32_t maxSpins = std::min(MAX_SPINS, spins * 2 + 10);
+	for (uint32_t spin = 0; spin < maxSpins; spin++) {
+		uint32_t state = _state.load(std::memory_order_relaxed);
+		if ((state == UNLOCKED) && _state.compare_exchange_weak(state, LOCKED, std::memory_order_acquire)) {
+			_spins.store(spins + (static_cast<int32_t>(spin) - static_cast<int32_t>(spins)) / 8,
+				std::memory_order_relaxed);
+			return true;
+		}
+		cpuRelax();
+	}
+	_spins.store(spins + (maxSpins - spins) / 8, std::memory_order_relaxed);
+	return false;
+}
+
+void Mutex::_lockContended()
+{
+	uint64_t start = (_profileId && MutexProfiler::enabled()) ? nowNs() : 0;
+	bool slept = false;
+	if (!_spin()) {
+		// the waiters keep the state CONTENDED, so the unlock wakes the next one of them
+		while (_state.exchange(CONTENDED, std::memory_order_acquire) != UNLOCKED) {
+			futexWait(&_state, CONTENDED);
+			slept = true;
+		}
+	}
+	if (start)
+		MutexProfiler::_record(_profileId, nowNs() - start, slept);
+}
+
+void Mutex::_wake()
+{
+	futexWake(&_state, 1);
+}
+
+std::atomic<bool> MutexProfiler::_enabled(false);
+
+uint16_t MutexProfiler::_register(const char *name)
+{
+	Profiles &profiles = Profiles::instance();
+	AutoMutex autoSync(&profiles.sync);
+	for (size_t i = 0; i < profiles.names.size(); i++) {
+		if (profiles.names[i] == name)
+			return i + 1;
+	}
+	if (profiles.names.size() + 1 >= MAX_NAMED_MUTEXES)
+		return 0;
+	profiles.names.push_back(name);
+	return profiles.names.size();
+}
+
+void MutexProfiler::_record(const uint16_t profileId, const uint64_t waitNs, const bool slept)
+{
+	Counter &counter = threadProfile.counters().counters[profileId];
+	counter.waits.fetch_add(1, std::memory_order_relaxed);
+	if (slept)
+		counter.sleeps.fetch_add(1, std::memory_order_relaxed);
+	counter.waitNs.fetch_add(waitNs, std::memory_order_relaxed);
+	if (waitNs > counter.maxWaitNs.load(std::memory_order_relaxed))
+		counter.maxWaitNs.store(waitNs, std::memory_order_relaxed);
+}
+
+MutexProfiler::TLockStatsVector MutexProfiler::report(const size_t top)
+{
+	Profiles &profiles = Profiles::instance();
+	AutoMutex autoSync(&profiles.sync);
+	ThreadCounters sum;
+	for (size_t i = 1; i <= profiles.names.size(); i++) {
+		addCounter(sum.counters[i], profiles.finished.counters[i]);
+		for (auto thread = profiles.threads.begin(); thread != profiles.threads.end(); thread++)
+			addCounter(sum.counters[i], (*thread)->counters[i]);
+	}
+	TLockStatsVector stats;
+	for (size_t i = 1; i <= profiles.names.size(); i++) {
+		const Counter &counter = sum.counters[i];
+		if (!counter.waits.load())
+			continue;
+		LockStats lockStats;
+		lockStats.name = profiles.names[i - 1];
+		lockStats.waits = counter.waits.load();
+		lockStats.sleeps = counter.sleeps.load();
+		lockStats.waitNs = counter.waitNs.load();
+		lockStats.maxWaitNs = counter.maxWaitNs.load();
+		stats.push_back(lockStats);
+	}
+	std::sort(stats.begin(), stats.end(), [](const LockStats &a, const LockStats &b) { return a.waitNs > b.waitNs; });
+	if (stats.size() > top)
+		stats.resize(top);
+	return stats;
+}
+
+std::string MutexProfiler::reportText(const size_t top)
+{
+	TLockStatsVector stats = report(top);
+	std::string text;
+	for (auto lockStats = stats.begin(); lockStats != stats.end(); lockStats++) {
+		char line[256];
+		snprintf(line, sizeof(line), "%s: %llu waits, %llu sleeps, %llu us total, %llu us max\n",
+			lockStats->name.c_str(), static_cast<unsigned long long>(lockStats->waits),
+			static_cast<unsigned long long>(lockStats->sleeps),
+			static_cast<unsigned long long>(lockStats->waitNs / 1000),
+			static_cast<unsigned long long>(lockStats->maxWaitNs / 1000));
+		text.append(line);
+	}
+	return text;
 }
 
-void Mutex::unLock()
+void MutexProfiler::reset()
 {
-	pthread_mutex_unlock(&_mutex);
+	Profiles &profiles = Profiles::instance();
+	AutoMutex autoSync(&profiles.sync);
+	std::vector<ThreadCounters*> counters(profiles.threads);
+	counters.push_back(&profiles.finished);
+	for (auto thread = counters.begin(); thread != counters.end(); thread++) {
+		for (size_t i = 0; i < MAX_NAMED_MUTEXES; i++) {
+			Counter &counter = (*thread)->counters[i];
+			counter.waits.store(0, std::memory_order_relaxed);
+			counter.sleeps.store(0, std::memory_order_relaxed);
+			counter.waitNs.store(0, std::memory_order_relaxed);
+			counter.maxWaitNs.store(0, std::memory_order_relaxed);
+		}
+	}
 }
 
 AutoMutex &AutoMutex::operator=(AutoMutex &&autoSync)
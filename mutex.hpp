@@ -8,17 +8,25 @@
 // Distributed under BSD (3-Clause) License (See
 // accompanying file LICENSE)
 //
-// Description: Mutex primitive wrapper class
+// Description: Adaptive futex mutex and its contention profiler
 ///////////////////////////////////////////////////////////////////////////////
 
-#include <pthread.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
 
 namespace fl {
 	namespace threads {
+		// Futex mutex which spins for a while before it sleeps, the spin count adapts to the time the lock
+		// has been held for. The uncontended lock and unlock are an atomic operation each. The waits of the
+		// named mutexes are counted by MutexProfiler
 		class Mutex
 		{
 		public:
 			Mutex();
+			// the mutexes with the same name are counted together, the name should be a literal
+			explicit Mutex(const char *name);
 			~Mutex();
 			Mutex(const Mutex&) = delete;
 			Mutex &operator=(const Mutex&) = delete;
@@ -26,11 +34,73 @@ namespace fl {
 			Mutex(const Mutex&&) = delete;
 			Mutex &operator=(Mutex&&) = delete;
 			
-			void lock();
-			bool tryLock();
-			void unLock();
+			void lock()
+			{
+				uint32_t state = UNLOCKED;
+				if (!_state.compare_exchange_strong(state, LOCKED, std::memory_order_acquire))
+					_lockContended();
+			}
+			bool tryLock()
+			{
+				uint32_t state = UNLOCKED;
+				return _state.compare_exchange_strong(state, LOCKED, std::memory_order_acquire);
+			}
+			void unLock()
+			{
+				if (_state.exchange(UNLOCKED, std::memory_order_release) == CONTENDED)
+					_wake();
+			}
+		private:
+			enum EState : uint32_t
+			{
+				UNLOCKED,
+				LOCKED,
+				CONTENDED, // locked and there can be sleeping threads
+			};
+			void _lockContended();
+			bool _spin();
+			void _wake();
+
+			std::atomic<uint32_t> _state;
+			std::atomic<uint16_t> _spins; // the average count of the spins of the successful spinning
+			uint16_t _profileId; // 0 is not profiled
+		};
+
+		// Counts the contended locks of the named mutexes when it is enabled. The counters are per thread, so
+		// the profiling doesn't add the contention of its own
+		class MutexProfiler
+		{
+		public:
+			struct LockStats
+			{
+				std::string name;
+				uint64_t waits; // the contended locks
+				uint64_t sleeps; // the waits on the futex after the spinning
+				uint64_t waitNs;
+				uint64_t maxWaitNs;
+			};
+			typedef std::vector<LockStats> TLockStatsVector;
+
+			static void enable(const bool enabled)
+			{
+				_enabled.store(enabled, std::memory_order_relaxed);
+			}
+			static bool enabled()
+			{
+				return _enabled.load(std::memory_order_relaxed);
+			}
+			// the top contended mutexes by the wait time
+			static TLockStatsVector report(const size_t top = 10);
+			// one line per mutex for the logs
+			static std::string reportText(const size_t top = 10);
+			static void reset();
+
+			static const uint16_t MAX_NAMED_MUTEXES = 256;
 		private:
-			pthread_mutex_t _mutex;
+			friend class Mutex;
+			static uint16_t _register(const char *name);
+			static void _record(const uint16_t profileId, const uint64_t waitNs, const bool slept);
+			static std::atomic<bool> _enabled;
 		};
 
 		class WeekAutoMutex
@@ -23,7 +23,7 @@ MysqlPool::MysqlPool(const size_t connectionCount, const std::string &dbHost, co
 		throw MysqlError("Connection pool can't be empty");
 	
 	for (size_t i = 0; i < connectionCount; i++) {
-		_syncs.push_back(new Mutex());
+		_syncs.push_back(new Mutex("MysqlPool::_syncs"));
 	}
 }
 
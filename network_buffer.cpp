@@ -9,13 +9,14 @@
 
 #include <cerrno>
 #include <sys/socket.h>
+#include <cstring>
 #include "network_buffer.hpp"
 
 using namespace fl::network;
 
 
 NetworkBuffer::NetworkBuffer(NetworkBuffer &&moveFrom)
-	: BString(std::move(moveFrom)), _sended(moveFrom._sended)
+	: BString(std::move(moveFrom)), _sended(moveFrom._sended), _pool(NULL), _depot(NULL), _next(NULL)
 {
 	moveFrom._sended = 0;
 }
@@ -74,21 +75,38 @@ NetworkBuffer::EResult NetworkBuffer::read(const TDescriptor descr, const TSize
 	return EResult::OK;
 }
 
-NetworkBuffer::EResult NetworkBuffer::read(const TDescriptor descr)
+NetworkBuffer::TSize NetworkBuffer::prepareRead()
 {
 	_sended = 0;
-	if (!_reserved) {
-		static TSize MIN_RESERVE = 32 * 1024;
+	if (_isInline()) {
+		static const TSize MIN_RESERVE = 32 * 1024;
 		reserve(MIN_RESERVE);
 	}
 	TSize chunkSize = _reserved;
 	if (_size) {
 		chunkSize -= _size;
-		if (chunkSize < (_reserved / 4))
-			chunkSize = _reserved; // double buf after using of 1/4
+		if (chunkSize < (_reserved / 4)) { // double buf after using of 1/4
+			if (_pool && _pool->promote(*this, _size + _reserved + 1))
+				chunkSize = _reserved - _size;
+			else
+				chunkSize = _reserved;
+		}
 	}
 	chunkSize--;
-	return _read(descr, chunkSize);
+	return chunkSize;
+}
+
+void NetworkBuffer::expand(const TSize minReserved)
+{
+	if (_reserved >= minReserved)
+		return;
+	if (!_pool || !_pool->promote(*this, minReserved))
+		reserve(minReserved);
+}
+
+NetworkBuffer::EResult NetworkBuffer::read(const TDescriptor descr)
+{
+	return _read(descr, prepareRead());
 }
 
 NetworkBuffer::EResult NetworkBuffer::_read(const TDescriptor descr, const TSize chunkSize)
@@ -109,31 +127,350 @@ NetworkBuffer::EResult NetworkBuffer::_read(const TDescriptor descr, const TSize
 		return ERROR;	
 }
 
+namespace
+{
+	// bigger classes keep the same amount of memory as the base class
+	uint32_t classLimit(const uint32_t limit, const int bufferSize, const NetworkBuffer::TSize size)
+	{
+		uint32_t classLimit = (size <= static_cast<NetworkBuffer::TSize>(bufferSize)) ? limit :
+			static_cast<uint64_t>(limit) * bufferSize / size;
+		return classLimit ? classLimit : 1;
+	}
+};
+
+NetworkBuffer::TSize NetworkBufferPool::classSize(const int bufferSize, const size_t sizeClass)
+{
+	static const NetworkBuffer::TSize MIN_CLASS_SIZE = 512;
+	static const uint32_t CLASS_SIZE_SCALE[CLASSES_COUNT][2] = { {1, 8}, {1, 1}, {8, 1}, {32, 1} }; // multiplier, divider
+	NetworkBuffer::TSize size = static_cast<NetworkBuffer::TSize>(bufferSize) * CLASS_SIZE_SCALE[sizeClass][0] 
+		/ CLASS_SIZE_SCALE[sizeClass][1];
+	return (size < MIN_CLASS_SIZE) ? MIN_CLASS_SIZE : size;
+}
+
 NetworkBufferPool::NetworkBufferPool(const int bufferSize, const uint32_t freeBuffersLimit)
-	: _bufferSize(bufferSize), _freeBuffersLimit(freeBuffersLimit)
+	: _depot(NULL)
+{
+	for (size_t i = 0; i < CLASSES_COUNT; i++) {
+		SizeClass &sizeClass = _classes[i];
+		NetworkBuffer::TSize size = classSize(bufferSize, i);
+		sizeClass.freeBuffersLimit = classLimit(freeBuffersLimit, bufferSize, size);
+		sizeClass.lowWater = 0;
+		memset(&sizeClass.stats, 0, sizeof(sizeClass.stats));
+		sizeClass.stats.size = size;
+	}
+}
+
+void NetworkBufferPool::setDepot(NetworkBufferDepot *depot)
 {
-	
+	for (size_t i = 0; i < CLASSES_COUNT; i++) {
+		if (depot->classSize(i) != _classes[i].stats.size)
+			throw BString::Error("Size classes of the depot differ from the pool ones");
+	}
+	_depot = depot;
+}
+
+void NetworkBufferPool::release(NetworkBuffer *buf)
+{
+	if (buf->_depot)
+		buf->_depot->freeRemote(buf);
+	else
+		delete buf;
 }
 
-NetworkBuffer *NetworkBufferPool::get()
+NetworkBufferPool::~NetworkBufferPool()
 {
-	if (_freeBuffers.empty())	{
-		return new NetworkBuffer(_bufferSize);
-	}	else {
-		NetworkBuffer *buf = _freeBuffers.back();
-		_freeBuffers.pop_back();
+	for (size_t i = 0; i < CLASSES_COUNT; i++) {
+		for (auto buf = _classes[i].freeBuffers.begin(); buf != _classes[i].freeBuffers.end(); buf++)
+			delete *buf;
+	}
+}
+
+int NetworkBufferPool::_classFor(const NetworkBuffer::TSize minReserved) const
+{
+	for (size_t i = 0; i < CLASSES_COUNT; i++) {
+		if (_classes[i].stats.size >= minReserved)
+			return i;
+	}
+	return -1;
+}
+
+int NetworkBufferPool::_classOf(const NetworkBuffer::TSize reserved) const
+{
+	if ((reserved < _classes[0].stats.size) || (reserved > 2 * _classes[CLASSES_COUNT - 1].stats.size))
+		return -1;
+	for (int i = CLASSES_COUNT - 1; i > 0; i--) {
+		if (_classes[i].stats.size <= reserved)
+			return i;
+	}
+	return 0;
+}
+
+NetworkBuffer *NetworkBufferPool::_get(const int sizeClassNumber)
+{
+	SizeClass &sizeClass = _classes[sizeClassNumber];
+	if (sizeClass.freeBuffers.empty() && (!_depot || !_refill(sizeClassNumber)))	{
+		sizeClass.stats.misses++;
+		NetworkBuffer *buf = new NetworkBuffer(sizeClass.stats.size);
+		buf->_pool = this;
+		buf->_depot = _depot;
 		return buf;
 	}
+	sizeClass.stats.hits++;
+	NetworkBuffer *buf = sizeClass.freeBuffers.back();
+	sizeClass.freeBuffers.pop_back();
+	sizeClass.stats.freeBuffers = sizeClass.freeBuffers.size();
+	sizeClass.stats.residentBytes -= buf->reserved();
+	if (sizeClass.lowWater > sizeClass.freeBuffers.size())
+		sizeClass.lowWater = sizeClass.freeBuffers.size();
+	return buf;
+}
+
+NetworkBuffer *NetworkBufferPool::get(const NetworkBuffer::TSize minReserved)
+{
+	int sizeClass = _classFor(minReserved);
+	if (sizeClass < 0) {
+		NetworkBuffer *buf = new NetworkBuffer(minReserved);
+		buf->_pool = this;
+		buf->_depot = _depot;
+		return buf;
+	}
+	return _get(sizeClass);
+}
+
+bool NetworkBufferPool::promote(NetworkBuffer &buf, const NetworkBuffer::TSize minReserved)
+{
+	int sizeClass = _classFor(minReserved);
+	if (sizeClass < 0)
+		return false;
+	_classes[sizeClass].stats.promotions++;
+	NetworkBuffer *spare = _get(sizeClass);
+	spare->add(buf.c_str(), buf.size());
+	spare->_sended = buf._sended;
+	buf = std::move(*spare); // swaps the storages
+	free(spare);
+	return true;
 }
 
 void NetworkBufferPool::free(NetworkBuffer *buf)
 {
-	if (_freeBuffers.size() < _freeBuffersLimit) {
-		buf->clear();
-		if (buf->reserved() != _bufferSize)
-			buf->reserve(_bufferSize);
-		_freeBuffers.push_back(buf);
-	} else {
+	int sizeClassNumber = _classOf(buf->reserved());
+	if (sizeClassNumber < 0) {
 		delete buf;
+		return;
+	}
+	SizeClass &sizeClass = _classes[sizeClassNumber];
+	if (sizeClass.freeBuffers.size() >= sizeClass.freeBuffersLimit) {
+		if (!_depot) {
+			delete buf;
+			return;
+		}
+		_putToDepot(sizeClassNumber);
+		if (sizeClass.freeBuffers.size() >= sizeClass.freeBuffersLimit) { // the depot is full
+			delete buf;
+			return;
+		}
 	}
+	buf->clear();
+	buf->_pool = this;
+	buf->_depot = _depot;
+	sizeClass.freeBuffers.push_back(buf);
+	sizeClass.stats.freeBuffers = sizeClass.freeBuffers.size();
+	sizeClass.stats.residentBytes += buf->reserved();
+}
+
+void NetworkBufferPool::_takeRemote(const int sizeClassNumber)
+{
+	NetworkBuffer *remote = _depot->takeRemote(sizeClassNumber);
+	while (remote) {
+		NetworkBuffer *next = remote->_next;
+		remote->_next = NULL;
+		_classes[sizeClassNumber].stats.remoteReturns++;
+		free(remote);
+		remote = next;
+	}
+}
+
+bool NetworkBufferPool::_refill(const int sizeClassNumber)
+{
+	SizeClass &sizeClass = _classes[sizeClassNumber];
+	_takeRemote(sizeClassNumber);
+	if (sizeClass.freeBuffers.empty()) {
+		NetworkBuffer *buffers[NetworkBufferDepot::MAGAZINE_SIZE];
+		uint32_t count = _depot->get(sizeClassNumber, buffers);
+		if (!count)
+			return false;
+		sizeClass.stats.depotGets++;
+		for (uint32_t i = 0; i < count; i++) {
+			buffers[i]->_pool = this;
+			sizeClass.freeBuffers.push_back(buffers[i]);
+			sizeClass.stats.residentBytes += buffers[i]->reserved();
+		}
+	}
+	sizeClass.stats.freeBuffers = sizeClass.freeBuffers.size();
+	return true;
+}
+
+void NetworkBufferPool::_putToDepot(const int sizeClassNumber)
+{
+	SizeClass &sizeClass = _classes[sizeClassNumber];
+	uint32_t count = (sizeClass.freeBuffers.size() < NetworkBufferDepot::MAGAZINE_SIZE) ? sizeClass.freeBuffers.size()
+		: NetworkBufferDepot::MAGAZINE_SIZE;
+	NetworkBuffer **buffers = &sizeClass.freeBuffers[sizeClass.freeBuffers.size() - count];
+	if (!count || !_depot->put(sizeClassNumber, buffers, count))
+		return;
+	sizeClass.stats.depotPuts++;
+	for (uint32_t i = 0; i < count; i++)
+		sizeClass.stats.residentBytes -= buffers[i]->reserved();
+	sizeClass.freeBuffers.resize(sizeClass.freeBuffers.size() - count);
+	if (sizeClass.lowWater > sizeClass.freeBuffers.size())
+		sizeClass.lowWater = sizeClass.freeBuffers.size();
+	sizeClass.stats.freeBuffers = sizeClass.freeBuffers.size();
+}
+
+size_t NetworkBufferPool::trim()
+{
+	size_t released = 0;
+	for (size_t i = 0; i < CLASSES_COUNT; i++) {
+		SizeClass &sizeClass = _classes[i];
+		if (_depot) // buffers freed by other threads are trimmed with the next call if they stay unused
+			_takeRemote(i);
+		// lowWater buffers weren't taken since the last trim
+		for (uint32_t j = 0; (j < sizeClass.lowWater) && !sizeClass.freeBuffers.empty(); j++) {
+			NetworkBuffer *buf = sizeClass.freeBuffers.back();
+			sizeClass.freeBuffers.pop_back();
+			sizeClass.stats.residentBytes -= buf->reserved();
+			delete buf;
+			sizeClass.stats.trimmed++;
+			released++;
+		}
+		sizeClass.lowWater = sizeClass.freeBuffers.size();
+		sizeClass.stats.freeBuffers = sizeClass.freeBuffers.size();
+	}
+	return released;
+}
+
+NetworkBufferDepot::NetworkBufferDepot(const int bufferSize, const uint32_t magazinesLimit)
+{
+	for (size_t i = 0; i < CLASSES_COUNT; i++) {
+		SizeClass &sizeClass = _classes[i];
+		sizeClass.size = NetworkBufferPool::classSize(bufferSize, i);
+		sizeClass.magazinesCount = classLimit(magazinesLimit, bufferSize, sizeClass.size);
+		sizeClass.magazines = new Magazine[sizeClass.magazinesCount];
+		sizeClass.loaded = 0;
+		sizeClass.empty = 0;
+		for (uint32_t j = 0; j < sizeClass.magazinesCount; j++) {
+			sizeClass.magazines[j].count = 0;
+			_push(sizeClass.empty, sizeClass.magazines, j);
+		}
+		sizeClass.remote = NULL;
+		sizeClass.stats.magazinesPut = 0;
+		sizeClass.stats.magazinesGot = 0;
+		sizeClass.stats.remoteFrees = 0;
+	}
+}
+
+NetworkBufferDepot::~NetworkBufferDepot()
+{
+	for (size_t i = 0; i < CLASSES_COUNT; i++) {
+		SizeClass &sizeClass = _classes[i];
+		uint32_t index;
+		while (_pop(sizeClass.loaded, sizeClass.magazines, index)) {
+			Magazine &magazine = sizeClass.magazines[index];
+			for (uint32_t j = 0; j < magazine.count; j++)
+				delete magazine.buffers[j];
+		}
+		delete[] sizeClass.magazines;
+		NetworkBuffer *remote = sizeClass.remote;
+		while (remote) {
+			NetworkBuffer *next = remote->_next;
+			delete remote;
+			remote = next;
+		}
+	}
+}
+
+bool NetworkBufferDepot::_pop(TMagazineStack &stack, Magazine *magazines, uint32_t &index)
+{
+	uint64_t head = stack.load(std::memory_order_acquire);
+	while (true) {
+		uint32_t top = static_cast<uint32_t>(head);
+		if (!top)
+			return false;
+		// the magazine can be popped and pushed by other threads here, the tag of the head fails the exchange then
+		uint64_t next = magazines[top - 1].next.load(std::memory_order_relaxed);
+		uint64_t newHead = (((head >> 32) + 1) << 32) | next;
+		if (stack.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire)) {
+			index = top - 1;
+			return true;
+		}
+	}
+}
+
+void NetworkBufferDepot::_push(TMagazineStack &stack, Magazine *magazines, const uint32_t index)
+{
+	uint64_t head = stack.load(std::memory_order_relaxed);
+	uint64_t newHead;
+	do {
+		magazines[index].next.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+		newHead = (((head >> 32) + 1) << 32) | (index + 1);
+	} while (!stack.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+}
+
+uint32_t NetworkBufferDepot::get(const size_t sizeClassNumber, NetworkBuffer **buffers)
+{
+	SizeClass &sizeClass = _classes[sizeClassNumber];
+	uint32_t index;
+	if (!_pop(sizeClass.loaded, sizeClass.magazines, index))
+		return 0;
+	Magazine &magazine = sizeClass.magazines[index];
+	uint32_t count = magazine.count;
+	memcpy(buffers, magazine.buffers, count * sizeof(NetworkBuffer*));
+	magazine.count = 0;
+	_push(sizeClass.empty, sizeClass.magazines, index);
+	sizeClass.stats.magazinesGot.fetch_add(1, std::memory_order_relaxed);
+	return count;
+}
+
+bool NetworkBufferDepot::put(const size_t sizeClassNumber, NetworkBuffer **buffers, const uint32_t count)
+{
+	SizeClass &sizeClass = _classes[sizeClassNumber];
+	uint32_t index;
+	if (!_pop(sizeClass.empty, sizeClass.magazines, index))
+		return false;
+	Magazine &magazine = sizeClass.magazines[index];
+	memcpy(magazine.buffers, buffers, count * sizeof(NetworkBuffer*));
+	magazine.count = count;
+	_push(sizeClass.loaded, sizeClass.magazines, index);
+	sizeClass.stats.magazinesPut.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+void NetworkBufferDepot::freeRemote(NetworkBuffer *buf)
+{
+	int sizeClassNumber = -1;
+	for (int i = CLASSES_COUNT - 1; i >= 0; i--) {
+		if (_classes[i].size <= buf->reserved()) {
+			sizeClassNumber = i;
+			break;
+		}
+	}
+	if ((sizeClassNumber < 0) || (buf->reserved() > 2 * _classes[CLASSES_COUNT - 1].size)) {
+		delete buf;
+		return;
+	}
+	SizeClass &sizeClass = _classes[sizeClassNumber];
+	sizeClass.stats.remoteFrees.fetch_add(1, std::memory_order_relaxed);
+	// the list is taken as a whole only, so the pushes have no ABA problem
+	NetworkBuffer *head = sizeClass.remote.load(std::memory_order_relaxed);
+	do {
+		buf->_next = head;
+	} while (!sizeClass.remote.compare_exchange_weak(head, buf, std::memory_order_release, std::memory_order_relaxed));
+}
+
+NetworkBuffer *NetworkBufferDepot::takeRemote(const size_t sizeClassNumber)
+{
+	SizeClass &sizeClass = _classes[sizeClassNumber];
+	if (!sizeClass.remote.load(std::memory_order_relaxed))
+		return NULL;
+	return sizeClass.remote.exchange(NULL, std::memory_order_acquire);
 }
@@ -13,6 +13,7 @@
 
 #include <cstdint>
 #include <vector>
+#include <atomic>
 #include "bstring.hpp"
 #include "socket.hpp"
 
@@ -22,7 +23,7 @@ namespace fl {
 		{
 		public:
 			NetworkBuffer(const TSize reserved = DEFAULT_RESERVED_SIZE)
-				: BString(reserved), _sended(0)
+				: BString(reserved), _sended(0), _pool(NULL), _depot(NULL), _next(NULL)
 			{
 			}
 			NetworkBuffer(NetworkBuffer &&moveFrom);
@@ -39,6 +40,7 @@ namespace fl {
 
 			EResult send(const TDescriptor descr);
 			EResult read(const TDescriptor descr);
+			TSize prepareRead();
 			EResult read(const TDescriptor descr, const TSize size);
 			void clear()
 			{
@@ -50,23 +52,136 @@ namespace fl {
 			{
 				return _sended;
 			}
+			// grows the buffer to at least minReserved, pooled buffers are grown through the pool size classes
+			void expand(const TSize minReserved);
 		protected:
+			friend class NetworkBufferPool;
+			friend class NetworkBufferDepot;
 			TSize _sended;
+			class NetworkBufferPool *_pool; // pool the buffer is taken from, used for the growth
+			class NetworkBufferDepot *_depot; // depot of the pool, the buffer is returned to it from other threads
+			NetworkBuffer *_next; // in the list of the buffers freed from other threads
 			EResult _read(const TDescriptor descr, const TSize chunkSize);
 		};
 		
+		// Per thread pool of network buffers with size classes of bufferSize / 8, bufferSize, bufferSize * 8
+		// and bufferSize * 32 (4K, 32K, 256K, 1M for default 32K buffers). Buffers are taken from the smallest class
+		// and promoted to the bigger classes while NetworkBuffer::read grows them. Free buffers which stay unused
+		// during a trim interval are released by trim()
 		class NetworkBufferPool
 		{
 		public:
+			static const size_t CLASSES_COUNT = 4;
 			NetworkBufferPool(const int bufferSize, const uint32_t freeBuffersLimit);
-			NetworkBuffer *get();
+			~NetworkBufferPool();
+			NetworkBuffer *get(const NetworkBuffer::TSize minReserved = 0);
 			void free(NetworkBuffer *buf);
+			bool promote(NetworkBuffer &buf, const NetworkBuffer::TSize minReserved);
+			size_t trim();
+			// the depot must be created with the same bufferSize, it is set before the first get
+			void setDepot(class NetworkBufferDepot *depot);
+			// frees the buffer from any thread, it goes to the depot of its pool or it is deleted without a depot
+			static void release(NetworkBuffer *buf);
+			static NetworkBuffer::TSize classSize(const int bufferSize, const size_t sizeClass);
+			
+			struct ClassStats
+			{
+				NetworkBuffer::TSize size;
+				uint64_t hits;
+				uint64_t misses;
+				uint64_t promotions;
+				uint64_t trimmed;
+				uint32_t freeBuffers;
+				uint64_t residentBytes;
+				uint64_t depotGets; // magazines taken from the depot
+				uint64_t depotPuts; // magazines given to the depot
+				uint64_t remoteReturns; // buffers freed by other threads and taken back from the depot
+			};
+			const ClassStats &stats(const size_t sizeClass) const
+			{
+				return _classes[sizeClass].stats;
+			}
 		private:
-			NetworkBuffer::TSize _bufferSize;
-			uint32_t _freeBuffersLimit;
+			int _classFor(const NetworkBuffer::TSize minReserved) const;
+			int _classOf(const NetworkBuffer::TSize reserved) const;
+			NetworkBuffer *_get(const int sizeClass);
+			bool _refill(const int sizeClass);
+			void _takeRemote(const int sizeClass);
+			void _putToDepot(const int sizeClass);
 			
 			typedef std::vector<NetworkBuffer*> TNetworkBufferVector;
-			TNetworkBufferVector _freeBuffers;
+			struct SizeClass
+			{
+				TNetworkBufferVector freeBuffers;
+				uint32_t freeBuffersLimit;
+				uint32_t lowWater; // minimum of free buffers since the last trim
+				ClassStats stats;
+			};
+			SizeClass _classes[CLASSES_COUNT];
+			class NetworkBufferDepot *_depot;
+		};
+
+		// Lock free depot of free buffers which is shared by the pools of all threads. Pools exchange magazines of up to
+		// MAGAZINE_SIZE buffers with the depot when their free lists overflow or run out instead of deleting and
+		// allocating the buffers, buffers released out of their pool threads are pushed to the remote lists of the
+		// depot and they are taken by the pools with the next magazine refill
+		class NetworkBufferDepot
+		{
+		public:
+			static const uint32_t MAGAZINE_SIZE = 16;
+			static const size_t CLASSES_COUNT = NetworkBufferPool::CLASSES_COUNT;
+			// magazinesLimit is for the base class, bigger classes keep the same amount of memory
+			NetworkBufferDepot(const int bufferSize, const uint32_t magazinesLimit = 64);
+			~NetworkBufferDepot();
+			NetworkBufferDepot(const NetworkBufferDepot &) = delete;
+			NetworkBufferDepot &operator=(const NetworkBufferDepot &) = delete;
+
+			// all calls are thread safe
+			// takes a loaded magazine into buffers, returns the count of the buffers or 0 if there are no magazines
+			uint32_t get(const size_t sizeClass, NetworkBuffer **buffers);
+			// returns false if there are no empty magazines, the buffers stay with the caller then
+			bool put(const size_t sizeClass, NetworkBuffer **buffers, const uint32_t count);
+			// buffer freed out of its pool thread
+			void freeRemote(NetworkBuffer *buf);
+			// takes all buffers of the class which were freed out of the pool threads
+			NetworkBuffer *takeRemote(const size_t sizeClass);
+
+			NetworkBuffer::TSize classSize(const size_t sizeClass) const
+			{
+				return _classes[sizeClass].size;
+			}
+			struct ClassStats
+			{
+				std::atomic<uint64_t> magazinesPut;
+				std::atomic<uint64_t> magazinesGot;
+				std::atomic<uint64_t> remoteFrees; // frees out of the pool threads
+			};
+			const ClassStats &stats(const size_t sizeClass) const
+			{
+				return _classes[sizeClass].stats;
+			}
+		private:
+			struct Magazine
+			{
+				std::atomic<uint32_t> next;
+				uint32_t count;
+				NetworkBuffer *buffers[MAGAZINE_SIZE];
+			};
+			// Treiber stack of magazine indexes, the head is (ABA tag << 32) | (index + 1), 0 is an empty stack
+			typedef std::atomic<uint64_t> TMagazineStack;
+			static bool _pop(TMagazineStack &stack, Magazine *magazines, uint32_t &index);
+			static void _push(TMagazineStack &stack, Magazine *magazines, const uint32_t index);
+			struct SizeClass
+			{
+				NetworkBuffer::TSize size;
+				uint32_t magazinesCount;
+				Magazine *magazines;
+				TMagazineStack loaded;
+				TMagazineStack empty;
+				std::atomic<NetworkBuffer*> remote;
+				ClassStats stats;
+			};
+			SizeClass _classes[CLASSES_COUNT];
 		};
 	};
 };
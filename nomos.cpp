@@ -10,6 +10,7 @@
 
 #include "nomos.hpp"
 #include "log.hpp"
+#include "format.hpp"
 
 using namespace fl::db;
 
@@ -32,7 +33,7 @@ bool Nomos::get(const std::string &level, const uint64_t subLevel, const uint64_
 	_connect();
 	
 	BString req;
-	req.sprintfSet("%s,G,%s,%llx,%llx,%u\n", VERSION.c_str(), level.c_str(), subLevel, key, lifeTime);
+	FL_FORMAT_SET(req, "{},G,{},{:x},{:x},{}\n", VERSION, level, subLevel, key, lifeTime);
 	if (!_conn.pollAndSendAll(req.c_str(), req.size(), _timeout)) {
 		log::Error::L("Nomos:get: can't send to %s:%u\n",  Socket::ip2String(_ip).c_str(), _port);
 		_conn.reset(INVALID_SOCKET);
@@ -91,29 +92,27 @@ void Nomos::_connect()
 }
 
 NomosPool::NomosPool(const size_t maxConnectionsPerServer, const uint32_t timeout)
-	: _maxConnectionsPerServer(maxConnectionsPerServer), _timeout(timeout)
+	: _maxConnectionsPerServer(maxConnectionsPerServer), _timeout(timeout), _servers(new TServerMap()),
+	_sync("NomosPool::_sync")
 {
 	
 }
 
 NomosPool::~NomosPool()
 {
-	for (auto s = _servers.begin(); s != _servers.end(); s++)
-		delete s->second;
 }
 
 void NomosPool::addServer(const uint32_t serverId, const TIPv4 ip, const TPort16 port)
 {
 	AutoMutex autoSync(&_sync);
-	auto res = _servers.insert(TNomosVectorMap::value_type(serverId, (Server*)NULL));
-	if (!res.second) {
-		delete res.first->second;
-	}
-	res.first->second = new Server(serverId, ip, port, _timeout);
+	TServerMap *servers = new TServerMap(*_servers.get());
+	(*servers)[serverId] = TServerPtr(new Server(serverId, ip, port, _timeout));
+	_servers.update(servers);
 }
 
 NomosPool::TNomosPtr NomosPool::Server::get(size_t maxConnectionsPerServer)
 {
+	AutoMutex autoSync(&_sync);
 	for (auto s = _servers.begin(); s != _servers.end(); s++) {
 		if (s->unique()) {
 			return (*s);
@@ -129,14 +128,16 @@ NomosPool::TNomosPtr NomosPool::Server::get(size_t maxConnectionsPerServer)
 
 bool NomosPool::_findServers(const Prefered &prefered, TNomosPtrVector &servers)
 {
-	auto f = _servers.find(prefered.mainId);
-	if (f != _servers.end()) {
+	RcuReadLock readLock;
+	const TServerMap *serverMap = _servers.get();
+	auto f = serverMap->find(prefered.mainId);
+	if (f != serverMap->end()) {
 		auto server = f->second->get(_maxConnectionsPerServer);
 		if (server.get())
 			servers.push_back(server);
 	} 
-	f = _servers.find(prefered.backupId);
-	if (f != _servers.end()) {
+	f = serverMap->find(prefered.backupId);
+	if (f != serverMap->end()) {
 		auto server = f->second->get(_maxConnectionsPerServer);
 		if (server.get())
 			servers.push_back(server);
@@ -148,10 +149,8 @@ bool NomosPool::get(const std::string &level, const uint64_t subLevel, const uin
 	BString &data, const Prefered &prefered)
 {
 	TNomosPtrVector servers;
-	AutoMutex autoSync(&_sync);
 	if (!_findServers(prefered, servers))
 		return false;
-	autoSync.unLock();
 	
 	for (auto s = servers.begin(); s != servers.end(); s++) {
 		try 
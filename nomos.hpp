@@ -19,12 +19,15 @@
 
 #include "socket.hpp"
 #include "mutex.hpp"
+#include "rcu.hpp"
 
 namespace fl {
 	namespace db {
 		using namespace fl::network;
 		using fl::threads::Mutex;
 		using fl::threads::AutoMutex;
+		using fl::threads::RcuPtr;
+		using fl::threads::RcuReadLock;
 		
 		class Nomos
 		{
@@ -75,15 +78,19 @@ namespace fl {
 			struct Server
 			{
 				Server(const uint32_t serverId, const TIPv4 ip, const TPort16 port, const uint32_t timeout)
+					: _sync("NomosPool::Server::_sync")
 				{
 					_servers.push_back(TNomosPtr(new Nomos(serverId, ip, port, timeout)));
 				}
 				TNomosPtr get(size_t maxConnectionsPerServer);
+				Mutex _sync;
 				TNomosPtrVector _servers;
 			};
-			typedef std::map<uint32_t, Server*> TNomosVectorMap;
-			TNomosVectorMap _servers;
-			Mutex _sync;
+			typedef std::shared_ptr<Server> TServerPtr;
+			typedef std::map<uint32_t, TServerPtr> TServerMap;
+			// the readers look up the servers without locks, addServer publishes a changed copy of the map
+			RcuPtr<TServerMap> _servers;
+			Mutex _sync; // serializes the changes of _servers
 			
 			bool _findServers(const Prefered &prefered, TNomosPtrVector &servers);
 		};
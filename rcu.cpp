@@ -0,0 +1,170 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Read-copy-update pointers with epoch based reclamation implementation
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "rcu.hpp"
+
+using namespace fl::threads;
+
+namespace
+{
+	void futexWait(std::atomic<uint32_t> *futex, const uint32_t value, const struct timespec *timeout)
+	{
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(futex), FUTEX_WAIT_PRIVATE, value, timeout, NULL, 0);
+	}
+
+	void futexWake(std::atomic<uint32_t> *futex, const int count)
+	{
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(futex), FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+	}
+};
+
+// the slots of the threads and the retired objects, it isn't destroyed as the threads can exit after
+// the static destructors
+struct Rcu::Registry
+{
+	static Registry &instance()
+	{
+		static Registry *registry = new Registry();
+		return *registry;
+	}
+	Mutex sync;
+	std::vector<ThreadSlot*> slots;
+	std::vector<Retired> retired;
+};
+
+std::atomic<uint64_t> Rcu::_epoch(1);
+std::atomic<size_t> Rcu::_pending(0);
+std::atomic<uint32_t> Rcu::_synchronizeWaiters(0);
+std::atomic<uint32_t> Rcu::_synchronizeFutex(0);
+thread_local Rcu::ThreadSlotHolder Rcu::_holder;
+__thread Rcu::ThreadSlot *Rcu::_threadSlot = NULL;
+
+Rcu::ThreadSlotHolder::ThreadSlotHolder()
+{
+	Registry &registry = Registry::instance();
+	AutoMutex autoSync(&registry.sync);
+	registry.slots.push_back(&slot);
+}
+
+Rcu::ThreadSlotHolder::~ThreadSlotHolder()
+{
+	Registry &registry = Registry::instance();
+	AutoMutex autoSync(&registry.sync);
+	registry.slots.erase(std::find(registry.slots.begin(), registry.slots.end(), &slot));
+	_threadSlot = NULL;
+	_wakeSynchronize();
+}
+
+void Rcu::registerThread()
+{
+	ThreadSlot &slot = _slot();
+	slot.registered = true;
+	_enter(slot);
+}
+
+void Rcu::unregisterThread()
+{
+	ThreadSlot &slot = _slot();
+	slot.registered = false;
+	slot.nesting = 0;
+	slot.epoch.store(0, std::memory_order_release);
+	_wakeSynchronize();
+}
+
+void Rcu::_wakeSynchronizeWaiters()
+{
+	_synchronizeFutex.fetch_add(1, std::memory_order_release);
+	futexWake(&_synchronizeFutex, INT_MAX);
+}
+
+uint64_t Rcu::_minEpoch()
+{
+	Registry &registry = Registry::instance();
+	uint64_t minEpoch = UINT64_MAX;
+	for (auto slot = registry.slots.begin(); slot != registry.slots.end(); slot++) {
+		uint64_t epoch = (*slot)->epoch.load(std::memory_order_acquire);
+		if (epoch && (epoch < minEpoch))
+			minEpoch = epoch;
+	}
+	return minEpoch;
+}
+
+void Rcu::_retire(void *object, void (*deleter)(void *object))
+{
+	Retired retired;
+	retired.object = object;
+	retired.deleter = deleter;
+	// the readers which see the next epoch see the new pointer
+	retired.epoch = _epoch.fetch_add(1, std::memory_order_acq_rel);
+	Registry &registry = Registry::instance();
+	{
+		AutoMutex autoSync(&registry.sync);
+		registry.retired.push_back(retired);
+		_pending.fetch_add(1, std::memory_order_relaxed);
+	}
+	_reclaim(false);
+}
+
+void Rcu::_reclaim(const bool wait)
+{
+	Registry &registry = Registry::instance();
+	std::vector<Retired> freed;
+	AutoMutex autoSync;
+	if (wait)
+		autoSync.lock(&registry.sync);
+	else if (!autoSync.tryLock(&registry.sync))
+		return;
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	uint64_t minEpoch = _minEpoch();
+	auto kept = std::partition(registry.retired.begin(), registry.retired.end(),
+		[minEpoch](const Retired &retired) { return retired.epoch >= minEpoch; });
+	freed.assign(kept, registry.retired.end());
+	registry.retired.erase(kept, registry.retired.end());
+	autoSync.unLock();
+	// the deleters can retire the other objects
+	for (auto retired = freed.begin(); retired != freed.end(); retired++)
+		retired->deleter(retired->object);
+	_pending.fetch_sub(freed.size(), std::memory_order_relaxed);
+}
+
+void Rcu::synchronize()
+{
+	ThreadSlot &slot = _slot();
+	// the calling registered thread doesn't wait for itself
+	bool wasOnline = slot.registered && slot.epoch.load(std::memory_order_relaxed);
+	if (wasOnline)
+		offline();
+	uint64_t target = _epoch.fetch_add(1, std::memory_order_acq_rel);
+	Registry &registry = Registry::instance();
+	struct timespec timeout;
+	timeout.tv_sec = 0;
+	timeout.tv_nsec = SYNCHRONIZE_SLEEP_NS;
+	_synchronizeWaiters.fetch_add(1);
+	while (true) {
+		// the futex value is taken before the check, so a wake up after the check isn't lost
+		uint32_t futex = _synchronizeFutex.load(std::memory_order_acquire);
+		{
+			AutoMutex autoSync(&registry.sync);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (_minEpoch() > target)
+				break;
+		}
+		futexWait(&_synchronizeFutex, futex, &timeout);
+	}
+	_synchronizeWaiters.fetch_sub(1);
+	_reclaim(true);
+	if (wasOnline)
+		online();
+}
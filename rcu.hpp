@@ -0,0 +1,207 @@
+#pragma once
+#ifndef __FL_RCU_HPP
+#define	__FL_RCU_HPP
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Read-copy-update pointers with epoch based reclamation
+///////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "mutex.hpp"
+
+namespace fl {
+	namespace threads {
+		// Epoch based reclamation of the objects of RcuPtr. Each thread has its own epoch slot, so the readers
+		// don't share cache lines. The registered threads (the event and the worker threads) read without
+		// RcuReadLock and report their quiescent states from their loops, where they don't keep the pointers
+		// they have read. The other threads read under RcuReadLock. A retired object is deleted when all of the
+		// readers have passed a quiescent state or left their read sections after its retirement
+		class Rcu
+		{
+		public:
+			// the thread is online till offline, unregisterThread or its exit
+			static void registerThread();
+			static void unregisterThread();
+			// the registered thread doesn't keep the pointers it has read before, the retired objects are
+			// reclaimed from here from time to time
+			static void quiescent()
+			{
+				ThreadSlot &slot = _slot();
+				slot.epoch.store(_epoch.load(std::memory_order_acquire), std::memory_order_release);
+				_wakeSynchronize();
+				_reclaimPeriodically(slot);
+			}
+			// the registered thread doesn't read till online, e.g. while it sleeps in epoll_wait. The threads
+			// which only go offline and online reclaim the retired objects from online
+			static void offline()
+			{
+				_slot().epoch.store(0, std::memory_order_release);
+				_wakeSynchronize();
+			}
+			static void online()
+			{
+				ThreadSlot &slot = _slot();
+				_enter(slot);
+				_reclaimPeriodically(slot);
+			}
+			// the read section of a thread which isn't registered, the sections can be nested
+			static void readLock()
+			{
+				ThreadSlot &slot = _slot();
+				if (!slot.registered && !slot.nesting++)
+					_enter(slot);
+			}
+			static void readUnLock()
+			{
+				ThreadSlot &slot = _slot();
+				if (!slot.registered && !--slot.nesting) {
+					slot.epoch.store(0, std::memory_order_release);
+					_wakeSynchronize();
+				}
+			}
+			// deletes the object after the current readers
+			template <class T>
+			static void retire(T *object)
+			{
+				_retire(object, [](void *retired) { delete static_cast<T*>(retired); });
+			}
+			// waits for the current readers and deletes the objects retired before, it can't be called from a
+			// read section. The waiting thread sleeps on a futex and is woken by the readers which pass their
+			// quiescent states, it looks at the readers again after SYNCHRONIZE_SLEEP_NS if a wake up is missed
+			static void synchronize();
+			static const long SYNCHRONIZE_SLEEP_NS = 1000000;
+			// the retired objects which haven't been deleted yet
+			static size_t pending()
+			{
+				return _pending.load(std::memory_order_relaxed);
+			}
+		private:
+			static const uint32_t RECLAIM_PERIOD = 64;
+			struct alignas(64) ThreadSlot
+			{
+				ThreadSlot()
+					: epoch(0), nesting(0), quiescentCalls(0), registered(false)
+				{
+				}
+				std::atomic<uint64_t> epoch; // the global epoch seen by the online thread, 0 is offline
+				uint32_t nesting;
+				uint32_t quiescentCalls;
+				bool registered;
+			};
+			class ThreadSlotHolder
+			{
+			public:
+				ThreadSlotHolder();
+				~ThreadSlotHolder();
+				ThreadSlot slot;
+			};
+			struct Retired
+			{
+				void *object;
+				void (*deleter)(void *object);
+				uint64_t epoch;
+			};
+			struct Registry;
+
+			static ThreadSlot &_slot()
+			{
+				if (!_threadSlot)
+					_threadSlot = &_holder.slot;
+				return *_threadSlot;
+			}
+			static void _enter(ThreadSlot &slot)
+			{
+				slot.epoch.store(_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				// the writer either sees the slot or the reader sees the new pointer
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+			}
+			static void _reclaimPeriodically(ThreadSlot &slot)
+			{
+				if (_pending.load(std::memory_order_relaxed) && !(++slot.quiescentCalls % RECLAIM_PERIOD))
+					_reclaim(false);
+			}
+			// the readers don't order the check with their epochs, a missed wake up is taken by the timeout
+			static void _wakeSynchronize()
+			{
+				if (_synchronizeWaiters.load(std::memory_order_relaxed))
+					_wakeSynchronizeWaiters();
+			}
+			static void _wakeSynchronizeWaiters();
+			static void _retire(void *object, void (*deleter)(void *object));
+			// returns the minimal epoch of the online threads, the registry lock is held by the caller
+			static uint64_t _minEpoch();
+			static void _reclaim(const bool wait);
+
+			static std::atomic<uint64_t> _epoch;
+			static std::atomic<size_t> _pending;
+			static std::atomic<uint32_t> _synchronizeWaiters;
+			static std::atomic<uint32_t> _synchronizeFutex; // is moved by the readers to wake the waiters
+			// the holder unregisters the slot on the exit of the thread, so it needs thread_local. The slot
+			// is taken through the __thread pointer, which doesn't have the checks of the thread_local init
+			static thread_local ThreadSlotHolder _holder;
+			static __thread ThreadSlot *_threadSlot;
+		};
+
+		class RcuReadLock
+		{
+		public:
+			RcuReadLock()
+			{
+				Rcu::readLock();
+			}
+			~RcuReadLock()
+			{
+				Rcu::readUnLock();
+			}
+			RcuReadLock(const RcuReadLock &) = delete;
+			RcuReadLock &operator=(const RcuReadLock &) = delete;
+		};
+
+		// Pointer to a read-mostly object, e.g. a routing table. The readers get the current object without
+		// atomic read-modify-writes, the writers publish a changed copy and the old one is deleted by Rcu after
+		// its readers. The writers should be serialized by the owner
+		template <class T>
+		class RcuPtr
+		{
+		public:
+			RcuPtr(T *value = NULL)
+				: _value(value)
+			{
+			}
+			// there are no readers anymore
+			~RcuPtr()
+			{
+				delete _value.load(std::memory_order_relaxed);
+			}
+			RcuPtr(const RcuPtr &) = delete;
+			RcuPtr &operator=(const RcuPtr &) = delete;
+
+			// the object is valid till the end of the read section or the next quiescent state
+			const T *get() const
+			{
+				return _value.load(std::memory_order_acquire);
+			}
+			const T *operator->() const
+			{
+				return get();
+			}
+			void update(T *value)
+			{
+				T *old = _value.exchange(value, std::memory_order_acq_rel);
+				if (old)
+					Rcu::retire(old);
+			}
+		private:
+			std::atomic<T*> _value;
+		};
+	};
+};
+
+#endif	// __FL_RCU_HPP
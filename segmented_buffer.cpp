@@ -0,0 +1,337 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Network buffer of chained fixed size segments with readv / writev
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "segmented_buffer.hpp"
+
+using namespace fl::network;
+
+SegmentPool::SegmentPool(const uint32_t segmentSize, const uint32_t freeSegmentsLimit)
+	: _segmentSize(segmentSize), _freeSegmentsLimit(freeSegmentsLimit), _region(NULL)
+{
+}
+
+SegmentPool::~SegmentPool()
+{
+	for (auto segment = _freeSegments.begin(); segment != _freeSegments.end(); segment++)
+		_deallocate(*segment);
+}
+
+void SegmentPool::setRegion(MemoryRegion *region)
+{
+	if (region->chunkSize() < sizeof(Segment) + _segmentSize)
+		throw MemoryRegion::Error("Memory region chunks are smaller than segments");
+	_region = region;
+}
+
+void SegmentPool::_deallocate(Segment *segment)
+{
+	if (segment->region)
+		segment->region->free(segment);
+	else
+		::free(segment);
+}
+
+SegmentPool::Segment *SegmentPool::get()
+{
+	Segment *segment;
+	if (_freeSegments.empty()) {
+		MemoryRegion *region = _region;
+		segment = region ? static_cast<Segment*>(region->get()) : NULL;
+		if (!segment) {
+			region = NULL;
+			segment = static_cast<Segment*>(malloc(sizeof(Segment) + _segmentSize));
+			if (!segment)
+				throw std::bad_alloc();
+		}
+		segment->region = region;
+	} else {
+		segment = _freeSegments.back();
+		_freeSegments.pop_back();
+	}
+	segment->refs = 1;
+	segment->size = _segmentSize;
+	segment->pool = this;
+	return segment;
+}
+
+void SegmentPool::free(Segment *segment)
+{
+	if (_freeSegments.size() >= _freeSegmentsLimit)
+		_deallocate(segment);
+	else
+		_freeSegments.push_back(segment);
+}
+
+const size_t SegmentedBuffer::NPOS;
+
+SegmentedBuffer::SegmentedBuffer(SegmentPool *pool)
+	: _size(0), _pool(pool)
+{
+}
+
+SegmentedBuffer::~SegmentedBuffer()
+{
+	clear();
+}
+
+void SegmentedBuffer::clear()
+{
+	for (auto slice = _slices.begin(); slice != _slices.end(); slice++)
+		SegmentPool::release(slice->segment);
+	_slices.clear();
+	_size = 0;
+}
+
+void SegmentedBuffer::detachPool()
+{
+	for (auto slice = _slices.begin(); slice != _slices.end(); slice++) {
+		if (slice->segment->refs == 1)
+			slice->segment->pool = NULL;
+	}
+}
+
+bool SegmentedBuffer::_canWriteToLast() const
+{
+	if (_slices.empty())
+		return false;
+	const Slice &last = _slices.back();
+	// a shared segment can be appended by another buffer
+	return (last.segment->refs == 1) && (last.end < last.segment->size);
+}
+
+char *SegmentedBuffer::prepareWrite(uint32_t &available)
+{
+	if (!_canWriteToLast()) {
+		Slice slice = {_pool->get(), 0, 0};
+		_slices.push_back(slice);
+	}
+	Slice &last = _slices.back();
+	available = last.segment->size - last.end;
+	return last.segment->data() + last.end;
+}
+
+void SegmentedBuffer::commitWrite(const uint32_t size)
+{
+	Slice &last = _slices.back();
+	last.end += size;
+	_size += size;
+	if (last.begin == last.end) { // nothing was written to a new segment
+		SegmentPool::release(last.segment);
+		_slices.pop_back();
+	}
+}
+
+void SegmentedBuffer::add(const char *data, size_t size)
+{
+	while (size > 0) {
+		uint32_t available;
+		char *dst = prepareWrite(available);
+		if (available > size)
+			available = size;
+		memcpy(dst, data, available);
+		commitWrite(available);
+		data += available;
+		size -= available;
+	}
+}
+
+bool SegmentedBuffer::_locate(const size_t offset, size_t &slice, uint32_t &sliceOffset) const
+{
+	size_t passed = 0;
+	for (slice = 0; slice < _slices.size(); slice++) {
+		uint32_t sliceSize = _slices[slice].size();
+		if (offset < passed + sliceSize) {
+			sliceOffset = offset - passed;
+			return true;
+		}
+		passed += sliceSize;
+	}
+	return false;
+}
+
+void SegmentedBuffer::add(const SegmentedBuffer &from, size_t offset, size_t size)
+{
+	if (offset + size > from._size)
+		throw BString::Error("Slice is out of the segmented buffer");
+	size_t slice = 0;
+	uint32_t sliceOffset = 0;
+	if (!size || !from._locate(offset, slice, sliceOffset))
+		return;
+	for (; size > 0; slice++, sliceOffset = 0) {
+		const Slice &src = from._slices[slice];
+		Slice part = {src.segment, src.begin + sliceOffset, src.end};
+		if (part.size() > size)
+			part.end = part.begin + size;
+		SegmentPool::addRef(part.segment);
+		_slices.push_back(part);
+		_size += part.size();
+		size -= part.size();
+	}
+}
+
+void SegmentedBuffer::consume(size_t size)
+{
+	if (size > _size)
+		throw BString::Error("Try to consume more than the segmented buffer size");
+	_size -= size;
+	while (size > 0) {
+		Slice &first = _slices.front();
+		if (first.size() > size) {
+			first.begin += size;
+			return;
+		}
+		size -= first.size();
+		SegmentPool::release(first.segment);
+		_slices.pop_front();
+	}
+}
+
+SegmentedBuffer::EResult SegmentedBuffer::read(const TDescriptor descr, const size_t expected)
+{
+	static const int MAX_READ_SEGMENTS = 4;
+	struct iovec iov[MAX_READ_SEGMENTS];
+	int iovCount = 0;
+	size_t space = 0;
+	if (_canWriteToLast()) {
+		Slice &last = _slices.back();
+		iov[iovCount].iov_base = last.segment->data() + last.end;
+		iov[iovCount].iov_len = last.segment->size - last.end;
+		space += iov[iovCount].iov_len;
+		iovCount++;
+	}
+	size_t firstNew = _slices.size();
+	// the segments which can't be filled aren't taken from the pool
+	while ((iovCount < MAX_READ_SEGMENTS) && (!iovCount || !expected || (space < expected))) {
+		Slice slice = {_pool->get(), 0, 0};
+		_slices.push_back(slice);
+		iov[iovCount].iov_base = slice.segment->data();
+		iov[iovCount].iov_len = _pool->segmentSize();
+		space += iov[iovCount].iov_len;
+		iovCount++;
+	}
+	ssize_t res = readv(descr, iov, iovCount);
+	int saveErrno = errno;
+	size_t left = (res > 0) ? res : 0;
+	_size += left;
+	for (size_t i = _slices.size() - iovCount; i < _slices.size(); i++) {
+		Slice &slice = _slices[i];
+		uint32_t filled = (left < (slice.segment->size - slice.end)) ? left :
+			slice.segment->size - slice.end;
+		slice.end += filled;
+		left -= filled;
+	}
+	while ((_slices.size() > firstNew) && (_slices.back().size() == 0)) { // unused new segments
+		SegmentPool::release(_slices.back().segment);
+		_slices.pop_back();
+	}
+	if (res > 0)
+		return NetworkBuffer::OK;
+	else if (res == 0)
+		return NetworkBuffer::CONNECTION_CLOSE;
+	else if ((saveErrno == EAGAIN) || (saveErrno == EINTR))
+		return NetworkBuffer::IN_PROGRESS;
+	else
+		return NetworkBuffer::ERROR;
+}
+
+SegmentedBuffer::EResult SegmentedBuffer::send(const TDescriptor descr)
+{
+	static const size_t MAX_SEND_SEGMENTS = 64;
+	struct iovec iov[MAX_SEND_SEGMENTS];
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	while (_size > 0) {
+		size_t iovCount = 0;
+		for (auto slice = _slices.begin(); (slice != _slices.end()) && (iovCount < MAX_SEND_SEGMENTS); slice++) {
+			iov[iovCount].iov_base = slice->segment->data() + slice->begin;
+			iov[iovCount].iov_len = slice->size();
+			iovCount++;
+		}
+		msg.msg_iovlen = iovCount;
+		ssize_t res = sendmsg(descr, &msg, MSG_NOSIGNAL); // writev with MSG_NOSIGNAL
+		if (res <= 0) {
+			if ((errno == EAGAIN) || (errno == EINTR))
+				return NetworkBuffer::IN_PROGRESS;
+			else
+				return NetworkBuffer::ERROR;
+		}
+		consume(res);
+	}
+	return NetworkBuffer::OK;
+}
+
+const char *SegmentedBuffer::view(const size_t offset, const size_t size, BString &spill) const
+{
+	if (offset + size > _size)
+		throw BString::Error("View is out of the segmented buffer");
+	size_t slice = 0;
+	uint32_t sliceOffset = 0;
+	if (!size || !_locate(offset, slice, sliceOffset)) {
+		spill.clear();
+		return spill.c_str();
+	}
+	const Slice &first = _slices[slice];
+	if (first.size() - sliceOffset >= size)
+		return first.segment->data() + first.begin + sliceOffset;
+	spill.clear();
+	spill.reserve(size);
+	size_t left = size;
+	for (; left > 0; slice++, sliceOffset = 0) {
+		const Slice &part = _slices[slice];
+		uint32_t partSize = part.size() - sliceOffset;
+		if (partSize > left)
+			partSize = left;
+		spill.add(part.segment->data() + part.begin + sliceOffset, partSize);
+		left -= partSize;
+	}
+	return spill.c_str();
+}
+
+size_t SegmentedBuffer::find(const char ch, const size_t from) const
+{
+	size_t slice = 0;
+	uint32_t sliceOffset = 0;
+	if (!_locate(from, slice, sliceOffset))
+		return NPOS;
+	size_t position = from - sliceOffset;
+	for (; slice < _slices.size(); slice++, sliceOffset = 0) {
+		const Slice &part = _slices[slice];
+		const char *start = part.segment->data() + part.begin;
+		const char *found = static_cast<const char*>(memchr(start + sliceOffset, ch, part.size() - sliceOffset));
+		if (found)
+			return position + (found - start);
+		position += part.size();
+	}
+	return NPOS;
+}
+
+const char *SegmentedBuffer::front(uint32_t &size) const
+{
+	if (_slices.empty()) {
+		size = 0;
+		return NULL;
+	}
+	const Slice &first = _slices.front();
+	size = first.size();
+	return first.segment->data() + first.begin;
+}
+
+void SegmentedBuffer::copyTo(BString &to) const
+{
+	to.reserve(to.size() + _size);
+	for (auto slice = _slices.begin(); slice != _slices.end(); slice++)
+		to.add(slice->segment->data() + slice->begin, slice->size());
+}
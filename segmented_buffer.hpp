@@ -0,0 +1,154 @@
+#pragma once
+#ifndef __FL_SEGMENTED_BUFFER_HPP
+#define	__FL_SEGMENTED_BUFFER_HPP
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Network buffer of chained fixed size segments with readv / writev
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+#include "network_buffer.hpp"
+#include "memory_region.hpp"
+
+namespace fl {
+	namespace network {
+		using fl::strings::BString;
+		using fl::utils::MemoryRegion;
+
+		// Per thread pool of fixed size segments. Segments are reference counted without atomics to be shared
+		// by slices of SegmentedBuffers, so the buffers which share segments must be used by one thread
+		class SegmentPool
+		{
+		public:
+			static const uint32_t DEFAULT_SEGMENT_SIZE = 16 * 1024;
+			SegmentPool(const uint32_t segmentSize = DEFAULT_SEGMENT_SIZE, const uint32_t freeSegmentsLimit = 1024);
+			~SegmentPool();
+
+			struct Segment
+			{
+				uint32_t refs;
+				uint32_t size;
+				SegmentPool *pool; // NULL for detached segments
+				MemoryRegion *region; // region of the segment memory, NULL for the heap
+				char *data()
+				{
+					return reinterpret_cast<char*>(this + 1);
+				}
+			};
+			Segment *get();
+			void free(Segment *segment);
+			// segments are carved from the region while it has free chunks and from the heap after that,
+			// it is set before the first get and the region must outlive the pool and its detached segments
+			void setRegion(MemoryRegion *region);
+			uint32_t segmentSize() const
+			{
+				return _segmentSize;
+			}
+			size_t freeSegments() const
+			{
+				return _freeSegments.size();
+			}
+			static void addRef(Segment *segment)
+			{
+				segment->refs++;
+			}
+			static void release(Segment *segment)
+			{
+				if (--segment->refs > 0)
+					return;
+				if (segment->pool)
+					segment->pool->free(segment);
+				else if (segment->region)
+					segment->region->freeRemote(segment);
+				else
+					::free(segment);
+			}
+		private:
+			void _deallocate(Segment *segment);
+
+			uint32_t _segmentSize;
+			uint32_t _freeSegmentsLimit;
+			std::vector<Segment*> _freeSegments;
+			MemoryRegion *_region;
+		};
+
+		class SegmentedBuffer
+		{
+		public:
+			typedef NetworkBuffer::EResult EResult;
+			static const size_t NPOS = static_cast<size_t>(-1);
+
+			SegmentedBuffer(SegmentPool *pool);
+			~SegmentedBuffer();
+			SegmentedBuffer(const SegmentedBuffer &) = delete;
+			SegmentedBuffer &operator=(const SegmentedBuffer &) = delete;
+
+			size_t size() const
+			{
+				return _size;
+			}
+			bool empty() const
+			{
+				return _size == 0;
+			}
+			size_t segmentsCount() const
+			{
+				return _slices.size();
+			}
+			void clear();
+			// not shared segments are freed to the heap instead of the pool, it is used before the destruction
+			// of the buffer out of the pool thread
+			void detachPool();
+			void add(const char *data, size_t size);
+			// zero copy append of a part of another buffer, both buffers share the segments
+			void add(const SegmentedBuffer &from, size_t offset, size_t size);
+			// removes size bytes from the front, the segments are returned to the pool when they are not used
+			void consume(size_t size);
+
+			// free space at the end for direct writes (recv, SSL_read), it allocates a segment if needed
+			char *prepareWrite(uint32_t &available);
+			void commitWrite(const uint32_t size);
+			// one readv into the free space of the last segment and new segments, the new segments are limited by
+			// expected, the size of the rest of the data (e.g. Content-Length), if it is known
+			EResult read(const TDescriptor descr, const size_t expected = 0);
+			// writev of the whole buffer, the sent data is consumed
+			EResult send(const TDescriptor descr);
+
+			// returns a contiguous view of the range, the range is copied into spill only when it spans segments
+			const char *view(const size_t offset, const size_t size, BString &spill) const;
+			size_t find(const char ch, const size_t from = 0) const;
+			// the contiguous data of the first segment, NULL if the buffer is empty
+			const char *front(uint32_t &size) const;
+			void copyTo(BString &to) const;
+		private:
+			struct Slice
+			{
+				SegmentPool::Segment *segment;
+				uint32_t begin;
+				uint32_t end;
+				uint32_t size() const
+				{
+					return end - begin;
+				}
+			};
+			// the slice and the offset in it of the offset in the buffer
+			bool _locate(const size_t offset, size_t &slice, uint32_t &sliceOffset) const;
+			bool _canWriteToLast() const;
+
+			typedef std::deque<Slice> TSliceDeque;
+			TSliceDeque _slices;
+			size_t _size;
+			SegmentPool *_pool;
+		};
+	};
+};
+
+#endif	// __FL_SEGMENTED_BUFFER_HPP
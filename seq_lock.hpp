@@ -0,0 +1,85 @@
+#pragma once
+#ifndef __FL_SEQ_LOCK_HPP
+#define	__FL_SEQ_LOCK_HPP
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Sequence lock for the small snapshots
+///////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <sched.h>
+#include "mutex.hpp"
+
+namespace fl {
+	namespace threads {
+		// Keeps a copy of a small trivially copyable value, e.g. a limits config. The readers copy it without
+		// writing anything and retry when a write has been in progress, the writers are serialized by a mutex.
+		// The value is kept in atomic words, so the concurrent copies aren't data races
+		template <class T>
+		class SeqLock
+		{
+		public:
+			static_assert(std::is_trivially_copyable<T>::value, "SeqLock keeps trivially copyable values only");
+
+			SeqLock(const T &value = T())
+				: _sequence(0)
+			{
+				_write(value);
+			}
+			SeqLock(const SeqLock &) = delete;
+			SeqLock &operator=(const SeqLock &) = delete;
+
+			T load() const
+			{
+				uint64_t words[WORDS];
+				while (true) {
+					uint32_t sequence = _sequence.load(std::memory_order_acquire);
+					if (sequence & 1) {
+						sched_yield();
+						continue;
+					}
+					for (size_t i = 0; i < WORDS; i++)
+						words[i] = _words[i].load(std::memory_order_relaxed);
+					std::atomic_thread_fence(std::memory_order_acquire);
+					if (_sequence.load(std::memory_order_relaxed) == sequence)
+						break;
+				}
+				T value;
+				memcpy(&value, words, sizeof(value));
+				return value;
+			}
+			void store(const T &value)
+			{
+				AutoMutex autoSync(&_writeSync);
+				uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+				_sequence.store(sequence + 1, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_release);
+				_write(value);
+				_sequence.store(sequence + 2, std::memory_order_release);
+			}
+		private:
+			static const size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+			void _write(const T &value)
+			{
+				uint64_t words[WORDS] = {0};
+				memcpy(words, &value, sizeof(value));
+				for (size_t i = 0; i < WORDS; i++)
+					_words[i].store(words[i], std::memory_order_relaxed);
+			}
+
+			std::atomic<uint32_t> _sequence; // odd while a write is in progress
+			std::atomic<uint64_t> _words[WORDS];
+			Mutex _writeSync;
+		};
+	};
+};
+
+#endif	// __FL_SEQ_LOCK_HPP
@@ -0,0 +1,63 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Compact binary serialization on top of Buffer (varints, zigzag and optional field tags)
+///////////////////////////////////////////////////////////////////////////////
+
+#include "serialize.hpp"
+
+using namespace fl::utils;
+using namespace fl::utils::serialize;
+
+uint64_t fl::utils::serialize::getVarintTail(Buffer &buf, const uint8_t first)
+{
+	uint64_t value = first & 0x7F;
+	const uint8_t *start = buf.readPtr();
+	Buffer::TSize left = buf.writtenSize() - buf.readPos();
+	if (left > MAX_VARINT_SIZE - 1)
+		left = MAX_VARINT_SIZE - 1;
+	const uint8_t *pos = start;
+	for (uint32_t shift = 7; pos < start + left; shift += 7) {
+		uint8_t byte = *pos++;
+		value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			buf.skip(pos - start);
+			return value;
+		}
+	}
+	if (left < MAX_VARINT_SIZE - 1)
+		throw Buffer::Error("Read out of range");
+	throw Buffer::Error("Varint is too long");
+}
+
+Buffer::TSize fl::utils::serialize::getLength(Buffer &buf)
+{
+	uint64_t length = getVarint(buf);
+	if (length > (buf.writtenSize() - buf.readPos()))
+		throw Buffer::Error("Read out of range");
+	return length;
+}
+
+void fl::utils::serialize::skip(Buffer &buf, const uint8_t wireType)
+{
+	switch (wireType)
+	{
+		case WIRE_VARINT:
+			getVarint(buf);
+			break;
+		case WIRE_FIXED64:
+			buf.skip(sizeof(uint64_t));
+			break;
+		case WIRE_LENGTH:
+			buf.skip(getLength(buf));
+			break;
+		case WIRE_FIXED32:
+			buf.skip(sizeof(uint32_t));
+			break;
+		default:
+			throw Buffer::Error("Unknown wire type");
+	}
+}
@@ -0,0 +1,484 @@
+#pragma once
+#ifndef __FL_SERIALIZE_HPP
+#define	__FL_SERIALIZE_HPP
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Compact binary serialization on top of Buffer (varints, zigzag and optional field tags)
+///////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <vector>
+#include <type_traits>
+#include <utility>
+#include "buffer.hpp"
+
+// Structures are described by a template member which lists the fields with their tags:
+//
+// struct IndexRecord
+// {
+// 	uint64_t id;
+// 	std::string subject;
+// 	template <class TArchive> void fields(TArchive &ar)
+// 	{
+// 		ar(1, id)(2, subject);
+// 	}
+// };
+//
+// encode / decode write the fields in the listed order without tags. encodeTagged / decodeTagged prefix every field
+// with its tag and wire type and every structure with its size, decodeTagged skips unknown tags and keeps default
+// values of absent fields, so fields can be added to the end of the list and removed
+//
+// Encoding of values:
+// unsigned integers, enums and bool - LEB128 varint
+// signed integers - zigzag varint
+// float, double - 4 / 8 bytes as is
+// std::string, BString - varint size and the bytes
+// std::vector - varint count and the elements, vectors of floating point values, 1 byte integers and plain structures
+// without fields() are copied as one block
+// plain structures without fields() (trivially copyable) - their bytes as is
+
+namespace fl {
+	namespace utils {
+		namespace serialize {
+			using fl::strings::BString;
+
+			static const Buffer::TSize MAX_VARINT_SIZE = 10;
+
+			enum EWireType : uint8_t
+			{
+				WIRE_VARINT = 0,
+				WIRE_FIXED64 = 1,
+				WIRE_LENGTH = 2,
+				WIRE_FIXED32 = 5,
+			};
+
+			inline uint64_t zigzag(const int64_t value)
+			{
+				return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+			}
+			inline int64_t unzigzag(const uint64_t value)
+			{
+				return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+			}
+			inline Buffer::TSize varintSize(const uint64_t value)
+			{
+				return (64 - __builtin_clzll(value | 1) + 6) / 7;
+			}
+			inline uint8_t *writeVarint(uint8_t *pos, uint64_t value)
+			{
+				while (value >= 0x80) {
+					*pos++ = static_cast<uint8_t>(value) | 0x80;
+					value >>= 7;
+				}
+				*pos++ = static_cast<uint8_t>(value);
+				return pos;
+			}
+			inline void addVarint(Buffer &buf, const uint64_t value)
+			{
+				if (value < 0x80) {
+					buf.add<uint8_t>(value);
+					return;
+				}
+				Buffer::TSize size = varintSize(value);
+				writeVarint(buf.reserveBuffer(size), value);
+			}
+			// the rest of a varint which doesn't fit one byte
+			uint64_t getVarintTail(Buffer &buf, const uint8_t first);
+			inline uint64_t getVarint(Buffer &buf)
+			{
+				uint8_t first;
+				buf.get(first);
+				if (first < 0x80)
+					return first;
+				return getVarintTail(buf, first);
+			}
+			// reads a varint size which is checked against the unread data
+			Buffer::TSize getLength(Buffer &buf);
+			// skips a value of an unknown field
+			void skip(Buffer &buf, const uint8_t wireType);
+
+			// the detection of structures with fields()
+			class FieldsProbe
+			{
+			public:
+				template <class T> FieldsProbe &operator()(const uint32_t tag, T &value);
+			};
+			template <class T>
+			class HasFields
+			{
+				template <class U> static char _test(decltype(std::declval<U&>().fields(std::declval<FieldsProbe&>()))*);
+				template <class U> static long _test(...);
+			public:
+				static const bool value = (sizeof(_test<T>(0)) == sizeof(char));
+			};
+
+			enum EKind
+			{
+				KIND_UNSIGNED,
+				KIND_SIGNED,
+				KIND_FLOAT,
+				KIND_STRING,
+				KIND_VECTOR,
+				KIND_STRUCT,
+				KIND_POD,
+			};
+			template <class T, class Enable = void>
+			struct Kind
+			{
+				static const EKind value = HasFields<T>::value ? KIND_STRUCT : KIND_POD;
+			};
+			template <class T>
+			struct Kind<T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type>
+			{
+				static const EKind value = (std::is_signed<T>::value && !std::is_enum<T>::value) ? KIND_SIGNED
+					: KIND_UNSIGNED;
+			};
+			template <class T>
+			struct Kind<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+			{
+				static const EKind value = KIND_FLOAT;
+			};
+			template <>
+			struct Kind<std::string>
+			{
+				static const EKind value = KIND_STRING;
+			};
+			template <>
+			struct Kind<BString>
+			{
+				static const EKind value = KIND_STRING;
+			};
+			template <class T>
+			struct Kind<std::vector<T> >
+			{
+				static const EKind value = KIND_VECTOR;
+			};
+
+			template <class T>
+			struct WireType
+			{
+				static const EWireType value = ((Kind<T>::value == KIND_UNSIGNED) || (Kind<T>::value == KIND_SIGNED))
+					? WIRE_VARINT : (Kind<T>::value != KIND_FLOAT) ? WIRE_LENGTH
+					: (sizeof(T) == sizeof(uint32_t)) ? WIRE_FIXED32 : WIRE_FIXED64;
+			};
+
+			// elements which are copied as one block in vectors
+			template <class T>
+			struct IsBlock
+			{
+				static const bool value = (Kind<T>::value == KIND_FLOAT) || (Kind<T>::value == KIND_POD)
+					|| ((sizeof(T) == 1) && ((Kind<T>::value == KIND_UNSIGNED) || (Kind<T>::value == KIND_SIGNED)));
+			};
+
+			template <bool tagged> class Writer;
+			template <bool tagged> class Reader;
+
+			template <class T, EKind kind = Kind<T>::value>
+			struct Codec
+			{
+			};
+
+			template <class T>
+			struct Codec<T, KIND_UNSIGNED>
+			{
+				template <class TWriter> static void write(TWriter &writer, const T &value)
+				{
+					addVarint(writer.buffer(), static_cast<uint64_t>(value));
+				}
+				template <class TReader> static void read(TReader &reader, T &value)
+				{
+					value = static_cast<T>(getVarint(reader.buffer()));
+				}
+			};
+
+			template <class T>
+			struct Codec<T, KIND_SIGNED>
+			{
+				template <class TWriter> static void write(TWriter &writer, const T &value)
+				{
+					addVarint(writer.buffer(), zigzag(value));
+				}
+				template <class TReader> static void read(TReader &reader, T &value)
+				{
+					value = static_cast<T>(unzigzag(getVarint(reader.buffer())));
+				}
+			};
+
+			template <class T>
+			struct Codec<T, KIND_FLOAT>
+			{
+				template <class TWriter> static void write(TWriter &writer, const T &value)
+				{
+					writer.buffer().add(value);
+				}
+				template <class TReader> static void read(TReader &reader, T &value)
+				{
+					reader.buffer().get(value);
+				}
+			};
+
+			template <class T>
+			struct Codec<T, KIND_POD>
+			{
+				static_assert(std::is_trivially_copyable<T>::value, "Structures with pointers need fields()");
+				template <class TWriter> static void write(TWriter &writer, const T &value)
+				{
+					if (TWriter::TAGGED)
+						addVarint(writer.buffer(), sizeof(T));
+					writer.buffer().add(value);
+				}
+				template <class TReader> static void read(TReader &reader, T &value)
+				{
+					if (TReader::TAGGED && (getVarint(reader.buffer()) != sizeof(T)))
+						throw Buffer::Error("Wrong size of a plain structure");
+					reader.buffer().get(value);
+				}
+			};
+
+			template <class T>
+			struct Codec<T, KIND_STRING>
+			{
+				template <class TWriter> static void write(TWriter &writer, const T &value)
+				{
+					Buffer::TSize size = value.size();
+					uint8_t *pos = writeVarint(writer.buffer().reserveBuffer(varintSize(size) + size), size);
+					memcpy(pos, value.c_str(), size);
+				}
+				static void read(Buffer &buf, std::string &value)
+				{
+					Buffer::TSize size = getLength(buf);
+					value.assign(reinterpret_cast<char*>(buf.mapBuffer(size)), size);
+				}
+				static void read(Buffer &buf, BString &value)
+				{
+					Buffer::TSize size = getLength(buf);
+					value.clear();
+					value.add(reinterpret_cast<char*>(buf.mapBuffer(size)), size);
+				}
+				template <class TReader> static void read(TReader &reader, T &value)
+				{
+					read(reader.buffer(), value);
+				}
+			};
+
+			template <class T>
+			struct Codec<std::vector<T>, KIND_VECTOR>
+			{
+				template <class TWriter> static void write(TWriter &writer, const std::vector<T> &value)
+				{
+					size_t start = writer.beginLength();
+					addVarint(writer.buffer(), value.size());
+					_writeElements(writer, value, std::integral_constant<bool, IsBlock<T>::value>());
+					writer.endLength(start);
+				}
+				template <class TReader> static void read(TReader &reader, std::vector<T> &value)
+				{
+					Buffer::TSize end = reader.beginLength();
+					uint64_t count = getVarint(reader.buffer());
+					_readElements(reader, count, value, std::integral_constant<bool, IsBlock<T>::value>());
+					reader.endLength(end);
+				}
+			private:
+				template <class TWriter> static void _writeElements(TWriter &writer, const std::vector<T> &value,
+					std::true_type)
+				{
+					if (!value.empty())
+						writer.buffer().add(value.data(), value.size() * sizeof(T));
+				}
+				template <class TWriter> static void _writeElements(TWriter &writer, const std::vector<T> &value,
+					std::false_type)
+				{
+					for (auto element = value.begin(); element != value.end(); element++)
+						writer.write(*element);
+				}
+				template <class TReader> static void _readElements(TReader &reader, const uint64_t count,
+					std::vector<T> &value, std::true_type)
+				{
+					if (count > (reader.buffer().writtenSize() - reader.buffer().readPos()) / sizeof(T))
+						throw Buffer::Error("Read out of range");
+					value.resize(count);
+					if (count)
+						reader.buffer().get(value.data(), count * sizeof(T));
+				}
+				template <class TReader> static void _readElements(TReader &reader, const uint64_t count,
+					std::vector<T> &value, std::false_type)
+				{
+					// every element takes at least one byte
+					if (count > (reader.buffer().writtenSize() - reader.buffer().readPos()))
+						throw Buffer::Error("Read out of range");
+					value.resize(count);
+					for (auto element = value.begin(); element != value.end(); element++)
+						reader.read(*element);
+				}
+			};
+
+			template <class T>
+			struct Codec<T, KIND_STRUCT>
+			{
+				template <class TWriter> static void write(TWriter &writer, const T &value)
+				{
+					size_t start = writer.beginLength();
+					const_cast<T&>(value).fields(writer); // the writer doesn't change the fields
+					writer.endLength(start);
+				}
+				template <class TReader> static void read(TReader &reader, T &value)
+				{
+					reader.readStruct(value);
+				}
+			};
+
+			template <bool tagged>
+			class Writer
+			{
+			public:
+				static const bool TAGGED = tagged;
+				Writer(Buffer &buf)
+					: _buf(buf)
+				{
+				}
+				template <class T> Writer &operator()(const uint32_t tag, const T &value)
+				{
+					if (tagged)
+						addVarint(_buf, (static_cast<uint64_t>(tag) << 3) | WireType<T>::value);
+					write(value);
+					return *this;
+				}
+				template <class T> void write(const T &value)
+				{
+					Codec<T>::write(*this, value);
+				}
+				Buffer &buffer()
+				{
+					return _buf;
+				}
+				// size prefix of a tagged structure or vector, it takes 1 byte and it is expanded if needed
+				size_t beginLength()
+				{
+					if (!tagged)
+						return 0;
+					size_t start = _buf.writtenSize();
+					_buf.add<uint8_t>(0);
+					return start;
+				}
+				void endLength(const size_t start)
+				{
+					if (!tagged)
+						return;
+					Buffer::TSize length = _buf.writtenSize() - start - 1;
+					Buffer::TSize size = varintSize(length);
+					if (size > 1) {
+						_buf.reserveBuffer(size - 1);
+						memmove(_buf.begin() + start + size, _buf.begin() + start + 1, length);
+					}
+					writeVarint(_buf.begin() + start, length);
+				}
+			private:
+				Buffer &_buf;
+			};
+
+			template <bool tagged>
+			class Reader
+			{
+			public:
+				static const bool TAGGED = tagged;
+				Reader(Buffer &buf)
+					: _buf(buf), _tag(0), _wireType(0), _found(false)
+				{
+				}
+				template <class T> Reader &operator()(const uint32_t tag, T &value)
+				{
+					if (!tagged) {
+						read(value);
+					} else if (!_found && (tag == _tag)) {
+						if (_wireType != WireType<T>::value)
+							throw Buffer::Error("Wrong wire type of a field");
+						_found = true;
+						read(value);
+					}
+					return *this;
+				}
+				template <class T> void read(T &value)
+				{
+					Codec<T>::read(*this, value);
+				}
+				template <class T> void readStruct(T &value)
+				{
+					if (!tagged) {
+						value.fields(*this);
+						return;
+					}
+					Buffer::TSize end = beginLength();
+					uint32_t tag = _tag; // fields of a nested structure
+					uint8_t wireType = _wireType;
+					bool found = _found;
+					while (_buf.readPos() < end) {
+						uint64_t key = getVarint(_buf);
+						_tag = key >> 3;
+						_wireType = key & 0x7;
+						_found = false;
+						value.fields(*this);
+						if (!_found)
+							skip(_buf, _wireType);
+					}
+					_tag = tag;
+					_wireType = wireType;
+					_found = found;
+					endLength(end);
+				}
+				Buffer &buffer()
+				{
+					return _buf;
+				}
+				Buffer::TSize beginLength()
+				{
+					if (!tagged)
+						return 0;
+					Buffer::TSize length = getLength(_buf);
+					return _buf.readPos() + length;
+				}
+				void endLength(const Buffer::TSize end)
+				{
+					if (tagged && (_buf.readPos() != end))
+						throw Buffer::Error("Wrong size of a tagged value");
+				}
+			private:
+				Buffer &_buf;
+				uint32_t _tag;
+				uint8_t _wireType;
+				bool _found;
+			};
+
+			template <class T>
+			void encode(Buffer &buf, const T &value)
+			{
+				Writer<false> writer(buf);
+				writer.write(value);
+			}
+			template <class T>
+			void decode(Buffer &buf, T &value)
+			{
+				Reader<false> reader(buf);
+				reader.read(value);
+			}
+			template <class T>
+			void encodeTagged(Buffer &buf, const T &value)
+			{
+				Writer<true> writer(buf);
+				writer.write(value);
+			}
+			template <class T>
+			void decodeTagged(Buffer &buf, T &value)
+			{
+				Reader<true> reader(buf);
+				reader.read(value);
+			}
+		};
+	};
+};
+
+#endif	// __FL_SERIALIZE_HPP
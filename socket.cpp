@@ -257,7 +257,7 @@ bool Socket::pollReadHttpAnswer(BString &answer, const size_t timeout)
 				chunkSize = answer.reserved(); // double buffer size after using of 1/4
 		}
 		static const size_t HTTP_ANSWER_SIZE = 8 * 1024;
-		if (chunkSize <= 1)
+		if (chunkSize <= BString::INLINE_CAPACITY) // don't read by the inline buffer sized chunks
 			chunkSize = HTTP_ANSWER_SIZE;
 		else
 			chunkSize--;
@@ -0,0 +1,180 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Non-blocking TLS termination for the http events system
+///////////////////////////////////////////////////////////////////////////////
+
+#include <openssl/err.h>
+#include "ssl_http_event.hpp"
+#include "log.hpp"
+
+using namespace fl::events;
+
+SslHttpEvent::SslHttpEvent(const TEventDescriptor descr, const time_t timeOutTime, HttpEventInterface *interface, 
+	SSLServerContext *sslContext, const TIPv4 ip)
+	: HttpEvent(descr, timeOutTime, interface, ip), _ssl(sslContext->createSSL(descr)), _handshakeFinished(false),
+	_sslFailed(false), _sslWantWrite(false), _waitSwapped(false)
+{
+	if (!_ssl)
+		log::Error::L("SslHttpEvent: Cannot create SSL object\n");
+}
+
+SslHttpEvent::~SslHttpEvent()
+{
+	if (_descr != 0)
+		_shutdown();
+	if (_ssl) {
+		SSL_free(_ssl);
+		_ssl = NULL;
+	}
+}
+
+void SslHttpEvent::_shutdown()
+{
+	if (_ssl && _handshakeFinished && !_sslFailed) {
+		// send close_notify once and don't wait for the answer, the socket is non-blocking
+		SSL_shutdown(_ssl);
+	}
+}
+
+NetworkBuffer::EResult SslHttpEvent::_sslError(const int res)
+{
+	int err = SSL_get_error(_ssl, res);
+	switch (err) {
+		case SSL_ERROR_WANT_READ:
+			_sslWantWrite = false;
+			return NetworkBuffer::IN_PROGRESS;
+		case SSL_ERROR_WANT_WRITE:
+			_sslWantWrite = true;
+			return NetworkBuffer::IN_PROGRESS;
+		case SSL_ERROR_ZERO_RETURN:
+			return NetworkBuffer::CONNECTION_CLOSE;
+		default: // SSL_ERROR_SYSCALL, SSL_ERROR_SSL
+			_sslFailed = true;
+			ERR_clear_error();
+			return NetworkBuffer::ERROR;
+	}
+}
+
+NetworkBuffer::EResult SslHttpEvent::_recv()
+{
+	NetworkBuffer *buf = networkBuffer();
+	bool wasRead = false;
+	do {
+		auto chunkSize = buf->prepareRead();
+		char *data = buf->reserveBuffer(chunkSize);
+		int res = SSL_read(_ssl, data, chunkSize);
+		if (res > 0) {
+			buf->trim(buf->size() - (chunkSize - res));
+			wasRead = true;
+			continue;
+		}
+		buf->trim(buf->size() - chunkSize);
+		if (wasRead)
+			return NetworkBuffer::OK;
+		return _sslError(res);
+	} while (SSL_pending(_ssl) > 0); // decrypted data left in the SSL buffers won't wake up epoll
+	return NetworkBuffer::OK;
+}
+
+NetworkBuffer::EResult SslHttpEvent::_recvBody()
+{
+	SegmentedBuffer *body = segmentedBody();
+	bool wasRead = false;
+	do {
+		uint32_t available;
+		char *data = body->prepareWrite(available);
+		int res = SSL_read(_ssl, data, available);
+		if (res > 0) {
+			body->commitWrite(res);
+			wasRead = true;
+			continue;
+		}
+		body->commitWrite(0);
+		if (wasRead)
+			return NetworkBuffer::OK;
+		return _sslError(res);
+	} while (SSL_pending(_ssl) > 0);
+	return NetworkBuffer::OK;
+}
+
+NetworkBuffer::EResult SslHttpEvent::_send()
+{
+	NetworkBuffer *buf = networkBuffer();
+	while (buf->sended() < buf->size()) {
+		int res = SSL_write(_ssl, buf->c_str() + buf->sended(), buf->size() - buf->sended());
+		if (res <= 0)
+			return _sslError(res);
+		buf->setSended(buf->sended() + res);
+	}
+	return NetworkBuffer::OK;
+}
+
+bool SslHttpEvent::_setWaitInProgress(const bool sending)
+{
+	// a read can need a write and a write can need a read during renegotiation or a partial record
+	_waitSwapped = (_sslWantWrite != sending);
+	if (_sslWantWrite)
+		setWaitSend();
+	else if (sending)
+		setWaitRead();
+	else
+		return false;
+	return true;
+}
+
+SslHttpEvent::ECallResult SslHttpEvent::_handshake()
+{
+	int res = SSL_do_handshake(_ssl);
+	if (res == 1) {
+		_handshakeFinished = true;
+		setWaitRead();
+		if (!_thread->ctrl(this))
+			return FINISHED;
+		_updateTimeout();
+		// a client can send a request together with the last handshake message
+		return HttpEvent::call(E_INPUT);
+	}
+	int err = SSL_get_error(_ssl, res);
+	if (err == SSL_ERROR_WANT_READ) {
+		setWaitRead();
+	} else if (err == SSL_ERROR_WANT_WRITE) {
+		setWaitSend();
+	} else {
+		ERR_clear_error();
+		log::Warning::L("SslHttpEvent: Handshake error %d\n", err);
+		return FINISHED;
+	}
+	if (!_thread->ctrl(this))
+		return FINISHED;
+	return CHANGE;
+}
+
+const SslHttpEvent::ECallResult SslHttpEvent::call(const TEvents events)
+{
+	if (!_ssl)
+		return FINISHED;
+	if (_handshakeFinished) {
+		if (_waitSwapped && (events & (E_INPUT | E_OUTPUT))) {
+			// the socket is ready for the direction OpenSSL has asked for, the interrupted operation is repeated
+			// with the events of its own direction
+			_waitSwapped = false;
+			bool sending = (_events & E_INPUT);
+			if (sending)
+				setWaitSend();
+			else
+				setWaitRead();
+			if (!_thread->ctrl(this))
+				return FINISHED;
+			return HttpEvent::call((events & ~(E_INPUT | E_OUTPUT)) | (sending ? E_OUTPUT : E_INPUT));
+		}
+		return HttpEvent::call(events);
+	}
+	if (((events & E_HUP) == E_HUP) || ((events & E_ERROR) == E_ERROR))
+		return FINISHED;
+	return _handshake();
+}
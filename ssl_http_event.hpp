@@ -0,0 +1,65 @@
+#pragma once
+#ifndef __FL_SSL_HTTP_EVENT_HPP
+#define	__FL_SSL_HTTP_EVENT_HPP
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Non-blocking TLS termination for the http events system
+///////////////////////////////////////////////////////////////////////////////
+
+#include "http_event.hpp"
+#include "ssl_socket.hpp"
+
+namespace fl {
+	namespace events {
+		using fl::network::SSLServerContext;
+		
+		class SslHttpEvent : public HttpEvent
+		{
+		public:
+			SslHttpEvent(const TEventDescriptor descr, const time_t timeOutTime, HttpEventInterface *interface, 
+				SSLServerContext *sslContext, const TIPv4 ip);
+			virtual ~SslHttpEvent();
+			virtual const ECallResult call(const TEvents events);
+		protected:
+			virtual NetworkBuffer::EResult _recv();
+			virtual NetworkBuffer::EResult _send();
+			virtual NetworkBuffer::EResult _recvBody();
+			virtual bool _setWaitInProgress(const bool sending);
+			virtual void _shutdown();
+		private:
+			ECallResult _handshake();
+			NetworkBuffer::EResult _sslError(const int res);
+			SSL *_ssl;
+			bool _handshakeFinished;
+			bool _sslFailed; // a fatal error, SSL_shutdown mustn't be called after it
+			bool _sslWantWrite; // the direction OpenSSL has asked for on the last IN_PROGRESS
+			bool _waitSwapped; // a read waits for the output or a write waits for the input (renegotiation)
+		};
+		
+		template <class T>
+		class SslHttpEventFactory : public WorkEventFactory 
+		{
+		public:
+			SslHttpEventFactory(SSLServerContext *sslContext)
+				: _sslContext(sslContext)
+			{
+			}
+			virtual WorkEvent *create(const TEventDescriptor descr, const TIPv4 ip, const time_t timeOutTime, 
+				Socket *acceptSocket)
+			{
+				return new SslHttpEvent(descr, timeOutTime, new T(), _sslContext, ip);
+			}
+			virtual ~SslHttpEventFactory() {};
+		private:
+			SSLServerContext *_sslContext;
+		};
+	};
+};
+
+#endif	// __FL_SSL_HTTP_EVENT_HPP
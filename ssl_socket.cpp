@@ -19,11 +19,13 @@ using namespace fl::network;
 std::vector<std::mutex> SSLSocket::OpenSSL::_locks;
 
 void SSLSocket::OpenSSL::lockCallBack(int mode, int type, const char *file, int line) {
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
   if (mode & CRYPTO_LOCK) {
     _locks[type].lock();
   } else {
     _locks[type].unlock();
   }
+#endif
 }
 
 unsigned long SSLSocket::OpenSSL::currentThreadId(void) {
@@ -39,10 +41,13 @@ SSLSocket::OpenSSL::OpenSSL() {
 
   /* Ignore Broken Pipe signal */
   signal(SIGPIPE, SIG_IGN);
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+  // OpenSSL 1.1.0+ has its own thread safety, legacy callbacks are only needed for older versions
   std::vector<std::mutex> locks(CRYPTO_num_locks());
   _locks.swap(locks);
   CRYPTO_set_id_callback(currentThreadId);
   CRYPTO_set_locking_callback(lockCallBack);
+#endif
 }
 
 SSLSocket::OpenSSL SSLSocket::_openSSL;
@@ -192,3 +197,55 @@ bool SSLSocket::reopen() {
   close();
   return _socket.reopen();
 }
+
+SSLServerContext::SSLServerContext(const char *certFile, const char *keyFile,
+  const long sessionCacheSize, const long sessionTimeout)
+  : _ctx(nullptr)
+{
+  _ctx = SSL_CTX_new(SSLv23_server_method());
+  if (_ctx == nullptr) {
+    throw NetworkError("Cannot create SSL server context");
+  }
+  SSL_CTX_set_options(_ctx, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION
+    | SSL_OP_CIPHER_SERVER_PREFERENCE);
+  // NetworkBuffer can be reallocated between SSL_write retries and answers are sent chunk by chunk
+  SSL_CTX_set_mode(_ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER
+    | SSL_MODE_RELEASE_BUFFERS);
+  if (SSL_CTX_use_certificate_chain_file(_ctx, certFile) != 1) {
+    SSL_CTX_free(_ctx);
+    throw NetworkError("Cannot load SSL certificate");
+  }
+  if (SSL_CTX_use_PrivateKey_file(_ctx, keyFile, SSL_FILETYPE_PEM) != 1) {
+    SSL_CTX_free(_ctx);
+    throw NetworkError("Cannot load SSL private key");
+  }
+  if (SSL_CTX_check_private_key(_ctx) != 1) {
+    SSL_CTX_free(_ctx);
+    throw NetworkError("SSL private key does not match the certificate");
+  }
+  // session resumption: server side cache for session ids and stateless tickets (enabled by default)
+  static const unsigned char SESSION_ID_CONTEXT[] = "fl::SSLServerContext";
+  SSL_CTX_set_session_id_context(_ctx, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT) - 1);
+  SSL_CTX_set_session_cache_mode(_ctx, SSL_SESS_CACHE_SERVER);
+  SSL_CTX_sess_set_cache_size(_ctx, sessionCacheSize);
+  SSL_CTX_set_timeout(_ctx, sessionTimeout);
+}
+
+SSLServerContext::~SSLServerContext()
+{
+  SSL_CTX_free(_ctx);
+}
+
+SSL *SSLServerContext::createSSL(const TDescriptor descr)
+{
+  SSL *ssl = SSL_new(_ctx);
+  if (ssl == nullptr) {
+    return nullptr;
+  }
+  if (SSL_set_fd(ssl, descr) != 1) {
+    SSL_free(ssl);
+    return nullptr;
+  }
+  SSL_set_accept_state(ssl);
+  return ssl;
+}
@@ -48,6 +48,26 @@ namespace fl {
       };
       static OpenSSL _openSSL;
     };
+
+    class SSLServerContext {
+    public:
+      static const long DEFAULT_SESSION_CACHE_SIZE = 20 * 1024;
+      static const long DEFAULT_SESSION_TIMEOUT = 300; // seconds
+      SSLServerContext(const char *certFile, const char *keyFile,
+        const long sessionCacheSize = DEFAULT_SESSION_CACHE_SIZE,
+        const long sessionTimeout = DEFAULT_SESSION_TIMEOUT);
+      ~SSLServerContext();
+      SSLServerContext(const SSLServerContext &) = delete;
+      SSLServerContext &operator=(const SSLServerContext &) = delete;
+
+      SSL *createSSL(const TDescriptor descr);
+      SSL_CTX *ctx()
+      {
+        return _ctx;
+      }
+    private:
+      SSL_CTX *_ctx;
+    };
   }
 }
 
@@ -0,0 +1,126 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Arena allocator unit tests
+///////////////////////////////////////////////////////////////////////////////
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstring>
+#include "arena.hpp"
+#include "rapidxml/rapidxml.hpp"
+
+using namespace fl::utils;
+
+BOOST_AUTO_TEST_SUITE( ArenaTest )
+
+BOOST_AUTO_TEST_CASE( allocateTest )
+{
+	Arena arena(1024);
+	BOOST_REQUIRE_EQUAL(arena.reserved(), 0U);
+	char *c = static_cast<char*>(arena.allocate(1, 1));
+	uint64_t *value = static_cast<uint64_t*>(arena.allocate(sizeof(uint64_t), alignof(uint64_t)));
+	BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(value) % alignof(uint64_t), 0U);
+	BOOST_REQUIRE(reinterpret_cast<char*>(value) > c);
+	BOOST_REQUIRE_EQUAL(arena.reserved(), 1024U);
+	BOOST_REQUIRE_EQUAL(arena.allocated(), 1U + sizeof(uint64_t));
+
+	// a block over the block size
+	void *big = arena.allocate(4096);
+	memset(big, 0, 4096);
+	BOOST_REQUIRE(arena.reserved() > 1024U + 4096U);
+
+	const char *str = arena.strdup("text", 4);
+	BOOST_REQUIRE(!strcmp(str, "text"));
+	std::pair<int, int> *pair = arena.create<std::pair<int, int>>(1, 2);
+	BOOST_REQUIRE_EQUAL(pair->second, 2);
+}
+
+BOOST_AUTO_TEST_CASE( resetTest )
+{
+	Arena arena(1024, 4096);
+	for (int i = 0; i < 3; i++)
+		arena.allocate(1000);
+	size_t reserved = arena.reserved();
+	arena.reset();
+	BOOST_REQUIRE_EQUAL(arena.allocated(), 0U);
+	BOOST_REQUIRE_EQUAL(arena.reserved(), reserved); // the blocks are kept for the next request
+	for (int i = 0; i < 3; i++)
+		arena.allocate(1000);
+	BOOST_REQUIRE_EQUAL(arena.reserved(), reserved);
+
+	arena.allocate(100000); // it is over the retain limit
+	arena.reset();
+	BOOST_REQUIRE_EQUAL(arena.reserved(), reserved);
+}
+
+BOOST_AUTO_TEST_CASE( freeLastTest )
+{
+	Arena arena(1024);
+	void *first = arena.allocate(100);
+	arena.free(first, 100);
+	BOOST_REQUIRE_EQUAL(arena.allocated(), 0U);
+	BOOST_REQUIRE(arena.allocate(100) == first);
+	arena.allocate(10);
+	arena.free(first, 100); // not the last allocation
+	BOOST_REQUIRE(arena.allocated() == 110U);
+}
+
+BOOST_AUTO_TEST_CASE( containersTest )
+{
+	Arena arena;
+	ArenaString str(&arena);
+	str.assign("a long string which doesn't fit the small string buffer");
+	str += " and it grows";
+	BOOST_REQUIRE(str == "a long string which doesn't fit the small string buffer and it grows");
+	ArenaVector<ArenaString> strings(&arena);
+	for (int i = 0; i < 100; i++)
+		strings.push_back(str);
+	BOOST_REQUIRE_EQUAL(strings.size(), 100U);
+	BOOST_REQUIRE(strings[99] == str);
+	BOOST_REQUIRE(strings[99].get_allocator().arena() == &arena);
+	BOOST_REQUIRE(arena.reserved() <= 2 * Arena::DEFAULT_BLOCK_SIZE);
+}
+
+BOOST_AUTO_TEST_CASE( poolTest )
+{
+	ArenaPool pool(1024, 1);
+	Arena *arena = pool.get();
+	arena->allocate(100);
+	pool.free(arena);
+	BOOST_REQUIRE_EQUAL(pool.freeArenas(), 1U);
+	BOOST_REQUIRE(pool.get() == arena);
+	BOOST_REQUIRE_EQUAL(arena->allocated(), 0U);
+	Arena *second = pool.get();
+	pool.free(arena);
+	pool.free(second);
+	BOOST_REQUIRE_EQUAL(pool.freeArenas(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE( xmlTest )
+{
+	std::string xml("<propfind>");
+	for (int i = 0; i < 5000; i++)
+		xml.append("<prop><getcontentlength/><getlastmodified/></prop>");
+	xml.append("</propfind>");
+	Arena arena;
+	BOOST_REQUIRE(Arena::current() == NULL);
+	{
+		Arena::Scope scope(&arena);
+		BOOST_REQUIRE(Arena::current() == &arena);
+		rapidxml::xml_document<> doc;
+		doc.set_allocator(Arena::xmlAllocate, Arena::xmlFree);
+		doc.parse<rapidxml::parse_default>(&xml[0]);
+		size_t count = 0;
+		for (auto prop = doc.first_node()->first_node(); prop != NULL; prop = prop->next_sibling())
+			count++;
+		BOOST_REQUIRE_EQUAL(count, 5000U);
+	}
+	BOOST_REQUIRE(Arena::current() == NULL);
+	BOOST_REQUIRE(arena.allocated() > 0); // the nodes over the static pool of the document
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,185 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Asynchronous log target unit tests
+///////////////////////////////////////////////////////////////////////////////
+
+#include <boost/test/unit_test.hpp>
+
+#include <fstream>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "async_log.hpp"
+#include "mock_log_system.hpp"
+
+using namespace fl::log;
+
+namespace
+{
+	const char * const ASYNC_LOG_FILE = "/tmp/fl_async_log_test.txt";
+
+	const char ASYNC_LOG_TAG[] = "test";
+	typedef MockLogSystem<ASYNC_LOG_TAG> AsyncTestLogSystem;
+
+	typedef Log<true, ELogLevel::FATAL, AsyncTestLogSystem> TestFatal;
+	typedef Log<true, ELogLevel::ERROR, AsyncTestLogSystem> TestError;
+
+	void logOwnTime(const char *fmt, ...)
+	{
+		time_t curTime = 0;
+		struct tm ct;
+		localtime_r(&curTime, &ct);
+		va_list args;
+		va_start(args, fmt);
+		AsyncTestLogSystem::logSystem().log(0, ELogLevel::WARNING, "own", curTime, &ct, fmt, args);
+		va_end(args);
+	}
+
+	std::vector<std::string> readLines()
+	{
+		std::vector<std::string> lines;
+		std::ifstream file(ASYNC_LOG_FILE);
+		std::string line;
+		while (std::getline(file, line))
+			lines.push_back(line);
+		return lines;
+	}
+};
+
+BOOST_AUTO_TEST_SUITE( AsyncLogTest )
+
+BOOST_AUTO_TEST_CASE( Threads )
+{
+	unlink(ASYNC_LOG_FILE);
+	AsyncFileTarget *target = AsyncTestLogSystem::setTarget(new AsyncFileTarget(ASYNC_LOG_FILE,
+		AsyncFileTarget::BLOCK, 8192, 1));
+	const int THREADS = 4;
+	const int MESSAGES = 5000;
+	std::vector<std::thread> threads;
+	for (int i = 0; i < THREADS; i++) {
+		threads.emplace_back([i]() {
+			for (int message = 0; message < MESSAGES; message++)
+				TestError::L("thread %d message %d\n", i, message);
+		});
+	}
+	for (auto thread = threads.begin(); thread != threads.end(); thread++)
+		thread->join();
+	AsyncTestLogSystem::logSystem().flush();
+	BOOST_CHECK_EQUAL(target->dropped(), 0U);
+
+	std::vector<std::string> lines = readLines();
+	BOOST_REQUIRE_EQUAL(lines.size(), static_cast<size_t>(THREADS * MESSAGES));
+	std::vector<int> next(THREADS, 0);
+	for (auto line = lines.begin(); line != lines.end(); line++) {
+		size_t pos = line->find("] thread ");
+		BOOST_REQUIRE(pos != std::string::npos);
+		int thread, message;
+		BOOST_REQUIRE_EQUAL(sscanf(line->c_str() + pos, "] thread %d message %d", &thread, &message), 2);
+		BOOST_REQUIRE_EQUAL(message, next[thread]++); // messages of a thread are kept in order
+	}
+	AsyncTestLogSystem::logSystem().clearTargets();
+	unlink(ASYNC_LOG_FILE);
+}
+
+BOOST_AUTO_TEST_CASE( DropOverflow )
+{
+	unlink(ASYNC_LOG_FILE);
+	// the writer doesn't wake up during the test
+	AsyncFileTarget *target = AsyncTestLogSystem::setTarget(new AsyncFileTarget(ASYNC_LOG_FILE,
+		AsyncFileTarget::DROP, 8192, 60000));
+	std::string text(100, 'x');
+	const int MESSAGES = 1000;
+	for (int i = 0; i < MESSAGES; i++)
+		TestError::L("%s\n", text.c_str());
+	BOOST_CHECK(target->dropped() > 0);
+	target->flush();
+	std::vector<std::string> lines = readLines();
+	BOOST_CHECK_EQUAL(lines.size() + target->dropped(), static_cast<size_t>(MESSAGES));
+	BOOST_CHECK_EQUAL(target->written(), lines.size() * (lines[0].size() + 1));
+	AsyncTestLogSystem::logSystem().clearTargets();
+	unlink(ASYNC_LOG_FILE);
+}
+
+BOOST_AUTO_TEST_CASE( FatalFlush )
+{
+	unlink(ASYNC_LOG_FILE);
+	AsyncTestLogSystem::setTarget(new AsyncFileTarget(ASYNC_LOG_FILE, AsyncFileTarget::DROP,
+		AsyncFileTarget::DEFAULT_RING_SIZE, 60000));
+	TestError::L("error before\n");
+	TestFatal::L("fatal %d\n", 1);
+	std::vector<std::string> lines = readLines();
+	BOOST_REQUIRE_EQUAL(lines.size(), 2U);
+	BOOST_CHECK(lines[0].find("/E] error before") != std::string::npos);
+	BOOST_CHECK(lines[1].find("/F] fatal 1") != std::string::npos);
+
+	TestError::L("written by the destructor\n");
+	AsyncTestLogSystem::logSystem().clearTargets();
+	BOOST_CHECK_EQUAL(readLines().size(), 3U);
+	unlink(ASYNC_LOG_FILE);
+}
+
+BOOST_AUTO_TEST_CASE( SeveralTargets )
+{
+	const char * const SECOND_LOG_FILE = "/tmp/fl_async_log_test2.txt";
+	unlink(ASYNC_LOG_FILE);
+	unlink(SECOND_LOG_FILE);
+	AsyncFileTarget *first = AsyncTestLogSystem::setTarget(new AsyncFileTarget(ASYNC_LOG_FILE));
+	AsyncFileTarget *second = new AsyncFileTarget(SECOND_LOG_FILE);
+	AsyncTestLogSystem::logSystem().addTarget(second);
+	const int MESSAGES = 100;
+	for (int i = 0; i < MESSAGES; i++)
+		TestError::L("message %d\n", i);
+	first->flush();
+	second->flush();
+	BOOST_CHECK_EQUAL(readLines().size(), static_cast<size_t>(MESSAGES));
+	BOOST_CHECK_EQUAL(second->written(), first->written());
+	AsyncTestLogSystem::logSystem().clearTargets();
+	unlink(ASYNC_LOG_FILE);
+	unlink(SECOND_LOG_FILE);
+}
+
+BOOST_AUTO_TEST_CASE( CachedTime )
+{
+	LogTime::update();
+	time_t seconds = LogTime::seconds();
+	struct tm ct;
+	localtime_r(&seconds, &ct);
+	char date[32];
+	snprintf(date, sizeof(date), "%02i.%02i %02i:%02i:%02i", ct.tm_mday, ct.tm_mon + 1, ct.tm_hour, ct.tm_min,
+		ct.tm_sec);
+	BOOST_CHECK_EQUAL(std::string(LogTime::date()), date);
+	BOOST_CHECK_EQUAL(LogTime::localTime()->tm_min, ct.tm_min);
+	BOOST_CHECK(LogTime::nanoseconds() < 1000000000U);
+}
+
+BOOST_AUTO_TEST_CASE( TimePrecision )
+{
+	unlink(ASYNC_LOG_FILE);
+	AsyncFileTarget *target = AsyncTestLogSystem::setTarget(new AsyncFileTarget(ASYNC_LOG_FILE));
+	TestError::L("seconds\n");
+	target->setTimePrecision(ETimePrecision::MILLISECONDS);
+	TestError::L("milliseconds\n");
+	target->setTimePrecision(ETimePrecision::MICROSECONDS);
+	TestError::L("microseconds\n");
+	// a time which doesn't come from Log::L is formatted with seconds
+	logOwnTime("own time\n");
+	target->flush();
+	std::vector<std::string> lines = readLines();
+	BOOST_REQUIRE_EQUAL(lines.size(), 4U);
+	BOOST_CHECK(std::regex_match(lines[0], std::regex("\\[test/[0-9]+/[0-9]{2}\\.[0-9]{2} [0-9:]{8}/E\\] seconds")));
+	BOOST_CHECK(std::regex_match(lines[1],
+		std::regex("\\[test/[0-9]+/[0-9]{2}\\.[0-9]{2} [0-9:]{8}\\.[0-9]{3}/E\\] milliseconds")));
+	BOOST_CHECK(std::regex_match(lines[2],
+		std::regex("\\[test/[0-9]+/[0-9]{2}\\.[0-9]{2} [0-9:]{8}\\.[0-9]{6}/E\\] microseconds")));
+	BOOST_CHECK(std::regex_match(lines[3], std::regex("\\[own/[0-9]+/[0-9]{2}\\.[0-9]{2} [0-9:]{8}/W\\] own time")));
+	AsyncTestLogSystem::logSystem().clearTargets();
+	unlink(ASYNC_LOG_FILE);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
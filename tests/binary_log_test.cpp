@@ -0,0 +1,170 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Binary log target and decoder unit tests
+///////////////////////////////////////////////////////////////////////////////
+
+#include <boost/test/unit_test.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include "binary_log.hpp"
+#include "mock_log_system.hpp"
+
+using namespace fl::log;
+
+namespace
+{
+	const char * const BINARY_LOG_FILE = "/tmp/fl_binary_log_test.bin";
+	const char * const TEXT_LOG_FILE = "/tmp/fl_binary_log_test.txt";
+
+	const char BINARY_LOG_TAG[] = "bin";
+	typedef MockLogSystem<BINARY_LOG_TAG> BinaryTestLogSystem;
+	typedef Log<true, ELogLevel::INFO, BinaryTestLogSystem> TestInfo;
+	typedef Log<true, ELogLevel::ERROR, BinaryTestLogSystem> TestError;
+
+	std::string readFile(const char *fileName)
+	{
+		std::ifstream file(fileName, std::ios::binary);
+		std::stringstream data;
+		data << file.rdbuf();
+		return data.str();
+	}
+
+	void logLocation(const char *fmt, ...)
+	{
+		time_t curTime = LogTime::seconds();
+		va_list args;
+		for (size_t target = 0; ; target++) {
+			va_start(args, fmt);
+			bool res = BinaryTestLogSystem::logSystem().log(target, ELogLevel::WARNING, "source.cpp", 42, "loc", curTime,
+				LogTime::localTime(), fmt, args);
+			va_end(args);
+			if (!res)
+				break;
+		}
+	}
+
+	// logs the same messages to the text and the binary targets
+	void startLogs(const ETimePrecision::ETimePrecision timePrecision = ETimePrecision::SECONDS)
+	{
+		unlink(BINARY_LOG_FILE);
+		unlink(TEXT_LOG_FILE);
+		LogSystem &logSystem = BinaryTestLogSystem::logSystem();
+		logSystem.clearTargets();
+		AsyncFileTarget *text = new AsyncFileTarget(TEXT_LOG_FILE);
+		text->setTimePrecision(timePrecision);
+		logSystem.addTarget(text);
+		logSystem.addTarget(new BinaryLogTarget(BINARY_LOG_FILE));
+	}
+
+	void stopLogs()
+	{
+		BinaryTestLogSystem::logSystem().clearTargets();
+	}
+};
+
+BOOST_AUTO_TEST_SUITE( BinaryLogTest )
+
+BOOST_AUTO_TEST_CASE( Conversions )
+{
+	startLogs();
+	TestInfo::L("q: [%s], r: %u\n", "SELECT * FROM users WHERE id = 1", 1U);
+	TestError::L("%d %i %5d %-5d|%05.1f %e %g %x %X %o %c %p %%\n", -1, 2, 3, -4, 5.25, 1e10, 0.5, 255U, 255U, 8U,
+		'z', (void*)0x1234);
+	TestError::L("%ld %lld %lu %zu %jd %hhd %hu %Lf\n", -5L, -6LL, 7UL, (size_t)8, (intmax_t)-9, 10, 11,
+		(long double)1.5);
+	TestError::L("%*d|%-*.*s|%.3s|\n", 6, 42, 8, 3, "abcdef", "xyzw");
+	TestError::L("%s %ls %lc\n", (const char*)NULL, L"wide", (wint_t)L'w');
+	errno = ENOENT;
+	TestError::L("open failed: %m\n");
+	TestError::L("no arguments\n");
+	logLocation("location %d\n", 1);
+	std::string longString(10000, 'l');
+	TestError::L("%s\n", longString.c_str());
+	stopLogs();
+
+	std::string text = readFile(TEXT_LOG_FILE);
+	std::string binary = readFile(BINARY_LOG_FILE);
+	BOOST_REQUIRE(binary.compare(0, BinaryLogTarget::SESSION_MAGIC_SIZE, BinaryLogTarget::SESSION_MAGIC) == 0);
+	BinaryLogDecoder decoder;
+	std::string decoded;
+	BOOST_REQUIRE_EQUAL(decoder.decode(binary.c_str(), binary.size(), decoded), binary.size());
+	// the long string is cut differently
+	size_t longLine = text.find("lllll");
+	BOOST_REQUIRE(longLine != std::string::npos);
+	BOOST_CHECK_EQUAL(decoded.substr(0, longLine), text.substr(0, longLine));
+	BOOST_CHECK(decoded.find("[loc:source.cpp:42/") != std::string::npos);
+	BOOST_CHECK(decoded.find("open failed: No such file or directory\n") != std::string::npos);
+	BOOST_CHECK(decoded.size() > longLine + 2048);
+	unlink(BINARY_LOG_FILE);
+	unlink(TEXT_LOG_FILE);
+}
+
+BOOST_AUTO_TEST_CASE( ChunksAndSessions )
+{
+	startLogs(ETimePrecision::MICROSECONDS);
+	for (int i = 0; i < 100; i++)
+		TestInfo::L("message %d of %s\n", i, "the first session");
+	stopLogs();
+	std::string firstText = readFile(TEXT_LOG_FILE);
+	std::string firstBinary = readFile(BINARY_LOG_FILE);
+	startLogs(ETimePrecision::MICROSECONDS);
+	TestInfo::L("message %d of %s\n", 0, "the second session");
+	stopLogs();
+	std::string binary = firstBinary + readFile(BINARY_LOG_FILE);
+	std::string text = firstText + readFile(TEXT_LOG_FILE);
+
+	// the data comes by small parts
+	BinaryLogDecoder decoder(ETimePrecision::MICROSECONDS);
+	std::string decoded;
+	std::string pending;
+	for (size_t pos = 0; pos < binary.size(); pos += 7) {
+		pending.append(binary, pos, 7);
+		size_t done = decoder.decode(pending.c_str(), pending.size(), decoded);
+		pending.erase(0, done);
+	}
+	BOOST_CHECK(pending.empty());
+	BOOST_CHECK_EQUAL(decoded, text);
+	unlink(BINARY_LOG_FILE);
+	unlink(TEXT_LOG_FILE);
+}
+
+BOOST_AUTO_TEST_CASE( ReusedFormatBuffer )
+{
+	startLogs();
+	char fmt[64];
+	strcpy(fmt, "first %d\n");
+	TestInfo::L(fmt, 1);
+	strcpy(fmt, "second %s\n");
+	TestInfo::L(fmt, "format");
+	stopLogs();
+	std::string binary = readFile(BINARY_LOG_FILE);
+	BinaryLogDecoder decoder;
+	std::string decoded;
+	decoder.decode(binary.c_str(), binary.size(), decoded);
+	BOOST_CHECK_EQUAL(decoded, readFile(TEXT_LOG_FILE));
+	unlink(BINARY_LOG_FILE);
+	unlink(TEXT_LOG_FILE);
+}
+
+BOOST_AUTO_TEST_CASE( BadData )
+{
+	BinaryLogDecoder decoder;
+	std::string decoded;
+	BOOST_CHECK_THROW(decoder.decode("X", 1, decoded), BinaryLogDecoder::Error);
+	BOOST_CHECK_THROW(decoder.decode("FLBLOG2\n\x01", 9, decoded), BinaryLogDecoder::Error);
+	BOOST_CHECK_EQUAL(decoder.decode("FLBL", 4, decoded), 0U); // incomplete
+	// a message with an unknown format id
+	BOOST_CHECK_EQUAL(decoder.decode("FLBLOG1\n\x01", 9, decoded), 9U);
+	BOOST_CHECK_THROW(decoder.decode("M\x06\x02\x00\x05\x00\x00\x00", 8, decoded), BinaryLogDecoder::Error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
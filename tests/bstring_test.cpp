@@ -22,29 +22,36 @@ BOOST_AUTO_TEST_CASE( Create )
 	BOOST_CHECK_NO_THROW (
 		BString str;
 		BOOST_CHECK(str.size() == 0);
-		BOOST_CHECK(str.reserved() == 0);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
+		BOOST_CHECK(str == "");
 	);
 
 	BOOST_CHECK_NO_THROW (
 		BString str(10);
 		BOOST_CHECK(str.size() == 0);
-		BOOST_CHECK(str.reserved() == 10);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
+	);
+
+	BOOST_CHECK_NO_THROW (
+		BString str(100);
+		BOOST_CHECK(str.size() == 0);
+		BOOST_CHECK(str.reserved() == 100);
 	);
 }
 
 BOOST_AUTO_TEST_CASE( MoveCreate )
 {
 	BOOST_CHECK_NO_THROW (
-		BString str(10);
+		BString str(100);
 		BOOST_CHECK(str.sprintfSet("test") == 4);
 		
 		BString strTo(std::move(str));
 
 		BOOST_CHECK(str.size() == 0);
-		BOOST_CHECK(str.reserved() == 0);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
 
 		BOOST_CHECK(strTo.size() == 4);
-		BOOST_CHECK(strTo.reserved() == 10);
+		BOOST_CHECK(strTo.reserved() == 100);
 		BOOST_CHECK(strTo == "test");
 	);
 }
@@ -52,17 +59,17 @@ BOOST_AUTO_TEST_CASE( MoveCreate )
 BOOST_AUTO_TEST_CASE( MoveAssignment )
 {
 	BOOST_CHECK_NO_THROW (
-		BString str(10);
+		BString str(100);
 		BOOST_CHECK(str.sprintfSet("test") == 4);
 		
 		BString strTo;
 		strTo = std::move(str);
 
 		BOOST_CHECK(str.size() == 0);
-		BOOST_CHECK(str.reserved() == 0);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
 
 		BOOST_CHECK(strTo.size() == 4);
-		BOOST_CHECK(strTo.reserved() == 10);
+		BOOST_CHECK(strTo.reserved() == 100);
 		BOOST_CHECK(strTo == "test");
 	);
 }
@@ -74,12 +81,12 @@ BOOST_AUTO_TEST_CASE( sprintfSet )
 		BOOST_CHECK(str.sprintfSet("1234%u", 5) == 5);
 		BOOST_CHECK(str == "12345");
 		BOOST_CHECK(str.size() == 5);
-		BOOST_CHECK(str.reserved() == 6);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
 		
 		BOOST_CHECK(str.sprintfSet("678%s", "9") == 4);
 		BOOST_CHECK(str == "6789");
 		BOOST_CHECK(str.size() == 4);
-		BOOST_CHECK(str.reserved() == 6);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
 	);
 }
 
@@ -90,12 +97,12 @@ BOOST_AUTO_TEST_CASE( sprintfAdd )
 		BOOST_CHECK(str.sprintfAdd("1234%u", 5) == 5);
 		BOOST_CHECK(str == "12345");
 		BOOST_CHECK(str.size() == 5);
-		BOOST_CHECK(str.reserved() == 6);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
 		
 		BOOST_CHECK(str.sprintfAdd("678%s", "9") == 4);
 		BOOST_CHECK(str == "123456789");
 		BOOST_CHECK(str.size() == 9);
-		BOOST_CHECK(str.reserved() == 11);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
 	);
 }
 
@@ -106,12 +113,12 @@ BOOST_AUTO_TEST_CASE( addString )
 		str.add("12345", strlen("12345"));
 		BOOST_CHECK(str == "12345");
 		BOOST_CHECK(str.size() == 5);
-		BOOST_CHECK(str.reserved() == 6);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
 		
 		str.add("6789", strlen("6789"));
 		BOOST_CHECK(str == "123456789");
 		BOOST_CHECK(str.size() == 9);
-		BOOST_CHECK(str.reserved() == 10);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
 	);
 }
 
@@ -142,17 +149,17 @@ BOOST_AUTO_TEST_CASE( AddNumber )
 		str << 12345;
 		BOOST_CHECK(str == "12345");
 		BOOST_CHECK(str.size() == 5);
-		BOOST_CHECK(str.reserved() == 6);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
 		
 		str << 6789;
 		BOOST_CHECK(str == "123456789");
 		BOOST_CHECK(str.size() == 9);
-		BOOST_CHECK(str.reserved() == 11);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
 	
 		str << 10 << 11;
 		BOOST_CHECK(str == "1234567891011");
 		BOOST_CHECK(str.size() == 13);
-		BOOST_CHECK(str.reserved() == 14);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
 	);
 }
 
@@ -163,12 +170,12 @@ BOOST_AUTO_TEST_CASE( AddChar )
 		str << 'a';
 		BOOST_CHECK(str == "a");
 		BOOST_CHECK(str.size() == 1);
-		BOOST_CHECK(str.reserved() == 2);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
 		
 		str << 'b' << 'c';
 		BOOST_CHECK(str == "abc");
 		BOOST_CHECK(str.size() == 3);
-		BOOST_CHECK(str.reserved() == 4);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
 	);
 }
 
@@ -180,7 +187,7 @@ BOOST_AUTO_TEST_CASE( clear )
 		BOOST_CHECK(str == "abc");
 		str.clear();
 		BOOST_CHECK(str.size() == 0);
-		BOOST_CHECK(str.reserved() == 4);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
 	);
 }
 
@@ -192,7 +199,7 @@ BOOST_AUTO_TEST_CASE( reserveBuffer )
 		memcpy(buf, "abc", 3);
 		BOOST_CHECK(str == "abc");
 		BOOST_CHECK(str.size() == 3);
-		BOOST_CHECK(str.reserved() == 4);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
 	);
 }
 
@@ -206,12 +213,12 @@ BOOST_AUTO_TEST_CASE( trim )
 		str.trim(str.size() -1 );
 		BOOST_CHECK(str == "ab");
 		BOOST_CHECK(str.size() == 2);
-		BOOST_CHECK(str.reserved() == 4);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
 		
 		str.trimLast();
 		BOOST_CHECK(str == "a");
 		BOOST_CHECK(str.size() == 1);
-		BOOST_CHECK(str.reserved() == 4);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
 	);
 }
 
@@ -222,12 +229,22 @@ BOOST_AUTO_TEST_CASE( reserve )
 		str << "abcd";
 		BOOST_CHECK(str == "abcd");
 		BOOST_CHECK(str.size() == 4);
-		BOOST_CHECK(str.reserved() == 5);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
 		
 		str.reserve(2);
 		BOOST_CHECK(str == "ab");
 		BOOST_CHECK(str.size() == 2);
-		BOOST_CHECK(str.reserved() == 2);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
+
+		str.reserve(100);
+		BOOST_CHECK(str == "ab");
+		BOOST_CHECK(str.reserved() == 100);
+		str.reserve(1);
+		BOOST_CHECK(str == "a");
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
+		str.reserve(0);
+		BOOST_CHECK(str.size() == 0);
+		BOOST_CHECK(str == "");
 	);
 }
 
@@ -241,7 +258,7 @@ BOOST_AUTO_TEST_CASE( streamOperatorsTest )
 		str << "abcd" << 'e' << unsignedInt << signedInt << integer;
 		BOOST_CHECK(str == "abcde11223333");
 		BOOST_CHECK(str.size() == 13);
-		BOOST_CHECK(str.reserved() == 17);
+		BOOST_CHECK(str.reserved() == BString::INLINE_CAPACITY);
 		
 	);
 }
@@ -299,4 +316,71 @@ BOOST_AUTO_TEST_CASE( trimLastSpacesTest )
 	BOOST_REQUIRE(str == "");
 }
 
+BOOST_AUTO_TEST_CASE( smallStringMoveTest )
+{
+	BString small;
+	small << "small";
+	BString large;
+	large << std::string(100, 'l');
+	BOOST_REQUIRE(small.reserved() == BString::INLINE_CAPACITY);
+	BOOST_REQUIRE(large.reserved() > BString::INLINE_CAPACITY);
+
+	BString smallTo(std::move(small));
+	BOOST_REQUIRE(smallTo == "small");
+	BOOST_REQUIRE(small.size() == 0);
+	
+	small = std::move(large);
+	BOOST_REQUIRE(small == std::string(100, 'l'));
+	BOOST_REQUIRE(large.size() == 0);
+	
+	large << "after move";
+	std::swap(small, large);
+	BOOST_REQUIRE(small == "after move");
+	BOOST_REQUIRE(large == std::string(100, 'l'));
+	BOOST_REQUIRE(small.reserved() == BString::INLINE_CAPACITY);
+}
+
+BOOST_AUTO_TEST_CASE( releaseSmallStringTest )
+{
+	BString str;
+	str << "inline";
+	BString::TSize reserved = str.reserved();
+	char *data = str.release();
+	BOOST_REQUIRE(strcmp(data, "inline") == 0);
+	BOOST_REQUIRE(reserved == BString::INLINE_CAPACITY);
+	free(data);
+	BOOST_REQUIRE(str.size() == 0);
+	str << "reuse";
+	BOOST_REQUIRE(str == "reuse");
+}
+
+BOOST_AUTO_TEST_CASE( geometricGrowthTest )
+{
+	BString str;
+	uint32_t reallocs = 0;
+	BString::TSize reserved = str.reserved();
+	for (int i = 0; i < 10000; i++) {
+		str << "0123456789";
+		if (str.reserved() != reserved) {
+			reallocs++;
+			reserved = str.reserved();
+		}
+	}
+	BOOST_REQUIRE(str.size() == 100000);
+	BOOST_REQUIRE(reallocs < 20);
+}
+
+BOOST_AUTO_TEST_CASE( exactCapacityPolicyTest )
+{
+	BString::setCapacityPolicy(BString::exactCapacity);
+	BString str;
+	str << std::string(30, 'a');
+	BOOST_CHECK(str.reserved() == 31);
+	str << "b";
+	BOOST_CHECK(str.reserved() == 32);
+	BString::setCapacityPolicy(BString::geometricCapacity);
+	str << "c";
+	BOOST_CHECK(str.reserved() >= 64);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -39,7 +39,7 @@ BOOST_AUTO_TEST_CASE( AddGetTest )
 		buffer.add<u_int32_t>(10);
 		buffer.add<u_int32_t>(20);
 		BOOST_CHECK(buffer.writtenSize() == sizeof(u_int32_t) * 2);
-		BOOST_CHECK(buffer.reserved() == (sizeof(u_int32_t) + 1) * 2);
+		BOOST_CHECK(buffer.reserved() == 64); // minimal heap capacity of the geometric growth
 		u_int32_t value;
 		buffer.get(value);
 		BOOST_CHECK(value == 10);
@@ -149,7 +149,7 @@ BOOST_AUTO_TEST_CASE( MoveFromBString )
 		Buffer buf(std::move(bstr));
 		BOOST_CHECK(buf.writtenSize() == size);
 		BOOST_CHECK(buf.reserved() == resereved);
-		BOOST_CHECK(bstr.reserved() == 0);
+		BOOST_CHECK(bstr.reserved() == BString::INLINE_CAPACITY);
 	);
 }
 
@@ -160,12 +160,12 @@ BOOST_AUTO_TEST_CASE( TruncateTest )
 		buffer.add<u_int32_t>(10);
 		buffer.add<u_int32_t>(20);
 		BOOST_CHECK(buffer.writtenSize() == sizeof(u_int32_t) * 2);
-		BOOST_CHECK(buffer.reserved() == (sizeof(u_int32_t) + 1) * 2);
+		BOOST_CHECK(buffer.reserved() == 64); // minimal heap capacity of the geometric growth
 		
 		buffer.truncate(buffer.writtenSize() -  sizeof(u_int32_t));
 		
 		BOOST_CHECK(buffer.writtenSize() == sizeof(u_int32_t));
-		BOOST_CHECK(buffer.reserved() == (sizeof(u_int32_t) + 1) * 2);
+		BOOST_CHECK(buffer.reserved() == 64); // minimal heap capacity of the geometric growth
 		
 		BOOST_CHECK_THROW(buffer.truncate(sizeof(u_int32_t) * 2), Buffer::Error);
 		BOOST_CHECK_THROW(buffer.truncate(-1), Buffer::Error);
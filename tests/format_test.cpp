@@ -0,0 +1,109 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: BString formatting unit tests
+///////////////////////////////////////////////////////////////////////////////
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdlib>
+#include <limits>
+#include "format.hpp"
+
+using namespace fl::strings;
+
+BOOST_AUTO_TEST_SUITE( FormatTests )
+
+BOOST_AUTO_TEST_CASE( integersTest )
+{
+	BString str;
+	FL_FORMAT_SET(str, "{} {} {} {} {}", 0, -1, 1234567890U, std::numeric_limits<int64_t>::min(),
+		std::numeric_limits<uint64_t>::max());
+	BOOST_REQUIRE(str == "0 -1 1234567890 -9223372036854775808 18446744073709551615");
+
+	for (uint64_t value = 1, i = 0; i < 20; i++, value *= 10) {
+		char expected[64];
+		snprintf(expected, sizeof(expected), "%llu %llu %lld", (unsigned long long)(value - 1), (unsigned long long)value,
+			-(long long)(value - 1));
+		FL_FORMAT_SET(str, "{} {} {}", value - 1, value, -(int64_t)(value - 1));
+		BOOST_REQUIRE(str == expected);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( specTest )
+{
+	BString str;
+	FL_FORMAT_SET(str, "{:x}|{:X}|{:08x}|{:4}|{:04}|{:6}|{:03}", 0xDEADBEEFULL, 255, 0xABCU, 7, -7, "ab", 0);
+	BOOST_REQUIRE(str == "deadbeef|FF|00000abc|   7|-007|    ab|000");
+	FL_FORMAT_SET(str, "{{}} {{{}}}", 1);
+	BOOST_REQUIRE(str == "{} {1}");
+}
+
+BOOST_AUTO_TEST_CASE( typesTest )
+{
+	BString str;
+	BString bstr("bstr");
+	std::string stdStr("std");
+	FL_FORMAT_SET(str, "{}:{}:{}:{}:{}:{}", "chars", bstr, stdStr, 'c', true, false);
+	BOOST_REQUIRE(str == "chars:bstr:std:c:true:false");
+	FL_FORMAT_SET(str, "no placeholders");
+	BOOST_REQUIRE(str == "no placeholders");
+	BOOST_REQUIRE(FL_FORMAT_ADD(str, " {}", 12) == 3);
+	BOOST_REQUIRE(str == "no placeholders 12");
+	int value = 0;
+	char chars[] = "mutable";
+	FL_FORMAT_SET(str, "{} {:X} {:08} {} {}", reinterpret_cast<const void*>(0xabc), reinterpret_cast<int*>(0xabc),
+		reinterpret_cast<const void*>(0xabc), &value != NULL, chars);
+	BOOST_REQUIRE(str == "0xabc 0xABC 0x000abc true mutable");
+}
+
+BOOST_AUTO_TEST_CASE( doubleTest )
+{
+	BString str;
+	FL_FORMAT_SET(str, "{} {} {} {} {} {} {}", 0.0, -0.0, 1.0, 0.5, -1.25, 100.0, 0.1);
+	BOOST_REQUIRE(str == "0 -0 1 0.5 -1.25 100 0.1");
+	FL_FORMAT_SET(str, "{} {} {} {}", 1e21, 1.5e-7, 123456.789, 5e-324);
+	BOOST_REQUIRE(str == "1e+21 1.5e-07 123456.789 5e-324");
+	FL_FORMAT_SET(str, "{} {} {}", std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(),
+		std::numeric_limits<double>::quiet_NaN());
+	BOOST_REQUIRE(str == "inf -inf nan");
+	FL_FORMAT_SET(str, "{}", std::numeric_limits<double>::max());
+	BOOST_REQUIRE(str == "1.7976931348623157e+308");
+}
+
+BOOST_AUTO_TEST_CASE( doubleRoundTripTest )
+{
+	srand(1);
+	BString str;
+	for (int i = 0; i < 100000; i++) {
+		uint64_t bits = ((uint64_t)rand() << 62) ^ ((uint64_t)rand() << 31) ^ rand();
+		double value;
+		memcpy(&value, &bits, sizeof(value));
+		if (value != value || value - value != 0) // nan and inf
+			continue;
+		FL_FORMAT_SET(str, "{}", value);
+		BOOST_REQUIRE(strtod(str.c_str(), NULL) == value);
+		BOOST_REQUIRE(str.size() <= format::MAX_DOUBLE_SIZE);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( streamIntegersTest )
+{
+	BString str;
+	str << 0 << ' ' << -42 << ' ' << (int64_t)-9000000000LL << ' ' << (uint64_t)18446744073709551615ULL << ' ' << 7U;
+	BOOST_REQUIRE(str == "0 -42 -9000000000 18446744073709551615 7");
+}
+
+BOOST_AUTO_TEST_CASE( errorsTest )
+{
+	BString str;
+	BOOST_CHECK_THROW(formatSet<1>(str, "{:y}", 1), format::Error);
+	BOOST_CHECK_THROW(formatSet<1>(str, "{}}", 1), format::Error);
+	BOOST_CHECK_THROW(formatSet<1>(str, "{} {}", 1), format::Error);
+	BOOST_CHECK_THROW(formatSet<1>(str, "{:999}", 1), format::Error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
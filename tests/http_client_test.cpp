@@ -0,0 +1,356 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: HttpClient class unit tests
+///////////////////////////////////////////////////////////////////////////////
+
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "http_client.hpp"
+#include "thread.hpp"
+#include "mutex.hpp"
+#include "timer_event.hpp"
+
+using namespace fl::http;
+using namespace fl::network;
+using namespace fl::events;
+using namespace fl::threads;
+
+BOOST_AUTO_TEST_SUITE( HttpClientTest )
+
+static HttpAnswerParser::EResult parseByParts(HttpAnswerParser &parser, const std::string &data, const size_t partSize,
+	HttpClientAnswer &answer, size_t &left)
+{
+	std::string buf;
+	HttpAnswerParser::EResult res = HttpAnswerParser::NEED_MORE;
+	for (size_t pos = 0; pos < data.size(); pos += partSize) {
+		buf.append(data, pos, partSize);
+		size_t consumed = 0;
+		res = parser.parse(buf.c_str(), buf.size(), consumed, answer);
+		buf.erase(0, consumed);
+		if (res != HttpAnswerParser::NEED_MORE)
+			break;
+	}
+	left = buf.size();
+	return res;
+}
+
+BOOST_AUTO_TEST_CASE( ParseContentLength )
+{
+	HttpAnswerParser parser;
+	HttpClientAnswer answer;
+	size_t left = 0;
+	const std::string data("HTTP/1.1 200 OK\r\nContent-Length: 5\r\nX-Test:  value\r\n\r\nhello");
+	for (size_t partSize = 1; partSize <= data.size(); partSize++) {
+		parser.reset(false);
+		BOOST_REQUIRE_EQUAL(parseByParts(parser, data, partSize, answer, left), HttpAnswerParser::DONE);
+		BOOST_CHECK_EQUAL(answer.status, 200);
+		BOOST_CHECK(answer.keepAlive);
+		BOOST_CHECK(answer.body == "hello");
+	}
+	const char *value;
+	size_t valueLength;
+	BOOST_REQUIRE(answer.header("x-test", value, valueLength));
+	BOOST_CHECK_EQUAL(std::string(value, valueLength), "value");
+	BOOST_CHECK(!answer.header("X-Missed", value, valueLength));
+}
+
+BOOST_AUTO_TEST_CASE( ParseChunked )
+{
+	HttpAnswerParser parser;
+	HttpClientAnswer answer;
+	size_t left = 0;
+	const std::string data("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n"
+		"3\r\nhel\r\n2;ext=1\r\nlo\r\nA\r\n0123456789\r\n0\r\nX-Trailer: 1\r\n\r\n");
+	for (size_t partSize = 1; partSize <= data.size(); partSize++) {
+		parser.reset(false);
+		BOOST_REQUIRE_EQUAL(parseByParts(parser, data, partSize, answer, left), HttpAnswerParser::DONE);
+		BOOST_CHECK_EQUAL(left, 0);
+		BOOST_CHECK(!answer.keepAlive);
+		BOOST_CHECK(answer.body == "hello0123456789");
+	}
+	parser.reset(false);
+	BOOST_CHECK_EQUAL(parseByParts(parser, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nz\r\n", 100, answer, left),
+		HttpAnswerParser::ERROR);
+}
+
+BOOST_AUTO_TEST_CASE( ParseSpecialAnswers )
+{
+	HttpAnswerParser parser;
+	HttpClientAnswer answer;
+	size_t left = 0;
+	parser.reset(true);
+	BOOST_CHECK_EQUAL(parseByParts(parser, "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n", 100, answer, left),
+		HttpAnswerParser::DONE);
+	BOOST_CHECK(answer.body.empty());
+
+	parser.reset(false);
+	BOOST_CHECK_EQUAL(parseByParts(parser, "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 204 No Content\r\n\r\n", 100, answer,
+		left), HttpAnswerParser::DONE);
+	BOOST_CHECK_EQUAL(answer.status, 204);
+
+	parser.reset(false);
+	BOOST_CHECK_EQUAL(parseByParts(parser, "HTTP/1.0 200 OK\r\n\r\nuntil close", 100, answer, left),
+		HttpAnswerParser::NEED_MORE);
+	BOOST_CHECK_EQUAL(parser.finish(answer), HttpAnswerParser::DONE);
+	BOOST_CHECK(!answer.keepAlive);
+	BOOST_CHECK(answer.body == "until close");
+
+	parser.reset(false);
+	BOOST_CHECK_EQUAL(parseByParts(parser, "SSH-2.0-OpenSSH\r\n\r\n", 100, answer, left), HttpAnswerParser::ERROR);
+}
+
+// Blocking server with scripted answers, it supports pipelining unlike HttpEvent
+class ScriptedHttpServer : public Thread
+{
+public:
+	ScriptedHttpServer()
+		: connections(0), requests(0), _port(3000 + rand() % 10000)
+	{
+		do {
+			_port++;
+		} while (!_listen.listen("127.0.0.1", _port));
+		create();
+	}
+	~ScriptedHttpServer()
+	{
+		cancel();
+		waitMe();
+		for (auto connection = _connections.begin(); connection != _connections.end(); connection++) {
+			(*connection)->cancel();
+			(*connection)->waitMe();
+			delete *connection;
+		}
+	}
+	TPort16 port() const
+	{
+		return _port;
+	}
+	std::atomic<int> connections;
+	std::atomic<int> requests;
+private:
+	class Connection : public Thread
+	{
+	public:
+		Connection(ScriptedHttpServer *server, const TDescriptor descr)
+			: _server(server), _socket(descr)
+		{
+			create();
+		}
+	private:
+		virtual void run()
+		{
+			std::string buf;
+			char readBuf[4096];
+			while (true) {
+				int res = recv(_socket.descr(), readBuf, sizeof(readBuf), 0);
+				if (res <= 0)
+					return;
+				buf.append(readBuf, res);
+				size_t end;
+				while ((end = buf.find("\r\n\r\n")) != std::string::npos) {
+					size_t pathStart = buf.find(' ') + 1;
+					std::string path = buf.substr(pathStart, buf.find(' ', pathStart) - pathStart);
+					buf.erase(0, end + 4);
+					_server->requests++;
+					if (!_answer(path))
+						return;
+				}
+			}
+		}
+		bool _answer(const std::string &path)
+		{
+			std::string answer;
+			if (path == "/chunked")
+				answer = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nhel\r\n2\r\nlo\r\n0\r\n\r\n";
+			else if (path == "/close")
+				answer = "HTTP/1.0 200 OK\r\n\r\nuntil close";
+			else if (path == "/silent")
+				return true;
+			else
+				answer = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(path.size()) + "\r\n\r\n" + path;
+			send(_socket.descr(), answer.c_str(), answer.size(), MSG_NOSIGNAL);
+			if (path == "/close") {
+				shutdown(_socket.descr(), SHUT_RDWR);
+				return false;
+			}
+			return true;
+		}
+		ScriptedHttpServer *_server;
+		Socket _socket;
+	};
+	virtual void run()
+	{
+		while (true) {
+			TIPv4 ip;
+			TDescriptor descr = _listen.acceptDescriptor(ip);
+			if (descr == INVALID_SOCKET)
+				continue;
+			connections++;
+			_connections.push_back(new Connection(this, descr));
+		}
+	}
+	Socket _listen;
+	TPort16 _port;
+	std::vector<Connection*> _connections;
+};
+
+// Runs the scenario on the worker thread and collects answers
+class HttpClientTestDriver : public TimerEventInterface, public HttpClientHandler
+{
+public:
+	typedef std::function<void(HttpClientTestDriver &driver)> TScenario;
+	HttpClientTestDriver(const size_t maxConnectionsPerHost, const size_t maxPipelineDepth, TScenario scenario)
+		: _group(new EPollWorkerGroup(&_factory, 1, 100)),
+		client(_group->getThread(0), maxConnectionsPerHost, maxPipelineDepth), _scenario(scenario)
+	{
+		_timer.setTimer(0, 1000000, 0, 0, this);
+		_group->getThread(0)->ctrl(&_timer);
+	}
+	~HttpClientTestDriver()
+	{
+		delete _group;
+	}
+	virtual void timerCall(class TimerEvent *te)
+	{
+		_scenario(*this);
+	}
+	virtual void httpAnswer(const EResult result, HttpClientAnswer &answer)
+	{
+		AutoMutex autoSync(&_sync);
+		results.push_back(result);
+		bodies.push_back(answer.body.empty() ? std::string() : std::string(answer.body.c_str(), answer.body.size()));
+		if (next)
+			next(*this);
+	}
+	void failed(const EResult result)
+	{
+		AutoMutex autoSync(&_sync);
+		results.push_back(result);
+		bodies.push_back(std::string());
+	}
+	bool wait(const size_t answers)
+	{
+		for (int i = 0; i < 1000; i++) {
+			{
+				AutoMutex autoSync(&_sync);
+				if (results.size() >= answers)
+					return true;
+			}
+			EPollWorkerGroup::curTime.update();
+			struct timespec tim = {0, 10 * 1000 * 1000};
+			nanosleep(&tim, NULL);
+		}
+		return false;
+	}
+	bool get(TPort16 port, const char *path)
+	{
+		BString request;
+		request << "GET " << path << " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+		if (client.request(Socket::ip2Long("127.0.0.1"), port, request, 1, this))
+			return true;
+		failed(CONNECT_ERROR);
+		return false;
+	}
+private:
+	ThreadSpecificDataFactory _factory;
+	EPollWorkerGroup *_group;
+public:
+	HttpClient client;
+	std::vector<EResult> results;
+	std::vector<std::string> bodies;
+	TScenario next;
+private:
+	TimerEvent _timer;
+	TScenario _scenario;
+	Mutex _sync;
+};
+
+BOOST_AUTO_TEST_CASE( KeepAliveReuse )
+{
+	ScriptedHttpServer server;
+	TPort16 port = server.port();
+	int left = 5;
+	HttpClientTestDriver driver(4, 1, [port](HttpClientTestDriver &driver) {
+		driver.get(port, "/first");
+	});
+	driver.next = [port, &left](HttpClientTestDriver &driver) {
+		if (--left > 0)
+			driver.get(port, "/chunked");
+	};
+	BOOST_REQUIRE(driver.wait(5));
+	for (size_t i = 0; i < driver.results.size(); i++)
+		BOOST_CHECK_EQUAL(driver.results[i], HttpClientHandler::OK);
+	BOOST_CHECK_EQUAL(driver.bodies[0], "/first");
+	BOOST_CHECK_EQUAL(driver.bodies[4], "hello");
+	BOOST_CHECK_EQUAL(server.connections, 1);
+	BOOST_CHECK_EQUAL(server.requests, 5);
+}
+
+BOOST_AUTO_TEST_CASE( Pipelining )
+{
+	ScriptedHttpServer server;
+	TPort16 port = server.port();
+	HttpClientTestDriver driver(1, 4, [port](HttpClientTestDriver &driver) {
+		for (int i = 0; i < 6; i++)
+			driver.get(port, ("/" + std::to_string(i)).c_str());
+	});
+	BOOST_REQUIRE(driver.wait(6));
+	for (size_t i = 0; i < 6; i++) {
+		BOOST_CHECK_EQUAL(driver.results[i], HttpClientHandler::OK);
+		BOOST_CHECK_EQUAL(driver.bodies[i], "/" + std::to_string(i));
+	}
+	BOOST_CHECK_EQUAL(server.connections, 1);
+}
+
+BOOST_AUTO_TEST_CASE( ConnectionClose )
+{
+	ScriptedHttpServer server;
+	TPort16 port = server.port();
+	HttpClientTestDriver driver(1, 1, [port](HttpClientTestDriver &driver) {
+		driver.get(port, "/close");
+		driver.get(port, "/after");
+	});
+	BOOST_REQUIRE(driver.wait(2));
+	BOOST_CHECK_EQUAL(driver.results[0], HttpClientHandler::OK);
+	BOOST_CHECK_EQUAL(driver.bodies[0], "until close");
+	BOOST_CHECK_EQUAL(driver.results[1], HttpClientHandler::OK);
+	BOOST_CHECK_EQUAL(driver.bodies[1], "/after");
+	BOOST_CHECK_EQUAL(server.connections, 2);
+}
+
+BOOST_AUTO_TEST_CASE( Timeout )
+{
+	ScriptedHttpServer server;
+	TPort16 port = server.port();
+	HttpClientTestDriver driver(2, 1, [port](HttpClientTestDriver &driver) {
+		driver.get(port, "/silent");
+	});
+	BOOST_REQUIRE(driver.wait(1));
+	BOOST_CHECK_EQUAL(driver.results[0], HttpClientHandler::TIMEOUT);
+}
+
+BOOST_AUTO_TEST_CASE( ConnectError )
+{
+	TPort16 port;
+	{
+		ScriptedHttpServer server; // find a free port and release it
+		port = server.port();
+	}
+	HttpClientTestDriver driver(2, 1, [port](HttpClientTestDriver &driver) {
+		driver.get(port, "/refused");
+	});
+	BOOST_REQUIRE(driver.wait(1));
+	BOOST_CHECK_EQUAL(driver.results[0], HttpClientHandler::CONNECT_ERROR);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
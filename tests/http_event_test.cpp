@@ -9,6 +9,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <boost/test/unit_test.hpp>
+#include <atomic>
 #include "mock_http_util.hpp"
 #include "compatibility.hpp"
 
@@ -81,6 +82,60 @@ BOOST_AUTO_TEST_CASE( CreateDestruction )
 	BOOST_CHECK(CreateDestructionMockHttpEventInterface::checkStatus());
 }
 
+class ArenaMockHttpEventInterface : public HttpEventInterface
+{
+public:
+	static std::atomic<uint32_t> _requests;
+	static std::atomic<uint32_t> _errors;
+	ArenaMockHttpEventInterface()
+		: _arena(NULL)
+	{
+	}
+	virtual bool parseURI(const char *cmdStart, const EHttpVersion::EHttpVersion version,
+			const std::string &host, const std::string &fileName, const std::string &query)
+	{
+		_arena = Arena::current();
+		_errors += (_arena == NULL);
+		return true;
+	}
+	static const std::string ANSWER;
+	virtual EFormResult formResult(BString &networkBuffer, class HttpEvent *http)
+	{
+		_errors += (Arena::current() != _arena) || (Arena::current() != &http->arena());
+		_requests++;
+		networkBuffer << ANSWER;
+		return RESULT_OK_KEEP_ALIVE;
+	}
+	virtual bool reset()
+	{
+		// the arena is returned to the pool after the request, the interface calls out of the request don't use it
+		_errors += (Arena::current() != NULL);
+		_arena = NULL;
+		return true;
+	}
+private:
+	Arena *_arena;
+};
+
+std::atomic<uint32_t> ArenaMockHttpEventInterface::_requests(0);
+std::atomic<uint32_t> ArenaMockHttpEventInterface::_errors(0);
+const std::string ArenaMockHttpEventInterface::ANSWER("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+
+BOOST_AUTO_TEST_CASE( RequestArena )
+{
+	HttpMockEventFactory<ArenaMockHttpEventInterface> factory;
+	TestHttpEventFramework testEventFramework(&factory);
+	Socket conn;
+	BOOST_REQUIRE(testEventFramework.connect(conn));
+	for (int i = 0; i < 3; i++) {
+		BString answer;
+		BOOST_REQUIRE(testEventFramework.doRequest(conn, "GET / HTTP/1.1\r\n\r\n", answer));
+		BOOST_CHECK(answer == ArenaMockHttpEventInterface::ANSWER.c_str());
+	}
+	BOOST_CHECK_EQUAL(ArenaMockHttpEventInterface::_requests.load(), 3U);
+	BOOST_CHECK_EQUAL(ArenaMockHttpEventInterface::_errors.load(), 0U);
+}
+
 class FunctionalityMockHttpEventInterface : public HttpEventInterface
 {
 public:
@@ -546,6 +601,92 @@ BOOST_AUTO_TEST_CASE( HttpPostTest )
 }
 
 
+class SegmentedPostMockHttpEventInterface : public PostMockHttpEventInterface
+{
+public:
+	static const TStatus ST_SEGMENTED = 0x10;
+	virtual size_t segmentedBodySize()
+	{
+		return _contentLength;
+	}
+	virtual bool parseSegmentedPOSTData(SegmentedBuffer &body, bool &parseError)
+	{
+		parseError = false;
+		if (body.size() < _contentLength)
+			return false;
+		_status |= ST_SEGMENTED;
+		BString spill;
+		const char *query = body.view(_contentLength - POST_QUERY.size(), POST_QUERY.size(), spill);
+		parseError = _parseQuery(std::string(query, POST_QUERY.size()));
+		return true;
+	}
+};
+
+class SegmentedBodyThreadSpecificDataFactory : public ThreadSpecificDataFactory
+{
+public:
+	virtual ThreadSpecificData *create()
+	{
+		HttpThreadSpecificData *data = new HttpThreadSpecificData();
+		data->segmentedBodyThreshold = 64 * 1024;
+		return data;
+	}
+};
+
+BOOST_AUTO_TEST_CASE( HttpSegmentedPostTest )
+{
+	HttpMockEventFactory<SegmentedPostMockHttpEventInterface> factory;
+	TestHttpEventFramework testEventFramework(&factory, new SegmentedBodyThreadSpecificDataFactory());
+	for (uint32_t bodySize : {0U, 512U * 1024U}) {
+		BString request;
+		request << "POST " << PostMockHttpEventInterface::TEST_FILE_NAME << " HTTP/1.0\r\n";
+		request << "Content-Length: " << (PostMockHttpEventInterface::POST_QUERY.size() + bodySize) << "\r\n\r\n";
+		for (uint32_t i = 0; i < bodySize; i++)
+			request << 'x';
+		request << PostMockHttpEventInterface::POST_QUERY;
+		BString answer;
+		BOOST_REQUIRE(testEventFramework.doRequest(request, answer));
+		BOOST_CHECK(answer == PostMockHttpEventInterface::ANSWER.c_str());
+		BOOST_CHECK(PostMockHttpEventInterface::_status & PostMockHttpEventInterface::ST_URI);
+		BOOST_CHECK_EQUAL(bool(PostMockHttpEventInterface::_status & SegmentedPostMockHttpEventInterface::ST_SEGMENTED),
+			bodySize > 0);
+	}
+}
+
+class SegmentRegionThreadSpecificDataFactory : public ThreadSpecificDataFactory
+{
+public:
+	SegmentRegionThreadSpecificDataFactory()
+		: data(NULL)
+	{
+	}
+	virtual ThreadSpecificData *create()
+	{
+		data = new HttpThreadSpecificData();
+		data->segmentRegionSize = 4 * 1024 * 1024;
+		return data;
+	}
+	HttpThreadSpecificData *data;
+};
+
+BOOST_AUTO_TEST_CASE( HttpSegmentRegionTest )
+{
+	HttpMockEventFactory<SegmentedPostMockHttpEventInterface> factory;
+	SegmentRegionThreadSpecificDataFactory *dataFactory = new SegmentRegionThreadSpecificDataFactory();
+	TestHttpEventFramework testEventFramework(&factory, dataFactory);
+	BString request;
+	request << "POST " << PostMockHttpEventInterface::TEST_FILE_NAME << " HTTP/1.0\r\n";
+	request << "Content-Length: " << (PostMockHttpEventInterface::POST_QUERY.size() + 256 * 1024) << "\r\n\r\n";
+	request << std::string(256 * 1024, 'x') << PostMockHttpEventInterface::POST_QUERY;
+	BString answer;
+	BOOST_REQUIRE(testEventFramework.doRequest(request, answer));
+	BOOST_CHECK(answer == PostMockHttpEventInterface::ANSWER.c_str());
+	// the region is created by the worker and the segments of the body are carved from it
+	BOOST_REQUIRE(dataFactory->data->segmentRegion);
+	BOOST_CHECK(dataFactory->data->segmentRegion->usedChunks() >= 16);
+}
+
+
 class DependedMockHttpEventInterface : public HttpEventInterface
 {
 public:
@@ -0,0 +1,176 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: HttpRouter class unit tests
+///////////////////////////////////////////////////////////////////////////////
+
+#include <boost/test/unit_test.hpp>
+#include "http_router.hpp"
+#include "mock_http_util.hpp"
+
+using namespace fl::http;
+
+BOOST_AUTO_TEST_SUITE( HttpRouterTest )
+
+static std::string param(const std::string &path, const HttpRouter::Match &match, const size_t index)
+{
+	return path.substr(match.params[index].start, match.params[index].length);
+}
+
+BOOST_AUTO_TEST_CASE( StaticAndParamRoutes )
+{
+	HttpRouter router;
+	router.add(HttpRouter::M_GET, "/", 1);
+	router.add(HttpRouter::M_GET | HttpRouter::M_HEAD, "/users", 2);
+	router.add(HttpRouter::M_GET, "/users/:id", 3);
+	router.add(HttpRouter::M_POST, "/users/:id", 4);
+	router.add(HttpRouter::M_GET, "/users/me", 5);
+	router.add(HttpRouter::M_GET, "/users/:id/posts/:postId", 6);
+	router.add(HttpRouter::M_GET, "/static/css/main/*", 7);
+	router.add(HttpRouter::M_ANY, "/api/v1/very/long/static/path", 8);
+	router.compile();
+	BOOST_CHECK_EQUAL(router.size(), 8);
+	
+	HttpRouter::Match match;
+	std::string path("/");
+	BOOST_REQUIRE(router.resolve(HttpRouter::M_GET, path.c_str(), path.size(), match));
+	BOOST_CHECK_EQUAL(match.handler, 1);
+	
+	path = "/users/";
+	BOOST_REQUIRE(router.resolve(HttpRouter::M_HEAD, path.c_str(), path.size(), match));
+	BOOST_CHECK_EQUAL(match.handler, 2);
+	
+	path = "/users/42";
+	BOOST_REQUIRE(router.resolve(HttpRouter::M_GET, path.c_str(), path.size(), match));
+	BOOST_CHECK_EQUAL(match.handler, 3);
+	BOOST_REQUIRE_EQUAL(match.paramsCount, 1);
+	BOOST_CHECK_EQUAL(param(path, match, 0), "42");
+	BOOST_REQUIRE(router.resolve(HttpRouter::M_POST, path.c_str(), path.size(), match));
+	BOOST_CHECK_EQUAL(match.handler, 4);
+	
+	path = "/users/me";
+	BOOST_REQUIRE(router.resolve(HttpRouter::M_GET, path.c_str(), path.size(), match));
+	BOOST_CHECK_EQUAL(match.handler, 5);
+	BOOST_CHECK_EQUAL(match.paramsCount, 0);
+	// static segment doesn't support POST, falls back to the param route
+	BOOST_REQUIRE(router.resolve(HttpRouter::M_POST, path.c_str(), path.size(), match));
+	BOOST_CHECK_EQUAL(match.handler, 4);
+	
+	path = "/users/me/posts/7";
+	BOOST_REQUIRE(router.resolve(HttpRouter::M_GET, path.c_str(), path.size(), match));
+	BOOST_CHECK_EQUAL(match.handler, 6);
+	BOOST_REQUIRE_EQUAL(match.paramsCount, 2);
+	BOOST_CHECK_EQUAL(param(path, match, 0), "me");
+	BOOST_CHECK_EQUAL(param(path, match, 1), "7");
+	
+	path = "/static/css/main/a/b.css";
+	BOOST_REQUIRE(router.resolve(HttpRouter::M_GET, path.c_str(), path.size(), match));
+	BOOST_CHECK_EQUAL(match.handler, 7);
+	BOOST_REQUIRE_EQUAL(match.paramsCount, 1);
+	BOOST_CHECK_EQUAL(param(path, match, 0), "a/b.css");
+	
+	path = "/api/v1/very/long/static/path";
+	BOOST_REQUIRE(router.resolve(HttpRouter::M_DELETE, path.c_str(), path.size(), match));
+	BOOST_CHECK_EQUAL(match.handler, 8);
+	
+	path = "/api/v1/very/long/static/pathX";
+	BOOST_CHECK(!router.resolve(HttpRouter::M_GET, path.c_str(), path.size(), match));
+	BOOST_CHECK(!match.methodNotAllowed);
+	path = "/api/v1/very";
+	BOOST_CHECK(!router.resolve(HttpRouter::M_GET, path.c_str(), path.size(), match));
+	path = "/static/css/main";
+	BOOST_CHECK(!router.resolve(HttpRouter::M_GET, path.c_str(), path.size(), match));
+	
+	path = "/users";
+	BOOST_CHECK(!router.resolve(HttpRouter::M_DELETE, path.c_str(), path.size(), match));
+	BOOST_CHECK(match.methodNotAllowed);
+	BOOST_CHECK_EQUAL(match.handler, HttpRouter::NOT_FOUND);
+}
+
+BOOST_AUTO_TEST_CASE( RouteConflicts )
+{
+	HttpRouter router;
+	router.add(HttpRouter::M_GET, "/a/:id", 1);
+	BOOST_CHECK_THROW(router.add(HttpRouter::M_GET | HttpRouter::M_POST, "/a/:name", 2), HttpRouter::Error);
+	BOOST_CHECK_NO_THROW(router.add(HttpRouter::M_POST, "/a/:name", 2));
+	BOOST_CHECK_THROW(router.add(HttpRouter::M_GET, "/a/*/b", 3), HttpRouter::Error);
+	HttpRouter::Match match;
+	BOOST_CHECK(!router.resolve(HttpRouter::M_GET, "/a/1", 4, match)); // not compiled
+}
+
+BOOST_AUTO_TEST_CASE( ManyRoutes )
+{
+	HttpRouter router;
+	char pattern[128];
+	for (int i = 0; i < 500; i++) {
+		snprintf(pattern, sizeof(pattern), "/service%d/resource%d/:id/action%d", i % 10, i / 10, i);
+		router.add(HttpRouter::M_GET, pattern, i);
+	}
+	router.compile();
+	HttpRouter::Match match;
+	for (int i = 0; i < 500; i++) {
+		snprintf(pattern, sizeof(pattern), "/service%d/resource%d/%d/action%d", i % 10, i / 10, i * 3, i);
+		BOOST_REQUIRE(router.resolve(HttpRouter::M_GET, pattern, strlen(pattern), match));
+		BOOST_CHECK_EQUAL(match.handler, i);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( ParseMethod )
+{
+	BOOST_CHECK_EQUAL(HttpRouter::parseMethod("GET / HTTP/1.1"), HttpRouter::M_GET);
+	BOOST_CHECK_EQUAL(HttpRouter::parseMethod("post / HTTP/1.1"), HttpRouter::M_POST);
+	BOOST_CHECK_EQUAL(HttpRouter::parseMethod("PROPFIND / HTTP/1.1"), HttpRouter::M_PROPFIND);
+	BOOST_CHECK_EQUAL(HttpRouter::parseMethod("PUT / HTTP/1.1"), HttpRouter::M_PUT);
+	BOOST_CHECK_EQUAL(HttpRouter::parseMethod("PUTX / HTTP/1.1"), HttpRouter::M_UNKNOWN);
+}
+
+static HttpRouter &testRouter()
+{
+	static HttpRouter router;
+	if (!router.size()) {
+		router.add(HttpRouter::M_GET, "/hello/:name", 1);
+		router.compile();
+	}
+	return router;
+}
+
+class RoutedMockHttpEventInterface : public RoutedHttpEventInterface
+{
+public:
+	RoutedMockHttpEventInterface()
+		: RoutedHttpEventInterface(&testRouter())
+	{
+	}
+	virtual EFormResult formRouteResult(const HttpRouter::THandlerId handler, BString &networkBuffer, 
+		class HttpEvent *http)
+	{
+		const char *name;
+		size_t nameLength;
+		if (!_param(0, name, nameLength))
+			return RESULT_ERROR;
+		networkBuffer.sprintfSet("HTTP/1.0 200 OK\r\n\r\n%u:", handler);
+		networkBuffer.add(name, nameLength);
+		return RESULT_OK_CLOSE;
+	}
+};
+
+BOOST_AUTO_TEST_CASE( RoutedInterface )
+{
+	HttpMockEventFactory<RoutedMockHttpEventInterface> factory;
+	TestHttpEventFramework testEventFramework(&factory);
+	BString answer;
+	BOOST_REQUIRE(testEventFramework.doRequest("GET /hello/world?x=1 HTTP/1.0\r\n\r\n", answer));
+	BOOST_CHECK(answer == "HTTP/1.0 200 OK\r\n\r\n1:world");
+	answer.clear();
+	BOOST_REQUIRE(testEventFramework.doRequest("GET /bye HTTP/1.0\r\n\r\n", answer));
+	BOOST_CHECK(strstr(answer.c_str(), "404") != NULL);
+	answer.clear();
+	BOOST_REQUIRE(testEventFramework.doRequest("POST /hello/world HTTP/1.0\r\n\r\n", answer));
+	BOOST_CHECK(strstr(answer.c_str(), "405") != NULL);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
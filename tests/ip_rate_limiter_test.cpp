@@ -0,0 +1,115 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: IpRateLimiter class unit tests
+///////////////////////////////////////////////////////////////////////////////
+
+#include <boost/test/unit_test.hpp>
+#include "ip_rate_limiter.hpp"
+#include "mock_http_util.hpp"
+
+using namespace fl::network;
+using namespace fl::events;
+
+BOOST_AUTO_TEST_SUITE( IpRateLimiterTest )
+
+BOOST_AUTO_TEST_CASE( TokenBucket )
+{
+	IpRateLimiter limiter(1, 3);
+	const TIPv4 ip = Socket::ip2Long("10.0.0.1");
+	BOOST_CHECK(limiter.allow(ip));
+	BOOST_CHECK(limiter.allow(ip));
+	BOOST_CHECK(limiter.allow(ip));
+	BOOST_CHECK(!limiter.allow(ip));
+	BOOST_CHECK(limiter.allow(Socket::ip2Long("10.0.0.2")));
+	BOOST_CHECK_EQUAL(limiter.rejected(), 1);
+	BOOST_CHECK_EQUAL(limiter.size(), 2);
+	BOOST_CHECK(strstr(limiter.rejectAnswer().c_str(), "503") != NULL);
+	BOOST_CHECK(strstr(limiter.rejectAnswer().c_str(), "Retry-After: 1\r\n") != NULL);
+}
+
+BOOST_AUTO_TEST_CASE( Refill )
+{
+	IpRateLimiter limiter(100, 1);
+	const TIPv4 ip = Socket::ip2Long("10.0.0.1");
+	BOOST_CHECK(limiter.allow(ip));
+	BOOST_CHECK(!limiter.allow(ip));
+	struct timespec tim = {0, 50 * 1000 * 1000};
+	nanosleep(&tim, NULL);
+	BOOST_CHECK(limiter.allow(ip));
+}
+
+BOOST_AUTO_TEST_CASE( Sweep )
+{
+	IpRateLimiter limiter(10, 10, 0);
+	for (TIPv4 ip = 1; ip < 100; ip++)
+		limiter.allow(ip);
+	BOOST_CHECK_EQUAL(limiter.size(), 99);
+	BOOST_CHECK_EQUAL(limiter.sweep(), 99);
+	BOOST_CHECK_EQUAL(limiter.size(), 0);
+	
+	IpRateLimiter longLivedLimiter(10, 10, 3600);
+	longLivedLimiter.allow(1);
+	BOOST_CHECK_EQUAL(longLivedLimiter.sweep(), 0);
+}
+
+class RateLimitedMockHttpEventInterface : public HttpEventInterface
+{
+public:
+	virtual bool parseURI(const char *cmdStart, const EHttpVersion::EHttpVersion version,
+			const std::string &host, const std::string &fileName, const std::string &query)
+	{
+		return true;
+	}
+	virtual EFormResult formResult(BString &networkBuffer, class HttpEvent *http)
+	{
+		networkBuffer << "HTTP/1.0 200 OK\r\n\r\n";
+		return RESULT_OK_CLOSE;
+	}
+};
+
+class RateLimitedThreadSpecificDataFactory : public ThreadSpecificDataFactory
+{
+public:
+	RateLimitedThreadSpecificDataFactory(IpRateLimiter *limiter)
+		: _limiter(limiter)
+	{
+	}
+	virtual ThreadSpecificData *create()
+	{
+		HttpThreadSpecificData *data = new HttpThreadSpecificData();
+		data->requestRateLimiter = _limiter;
+		data->trustXRealIP = true;
+		return data;
+	}
+private:
+	IpRateLimiter *_limiter;
+};
+
+BOOST_AUTO_TEST_CASE( HttpEventRequestLimit )
+{
+	IpRateLimiter limiter(1, 2);
+	HttpMockEventFactory<RateLimitedMockHttpEventInterface> factory;
+	TestHttpEventFramework testEventFramework(&factory, new RateLimitedThreadSpecificDataFactory(&limiter));
+	BString answer;
+	for (int i = 0; i < 2; i++) {
+		answer.clear();
+		BOOST_REQUIRE(testEventFramework.doRequest("GET / HTTP/1.0\r\n\r\n", answer));
+		BOOST_CHECK(answer == "HTTP/1.0 200 OK\r\n\r\n");
+	}
+	answer.clear();
+	BOOST_REQUIRE(testEventFramework.doRequest("GET / HTTP/1.0\r\n\r\n", answer));
+	BOOST_CHECK(answer == limiter.rejectAnswer().c_str());
+	
+	// a client behind the balancer has its own bucket
+	answer.clear();
+	BOOST_REQUIRE(testEventFramework.doRequest("GET / HTTP/1.0\r\nX-Real-IP: 192.168.1.1\r\n\r\n", answer));
+	BOOST_CHECK(answer == "HTTP/1.0 200 OK\r\n\r\n");
+	BOOST_CHECK_EQUAL(limiter.size(), 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
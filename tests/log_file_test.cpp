@@ -0,0 +1,232 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Log file rotation, reopen and compression unit tests
+///////////////////////////////////////////////////////////////////////////////
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <csignal>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#ifndef NO_ZLIB
+#include <zlib.h>
+#endif
+#include "log_file.hpp"
+#include "binary_log.hpp"
+#include "dir.hpp"
+#include "mock_log_system.hpp"
+
+using namespace fl::log;
+using fl::fs::Directory;
+
+namespace
+{
+	const char * const LOG_DIR = "/tmp/fl_log_file_test";
+	const char * const LOG_FILE = "/tmp/fl_log_file_test/test.log";
+
+	const char FILE_LOG_TAG[] = "file";
+	typedef MockLogSystem<FILE_LOG_TAG> FileTestLogSystem;
+	typedef Log<true, ELogLevel::ERROR, FileTestLogSystem> TestError;
+
+	void createDir()
+	{
+		Directory::rmDirRecursive(LOG_DIR);
+		BOOST_REQUIRE(Directory::makeDirRecursive(LOG_DIR));
+	}
+
+	// the rotated files of the log in the order of their names
+	std::vector<std::string> rotatedFiles()
+	{
+		std::vector<std::string> files;
+		Directory dir(LOG_DIR);
+		while (dir.next()) {
+			std::string name = dir.name();
+			if (name.compare(0, 9, "test.log.") == 0)
+				files.push_back(std::string(LOG_DIR) + "/" + name);
+		}
+		std::sort(files.begin(), files.end());
+		return files;
+	}
+
+	std::string readFile(const std::string &fileName)
+	{
+		std::ifstream file(fileName.c_str(), std::ios::binary);
+		std::stringstream data;
+		data << file.rdbuf();
+		return data.str();
+	}
+
+	size_t countLines(const std::string &text)
+	{
+		return std::count(text.begin(), text.end(), '\n');
+	}
+};
+
+BOOST_AUTO_TEST_SUITE( LogFileTest )
+
+BOOST_AUTO_TEST_CASE( SizeRotation )
+{
+	createDir();
+	FileTarget *target = new FileTarget(LOG_FILE);
+	static const uint64_t MAX_SIZE = 1000;
+	target->setRotation(MAX_SIZE, 0, 3);
+	FileTestLogSystem::setTarget(target);
+	for (int i = 0; i < 100; i++)
+		TestError::L("message %d of the size rotation\n", i);
+	FileTestLogSystem::logSystem().clearTargets();
+	LogFile::waitArchive();
+
+	std::vector<std::string> files = rotatedFiles();
+	BOOST_CHECK_EQUAL(files.size(), 3U);
+	std::string current = readFile(LOG_FILE);
+	BOOST_CHECK(current.size() <= MAX_SIZE);
+	BOOST_CHECK(current.find("message 99 ") != std::string::npos);
+	std::string all = current;
+	for (auto file = files.begin(); file != files.end(); file++) {
+		std::string rotated = readFile(*file);
+		BOOST_CHECK(rotated.size() <= MAX_SIZE);
+		BOOST_CHECK(rotated.size() > MAX_SIZE / 2);
+		all += rotated;
+	}
+	// the oldest files are removed
+	BOOST_CHECK(countLines(all) < 100);
+	BOOST_CHECK(all.find("message 0 ") == std::string::npos);
+	BOOST_CHECK(all.find("message 98 ") != std::string::npos);
+	Directory::rmDirRecursive(LOG_DIR);
+}
+
+BOOST_AUTO_TEST_CASE( IntervalRotation )
+{
+	createDir();
+	LogFile file(LOG_FILE);
+	file.setRotation(0, 1);
+	time_t start = time(NULL);
+	BOOST_CHECK_EQUAL(file.write("first\n", 6), 6);
+	while (time(NULL) == start)
+		usleep(10000);
+	BOOST_CHECK_EQUAL(file.write("second\n", 7), 7);
+	std::vector<std::string> files = rotatedFiles();
+	BOOST_REQUIRE_EQUAL(files.size(), 1U);
+	BOOST_CHECK_EQUAL(readFile(files[0]), "first\n");
+	BOOST_CHECK_EQUAL(readFile(LOG_FILE), "second\n");
+
+	// the rotations of one second get the numbers
+	file.rotate();
+	BOOST_CHECK_EQUAL(file.write("third\n", 6), 6);
+	BOOST_CHECK_EQUAL(rotatedFiles().size(), 2U);
+	std::string stamped = files[0];
+	file.rotate();
+	struct iovec iov[2] = {{const_cast<char*>("fou"), 3}, {const_cast<char*>("rth\n"), 4}};
+	BOOST_CHECK_EQUAL(file.writev(iov, 2), 7);
+	files = rotatedFiles();
+	BOOST_REQUIRE_EQUAL(files.size(), 3U);
+	size_t numbered = 0;
+	for (auto rotated = files.begin(); rotated != files.end(); rotated++)
+		numbered += (rotated->size() == stamped.size() + 2);
+	BOOST_CHECK(numbered >= 1);
+	BOOST_CHECK_EQUAL(readFile(LOG_FILE), "fourth\n");
+	Directory::rmDirRecursive(LOG_DIR);
+}
+
+BOOST_AUTO_TEST_CASE( EmptyFileRotation )
+{
+	createDir();
+	LogFile file(LOG_FILE);
+	file.rotate();
+	BOOST_CHECK_EQUAL(file.write("message\n", 8), 8);
+	BOOST_CHECK(rotatedFiles().empty());
+	BOOST_CHECK_EQUAL(file.size(), 8U);
+	Directory::rmDirRecursive(LOG_DIR);
+}
+
+BOOST_AUTO_TEST_CASE( ReopenOnSigHup )
+{
+	createDir();
+	LogFile::reopenOnSigHup();
+	FileTarget *target = new FileTarget(LOG_FILE);
+	FileTestLogSystem::setTarget(target);
+	TestError::L("before the rotation\n");
+	// the external rotation moves the file and sends SIGHUP
+	std::string moved = std::string(LOG_FILE) + ".moved";
+	BOOST_REQUIRE_EQUAL(rename(LOG_FILE, moved.c_str()), 0);
+	TestError::L("still to the moved file\n");
+	raise(SIGHUP);
+	TestError::L("after the reopen\n");
+	FileTestLogSystem::logSystem().clearTargets();
+	signal(SIGHUP, SIG_DFL);
+
+	std::string old = readFile(moved);
+	BOOST_CHECK_EQUAL(countLines(old), 2U);
+	BOOST_CHECK(old.find("still to the moved file") != std::string::npos);
+	std::string current = readFile(LOG_FILE);
+	BOOST_CHECK_EQUAL(countLines(current), 1U);
+	BOOST_CHECK(current.find("after the reopen") != std::string::npos);
+	Directory::rmDirRecursive(LOG_DIR);
+}
+
+BOOST_AUTO_TEST_CASE( Compression )
+{
+	if (!LogFile::canCompress())
+		return;
+	createDir();
+	AsyncFileTarget *target = new AsyncFileTarget(LOG_FILE);
+	target->setRotation(0, 0, 0, true);
+	FileTestLogSystem::setTarget(target);
+	TestError::L("compressed message\n");
+	target->flush();
+	target->rotate();
+	TestError::L("current message\n");
+	FileTestLogSystem::logSystem().clearTargets();
+	LogFile::waitArchive();
+
+	std::vector<std::string> files = rotatedFiles();
+	BOOST_REQUIRE_EQUAL(files.size(), 1U);
+	BOOST_CHECK(files[0].find(".gz") == files[0].size() - 3);
+#ifndef NO_ZLIB
+	gzFile gz = gzopen(files[0].c_str(), "rb");
+	BOOST_REQUIRE(gz != NULL);
+	char buf[256];
+	int size = gzread(gz, buf, sizeof(buf));
+	gzclose(gz);
+	BOOST_REQUIRE(size > 0);
+	BOOST_CHECK(std::string(buf, size).find("compressed message\n") != std::string::npos);
+#endif
+	BOOST_CHECK(readFile(LOG_FILE).find("current message\n") != std::string::npos);
+	Directory::rmDirRecursive(LOG_DIR);
+}
+
+BOOST_AUTO_TEST_CASE( BinaryLogRotation )
+{
+	createDir();
+	BinaryLogTarget *target = new BinaryLogTarget(LOG_FILE);
+	FileTestLogSystem::setTarget(target);
+	TestError::L("first file %d\n", 1);
+	target->flush();
+	target->rotate();
+	TestError::L("second file %d\n", 2);
+	FileTestLogSystem::logSystem().clearTargets();
+
+	// each file has the definitions of the messages
+	std::vector<std::string> files = rotatedFiles();
+	BOOST_REQUIRE_EQUAL(files.size(), 1U);
+	std::string rotated = readFile(files[0]);
+	std::string current = readFile(LOG_FILE);
+	std::string text;
+	BOOST_CHECK_EQUAL(BinaryLogDecoder().decode(rotated.c_str(), rotated.size(), text), rotated.size());
+	BOOST_CHECK(text.find("first file 1\n") != std::string::npos);
+	text.clear();
+	BOOST_CHECK_EQUAL(BinaryLogDecoder().decode(current.c_str(), current.size(), text), current.size());
+	BOOST_CHECK_EQUAL(countLines(text), 1U);
+	BOOST_CHECK(text.find("second file 2\n") != std::string::npos);
+	Directory::rmDirRecursive(LOG_DIR);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,198 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Runtime log levels, rate limiting and sampling unit tests
+///////////////////////////////////////////////////////////////////////////////
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "log.hpp"
+#include "db_log.hpp"
+#include "mock_log_system.hpp"
+
+using namespace fl::log;
+
+namespace
+{
+	// keeps the formatted messages
+	class MessagesTarget : public Target
+	{
+	public:
+		virtual void log(const int level, const char *tag, const time_t curTime, struct tm *ct, const char *fmt,
+			va_list args)
+		{
+			char buf[1024];
+			vsnprintf(buf, sizeof(buf), fmt, args);
+			messages.push_back(buf);
+		}
+		virtual void log(const int level, const char *fileName, const int lineNumber, const char *tag,
+			const time_t curTime, struct tm *ct, const char *fmt, va_list args)
+		{
+			log(level, tag, curTime, ct, fmt, args);
+		}
+		std::vector<std::string> messages;
+	};
+
+	const char LEVEL_LOG_TAG[] = "levelTest";
+	class LevelTestLogSystem : public MockLogSystem<LEVEL_LOG_TAG>
+	{
+	public:
+		static TagLevel tagLevel;
+		static MessagesTarget *start()
+		{
+			return setTarget(new MessagesTarget());
+		}
+	};
+	TagLevel LevelTestLogSystem::tagLevel("levelTest", ELogLevel::WARNING);
+	TagLevel defaultTagLevel("defaultLevelTest");
+
+	typedef Log<true, ELogLevel::INFO, LevelTestLogSystem> TestInfo;
+	typedef Log<true, ELogLevel::WARNING, LevelTestLogSystem> TestWarning;
+	typedef Log<true, ELogLevel::ERROR, LevelTestLogSystem> TestError;
+	typedef Log<false, ELogLevel::ERROR, LevelTestLogSystem> TestCompiledOut;
+
+	const uint32_t ERRORS_PER_SECOND = 5;
+
+	// one call site for all the calls
+	void limitedError(const int i)
+	{
+		FL_LOG_RATE_LIMITED(TestError, ERRORS_PER_SECOND, "error %d\n", i);
+	}
+};
+
+BOOST_AUTO_TEST_SUITE( LogLevelTest )
+
+BOOST_AUTO_TEST_CASE( RuntimeLevel )
+{
+	MessagesTarget *target = LevelTestLogSystem::start();
+	BOOST_CHECK(TestWarning::enabled());
+	BOOST_CHECK(!TestInfo::enabled());
+	BOOST_CHECK(!TestCompiledOut::enabled());
+	TestInfo::L("info %d\n", 1);
+	TestWarning::L("warning %d\n", 1);
+	BOOST_REQUIRE_EQUAL(target->messages.size(), 1U);
+	BOOST_CHECK_EQUAL(target->messages[0], "warning 1\n");
+
+	BOOST_CHECK(TagLevel::set("levelTest", ELogLevel::INFO));
+	BOOST_CHECK(TestInfo::enabled());
+	TestInfo::L("info %d\n", 2);
+	BOOST_REQUIRE_EQUAL(target->messages.size(), 2U);
+	BOOST_CHECK_EQUAL(target->messages[1], "info 2\n");
+
+	BOOST_CHECK(TagLevel::set("levelTest", ELogLevel::ERROR));
+	TestWarning::L("warning %d\n", 2);
+	TestError::L("error %d\n", 1);
+	BOOST_REQUIRE_EQUAL(target->messages.size(), 3U);
+	BOOST_CHECK_EQUAL(target->messages[2], "error 1\n");
+
+	BOOST_CHECK(!TagLevel::set("noSuchTag", ELogLevel::INFO));
+	LevelTestLogSystem::tagLevel.set(ELogLevel::WARNING);
+	LevelTestLogSystem::logSystem().clearTargets();
+}
+
+BOOST_AUTO_TEST_CASE( DefaultLevel )
+{
+	// only the compile time level filters the messages till the runtime levels are configured
+	BOOST_CHECK_EQUAL(defaultTagLevel.get(), ELogLevel::INFO);
+	BOOST_CHECK(defaultTagLevel.enabled(ELogLevel::INFO));
+}
+
+BOOST_AUTO_TEST_CASE( Configure )
+{
+	int libLevel = LibLogSystem::tagLevel.get();
+	int dbLevel = fl::db::log::DbLogSystem::tagLevel.get();
+	BOOST_CHECK(TagLevel::configure("fLib=INFO,DB=1"));
+	BOOST_CHECK_EQUAL(LibLogSystem::tagLevel.get(), ELogLevel::INFO);
+	BOOST_CHECK_EQUAL(fl::db::log::DbLogSystem::tagLevel.get(), ELogLevel::FATAL);
+	BOOST_CHECK(TagLevel::configure("*=error"));
+	BOOST_CHECK_EQUAL(LibLogSystem::tagLevel.get(), ELogLevel::ERROR);
+	BOOST_CHECK_EQUAL(LevelTestLogSystem::tagLevel.get(), ELogLevel::ERROR);
+	BOOST_CHECK(!TagLevel::configure("fLib=VERBOSE"));
+	BOOST_CHECK(!TagLevel::configure("noSuchTag=INFO"));
+	BOOST_CHECK(!TagLevel::configure("fLib"));
+	BOOST_CHECK_EQUAL(LibLogSystem::tagLevel.get(), ELogLevel::ERROR);
+	LibLogSystem::tagLevel.set(libLevel);
+	fl::db::log::DbLogSystem::tagLevel.set(dbLevel);
+	LevelTestLogSystem::tagLevel.set(ELogLevel::WARNING);
+	defaultTagLevel.set(ELogLevel::INFO);
+}
+
+BOOST_AUTO_TEST_CASE( RateLimited )
+{
+	MessagesTarget *target = LevelTestLogSystem::start();
+	// the calls can cross a second, then the next second has its own messages
+	time_t start = time(NULL);
+	for (int i = 0; i < 100; i++)
+		limitedError(i);
+	bool sameSecond = (time(NULL) == start);
+	if (sameSecond)
+		BOOST_CHECK_EQUAL(target->messages.size(), ERRORS_PER_SECOND);
+	BOOST_CHECK(target->messages.size() < 100);
+
+	// the next second reports the suppressed messages before its first one
+	size_t limitedCount = target->messages.size();
+	while (time(NULL) <= start + 1)
+		usleep(10000);
+	limitedError(100);
+	BOOST_REQUIRE_EQUAL(target->messages.size(), limitedCount + 2);
+	BOOST_CHECK_EQUAL(target->messages.back(), "error 100\n");
+	if (sameSecond)
+		BOOST_CHECK(target->messages[limitedCount].find("95 messages of ") == 0);
+	BOOST_CHECK(target->messages[limitedCount].find("log_level_test.cpp") != std::string::npos);
+
+	// the disabled level doesn't reach the limiter
+	target = LevelTestLogSystem::start();
+	for (int i = 0; i < 100; i++)
+		FL_LOG_RATE_LIMITED(TestInfo, ERRORS_PER_SECOND, "disabled %d\n", i);
+	BOOST_CHECK(target->messages.empty());
+	LevelTestLogSystem::logSystem().clearTargets();
+}
+
+BOOST_AUTO_TEST_CASE( Limiter )
+{
+	RateLimiter limiter(2);
+	uint32_t suppressed = 0;
+	time_t start = time(NULL);
+	BOOST_CHECK(limiter.allow(suppressed));
+	BOOST_CHECK_EQUAL(suppressed, 0U);
+	BOOST_CHECK(limiter.allow(suppressed));
+	uint32_t allowed = 0;
+	for (int i = 0; i < 10; i++)
+		allowed += limiter.allow(suppressed);
+	bool sameSecond = (time(NULL) == start);
+	while (time(NULL) == start)
+		usleep(10000);
+	BOOST_CHECK(limiter.allow(suppressed));
+	if (sameSecond) {
+		BOOST_CHECK_EQUAL(allowed, 0U);
+		BOOST_CHECK_EQUAL(suppressed, 10U);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( Sampled )
+{
+	MessagesTarget *target = LevelTestLogSystem::start();
+	static const int CALLS = 10000;
+	for (int i = 0; i < CALLS; i++)
+		FL_LOG_SAMPLED(TestError, 0.1, "sampled %d\n", i);
+	BOOST_CHECK(target->messages.size() > CALLS / 20);
+	BOOST_CHECK(target->messages.size() < CALLS / 5);
+	size_t sampled = target->messages.size();
+	for (int i = 0; i < CALLS; i++)
+		FL_LOG_SAMPLED(TestError, 1, "all %d\n", i);
+	BOOST_CHECK_EQUAL(target->messages.size(), sampled + CALLS);
+	for (int i = 0; i < CALLS; i++)
+		FL_LOG_SAMPLED(TestError, 0, "none %d\n", i);
+	for (int i = 0; i < CALLS; i++)
+		FL_LOG_SAMPLED(TestInfo, 1, "disabled %d\n", i);
+	BOOST_CHECK_EQUAL(target->messages.size(), sampled + CALLS);
+	LevelTestLogSystem::logSystem().clearTargets();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Memory region unit tests
+///////////////////////////////////////////////////////////////////////////////
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "memory_region.hpp"
+#include "segmented_buffer.hpp"
+
+using namespace fl::utils;
+using fl::network::SegmentPool;
+using fl::network::SegmentedBuffer;
+using fl::strings::BString;
+
+BOOST_AUTO_TEST_SUITE( MemoryRegionTest )
+
+BOOST_AUTO_TEST_CASE( Chunks )
+{
+	MemoryRegion region(1, 1000);
+	BOOST_REQUIRE_EQUAL(region.size(), MemoryRegion::HUGE_PAGE_SIZE);
+	BOOST_REQUIRE_EQUAL(region.chunkSize(), 1024U);
+	BOOST_REQUIRE_EQUAL(region.chunksCount(), 2048U);
+	std::vector<void*> chunks;
+	void *chunk;
+	while ((chunk = region.get()) != NULL) {
+		BOOST_REQUIRE(region.contains(chunk));
+		BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(chunk) % MemoryRegion::CHUNK_ALIGN, 0U);
+		memset(chunk, 1, region.chunkSize());
+		chunks.push_back(chunk);
+	}
+	BOOST_REQUIRE_EQUAL(chunks.size(), region.chunksCount());
+	BOOST_REQUIRE_EQUAL(region.usedChunks(), chunks.size());
+	region.free(chunks[10]);
+	BOOST_REQUIRE_EQUAL(region.usedChunks(), chunks.size() - 1);
+	BOOST_REQUIRE(region.get() == chunks[10]);
+	BOOST_REQUIRE(region.get() == NULL);
+	int onStack;
+	BOOST_REQUIRE(!region.contains(&onStack));
+
+	MemoryRegion::Usage usage;
+	if (region.usage(usage)) {
+		BOOST_CHECK(usage.rss >= region.size());
+		if (!region.hugePages())
+			BOOST_CHECK_EQUAL(usage.hugePages, 0U);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( RemoteFrees )
+{
+	MemoryRegion region(MemoryRegion::HUGE_PAGE_SIZE, MemoryRegion::HUGE_PAGE_SIZE / 4);
+	std::vector<void*> chunks;
+	for (int i = 0; i < 4; i++)
+		chunks.push_back(region.get());
+	BOOST_REQUIRE(region.get() == NULL);
+	std::thread freeThread([&region, &chunks]() {
+		for (auto chunk = chunks.begin(); chunk != chunks.end(); chunk++)
+			region.freeRemote(*chunk);
+	});
+	freeThread.join();
+	BOOST_REQUIRE_EQUAL(region.usedChunks(), 4U); // until the owner takes them
+	for (int i = 0; i < 4; i++)
+		BOOST_REQUIRE(region.get() != NULL);
+	BOOST_REQUIRE_EQUAL(region.usedChunks(), 4U);
+	BOOST_REQUIRE(region.get() == NULL);
+}
+
+BOOST_AUTO_TEST_CASE( SegmentPoolRegion )
+{
+	MemoryRegion region(MemoryRegion::HUGE_PAGE_SIZE, sizeof(SegmentPool::Segment) + 64 * 1024);
+	SegmentPool smallChunks(256 * 1024, 4);
+	BOOST_CHECK_THROW(smallChunks.setRegion(&region), MemoryRegion::Error);
+
+	SegmentPool pool(64 * 1024, 4);
+	pool.setRegion(&region);
+	std::string data(region.chunksCount() * 64 * 1024 + 1000, 'x');
+	{
+		SegmentedBuffer buf(&pool);
+		buf.add(data.c_str(), data.size()); // the last segment is taken from the heap
+		BOOST_REQUIRE_EQUAL(buf.segmentsCount(), region.chunksCount() + 1);
+		BOOST_REQUIRE_EQUAL(region.usedChunks(), region.chunksCount());
+		BString copy;
+		buf.copyTo(copy);
+		BOOST_REQUIRE(data == copy.c_str());
+	}
+	BOOST_CHECK_EQUAL(pool.freeSegments(), 4U);
+	BOOST_CHECK_EQUAL(region.usedChunks(), 4U); // over the free segments limit they are returned to the region
+
+	SegmentedBuffer detached(&pool);
+	detached.add(data.c_str(), 100);
+	detached.detachPool();
+	std::thread([&detached]() { detached.clear(); }).join();
+	BOOST_CHECK_EQUAL(pool.freeSegments(), 3U);
+	size_t taken = 0;
+	while (region.get())
+		taken++;
+	BOOST_CHECK_EQUAL(taken, region.chunksCount() - 3); // the detached segment was freed remotely
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -46,7 +46,7 @@ namespace fl {
 			virtual WorkEvent *create(const TEventDescriptor descr, const TIPv4 ip, const time_t timeOutTime, 
 				Socket *acceptSocket)
 			{
-				return new HttpEvent(descr, timeOutTime, new T());
+				return new HttpEvent(descr, timeOutTime, new T(), ip);
 			}
 			virtual ~HttpMockEventFactory() {};
 		};
@@ -54,13 +54,15 @@ namespace fl {
 		class TestHttpEventFramework
 		{
 		public:
-			TestHttpEventFramework(WorkEventFactory *factory)
-				: _ip("127.0.0.1"), _port(2000 + rand() % 10000), _acceptThread(NULL), _workerGroup(NULL)
+			// dataFactory is owned by the framework
+			TestHttpEventFramework(WorkEventFactory *factory, ThreadSpecificDataFactory *dataFactory = NULL)
+				: _ip("127.0.0.1"), _port(2000 + rand() % 10000), _acceptThread(NULL), _workerGroup(NULL),
+				_dataFactory(dataFactory ? dataFactory : new MockThreadSpecificDataFactory())
 			{		
 				do {
 					_port++;
 				} while (!_listen.listen(_ip.c_str(), _port));
-				_workerGroup = new EPollWorkerGroup(new MockThreadSpecificDataFactory(), 1, 10, 200000);
+				_workerGroup = new EPollWorkerGroup(_dataFactory, 1, 10, 200000);
 				_acceptThread = new AcceptThread(_workerGroup, &_listen, factory);
 			};
 			~TestHttpEventFramework()
@@ -69,6 +71,7 @@ namespace fl {
 				_acceptThread->waitMe();
 				delete _acceptThread;
 				delete _workerGroup;
+				delete _dataFactory;
 			}
 			bool doRequest(const BString &request, BString &answer)
 			{
@@ -92,12 +95,21 @@ namespace fl {
 				else
 					return true;
 			}
+			const std::string &ip() const
+			{
+				return _ip;
+			}
+			uint16_t port() const
+			{
+				return _port;
+			}
 		private:
 			Socket _listen;
 			std::string _ip;
 			uint16_t _port;
 			AcceptThread *_acceptThread;
 			EPollWorkerGroup *_workerGroup;
+			ThreadSpecificDataFactory *_dataFactory;
 		};
 	};
 };
@@ -0,0 +1,52 @@
+#pragma once
+#ifndef __FL_MOCK_LOG_SYSTEM_HPP
+#define	__FL_MOCK_LOG_SYSTEM_HPP
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Log system of the log targets unit tests
+///////////////////////////////////////////////////////////////////////////////
+
+#include "log.hpp"
+
+namespace fl {
+	namespace log {
+
+		// Log system of a test module with its own targets, the messages are tagged with TAG
+		template <const char *TAG>
+		class MockLogSystem
+		{
+		public:
+			static bool log(
+				const size_t target,
+				const int level,
+				const time_t curTime,
+				struct tm *ct,
+				const char *fmt,
+				va_list args
+			)
+			{
+				return logSystem().log(target, level, TAG, curTime, ct, fmt, args);
+			}
+			static LogSystem &logSystem()
+			{
+				static LogSystem log;
+				return log;
+			}
+			// replaces the targets with the target
+			template <class T>
+			static T *setTarget(T *target)
+			{
+				logSystem().clearTargets();
+				logSystem().addTarget(target);
+				return target;
+			}
+		};
+	};
+};
+
+#endif	// __FL_MOCK_LOG_SYSTEM_HPP
@@ -0,0 +1,127 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Adaptive mutex and contention profiler unit tests
+///////////////////////////////////////////////////////////////////////////////
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "mutex.hpp"
+
+using namespace fl::threads;
+
+namespace
+{
+	// the thread waits for the mutex which is held for holdUs
+	void contend(Mutex &sync, const uint32_t holdUs)
+	{
+		std::atomic<bool> started(false);
+		sync.lock();
+		std::thread waiter([&]() {
+			started.store(true);
+			AutoMutex autoSync(&sync);
+		});
+		while (!started.load())
+			usleep(100);
+		usleep(holdUs);
+		sync.unLock();
+		waiter.join();
+	}
+
+	const MutexProfiler::LockStats *findStats(const MutexProfiler::TLockStatsVector &stats, const char *name)
+	{
+		for (auto lockStats = stats.begin(); lockStats != stats.end(); lockStats++) {
+			if (lockStats->name == name)
+				return &*lockStats;
+		}
+		return NULL;
+	}
+};
+
+BOOST_AUTO_TEST_SUITE( MutexTest )
+
+BOOST_AUTO_TEST_CASE( MutualExclusion )
+{
+	Mutex sync;
+	static const uint32_t THREADS = 8;
+	static const uint32_t ITERATIONS = 100000;
+	uint64_t counter = 0;
+	std::vector<std::thread> threads;
+	for (uint32_t t = 0; t < THREADS; t++) {
+		threads.emplace_back([&]() {
+			for (uint32_t i = 0; i < ITERATIONS; i++) {
+				AutoMutex autoSync(&sync);
+				counter++;
+			}
+		});
+	}
+	for (auto thread = threads.begin(); thread != threads.end(); thread++)
+		thread->join();
+	BOOST_CHECK_EQUAL(counter, uint64_t(THREADS) * ITERATIONS);
+}
+
+BOOST_AUTO_TEST_CASE( TryLock )
+{
+	Mutex sync;
+	BOOST_CHECK(sync.tryLock());
+	BOOST_CHECK(!sync.tryLock());
+	std::thread other([&]() {
+		BOOST_CHECK(!sync.tryLock());
+	});
+	other.join();
+	sync.unLock();
+	AutoMutex autoSync;
+	BOOST_CHECK(autoSync.tryLock(&sync));
+	BOOST_CHECK(!sync.tryLock());
+	autoSync.unLock();
+	BOOST_CHECK(sync.tryLock());
+	sync.unLock();
+}
+
+BOOST_AUTO_TEST_CASE( ContentionProfile )
+{
+	Mutex hot("MutexTest::hot");
+	Mutex hotToo("MutexTest::hot"); // is counted with the first one
+	Mutex cold("MutexTest::cold");
+	Mutex unnamed;
+	MutexProfiler::reset();
+
+	// the waits aren't counted till the profiler is enabled
+	contend(hot, 1000);
+	BOOST_CHECK(findStats(MutexProfiler::report(), "MutexTest::hot") == NULL);
+
+	MutexProfiler::enable(true);
+	contend(hot, 20000);
+	contend(hotToo, 20000);
+	contend(cold, 1000);
+	contend(unnamed, 1000);
+	MutexProfiler::enable(false);
+
+	// the counters of the finished threads are kept
+	MutexProfiler::TLockStatsVector stats = MutexProfiler::report();
+	const MutexProfiler::LockStats *hotStats = findStats(stats, "MutexTest::hot");
+	const MutexProfiler::LockStats *coldStats = findStats(stats, "MutexTest::cold");
+	BOOST_REQUIRE(hotStats != NULL);
+	BOOST_REQUIRE(coldStats != NULL);
+	BOOST_CHECK(hotStats < coldStats); // by the wait time
+	BOOST_CHECK_EQUAL(hotStats->waits, 2U);
+	BOOST_CHECK(hotStats->sleeps >= 1);
+	BOOST_CHECK(hotStats->waitNs >= 2 * 10000000);
+	BOOST_CHECK(hotStats->maxWaitNs >= 10000000);
+	BOOST_CHECK(hotStats->maxWaitNs <= hotStats->waitNs);
+	BOOST_CHECK_EQUAL(coldStats->waits, 1U);
+	BOOST_CHECK_EQUAL(MutexProfiler::report(1).size(), 1U);
+	BOOST_CHECK(MutexProfiler::reportText().find("MutexTest::hot: 2 waits") != std::string::npos);
+
+	MutexProfiler::reset();
+	BOOST_CHECK(MutexProfiler::report().empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,199 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: NetworkBuffer and NetworkBufferPool classes unit tests
+///////////////////////////////////////////////////////////////////////////////
+
+#include <boost/test/unit_test.hpp>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "network_buffer.hpp"
+
+using namespace fl::network;
+
+BOOST_AUTO_TEST_SUITE( NetworkBufferTest )
+
+BOOST_AUTO_TEST_CASE( PoolSizeClasses )
+{
+	NetworkBufferPool pool(32 * 1024, 16);
+	BOOST_CHECK_EQUAL(pool.stats(0).size, 4 * 1024);
+	BOOST_CHECK_EQUAL(pool.stats(1).size, 32 * 1024);
+	BOOST_CHECK_EQUAL(pool.stats(2).size, 256 * 1024);
+	BOOST_CHECK_EQUAL(pool.stats(3).size, 1024 * 1024);
+
+	NetworkBuffer *small = pool.get();
+	BOOST_CHECK_EQUAL(small->reserved(), 4 * 1024);
+	NetworkBuffer *big = pool.get(100 * 1024);
+	BOOST_CHECK_EQUAL(big->reserved(), 256 * 1024);
+	BOOST_CHECK_EQUAL(pool.stats(0).misses, 1);
+	pool.free(small);
+	pool.free(big);
+	BOOST_CHECK_EQUAL(pool.stats(0).freeBuffers, 1);
+	BOOST_CHECK_EQUAL(pool.stats(2).residentBytes, 256 * 1024);
+
+	small = pool.get();
+	BOOST_CHECK_EQUAL(pool.stats(0).hits, 1);
+	BOOST_CHECK_EQUAL(pool.stats(0).residentBytes, 0);
+	small->reserve(40 * 1024); // grown outside of the pool, goes to the nearest smaller class
+	pool.free(small);
+	BOOST_CHECK_EQUAL(pool.stats(1).freeBuffers, 1);
+
+	NetworkBuffer *huge = pool.get(4 * 1024 * 1024);
+	BOOST_CHECK(huge->reserved() >= 4 * 1024 * 1024);
+	pool.free(huge); // oversized buffers aren't kept
+	BOOST_CHECK_EQUAL(pool.stats(3).freeBuffers, 0);
+}
+
+BOOST_AUTO_TEST_CASE( PromotionOnRead )
+{
+	NetworkBufferPool pool(32 * 1024, 16);
+	int fds[2];
+	BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	std::string data;
+	for (int i = 0; data.size() < 300 * 1024; i++)
+		data += std::to_string(i);
+	NetworkBuffer *buf = pool.get();
+	size_t sent = 0;
+	while (buf->size() < data.size()) {
+		if (sent < data.size()) {
+			ssize_t res = send(fds[0], data.c_str() + sent, std::min<size_t>(16 * 1024, data.size() - sent), 0);
+			BOOST_REQUIRE(res > 0);
+			sent += res;
+		}
+		BOOST_REQUIRE(buf->read(fds[1]) == NetworkBuffer::OK);
+	}
+	BOOST_CHECK(memcmp(buf->c_str(), data.c_str(), data.size()) == 0);
+	BOOST_CHECK_EQUAL(buf->reserved(), 1024 * 1024);
+	BOOST_CHECK(pool.stats(1).promotions > 0);
+	BOOST_CHECK(pool.stats(3).promotions > 0);
+	// smaller buffers were returned to the pool during promotions
+	BOOST_CHECK_EQUAL(pool.stats(0).freeBuffers, 1);
+	BOOST_CHECK_EQUAL(pool.stats(1).freeBuffers, 1);
+	pool.free(buf);
+	BOOST_CHECK_EQUAL(pool.stats(3).freeBuffers, 1);
+
+	buf = pool.get();
+	buf->expand(200 * 1024);
+	BOOST_CHECK_EQUAL(buf->reserved(), 256 * 1024);
+	pool.free(buf);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+BOOST_AUTO_TEST_CASE( IdleTrimming )
+{
+	NetworkBufferPool pool(32 * 1024, 16);
+	NetworkBuffer *bufs[4];
+	for (int i = 0; i < 4; i++)
+		bufs[i] = pool.get();
+	for (int i = 0; i < 4; i++)
+		pool.free(bufs[i]);
+	BOOST_CHECK_EQUAL(pool.trim(), 0); // the first interval has used all buffers
+	BOOST_CHECK_EQUAL(pool.stats(0).freeBuffers, 4);
+
+	pool.free(pool.get());
+	BOOST_CHECK_EQUAL(pool.trim(), 3); // only one buffer was needed
+	BOOST_CHECK_EQUAL(pool.stats(0).freeBuffers, 1);
+	BOOST_CHECK_EQUAL(pool.stats(0).trimmed, 3);
+	BOOST_CHECK_EQUAL(pool.stats(0).residentBytes, 4 * 1024);
+	BOOST_CHECK_EQUAL(pool.trim(), 1);
+	BOOST_CHECK_EQUAL(pool.stats(0).residentBytes, 0);
+}
+
+BOOST_AUTO_TEST_CASE( DepotMagazines )
+{
+	NetworkBufferDepot depot(32 * 1024, 2);
+	NetworkBufferPool first(32 * 1024, 4);
+	NetworkBufferPool second(32 * 1024, 4);
+	first.setDepot(&depot);
+	second.setDepot(&depot);
+	NetworkBufferPool other(16 * 1024, 4);
+	BOOST_CHECK_THROW(other.setDepot(&depot), BString::Error);
+
+	std::vector<NetworkBuffer*> bufs;
+	for (int i = 0; i < 8; i++)
+		bufs.push_back(first.get());
+	for (auto buf = bufs.begin(); buf != bufs.end(); buf++)
+		first.free(*buf);
+	BOOST_CHECK_EQUAL(first.stats(0).depotPuts, 1); // the overflow of the free list went to the depot
+	BOOST_CHECK_EQUAL(first.stats(0).freeBuffers, 4);
+	BOOST_CHECK_EQUAL(depot.stats(0).magazinesPut, 1);
+
+	NetworkBuffer *buf = second.get();
+	BOOST_CHECK_EQUAL(second.stats(0).misses, 0);
+	BOOST_CHECK_EQUAL(second.stats(0).depotGets, 1);
+	BOOST_CHECK_EQUAL(second.stats(0).freeBuffers, 3);
+	second.free(buf);
+}
+
+BOOST_AUTO_TEST_CASE( DepotRemoteFrees )
+{
+	NetworkBufferDepot depot(32 * 1024);
+	NetworkBufferPool pool(32 * 1024, 16);
+	pool.setDepot(&depot);
+	std::vector<NetworkBuffer*> bufs;
+	for (int i = 0; i < 4; i++)
+		bufs.push_back(pool.get());
+	bufs.push_back(pool.get(100 * 1024));
+	std::thread releaser([&bufs]() {
+		for (auto buf = bufs.begin(); buf != bufs.end(); buf++)
+			NetworkBufferPool::release(*buf);
+	});
+	releaser.join();
+	BOOST_CHECK_EQUAL(depot.stats(0).remoteFrees, 4);
+	BOOST_CHECK_EQUAL(depot.stats(2).remoteFrees, 1);
+
+	NetworkBuffer *buf = pool.get();
+	BOOST_CHECK_EQUAL(pool.stats(0).misses, 4);
+	BOOST_CHECK_EQUAL(pool.stats(0).remoteReturns, 4);
+	BOOST_CHECK_EQUAL(pool.stats(0).freeBuffers, 3);
+	pool.free(buf);
+	pool.trim(); // the big buffer is taken from the remote list by the trim
+	BOOST_CHECK_EQUAL(pool.stats(2).remoteReturns, 1);
+
+	NetworkBufferPool::release(new NetworkBuffer(1024)); // without a depot
+}
+
+BOOST_AUTO_TEST_CASE( DepotThreads )
+{
+	static const int THREADS = 4;
+	static const int ROUNDS = 20000;
+	NetworkBufferDepot depot(4 * 1024, 8);
+	std::vector<NetworkBuffer*> exchange[THREADS];
+	std::vector<std::thread> threads;
+	for (int t = 0; t < THREADS; t++) {
+		threads.emplace_back([&depot, t]() {
+			NetworkBufferPool pool(4 * 1024, 8);
+			pool.setDepot(&depot);
+			std::vector<NetworkBuffer*> held;
+			for (int i = 0; i < ROUNDS; i++) {
+				if ((i % 3) && (held.size() < 64)) {
+					held.push_back(pool.get());
+					held.back()->add("x", 1);
+				} else if (!held.empty()) {
+					BOOST_REQUIRE(held.back()->size() == 1);
+					if (i % 2)
+						pool.free(held.back());
+					else
+						NetworkBufferPool::release(held.back());
+					held.pop_back();
+				}
+			}
+			for (auto buf = held.begin(); buf != held.end(); buf++)
+				NetworkBufferPool::release(*buf);
+		});
+	}
+	for (auto thread = threads.begin(); thread != threads.end(); thread++)
+		thread->join();
+	BOOST_CHECK(depot.stats(0).remoteFrees > 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,252 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: RcuPtr and SeqLock unit tests
+///////////////////////////////////////////////////////////////////////////////
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <ctime>
+#include <thread>
+#include <vector>
+#include <sched.h>
+#include <unistd.h>
+#include "rcu.hpp"
+#include "seq_lock.hpp"
+
+using namespace fl::threads;
+
+namespace
+{
+	std::atomic<int> liveConfigs(0);
+
+	// value is always the half of doubled, the destructor breaks it for the late readers
+	class Config
+	{
+	public:
+		Config(const uint64_t value)
+			: value(value), doubled(value * 2)
+		{
+			liveConfigs++;
+		}
+		~Config()
+		{
+			doubled = 1;
+			liveConfigs--;
+		}
+		uint64_t value;
+		uint64_t doubled;
+	};
+
+	struct Limits
+	{
+		uint64_t rate;
+		uint64_t burst;
+		uint32_t timeout;
+	};
+};
+
+BOOST_AUTO_TEST_SUITE( RcuTest )
+
+BOOST_AUTO_TEST_CASE( ReadersAndUpdates )
+{
+	Rcu::synchronize();
+	{
+		RcuPtr<Config> config(new Config(0));
+		static const uint32_t READERS = 4;
+		static const uint64_t UPDATES = 20000;
+		std::atomic<bool> finished(false);
+		std::atomic<uint64_t> broken(0);
+		std::vector<std::thread> readers;
+		for (uint32_t r = 0; r < READERS; r++) {
+			// the half of the readers are registered and read without the read sections
+			readers.emplace_back([&, r]() {
+				bool registered = r % 2;
+				if (registered)
+					Rcu::registerThread();
+				uint64_t last = 0;
+				while (!finished.load()) {
+					if (registered) {
+						const Config *value = config.get();
+						broken += (value->doubled != value->value * 2) || (value->value < last);
+						last = value->value;
+						Rcu::quiescent();
+					} else {
+						RcuReadLock readLock;
+						const Config *value = config.get();
+						broken += (value->doubled != value->value * 2) || (value->value < last);
+						last = value->value;
+					}
+				}
+				if (registered)
+					Rcu::unregisterThread();
+			});
+		}
+		for (uint64_t i = 1; i <= UPDATES; i++) {
+			config.update(new Config(i));
+			if (i % 1000 == 0)
+				sched_yield();
+		}
+		finished.store(true);
+		for (auto reader = readers.begin(); reader != readers.end(); reader++)
+			reader->join();
+		BOOST_CHECK_EQUAL(broken.load(), 0U);
+		Rcu::synchronize();
+		BOOST_CHECK_EQUAL(Rcu::pending(), 0U);
+		BOOST_CHECK_EQUAL(liveConfigs.load(), 1);
+		BOOST_CHECK_EQUAL(config->value, UPDATES);
+	}
+	BOOST_CHECK_EQUAL(liveConfigs.load(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( ReadSectionDefersDelete )
+{
+	RcuPtr<Config> config(new Config(1));
+	std::atomic<int> step(0);
+	std::thread reader([&]() {
+		RcuReadLock readLock;
+		{
+			RcuReadLock nested;
+		}
+		const Config *value = config.get();
+		step.store(1);
+		while (step.load() != 2)
+			sched_yield();
+		// the old value is alive till the end of the read section
+		BOOST_CHECK_EQUAL(value->doubled, 2U);
+	});
+	while (step.load() != 1)
+		sched_yield();
+	config.update(new Config(2));
+	BOOST_CHECK_EQUAL(liveConfigs.load(), 2);
+	BOOST_CHECK(Rcu::pending() >= 1);
+	step.store(2);
+	reader.join();
+	Rcu::synchronize();
+	BOOST_CHECK_EQUAL(liveConfigs.load(), 1);
+	BOOST_CHECK_EQUAL(Rcu::pending(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE( QuiescentStates )
+{
+	RcuPtr<Config> config(new Config(1));
+	std::atomic<int> step(0);
+	std::thread worker([&]() {
+		Rcu::registerThread();
+		const Config *value = config.get();
+		step.store(1);
+		while (step.load() != 2)
+			sched_yield();
+		BOOST_CHECK_EQUAL(value->doubled, 2U);
+		Rcu::quiescent();
+		// the offline thread doesn't keep the updates
+		Rcu::offline();
+		step.store(3);
+		while (step.load() != 4)
+			sched_yield();
+		Rcu::online();
+		BOOST_CHECK_EQUAL(config->value, 3U);
+		Rcu::unregisterThread();
+	});
+	while (step.load() != 1)
+		sched_yield();
+	config.update(new Config(2));
+	// the online registered thread hasn't passed a quiescent state yet
+	usleep(10000);
+	BOOST_CHECK_EQUAL(liveConfigs.load(), 2);
+	step.store(2);
+	while (step.load() != 3)
+		sched_yield();
+	Rcu::synchronize();
+	BOOST_CHECK_EQUAL(liveConfigs.load(), 1);
+	config.update(new Config(3));
+	Rcu::synchronize();
+	BOOST_CHECK_EQUAL(liveConfigs.load(), 1);
+	step.store(4);
+	worker.join();
+}
+
+BOOST_AUTO_TEST_CASE( OnlineReclaims )
+{
+	RcuPtr<Config> config(new Config(1));
+	std::atomic<int> step(0);
+	std::thread worker([&]() {
+		Rcu::registerThread();
+		step.store(1);
+		while (step.load() != 2)
+			sched_yield();
+		// like an event thread, which only goes offline and online around its waits
+		for (int i = 0; (i < 1000) && Rcu::pending(); i++) {
+			Rcu::offline();
+			Rcu::online();
+		}
+		Rcu::unregisterThread();
+	});
+	while (step.load() != 1)
+		sched_yield();
+	config.update(new Config(2));
+	BOOST_CHECK(Rcu::pending() >= 1);
+	step.store(2);
+	worker.join();
+	BOOST_CHECK_EQUAL(Rcu::pending(), 0U);
+	BOOST_CHECK_EQUAL(liveConfigs.load(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( SynchronizeSleeps )
+{
+	RcuPtr<Config> config(new Config(1));
+	std::atomic<int> step(0);
+	std::thread worker([&]() {
+		Rcu::registerThread();
+		step.store(1);
+		usleep(200000);
+		step.store(2);
+		Rcu::quiescent();
+		Rcu::unregisterThread();
+	});
+	while (step.load() != 1)
+		sched_yield();
+	config.update(new Config(2));
+	struct timespec start, finish;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+	Rcu::synchronize();
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &finish);
+	BOOST_CHECK_EQUAL(step.load(), 2);
+	BOOST_CHECK_EQUAL(liveConfigs.load(), 1);
+	BOOST_CHECK((finish.tv_sec - start.tv_sec) * 1000000000L + finish.tv_nsec - start.tv_nsec < 100000000L);
+	worker.join();
+}
+
+BOOST_AUTO_TEST_CASE( SeqLockSnapshots )
+{
+	Limits first = {1, 1, 1};
+	SeqLock<Limits> limits(first);
+	BOOST_CHECK_EQUAL(limits.load().burst, 1U);
+	static const uint64_t STORES = 100000;
+	std::atomic<bool> finished(false);
+	std::atomic<uint64_t> torn(0);
+	std::vector<std::thread> readers;
+	for (int r = 0; r < 3; r++) {
+		readers.emplace_back([&]() {
+			while (!finished.load()) {
+				Limits snapshot = limits.load();
+				torn += (snapshot.rate != snapshot.burst) || (snapshot.timeout != static_cast<uint32_t>(snapshot.rate));
+			}
+		});
+	}
+	for (uint64_t i = 2; i <= STORES; i++) {
+		Limits next = {i, i, static_cast<uint32_t>(i)};
+		limits.store(next);
+	}
+	finished.store(true);
+	for (auto reader = readers.begin(); reader != readers.end(); reader++)
+		reader->join();
+	BOOST_CHECK_EQUAL(torn.load(), 0U);
+	BOOST_CHECK_EQUAL(limits.load().rate, STORES);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
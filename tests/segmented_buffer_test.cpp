@@ -0,0 +1,173 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: SegmentedBuffer and SegmentPool classes unit tests
+///////////////////////////////////////////////////////////////////////////////
+
+#include <boost/test/unit_test.hpp>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+
+#include "segmented_buffer.hpp"
+
+using namespace fl::network;
+
+namespace
+{
+	std::string testData(const size_t size)
+	{
+		std::string data;
+		for (int i = 0; data.size() < size; i++)
+			data += std::to_string(i) + ',';
+		data.resize(size);
+		return data;
+	}
+	
+	std::string toString(const SegmentedBuffer &buf)
+	{
+		BString str;
+		buf.copyTo(str);
+		return std::string(str.c_str(), str.size());
+	}
+};
+
+BOOST_AUTO_TEST_SUITE( SegmentedBufferTest )
+
+BOOST_AUTO_TEST_CASE( AddConsume )
+{
+	SegmentPool pool(64, 16);
+	{
+		SegmentedBuffer buf(&pool);
+		std::string data = testData(1000);
+		buf.add(data.c_str(), 10);
+		buf.add(data.c_str() + 10, data.size() - 10);
+		BOOST_CHECK_EQUAL(buf.size(), data.size());
+		BOOST_CHECK_EQUAL(buf.segmentsCount(), (data.size() + 63) / 64);
+		BOOST_CHECK(toString(buf) == data);
+
+		buf.consume(100);
+		BOOST_CHECK(toString(buf) == data.substr(100));
+		BOOST_CHECK_EQUAL(pool.freeSegments(), 1);
+		BOOST_CHECK_THROW(buf.consume(buf.size() + 1), BString::Error);
+		buf.consume(buf.size());
+		BOOST_CHECK(buf.empty());
+		BOOST_CHECK_EQUAL(buf.segmentsCount(), 0);
+	}
+	BOOST_CHECK_EQUAL(pool.freeSegments(), 16);
+}
+
+BOOST_AUTO_TEST_CASE( ViewAndFind )
+{
+	SegmentPool pool(64, 16);
+	SegmentedBuffer buf(&pool);
+	std::string data = testData(300);
+	buf.add(data.c_str(), data.size());
+	BString spill;
+	const char *view = buf.view(10, 20, spill);
+	BOOST_CHECK(std::string(view, 20) == data.substr(10, 20));
+	BOOST_CHECK(spill.empty()); // inside of one segment
+	view = buf.view(60, 100, spill);
+	BOOST_CHECK(std::string(view, 100) == data.substr(60, 100));
+	BOOST_CHECK(view == spill.c_str());
+	BOOST_CHECK_THROW(buf.view(250, 51, spill), BString::Error);
+
+	BOOST_CHECK_EQUAL(buf.find(',', 0), data.find(','));
+	BOOST_CHECK_EQUAL(buf.find('9', 62), data.find('9', 62));
+	BOOST_CHECK_EQUAL(buf.find('#'), SegmentedBuffer::NPOS);
+	BOOST_CHECK_EQUAL(buf.find(',', 1000), SegmentedBuffer::NPOS);
+}
+
+BOOST_AUTO_TEST_CASE( ZeroCopySlice )
+{
+	SegmentPool pool(64, 16);
+	std::string data = testData(200);
+	SegmentedBuffer slice(&pool);
+	{
+		SegmentedBuffer buf(&pool);
+		buf.add(data.c_str(), data.size());
+		slice.add(buf, 50, 150);
+		BOOST_CHECK_EQUAL(slice.segmentsCount(), 4);
+		BOOST_CHECK_EQUAL(pool.freeSegments(), 0);
+		BOOST_CHECK_THROW(slice.add(buf, 150, 51), BString::Error);
+		buf.add("tail", 4); // the shared last segment isn't appended
+		BOOST_CHECK_EQUAL(buf.segmentsCount(), 5);
+		BOOST_CHECK(toString(buf) == data + "tail");
+	}
+	BOOST_CHECK(toString(slice) == data.substr(50));
+	BOOST_CHECK_EQUAL(pool.freeSegments(), 1);
+	slice.add("after", 5);
+	BOOST_CHECK_EQUAL(slice.segmentsCount(), 4);
+	BOOST_CHECK(toString(slice) == data.substr(50) + "after");
+}
+
+BOOST_AUTO_TEST_CASE( ReadSend )
+{
+	SegmentPool pool(1024, 64);
+	int fds[2];
+	BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+	std::string data = testData(100 * 1024);
+	SegmentedBuffer out(&pool);
+	out.add(data.c_str(), data.size());
+	SegmentedBuffer in(&pool);
+	SegmentedBuffer::EResult sendResult = NetworkBuffer::IN_PROGRESS;
+	while (in.size() < data.size()) {
+		if (sendResult != NetworkBuffer::OK) {
+			sendResult = out.send(fds[0]);
+			BOOST_REQUIRE(sendResult != NetworkBuffer::ERROR);
+		}
+		auto res = in.read(fds[1]);
+		BOOST_REQUIRE((res == NetworkBuffer::OK) || (res == NetworkBuffer::IN_PROGRESS));
+	}
+	BOOST_CHECK(out.empty());
+	BOOST_CHECK(toString(in) == data);
+	BOOST_CHECK_EQUAL(in.read(fds[1]), NetworkBuffer::IN_PROGRESS);
+	close(fds[0]);
+	BOOST_CHECK_EQUAL(in.read(fds[1]), NetworkBuffer::CONNECTION_CLOSE);
+	close(fds[1]);
+	BOOST_CHECK_EQUAL(in.size(), data.size());
+}
+
+BOOST_AUTO_TEST_CASE( ReadExpected )
+{
+	SegmentPool pool(1024, 64);
+	int fds[2];
+	BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+	std::string data = testData(1500);
+	BOOST_REQUIRE(write(fds[0], data.c_str(), data.size()) == (ssize_t)data.size());
+	SegmentedBuffer in(&pool);
+	BOOST_CHECK_EQUAL(in.read(fds[1], data.size()), NetworkBuffer::OK);
+	// only the segments which are needed for the expected size are taken from the pool
+	BOOST_CHECK_EQUAL(in.segmentsCount(), 2);
+	BOOST_CHECK_EQUAL(pool.freeSegments(), 0);
+	uint32_t size;
+	const char *front = in.front(size);
+	BOOST_CHECK_EQUAL(size, 1024U);
+	BOOST_CHECK(std::string(front, size) == data.substr(0, 1024));
+	in.consume(size);
+	BOOST_CHECK_EQUAL(pool.freeSegments(), 1);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+BOOST_AUTO_TEST_CASE( DetachPool )
+{
+	SegmentPool pool(64, 16);
+	{
+		SegmentedBuffer buf(&pool);
+		std::string data = testData(200);
+		buf.add(data.c_str(), data.size());
+		buf.detachPool();
+	}
+	BOOST_CHECK_EQUAL(pool.freeSegments(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,300 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Binary serialization unit tests
+///////////////////////////////////////////////////////////////////////////////
+
+#include <boost/test/unit_test.hpp>
+
+#include <limits>
+#include "serialize.hpp"
+
+using namespace fl::utils;
+using namespace fl::utils::serialize;
+
+namespace {
+	enum EColor
+	{
+		RED = 1,
+		GREEN = 300,
+	};
+
+	struct Point
+	{
+		int32_t x;
+		int32_t y;
+		bool operator==(const Point &p) const
+		{
+			return (x == p.x) && (y == p.y);
+		}
+	};
+
+	struct Attachment
+	{
+		std::string name;
+		uint32_t size;
+		template <class TArchive> void fields(TArchive &ar)
+		{
+			ar(1, name)(2, size);
+		}
+	};
+
+	struct Message
+	{
+		Message()
+			: id(0), date(0), delta(0), color(RED), score(0), seen(false)
+		{
+		}
+		uint64_t id;
+		uint32_t date;
+		int64_t delta;
+		EColor color;
+		double score;
+		bool seen;
+		std::string subject;
+		BString body;
+		std::vector<uint32_t> labels;
+		std::vector<int8_t> flags;
+		std::vector<double> weights;
+		std::vector<Point> points;
+		std::vector<std::string> to;
+		std::vector<Attachment> attachments;
+		Point center;
+		template <class TArchive> void fields(TArchive &ar)
+		{
+			ar(1, id)(2, date)(3, delta)(4, color)(5, score)(6, seen)(7, subject)(8, body)(9, labels)(10, flags)
+				(11, weights)(12, points)(13, to)(14, attachments)(15, center);
+		}
+	};
+
+	Message testMessage()
+	{
+		Message message;
+		message.id = std::numeric_limits<uint64_t>::max();
+		message.date = 1400000000;
+		message.delta = -5;
+		message.color = GREEN;
+		message.score = 0.25;
+		message.seen = true;
+		message.subject = "Subject";
+		message.body.add(std::string(300, 'b').c_str(), 300);
+		message.labels = {0, 127, 128, 100000};
+		message.flags = {-1, 0, 1};
+		message.weights = {1.5, -2.5};
+		message.points = {{1, 2}, {-3, 4}};
+		message.to = {"a@b.c", ""};
+		message.attachments.resize(2);
+		message.attachments[0].name = "file.txt";
+		message.attachments[0].size = 100;
+		message.attachments[1].name = std::string(200, 'n');
+		message.attachments[1].size = 0;
+		message.center = {-7, 7};
+		return message;
+	}
+
+	void checkEqual(const Message &a, const Message &b)
+	{
+		BOOST_REQUIRE_EQUAL(a.id, b.id);
+		BOOST_REQUIRE_EQUAL(a.date, b.date);
+		BOOST_REQUIRE_EQUAL(a.delta, b.delta);
+		BOOST_REQUIRE(a.color == b.color);
+		BOOST_REQUIRE(a.score == b.score);
+		BOOST_REQUIRE(a.seen == b.seen);
+		BOOST_REQUIRE(a.subject == b.subject);
+		BOOST_REQUIRE(a.body == b.body);
+		BOOST_REQUIRE(a.labels == b.labels);
+		BOOST_REQUIRE(a.flags == b.flags);
+		BOOST_REQUIRE(a.weights == b.weights);
+		BOOST_REQUIRE(a.points == b.points);
+		BOOST_REQUIRE(a.to == b.to);
+		BOOST_REQUIRE_EQUAL(a.attachments.size(), b.attachments.size());
+		for (size_t i = 0; i < a.attachments.size(); i++) {
+			BOOST_REQUIRE(a.attachments[i].name == b.attachments[i].name);
+			BOOST_REQUIRE_EQUAL(a.attachments[i].size, b.attachments[i].size);
+		}
+		BOOST_REQUIRE(a.center == b.center);
+	}
+
+	// the first version of Attachment without size and with a new field
+	struct AttachmentV2
+	{
+		AttachmentV2()
+			: mime("default")
+		{
+		}
+		std::string name;
+		std::string mime;
+		template <class TArchive> void fields(TArchive &ar)
+		{
+			ar(1, name)(3, mime);
+		}
+	};
+
+	struct MessageV2
+	{
+		MessageV2()
+			: id(0), added(42)
+		{
+		}
+		uint64_t id;
+		std::string subject;
+		std::vector<AttachmentV2> attachments;
+		uint32_t added;
+		template <class TArchive> void fields(TArchive &ar)
+		{
+			ar(1, id)(7, subject)(14, attachments)(16, added);
+		}
+	};
+};
+
+BOOST_AUTO_TEST_SUITE( SerializeTest )
+
+BOOST_AUTO_TEST_CASE( varintTest )
+{
+	const uint64_t values[] = {0, 1, 127, 128, 16383, 16384, 0xFFFFFFFFULL, 1ULL << 63,
+		std::numeric_limits<uint64_t>::max()};
+	const Buffer::TSize sizes[] = {1, 1, 1, 2, 2, 3, 5, 10, 10};
+	Buffer buf;
+	for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+		BOOST_REQUIRE_EQUAL(varintSize(values[i]), sizes[i]);
+		Buffer::TSize start = buf.writtenSize();
+		addVarint(buf, values[i]);
+		BOOST_REQUIRE_EQUAL(buf.writtenSize() - start, sizes[i]);
+	}
+	for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+		BOOST_REQUIRE_EQUAL(getVarint(buf), values[i]);
+	BOOST_REQUIRE(buf.isEnded());
+	BOOST_CHECK_THROW(getVarint(buf), Buffer::Error);
+
+	buf.clear();
+	for (int i = 0; i < 11; i++)
+		buf.add<uint8_t>(0x80);
+	BOOST_CHECK_THROW(getVarint(buf), Buffer::Error);
+}
+
+BOOST_AUTO_TEST_CASE( zigzagTest )
+{
+	BOOST_REQUIRE_EQUAL(zigzag(0), 0U);
+	BOOST_REQUIRE_EQUAL(zigzag(-1), 1U);
+	BOOST_REQUIRE_EQUAL(zigzag(1), 2U);
+	BOOST_REQUIRE_EQUAL(zigzag(-2), 3U);
+	BOOST_REQUIRE_EQUAL(zigzag(std::numeric_limits<int64_t>::max()), std::numeric_limits<uint64_t>::max() - 1);
+	BOOST_REQUIRE_EQUAL(zigzag(std::numeric_limits<int64_t>::min()), std::numeric_limits<uint64_t>::max());
+	const int64_t values[] = {0, -1, 1, -64, 64, std::numeric_limits<int64_t>::min(),
+		std::numeric_limits<int64_t>::max()};
+	for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+		BOOST_REQUIRE_EQUAL(unzigzag(zigzag(values[i])), values[i]);
+}
+
+BOOST_AUTO_TEST_CASE( compactRoundTripTest )
+{
+	Message message = testMessage();
+	Buffer buf;
+	encode(buf, message);
+	Message decoded;
+	decode(buf, decoded);
+	BOOST_REQUIRE(buf.isEnded());
+	checkEqual(message, decoded);
+
+	// small values take 1 byte each without tags
+	buf.clear();
+	Message small;
+	small.id = 1;
+	encode(buf, small);
+	BOOST_REQUIRE_EQUAL(buf.begin()[0], 1);
+	BOOST_REQUIRE_EQUAL(buf.begin()[1], 0);
+}
+
+BOOST_AUTO_TEST_CASE( taggedRoundTripTest )
+{
+	Message message = testMessage();
+	Buffer buf;
+	encodeTagged(buf, message);
+	Message decoded;
+	decodeTagged(buf, decoded);
+	BOOST_REQUIRE(buf.isEnded());
+	checkEqual(message, decoded);
+
+	Message empty;
+	buf.clear();
+	encodeTagged(buf, empty);
+	Message decodedEmpty;
+	decodeTagged(buf, decodedEmpty);
+	checkEqual(empty, decodedEmpty);
+}
+
+BOOST_AUTO_TEST_CASE( valuesTest )
+{
+	Buffer buf;
+	std::vector<uint64_t> values = {1, 2, 300};
+	encode(buf, values);
+	BOOST_REQUIRE_EQUAL(buf.writtenSize(), 5U); // count, 1, 2 and 2 bytes of 300
+	std::vector<uint64_t> decoded;
+	decode(buf, decoded);
+	BOOST_REQUIRE(decoded == values);
+
+	buf.clear();
+	std::string str("text");
+	encodeTagged(buf, str);
+	std::string decodedStr;
+	decodeTagged(buf, decodedStr);
+	BOOST_REQUIRE(decodedStr == str);
+}
+
+BOOST_AUTO_TEST_CASE( forwardCompatibilityTest )
+{
+	Message message = testMessage();
+	Buffer buf;
+	encodeTagged(buf, message);
+	MessageV2 v2;
+	decodeTagged(buf, v2);
+	BOOST_REQUIRE(buf.isEnded());
+	BOOST_REQUIRE_EQUAL(v2.id, message.id);
+	BOOST_REQUIRE(v2.subject == message.subject);
+	BOOST_REQUIRE_EQUAL(v2.added, 42U);
+	BOOST_REQUIRE_EQUAL(v2.attachments.size(), 2U);
+	BOOST_REQUIRE(v2.attachments[1].name == message.attachments[1].name);
+	BOOST_REQUIRE(v2.attachments[1].mime == "default");
+
+	buf.clear();
+	v2.added = 7;
+	v2.attachments[0].mime = "text/plain";
+	encodeTagged(buf, v2);
+	Message decoded;
+	decodeTagged(buf, decoded);
+	BOOST_REQUIRE(buf.isEnded());
+	BOOST_REQUIRE_EQUAL(decoded.id, message.id);
+	BOOST_REQUIRE(decoded.attachments[0].name == message.attachments[0].name);
+	BOOST_REQUIRE_EQUAL(decoded.attachments[0].size, 0U);
+	BOOST_REQUIRE_EQUAL(decoded.date, 0U);
+}
+
+BOOST_AUTO_TEST_CASE( errorsTest )
+{
+	Message message = testMessage();
+	Buffer buf;
+	encodeTagged(buf, message);
+	Buffer truncated;
+	truncated.add(buf.begin(), buf.writtenSize() - 1);
+	Message decoded;
+	BOOST_CHECK_THROW(decodeTagged(truncated, decoded), Buffer::Error);
+
+	// a string in place of the id
+	buf.clear();
+	addVarint(buf, 3);
+	addVarint(buf, (1 << 3) | WIRE_LENGTH);
+	addVarint(buf, 1);
+	buf.add<uint8_t>('a');
+	BOOST_CHECK_THROW(decodeTagged(buf, decoded), Buffer::Error);
+
+	// a huge vector count
+	buf.clear();
+	addVarint(buf, 1ULL << 40);
+	std::vector<uint32_t> labels;
+	BOOST_CHECK_THROW(decode(buf, labels), Buffer::Error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
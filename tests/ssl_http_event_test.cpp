@@ -0,0 +1,251 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2014 Final Level
+// Author: Denys Misko <gdraal@gmail.com>
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: SslHttpEvent class unit tests
+///////////////////////////////////////////////////////////////////////////////
+
+#include <boost/test/unit_test.hpp>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include "ip_rate_limiter.hpp"
+#include "mock_http_util.hpp"
+#include "ssl_http_event.hpp"
+#include "test_path.hpp"
+
+using namespace fl::network;
+using namespace fl::events;
+using fl::tests::TestPath;
+
+BOOST_AUTO_TEST_SUITE( SslHttpEventTest )
+
+static bool createSelfSignedCertificate(const std::string &certFile, const std::string &keyFile)
+{
+	EVP_PKEY *pkey = NULL;
+	EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+	if (!pctx)
+		return false;
+	bool res = (EVP_PKEY_keygen_init(pctx) > 0) && (EVP_PKEY_CTX_set_rsa_keygen_bits(pctx, 2048) > 0)
+		&& (EVP_PKEY_keygen(pctx, &pkey) > 0);
+	EVP_PKEY_CTX_free(pctx);
+	if (!res)
+		return false;
+	
+	X509 *x509 = X509_new();
+	ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+	X509_gmtime_adj(X509_get_notBefore(x509), 0);
+	X509_gmtime_adj(X509_get_notAfter(x509), 3600);
+	X509_set_pubkey(x509, pkey);
+	X509_NAME *name = X509_get_subject_name(x509);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)"127.0.0.1", -1, -1, 0);
+	X509_set_issuer_name(x509, name);
+	res = X509_sign(x509, pkey, EVP_sha256()) > 0;
+	
+	FILE *f = fopen(certFile.c_str(), "w");
+	res = res && f && PEM_write_X509(f, x509);
+	if (f)
+		fclose(f);
+	f = fopen(keyFile.c_str(), "w");
+	res = res && f && PEM_write_PrivateKey(f, pkey, NULL, NULL, 0, NULL, NULL);
+	if (f)
+		fclose(f);
+	X509_free(x509);
+	EVP_PKEY_free(pkey);
+	return res;
+}
+
+class SslMockHttpEventInterface : public HttpEventInterface
+{
+public:
+	SslMockHttpEventInterface()
+		: _isKeepAlive(false)
+	{
+	}
+	virtual bool parseURI(const char *cmdStart, const EHttpVersion::EHttpVersion version,
+			const std::string &host, const std::string &fileName, const std::string &query)
+	{
+		_fileName = fileName;
+		return true;
+	}
+	virtual bool parseHeader(const char *name, const size_t nameLength, const char *value, const size_t valueLen, 
+		const char *pEndHeader)
+	{
+		_parseKeepAlive(name, nameLength, value, _isKeepAlive);
+		return true;
+	}
+	virtual EFormResult formResult(BString &networkBuffer, class HttpEvent *http)
+	{
+		if (_fileName == "/big") { // is sent by many partial TLS writes
+			static const size_t BIG_SIZE = 4 * 1024 * 1024;
+			networkBuffer.sprintfSet("HTTP/1.1 200 OK\r\nContent-Length: %u\r\nConnection: close\r\n\r\n", BIG_SIZE);
+			memset(networkBuffer.reserveBuffer(BIG_SIZE), 'b', BIG_SIZE);
+			return RESULT_OK_CLOSE;
+		}
+		networkBuffer.sprintfSet("HTTP/1.1 200 OK\r\nContent-Length: %u\r\n", _fileName.size());
+		_addConnectionHeader(networkBuffer, _isKeepAlive);
+		networkBuffer << "\r\n" << _fileName;
+		return _isKeepAlive ? RESULT_OK_KEEP_ALIVE : RESULT_OK_CLOSE;
+	}
+	virtual bool reset()
+	{
+		_isKeepAlive = false;
+		_fileName.clear();
+		return true;
+	}
+private:
+	bool _isKeepAlive;
+	std::string _fileName;
+};
+
+static bool readAnswer(SSLSocket &socket, BString &answer, const char *expectedEnd)
+{
+	answer.clear();
+	const size_t READ_BUF_SIZE = 1024;
+	for (int i = 0; i < 100; i++) {
+		char *readBuf = answer.reserveBuffer(READ_BUF_SIZE);
+		auto res = socket.pollAndRecv(readBuf, READ_BUF_SIZE, 5000);
+		if (res <= 0) {
+			answer.trim(answer.size() - READ_BUF_SIZE);
+			return false;
+		}
+		answer.trim(answer.size() - (READ_BUF_SIZE - res));
+		if (strstr(answer.c_str(), expectedEnd))
+			return true;
+	}
+	return false;
+}
+
+BOOST_AUTO_TEST_CASE( SslHandshakeAndKeepAlive )
+{
+	TestPath testPath("ssl_http_event");
+	std::string certFile(testPath.path());
+	certFile.append("/cert.pem");
+	std::string keyFile(testPath.path());
+	keyFile.append("/key.pem");
+	BOOST_REQUIRE(createSelfSignedCertificate(certFile, keyFile));
+	
+	SSLServerContext sslContext(certFile.c_str(), keyFile.c_str());
+	SslHttpEventFactory<SslMockHttpEventInterface> factory(&sslContext);
+	TestHttpEventFramework testEventFramework(&factory);
+	
+	BString buf;
+	SSLSocket socket;
+	BOOST_REQUIRE(socket.connect(testEventFramework.ip().c_str(), testEventFramework.port(), buf));
+	for (int i = 0; i < 3; i++) {
+		buf.sprintfSet("GET /file%u HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n", i);
+		BOOST_REQUIRE(socket.pollAndSendAll(buf.c_str(), buf.size()));
+		std::string expected("/file");
+		expected.append(std::to_string(i));
+		BOOST_REQUIRE(readAnswer(socket, buf, expected.c_str()));
+		BOOST_CHECK(strstr(buf.c_str(), "HTTP/1.1 200 OK") == buf.c_str());
+		BOOST_CHECK(strstr(buf.c_str(), "Connection: Keep-Alive") != NULL);
+	}
+	
+	buf.sprintfSet("GET /last HTTP/1.1\r\nHost: localhost\r\n\r\n");
+	BOOST_REQUIRE(socket.pollAndSendAll(buf.c_str(), buf.size()));
+	BOOST_REQUIRE(readAnswer(socket, buf, "/last"));
+	BOOST_CHECK(strstr(buf.c_str(), "Connection: Close") != NULL);
+}
+
+BOOST_AUTO_TEST_CASE( SslPartialWrites )
+{
+	TestPath testPath("ssl_http_event");
+	std::string certFile(testPath.path());
+	certFile.append("/cert.pem");
+	std::string keyFile(testPath.path());
+	keyFile.append("/key.pem");
+	BOOST_REQUIRE(createSelfSignedCertificate(certFile, keyFile));
+	
+	SSLServerContext sslContext(certFile.c_str(), keyFile.c_str());
+	SslHttpEventFactory<SslMockHttpEventInterface> factory(&sslContext);
+	TestHttpEventFramework testEventFramework(&factory);
+	
+	BString buf;
+	SSLSocket socket;
+	BOOST_REQUIRE(socket.connect(testEventFramework.ip().c_str(), testEventFramework.port(), buf));
+	buf.sprintfSet("GET /big HTTP/1.1\r\nHost: localhost\r\n\r\n");
+	BOOST_REQUIRE(socket.pollAndSendAll(buf.c_str(), buf.size()));
+	// the socket buffers are filled before the client starts reading
+	usleep(50000);
+	size_t received = 0;
+	char readBuf[16 * 1024];
+	while (true) {
+		auto res = socket.pollAndRecv(readBuf, sizeof(readBuf), 5000);
+		if (res <= 0)
+			break;
+		received += res;
+	}
+	BOOST_CHECK(received > 4 * 1024 * 1024);
+	BOOST_CHECK_EQUAL(readBuf[0], 'b');
+}
+
+BOOST_AUTO_TEST_CASE( SslRejectPlainHttp )
+{
+	TestPath testPath("ssl_http_event");
+	std::string certFile(testPath.path());
+	certFile.append("/cert.pem");
+	std::string keyFile(testPath.path());
+	keyFile.append("/key.pem");
+	BOOST_REQUIRE(createSelfSignedCertificate(certFile, keyFile));
+	
+	SSLServerContext sslContext(certFile.c_str(), keyFile.c_str());
+	SslHttpEventFactory<SslMockHttpEventInterface> factory(&sslContext);
+	TestHttpEventFramework testEventFramework(&factory);
+	BString answer;
+	BOOST_CHECK(!testEventFramework.doRequest("GET / HTTP/1.0\r\n\r\n", answer));
+	BOOST_CHECK(answer.empty());
+}
+
+class SslRateLimitedThreadSpecificDataFactory : public ThreadSpecificDataFactory
+{
+public:
+	SslRateLimitedThreadSpecificDataFactory(IpRateLimiter *limiter)
+		: _limiter(limiter)
+	{
+	}
+	virtual ThreadSpecificData *create()
+	{
+		HttpThreadSpecificData *data = new HttpThreadSpecificData();
+		data->requestRateLimiter = _limiter;
+		return data;
+	}
+private:
+	IpRateLimiter *_limiter;
+};
+
+BOOST_AUTO_TEST_CASE( SslRequestLimitByPeer )
+{
+	TestPath testPath("ssl_http_event");
+	std::string certFile(testPath.path());
+	certFile.append("/cert.pem");
+	std::string keyFile(testPath.path());
+	keyFile.append("/key.pem");
+	BOOST_REQUIRE(createSelfSignedCertificate(certFile, keyFile));
+	
+	SSLServerContext sslContext(certFile.c_str(), keyFile.c_str());
+	SslHttpEventFactory<SslMockHttpEventInterface> factory(&sslContext);
+	IpRateLimiter limiter(1, 1);
+	TestHttpEventFramework testEventFramework(&factory, new SslRateLimitedThreadSpecificDataFactory(&limiter));
+	// the only token of the peer is taken, the request is limited only if it is counted under the peer address
+	BOOST_REQUIRE(limiter.allow(Socket::ip2Long(testEventFramework.ip().c_str())));
+	
+	BString buf;
+	SSLSocket socket;
+	BOOST_REQUIRE(socket.connect(testEventFramework.ip().c_str(), testEventFramework.port(), buf));
+	buf.sprintfSet("GET /limited HTTP/1.1\r\nHost: localhost\r\n\r\n");
+	BOOST_REQUIRE(socket.pollAndSendAll(buf.c_str(), buf.size()));
+	BOOST_REQUIRE(readAnswer(socket, buf, "\r\n\r\n"));
+	BOOST_CHECK(strstr(buf.c_str(), limiter.rejectAnswer().c_str()) == buf.c_str());
+	BOOST_CHECK_EQUAL(limiter.size(), 1U);
+	BOOST_CHECK_EQUAL(limiter.rejected(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE( SslServerContextBadFiles )
+{
+	BOOST_CHECK_THROW(SSLServerContext("/nonexistent/cert.pem", "/nonexistent/key.pem"), NetworkError);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -82,6 +82,14 @@ public:
 	{
 		return _status == (ST_PUT | ST_FILE_PUT);
 	}
+	static bool checkFilePut()
+	{
+		return _status & ST_FILE_PUT;
+	}
+	static void clearStatus()
+	{
+		_status = 0;
+	}
 protected:
 	static TStatus _status;
 	virtual EFormResult _formPut(BString &networkBuffer, class HttpEvent *http) override
@@ -153,6 +161,16 @@ BOOST_AUTO_TEST_CASE( PutCheck )
 	BOOST_REQUIRE(testEventFramework.doRequest(conn, request, answer));
 	BOOST_REQUIRE(answer == MockPutWebDavInterface::ANSWER.c_str());
 	BOOST_REQUIRE(MockPutWebDavInterface::checkStatus());
+
+	// the start of a pipelined request after the body isn't saved to the file
+	MockPutWebDavInterface::clearStatus();
+	Socket pipelinedConn;
+	BOOST_REQUIRE(testEventFramework.connect(pipelinedConn));
+	request << "GET /next HTTP/1.1\r\n";
+	answer.clear();
+	BOOST_REQUIRE(testEventFramework.doRequest(pipelinedConn, request, answer));
+	BOOST_REQUIRE(answer == MockPutWebDavInterface::ANSWER.c_str());
+	BOOST_REQUIRE(MockPutWebDavInterface::checkFilePut());
 }
 
 class MockMinimalWebDavInterface : public WebDavInterface
@@ -0,0 +1,509 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Worker thread manager and its queues unit tests
+///////////////////////////////////////////////////////////////////////////////
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <numeric>
+#include <sched.h>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "worker_thread.hpp"
+
+using namespace fl::threads;
+
+namespace
+{
+	class CountTask : public WorkerTaskInterface
+	{
+	public:
+		CountTask()
+			: manager(NULL), done(NULL), runs(0), children(NULL), childrenCount(0)
+		{
+		}
+		virtual void doTask()
+		{
+			runs++;
+			for (uint32_t i = 0; i < childrenCount; i++)
+				manager->add(&children[i]);
+			(*done)++;
+		}
+		WorkerThreadManager *manager;
+		std::atomic<uint64_t> *done;
+		std::atomic<uint32_t> runs;
+		CountTask *children;
+		uint32_t childrenCount;
+	};
+
+	// keeps the worker till it is opened
+	class GateTask : public WorkerTaskInterface
+	{
+	public:
+		GateTask()
+			: started(false), opened(false)
+		{
+		}
+		virtual void doTask()
+		{
+			started.store(true);
+			while (!opened.load())
+				sched_yield();
+		}
+		std::atomic<bool> started;
+		std::atomic<bool> opened;
+	};
+
+	// writes its number to the order of the runs
+	class OrderTask : public WorkerTaskInterface
+	{
+	public:
+		OrderTask()
+			: number(0), order(NULL), done(NULL), expired(false)
+		{
+		}
+		virtual void doTask()
+		{
+			order->push_back(number);
+			(*done)++;
+		}
+		virtual void expireTask()
+		{
+			expired = true;
+			(*done)++;
+		}
+		int number;
+		std::vector<int> *order; // is written by the only worker
+		std::atomic<uint64_t> *done;
+		bool expired;
+	};
+
+	void waitDone(std::atomic<uint64_t> &done, const uint64_t count)
+	{
+		while (done.load() < count)
+			sched_yield();
+	}
+};
+
+BOOST_AUTO_TEST_SUITE( WorkerThreadTest )
+
+BOOST_AUTO_TEST_CASE( DequeOrder )
+{
+	WorkStealingDeque deque;
+	static const size_t COUNT = 1000; // more than the initial buffer
+	std::vector<CountTask> tasks(COUNT);
+	BOOST_CHECK(deque.empty());
+	BOOST_CHECK(deque.pop() == NULL);
+	BOOST_CHECK(deque.steal() == NULL);
+	for (size_t i = 0; i < COUNT; i++)
+		deque.push(&tasks[i]);
+	BOOST_CHECK(!deque.empty());
+	BOOST_CHECK(deque.steal() == &tasks[0]);
+	BOOST_CHECK(deque.steal() == &tasks[1]);
+	for (size_t i = COUNT - 1; i >= 2; i--)
+		BOOST_REQUIRE(deque.pop() == &tasks[i]);
+	BOOST_CHECK(deque.empty());
+	BOOST_CHECK(deque.pop() == NULL);
+}
+
+BOOST_AUTO_TEST_CASE( DequeStealing )
+{
+	WorkStealingDeque deque;
+	static const size_t COUNT = 200000;
+	static const size_t THIEVES = 3;
+	std::vector<CountTask> tasks(COUNT);
+	std::atomic<bool> finished(false);
+	std::atomic<uint64_t> stolen(0);
+	std::vector<std::thread> thieves;
+	for (size_t i = 0; i < THIEVES; i++) {
+		thieves.emplace_back([&]() {
+			while (!finished.load() || !deque.empty()) {
+				WorkerTaskInterface *task = deque.steal();
+				if (task) {
+					static_cast<CountTask*>(task)->runs++;
+					stolen++;
+				}
+			}
+		});
+	}
+	uint64_t popped = 0;
+	for (size_t i = 0; i < COUNT; i++) {
+		deque.push(&tasks[i]);
+		if (i % 3 == 0) {
+			WorkerTaskInterface *task = deque.pop();
+			if (task) {
+				static_cast<CountTask*>(task)->runs++;
+				popped++;
+			}
+		}
+	}
+	while (WorkerTaskInterface *task = deque.pop()) {
+		static_cast<CountTask*>(task)->runs++;
+		popped++;
+	}
+	finished.store(true);
+	for (auto thief = thieves.begin(); thief != thieves.end(); thief++)
+		thief->join();
+	BOOST_CHECK_EQUAL(popped + stolen.load(), COUNT);
+	size_t once = 0;
+	for (size_t i = 0; i < COUNT; i++)
+		once += (tasks[i].runs.load() == 1);
+	BOOST_CHECK_EQUAL(once, COUNT);
+}
+
+BOOST_AUTO_TEST_CASE( QueueOverflow )
+{
+	TaskQueue queue(4);
+	static const size_t COUNT = 100;
+	std::vector<CountTask> tasks(COUNT);
+	BOOST_CHECK(queue.empty());
+	for (size_t i = 0; i < COUNT; i++)
+		queue.push(&tasks[i]);
+	BOOST_CHECK(!queue.empty());
+	for (size_t i = 0; i < COUNT; i++)
+		BOOST_REQUIRE(queue.pop() == &tasks[i]);
+	BOOST_CHECK(queue.pop() == NULL);
+	BOOST_CHECK(queue.empty());
+}
+
+BOOST_AUTO_TEST_CASE( ExternalTasks )
+{
+	WorkerThreadManager manager(4);
+	static const size_t COUNT = 100000;
+	static const size_t PRODUCERS = 4;
+	std::vector<CountTask> tasks(COUNT);
+	std::atomic<uint64_t> done(0);
+	for (auto task = tasks.begin(); task != tasks.end(); task++)
+		task->done = &done;
+	std::vector<std::thread> producers;
+	for (size_t p = 0; p < PRODUCERS; p++) {
+		producers.emplace_back([&, p]() {
+			for (size_t i = p; i < COUNT; i += PRODUCERS)
+				manager.add(&tasks[i]);
+		});
+	}
+	for (auto producer = producers.begin(); producer != producers.end(); producer++)
+		producer->join();
+	waitDone(done, COUNT);
+	manager.stopAndWait();
+	size_t once = 0;
+	for (size_t i = 0; i < COUNT; i++)
+		once += (tasks[i].runs.load() == 1);
+	BOOST_CHECK_EQUAL(once, COUNT);
+}
+
+BOOST_AUTO_TEST_CASE( SpawnedTasks )
+{
+	WorkerThreadManager manager(4);
+	static const size_t ROOTS = 1000;
+	static const uint32_t CHILDREN = 50;
+	std::vector<CountTask> tasks(ROOTS * (CHILDREN + 1));
+	std::atomic<uint64_t> done(0);
+	for (auto task = tasks.begin(); task != tasks.end(); task++) {
+		task->manager = &manager;
+		task->done = &done;
+	}
+	for (size_t i = 0; i < ROOTS; i++) {
+		tasks[i].children = &tasks[ROOTS + i * CHILDREN];
+		tasks[i].childrenCount = CHILDREN;
+	}
+	for (size_t i = 0; i < ROOTS; i++)
+		manager.add(&tasks[i]);
+	waitDone(done, tasks.size());
+	manager.stopAndWait();
+	// the tasks which are added from the workers go through the priority queues
+	BOOST_CHECK_EQUAL(manager.stats(ETaskPriority::NORMAL).added, tasks.size());
+	size_t once = 0;
+	for (size_t i = 0; i < tasks.size(); i++)
+		once += (tasks[i].runs.load() == 1);
+	BOOST_CHECK_EQUAL(once, tasks.size());
+}
+
+BOOST_AUTO_TEST_CASE( IdleWakeAndStop )
+{
+	WorkerThreadManager manager(8);
+	std::atomic<uint64_t> done(0);
+	CountTask task;
+	task.done = &done;
+	// the workers are asleep before each task
+	for (uint64_t i = 1; i <= 20; i++) {
+		usleep(1000);
+		manager.add(&task);
+		waitDone(done, i);
+	}
+	manager.stopAndWait();
+	BOOST_CHECK_EQUAL(task.runs.load(), 20U);
+}
+
+BOOST_AUTO_TEST_CASE( BatchTasks )
+{
+	WorkerThreadManager manager(4);
+	static const size_t COUNT = 10000;
+	std::vector<CountTask> tasks(COUNT);
+	std::vector<WorkerTaskInterface*> batch(COUNT);
+	std::atomic<uint64_t> done(0);
+	for (size_t i = 0; i < COUNT; i++) {
+		tasks[i].done = &done;
+		batch[i] = &tasks[i];
+	}
+	manager.addBatch(&batch[0], COUNT / 2);
+	manager.addBatch(&batch[COUNT / 2], COUNT - COUNT / 2);
+	waitDone(done, COUNT);
+	manager.stopAndWait();
+	size_t once = 0;
+	for (size_t i = 0; i < COUNT; i++)
+		once += (tasks[i].runs.load() == 1);
+	BOOST_CHECK_EQUAL(once, COUNT);
+}
+
+BOOST_AUTO_TEST_CASE( LatchAndFuture )
+{
+	WorkerLatch latch(2);
+	BOOST_CHECK(!latch.done());
+	std::thread counter([&latch]() {
+		usleep(1000);
+		latch.countDown(2);
+	});
+	latch.wait();
+	BOOST_CHECK(latch.done());
+	counter.join();
+
+	WorkerThreadManager manager(2);
+	WorkerFuture<int> answer([]() { return 42; });
+	WorkerFuture<int> failed([]() -> int { throw std::runtime_error("failed"); });
+	std::atomic<int> calls(0);
+	WorkerFuture<void> call([&calls]() { calls++; });
+	manager.add(&answer);
+	manager.add(&failed);
+	manager.add(&call);
+	BOOST_CHECK_EQUAL(answer.get(), 42);
+	BOOST_CHECK(answer.ready());
+	BOOST_CHECK_THROW(failed.get(), std::runtime_error);
+	call.get();
+	BOOST_CHECK_EQUAL(calls.load(), 1);
+	manager.stopAndWait();
+}
+
+BOOST_AUTO_TEST_CASE( IdleHelpSleeps )
+{
+	WorkerThreadManager manager(1);
+	WorkerLatch latch(1);
+	struct timespec cpuTime = {0, 0};
+	WorkerFuture<void> waiter([&latch, &cpuTime]() {
+		latch.wait();
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuTime);
+	});
+	manager.add(&waiter);
+	usleep(200000);
+	// the only worker waits, the task which counts the latch down is found after a sleep
+	WorkerFuture<void> counter([&latch]() { latch.countDown(); });
+	manager.add(&counter);
+	waiter.get();
+	BOOST_CHECK(counter.ready());
+	BOOST_CHECK(cpuTime.tv_sec * 1000000000L + cpuTime.tv_nsec < 100000000L);
+	manager.stopAndWait();
+}
+
+BOOST_AUTO_TEST_CASE( ParallelFor )
+{
+	WorkerThreadManager manager(4);
+	static const size_t SIZE = 100004; // the last chunk is shorter
+	std::vector<std::atomic<uint32_t>> visits(SIZE);
+	for (auto visit = visits.begin(); visit != visits.end(); visit++)
+		visit->store(0);
+	std::atomic<uint32_t> chunks(0);
+	std::atomic<uint32_t> bigChunks(0);
+	manager.parallelFor(3, SIZE, 1000, [&](const size_t from, const size_t to) {
+		bigChunks += (to - from > 1000);
+		chunks++;
+		for (size_t i = from; i < to; i++)
+			visits[i]++;
+	});
+	size_t once = 0;
+	for (size_t i = 3; i < SIZE; i++)
+		once += (visits[i].load() == 1);
+	BOOST_CHECK_EQUAL(once, SIZE - 3);
+	BOOST_CHECK_EQUAL(visits[0].load() + visits[1].load() + visits[2].load(), 0U);
+	BOOST_CHECK_EQUAL(chunks.load(), 101U);
+	BOOST_CHECK_EQUAL(bigChunks.load(), 0U);
+
+	// an empty range and a single chunk don't use the workers
+	manager.parallelFor(5, 5, 10, [&](const size_t from, const size_t to) { chunks++; });
+	manager.parallelFor(0, 10, 0, [&](const size_t from, const size_t to) { chunks++; });
+	BOOST_CHECK_EQUAL(chunks.load(), 111U);
+
+	// the other chunks are done before the exception is thrown
+	std::atomic<uint32_t> finished(0);
+	BOOST_CHECK_THROW(manager.parallelFor(0, 100, 1, [&](const size_t from, const size_t to) {
+		if (from == 50)
+			throw std::runtime_error("chunk failed");
+		finished++;
+	}), std::runtime_error);
+	BOOST_CHECK_EQUAL(finished.load(), 99U);
+	manager.stopAndWait();
+}
+
+BOOST_AUTO_TEST_CASE( ParallelReduce )
+{
+	WorkerThreadManager manager(4);
+	static const size_t SIZE = 1000000;
+	std::vector<uint64_t> values(SIZE);
+	std::iota(values.begin(), values.end(), 1);
+	uint64_t sum = manager.parallelReduce<uint64_t>(0, SIZE, 4096, 0,
+		[&values](const size_t from, const size_t to) {
+			return std::accumulate(values.begin() + from, values.begin() + to, uint64_t(0));
+		},
+		[](const uint64_t left, const uint64_t right) { return left + right; });
+	BOOST_CHECK_EQUAL(sum, uint64_t(SIZE) * (SIZE + 1) / 2);
+
+	// the chunks are reduced in their order
+	std::string text = manager.parallelReduce<std::string>(0, 26, 3, "",
+		[](const size_t from, const size_t to) {
+			std::string chunk;
+			for (size_t i = from; i < to; i++)
+				chunk += char('a' + i);
+			return chunk;
+		},
+		[](const std::string &left, const std::string &right) { return left + right; });
+	BOOST_CHECK_EQUAL(text, "abcdefghijklmnopqrstuvwxyz");
+	BOOST_CHECK_EQUAL(manager.parallelReduce<int>(10, 10, 3, 7,
+		[](const size_t from, const size_t to) { return 1; },
+		[](const int left, const int right) { return left + right; }), 7);
+	manager.stopAndWait();
+}
+
+BOOST_AUTO_TEST_CASE( NestedParallelFor )
+{
+	// the workers wait for the inner loops with running the other tasks
+	WorkerThreadManager manager(2);
+	std::atomic<uint64_t> sum(0);
+	manager.parallelFor(0, 16, 1, [&](const size_t outerFrom, const size_t outerTo) {
+		manager.parallelFor(0, 100, 10, [&](const size_t from, const size_t to) {
+			sum += to - from;
+		});
+	});
+	BOOST_CHECK_EQUAL(sum.load(), 1600U);
+	manager.stopAndWait();
+}
+
+BOOST_AUTO_TEST_CASE( PriorityWeights )
+{
+	WorkerThreadManager manager(1);
+	manager.setWeight(ETaskPriority::HIGH, 9);
+	manager.setWeight(ETaskPriority::LOW, 1);
+	GateTask gate;
+	manager.add(&gate);
+	while (!gate.started.load())
+		sched_yield();
+	static const size_t COUNT = 500;
+	std::vector<int> order;
+	std::atomic<uint64_t> done(0);
+	std::vector<OrderTask> tasks(COUNT * 2);
+	for (size_t i = 0; i < tasks.size(); i++) {
+		tasks[i].order = &order;
+		tasks[i].done = &done;
+		tasks[i].number = (i < COUNT) ? ETaskPriority::LOW : ETaskPriority::HIGH;
+	}
+	// the background burst is added first
+	for (size_t i = 0; i < tasks.size(); i++)
+		manager.add(&tasks[i], static_cast<ETaskPriority::ETaskPriority>(tasks[i].number));
+	BOOST_CHECK_EQUAL(manager.stats(ETaskPriority::LOW).depth, COUNT);
+	BOOST_CHECK_EQUAL(manager.stats(ETaskPriority::HIGH).depth, COUNT);
+	gate.opened.store(true);
+	waitDone(done, tasks.size());
+	manager.stopAndWait();
+
+	// the low priority gets about a tenth of the runs while both of the queues have tasks
+	size_t low = std::count(order.begin(), order.begin() + 200, ETaskPriority::LOW);
+	BOOST_CHECK(low > 0);
+	BOOST_CHECK(low < 60);
+	WorkerThreadManager::PriorityStats stats = manager.stats(ETaskPriority::LOW);
+	BOOST_CHECK_EQUAL(stats.added, COUNT);
+	BOOST_CHECK_EQUAL(stats.done, COUNT);
+	BOOST_CHECK_EQUAL(stats.depth, 0U);
+	BOOST_CHECK(stats.maxWaitNs >= stats.averageWaitNs);
+	BOOST_CHECK(stats.averageWaitNs > 0);
+	BOOST_CHECK_EQUAL(manager.stats(ETaskPriority::NORMAL).done, 1U); // the gate
+}
+
+BOOST_AUTO_TEST_CASE( Deadlines )
+{
+	WorkerThreadManager manager(1);
+	GateTask gate;
+	manager.add(&gate, ETaskPriority::HIGH);
+	while (!gate.started.load())
+		sched_yield();
+	std::vector<int> order;
+	std::atomic<uint64_t> done(0);
+	std::vector<OrderTask> tasks(5);
+	for (size_t i = 0; i < tasks.size(); i++) {
+		tasks[i].order = &order;
+		tasks[i].done = &done;
+		tasks[i].number = i;
+	}
+	// the earliest deadline first, then the tasks without deadlines
+	manager.add(&tasks[0], ETaskPriority::HIGH);
+	manager.add(&tasks[1], ETaskPriority::HIGH, 3000000);
+	manager.add(&tasks[2], ETaskPriority::HIGH, 1000000);
+	manager.add(&tasks[3], ETaskPriority::HIGH, 2000000);
+	manager.add(&tasks[4], ETaskPriority::HIGH, 1000);
+	WorkerFuture<int> late([]() { return 1; });
+	manager.add(&late, ETaskPriority::LOW, 1000);
+	usleep(10000);
+	gate.opened.store(true);
+	waitDone(done, tasks.size());
+	BOOST_CHECK_THROW(late.get(), WorkerTaskExpired);
+	manager.stopAndWait();
+
+	BOOST_REQUIRE_EQUAL(order.size(), 4U);
+	BOOST_CHECK_EQUAL(order[0], 2);
+	BOOST_CHECK_EQUAL(order[1], 3);
+	BOOST_CHECK_EQUAL(order[2], 1);
+	BOOST_CHECK_EQUAL(order[3], 0);
+	BOOST_CHECK(tasks[4].expired);
+	WorkerThreadManager::PriorityStats stats = manager.stats(ETaskPriority::HIGH);
+	BOOST_CHECK_EQUAL(stats.expired, 1U);
+	BOOST_CHECK_EQUAL(stats.done, 5U); // with the gate
+	BOOST_CHECK(stats.maxWaitNs >= 10000000);
+}
+
+BOOST_AUTO_TEST_CASE( DeadlineBurst )
+{
+	WorkerThreadManager manager(1);
+	GateTask gate;
+	manager.add(&gate, ETaskPriority::HIGH);
+	while (!gate.started.load())
+		sched_yield();
+	std::vector<int> order;
+	std::atomic<uint64_t> done(0);
+	const size_t DEADLINE_TASKS = 3 * WorkerThreadManager::DEADLINE_BURST;
+	std::vector<OrderTask> tasks(DEADLINE_TASKS + 1);
+	for (size_t i = 0; i < tasks.size(); i++) {
+		tasks[i].order = &order;
+		tasks[i].done = &done;
+		tasks[i].number = i;
+	}
+	// the task without a deadline isn't left till the end of the deadline tasks
+	manager.add(&tasks[DEADLINE_TASKS], ETaskPriority::HIGH);
+	for (size_t i = 0; i < DEADLINE_TASKS; i++)
+		manager.add(&tasks[i], ETaskPriority::HIGH, 10000000 + i);
+	gate.opened.store(true);
+	waitDone(done, tasks.size());
+	manager.stopAndWait();
+
+	BOOST_REQUIRE_EQUAL(order.size(), tasks.size());
+	BOOST_CHECK_EQUAL(order[WorkerThreadManager::DEADLINE_BURST], static_cast<int>(DEADLINE_TASKS));
+	for (size_t i = 0; i < WorkerThreadManager::DEADLINE_BURST; i++)
+		BOOST_CHECK_EQUAL(order[i], static_cast<int>(i));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
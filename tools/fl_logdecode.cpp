@@ -0,0 +1,92 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright Denys Misko <gdraal@gmail.com>, Final Level, 2014.
+// Distributed under BSD (3-Clause) License (See
+// accompanying file LICENSE)
+//
+// Description: Renders binary logs of BinaryLogTarget as text
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "binary_log.hpp"
+
+using namespace fl::log;
+
+namespace
+{
+	void usage()
+	{
+		fprintf(stderr, "Usage: fl-logdecode [-m | -u] [file ...]\n"
+			"  -m  milliseconds in the time\n"
+			"  -u  microseconds in the time\n"
+			"The standard input is decoded without files\n");
+	}
+
+	bool decodeFile(FILE *in, const char *name, const ETimePrecision::ETimePrecision timePrecision)
+	{
+		static const size_t READ_SIZE = 1024 * 1024;
+		BinaryLogDecoder decoder(timePrecision);
+		std::vector<char> data;
+		size_t dataSize = 0;
+		std::string text;
+		while (true) {
+			data.resize(dataSize + READ_SIZE);
+			size_t read = fread(&data[dataSize], 1, READ_SIZE, in);
+			if (!read)
+				break;
+			dataSize += read;
+			size_t decoded;
+			try {
+				decoded = decoder.decode(&data[0], dataSize, text);
+			} catch (BinaryLogDecoder::Error &error) {
+				fwrite(text.c_str(), 1, text.size(), stdout);
+				fprintf(stderr, "%s: %s\n", name, error.what());
+				return false;
+			}
+			fwrite(text.c_str(), 1, text.size(), stdout);
+			text.clear();
+			memmove(&data[0], &data[decoded], dataSize - decoded);
+			dataSize -= decoded;
+		}
+		if (dataSize > 0) {
+			fprintf(stderr, "%s: the last record is truncated\n", name);
+			return false;
+		}
+		return true;
+	}
+};
+
+int main(int argc, char *argv[])
+{
+	ETimePrecision::ETimePrecision timePrecision = ETimePrecision::SECONDS;
+	int opt;
+	while ((opt = getopt(argc, argv, "muh")) != -1) {
+		if (opt == 'm') {
+			timePrecision = ETimePrecision::MILLISECONDS;
+		} else if (opt == 'u') {
+			timePrecision = ETimePrecision::MICROSECONDS;
+		} else {
+			usage();
+			return 2;
+		}
+	}
+	if (optind == argc)
+		return decodeFile(stdin, "stdin", timePrecision) ? 0 : 1;
+	int res = 0;
+	for (int i = optind; i < argc; i++) {
+		FILE *in = fopen(argv[i], "rb");
+		if (!in) {
+			fprintf(stderr, "Cannot open %s\n", argv[i]);
+			res = 1;
+			continue;
+		}
+		if (!decodeFile(in, argv[i], timePrecision))
+			res = 1;
+		fclose(in);
+	}
+	return res;
+}
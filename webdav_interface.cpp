@@ -8,6 +8,7 @@
 // Description: WebDAV http extension classes implementation
 ///////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
 #include "webdav_interface.hpp"
 #include "log.hpp"
 #include "rapidxml/rapidxml.hpp"
@@ -113,7 +114,7 @@ bool WebDavInterface::_savePartialPOSTData(const uint32_t postStartPosition, Net
 {
 	if (_status & ST_POST_SPLITED) {
 		if (_contentLength <= (size_t)buf.size()) {
-			if (_savePostChunk(buf.c_str(), buf.size())) {
+			if (_savePostChunk(buf.c_str(), _contentLength)) { // the data after the body isn't a part of the file
 				return true;
 			}
 			else {
@@ -126,21 +127,23 @@ bool WebDavInterface::_savePartialPOSTData(const uint32_t postStartPosition, Net
 		}
 		return false;
 	} else {
+		if (_contentLength > _maxPostInMemmorySize) { // big files are always saved to the temporary file
+			static const NetworkBuffer::TSize UPLOAD_BUFFER_SIZE = 256 * 1024;
+			buf.expand(UPLOAD_BUFFER_SIZE); // save big uploads by big chunks
+			size_t loaded = buf.size() - postStartPosition;
+			if ((loaded >= _contentLength) || (buf.size() >= (buf.reserved() / 2))) {
+				_status |= ST_POST_SPLITED;
+				parseError = ! _savePostChunk(buf.c_str() + postStartPosition, std::min(loaded, _contentLength));
+				buf.clear();
+				return !parseError && !_contentLength;
+			}
+			return false;
+		}
 		if (postStartPosition + _contentLength <= (size_t)buf.size()) {	
 			_putData.add(buf.c_str() + postStartPosition, _contentLength);
 			return true;
 		}
-		else {
-			if (_contentLength > _maxPostInMemmorySize) {
-				if (buf.size() >= (buf.reserved() / 2)) {
-					_status |= ST_POST_SPLITED;
-					size_t loaded = buf.size() - postStartPosition;
-					parseError = ! _savePostChunk(buf.c_str() + postStartPosition, loaded);
-					buf.clear();
-				}
-			}
-			return false;	
-		}
+		return false;
 	}
 }
 
@@ -154,6 +157,8 @@ bool WebDavInterface::_parsePropFind(const char *data)
 	try
 	{
 		xml_document<> doc;
+		if (Arena::current()) // nodes over the static pool of the document are taken from the request arena
+			doc.set_allocator(Arena::xmlAllocate, Arena::xmlFree);
 		doc.parse<parse_default>(const_cast<char*>(data));
 		auto root = doc.first_node();
 		if (root == NULL) {
@@ -208,6 +213,31 @@ bool WebDavInterface::parsePOSTData(const uint32_t postStartPosition, NetworkBuf
 		return false;	
 }
 
+size_t WebDavInterface::segmentedBodySize()
+{
+	if ((_requestType == ERequestType::PUT) && (_contentLength > _maxPostInMemmorySize))
+		return _contentLength;
+	return 0;
+}
+
+bool WebDavInterface::parseSegmentedPOSTData(SegmentedBuffer &body, bool &parseError)
+{
+	parseError = false;
+	_status |= ST_POST_SPLITED;
+	while (!body.empty() && _contentLength) {
+		uint32_t size;
+		const char *data = body.front(size);
+		if (size > _contentLength) // the first segment can have the data after the body
+			size = _contentLength;
+		if (!_savePostChunk(data, size)) {
+			parseError = true;
+			return false;
+		}
+		body.consume(size);
+	}
+	return !_contentLength;
+}
+
 HttpEventInterface::EFormResult WebDavInterface::formResult(BString &networkBuffer, class HttpEvent *http)
 {
 	switch (_requestType)
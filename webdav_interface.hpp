@@ -31,6 +31,9 @@ namespace fl {
 			virtual bool parseURI(const char *cmdStart, const EHttpVersion::EHttpVersion version,
 				const std::string &host, const std::string &fileName, const std::string &query);
 			virtual bool parsePOSTData(const uint32_t postStartPosition, NetworkBuffer &buf, bool &parseError);
+			// big PUT bodies are received into segments and saved to the temporary file segment by segment
+			virtual size_t segmentedBodySize();
+			virtual bool parseSegmentedPOSTData(SegmentedBuffer &body, bool &parseError);
 			virtual bool parseHeader(const char *name, const size_t nameLength, const char *value, const size_t valueLen, 
 				const char *pEndHeader);
 			virtual bool formError(class BString &result, class HttpEvent *http);
@@ -8,56 +8,516 @@
 // Description: Worker thread classes implementation
 ///////////////////////////////////////////////////////////////////////////////
 
+#include <climits>
+#include <ctime>
+#include <sched.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include "worker_thread.hpp"
+#include "rcu.hpp"
 #include "log.hpp"
 
 using namespace fl::threads;
 
+namespace
+{
+	void futexWait(std::atomic<uint32_t> *futex, const uint32_t value, const struct timespec *timeout = NULL)
+	{
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(futex), FUTEX_WAIT_PRIVATE, value, timeout, NULL, 0);
+	}
+
+	void futexWake(std::atomic<uint32_t> *futex, const int count)
+	{
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(futex), FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+	}
+
+	uint32_t nextRandom(uint32_t &random)
+	{
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+		return random;
+	}
+};
+
+WorkStealingDeque::Buffer::Buffer(const int64_t size)
+	: size(size), mask(size - 1), tasks(new std::atomic<WorkerTaskInterface*>[size])
+{
+}
+
+WorkStealingDeque::WorkStealingDeque()
+	: _top(0), _bottom(0)
+{
+	_buffers.emplace_back(new Buffer(INITIAL_SIZE));
+	_buffer.store(_buffers.back().get());
+}
+
+WorkStealingDeque::~WorkStealingDeque()
+{
+}
+
+WorkStealingDeque::Buffer *WorkStealingDeque::_grow(Buffer *buffer, const int64_t bottom, const int64_t top)
+{
+	Buffer *grown = new Buffer(buffer->size * 2);
+	for (int64_t i = top; i < bottom; i++)
+		grown->put(i, buffer->get(i));
+	_buffers.emplace_back(grown);
+	_buffer.store(grown, std::memory_order_release);
+	return grown;
+}
+
+void WorkStealingDeque::push(WorkerTaskInterface *task)
+{
+	int64_t bottom = _bottom.load(std::memory_order_relaxed);
+	int64_t top = _top.load(std::memory_order_acquire);
+	Buffer *buffer = _buffer.load(std::memory_order_relaxed);
+	if (bottom - top > buffer->size - 1)
+		buffer = _grow(buffer, bottom, top);
+	buffer->put(bottom, task);
+	std::atomic_thread_fence(std::memory_order_release);
+	_bottom.store(bottom + 1, std::memory_order_relaxed);
+}
+
+WorkerTaskInterface *WorkStealingDeque::pop()
+{
+	int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+	Buffer *buffer = _buffer.load(std::memory_order_relaxed);
+	_bottom.store(bottom, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t top = _top.load(std::memory_order_relaxed);
+	if (top > bottom) { // empty
+		_bottom.store(bottom + 1, std::memory_order_relaxed);
+		return NULL;
+	}
+	WorkerTaskInterface *task = buffer->get(bottom);
+	if (top == bottom) { // the last task can be stolen at the same time
+		if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			task = NULL;
+		_bottom.store(bottom + 1, std::memory_order_relaxed);
+	}
+	return task;
+}
+
+WorkerTaskInterface *WorkStealingDeque::steal()
+{
+	int64_t top = _top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t bottom = _bottom.load(std::memory_order_acquire);
+	if (top >= bottom)
+		return NULL;
+	Buffer *buffer = _buffer.load(std::memory_order_acquire);
+	WorkerTaskInterface *task = buffer->get(top);
+	if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return NULL;
+	return task;
+}
+
+TaskQueue::TaskQueue(const uint32_t size)
+	: _pushPos(0), _popPos(0), _overflowSize(0)
+{
+	uint64_t cellsCount = 2;
+	while (cellsCount < size)
+		cellsCount *= 2;
+	_cells.reset(new Cell[cellsCount]);
+	_mask = cellsCount - 1;
+	for (uint64_t i = 0; i < cellsCount; i++)
+		_cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+bool TaskQueue::_tryPush(WorkerTaskInterface *task)
+{
+	uint64_t pos = _pushPos.load(std::memory_order_relaxed);
+	while (true) {
+		Cell &cell = _cells[pos & _mask];
+		int64_t diff = static_cast<int64_t>(cell.sequence.load(std::memory_order_acquire) - pos);
+		if (diff == 0) {
+			if (_pushPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				cell.task = task;
+				cell.sequence.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+		} else if (diff < 0) { // full
+			return false;
+		} else {
+			pos = _pushPos.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+WorkerTaskInterface *TaskQueue::_tryPop()
+{
+	uint64_t pos = _popPos.load(std::memory_order_relaxed);
+	while (true) {
+		Cell &cell = _cells[pos & _mask];
+		int64_t diff = static_cast<int64_t>(cell.sequence.load(std::memory_order_acquire) - (pos + 1));
+		if (diff == 0) {
+			if (_popPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				WorkerTaskInterface *task = cell.task;
+				cell.sequence.store(pos + _mask + 1, std::memory_order_release);
+				return task;
+			}
+		} else if (diff < 0) { // empty
+			return NULL;
+		} else {
+			pos = _popPos.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+void TaskQueue::push(WorkerTaskInterface *task)
+{
+	if (_tryPush(task))
+		return;
+	_overflowSync.lock();
+	_overflow.push_back(task);
+	_overflowSize.fetch_add(1, std::memory_order_release);
+	_overflowSync.unLock();
+}
+
+WorkerTaskInterface *TaskQueue::pop()
+{
+	WorkerTaskInterface *task = _tryPop();
+	if (task || !_overflowSize.load(std::memory_order_acquire))
+		return task;
+	_overflowSync.lock();
+	if (!_overflow.empty()) {
+		task = _overflow.front();
+		_overflow.pop_front();
+		_overflowSize.fetch_sub(1, std::memory_order_relaxed);
+	}
+	_overflowSync.unLock();
+	return task;
+}
+
+void WorkerLatch::countDown(const uint32_t count)
+{
+	uint32_t state = _state.fetch_sub(count);
+	// the latch can be destroyed by the waiter here, the wake only uses its address
+	if (((state & COUNT_MASK) == count) && (state & WAITING))
+		futexWake(&_state, INT_MAX);
+}
+
+void WorkerLatch::_sleep(const struct timespec *timeout)
+{
+	uint32_t state = _state.fetch_or(WAITING);
+	if (state & COUNT_MASK)
+		futexWait(&_state, state | WAITING, timeout);
+}
+
+void WorkerLatch::wait()
+{
+	if (done() || WorkerThreadManager::helpWhile(*this))
+		return;
+	while (!done())
+		_sleep(NULL);
+}
+
+__thread WorkerThread *WorkerThreadManager::_currentThread = NULL;
+__thread uint32_t WorkerThreadManager::_helpRandom = 0;
+
+bool WorkerThreadManager::helpWhile(WorkerLatch &latch)
+{
+	WorkerThread *thread = _currentThread;
+	if (!thread)
+		return false;
+	if (!_helpRandom)
+		_helpRandom = reinterpret_cast<uintptr_t>(&latch) | 1;
+	// the new tasks wake only the parked workers, the sleep is limited for the case all of the workers wait
+	struct timespec timeout;
+	timeout.tv_sec = 0;
+	timeout.tv_nsec = HELP_SLEEP_NS;
+	uint32_t emptyRounds = 0;
+	while (!latch.done()) {
+		WorkerTaskInterface *task = thread->manager()->_findTask(thread, _helpRandom);
+		if (task) {
+			emptyRounds = 0;
+			task->doTask();
+		} else if (emptyRounds < HELP_EMPTY_ROUNDS) {
+			emptyRounds++;
+			sched_yield();
+		} else {
+			latch._sleep(&timeout);
+		}
+	}
+	return true;
+}
+
 WorkerThreadManager::WorkerThreadManager(const size_t countThreads, const size_t workerThreadStackSize)
+	: _weightsSum(0), _wakeEpoch(0), _sleeping(0), _searching(0), _stopped(false), _threadsCount(0)
 {
+	setWeight(ETaskPriority::HIGH, 8);
+	setWeight(ETaskPriority::NORMAL, 4);
+	setWeight(ETaskPriority::LOW, 1);
+	_threads.reserve(countThreads);
 	for (size_t t = 0; t < countThreads; t++) {
 		_threads.emplace_back(new WorkerThread(this, workerThreadStackSize));
+		_threadsCount.store(_threads.size(), std::memory_order_release);
 	}
 	log::Info::L("%u WorkerThreadManager have been started\n", _threads.size());
 }
 
-void WorkerThreadManager::add(WorkerTaskInterface *task)
+WorkerThreadManager::~WorkerThreadManager()
 {
-	_sync.lock();
-	_tasks.push_back(task);
-	_sync.unLock();
-	
-	_threadCond.sendSignal();
+	if (!_stopped)
+		stopAndWait();
+}
+
+uint64_t WorkerThreadManager::_nowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+bool WorkerThreadManager::_laterDeadline(const WorkerTaskInterface *a, const WorkerTaskInterface *b)
+{
+	return a->_deadline > b->_deadline;
+}
+
+void WorkerThreadManager::setWeight(const ETaskPriority::ETaskPriority priority, const uint32_t weight)
+{
+	_queues[priority].weight.store(weight ? weight : 1, std::memory_order_relaxed);
+	uint32_t weightsSum = 0;
+	for (size_t i = 0; i < ETaskPriority::MAX_TASK_PRIORITY; i++)
+		weightsSum += _queues[i].weight.load(std::memory_order_relaxed);
+	_weightsSum.store(weightsSum, std::memory_order_relaxed);
+}
+
+WorkerThreadManager::PriorityStats WorkerThreadManager::stats(const ETaskPriority::ETaskPriority priority) const
+{
+	const PriorityQueue &queue = _queues[priority];
+	PriorityStats stats;
+	stats.done = queue.done.load();
+	stats.expired = queue.expired.load();
+	stats.added = queue.added.load();
+	stats.depth = (stats.added > stats.done + stats.expired) ? stats.added - stats.done - stats.expired : 0;
+	stats.averageWaitNs = stats.done ? queue.waitNs.load() / stats.done : 0;
+	stats.maxWaitNs = queue.maxWaitNs.load();
+	return stats;
+}
+
+void WorkerThreadManager::_push(WorkerTaskInterface *task, const ETaskPriority::ETaskPriority priority)
+{
+	PriorityQueue &queue = _queues[priority];
+	task->_addTime = _nowNs();
+	queue.added.fetch_add(1, std::memory_order_relaxed);
+	if (task->_deadline) {
+		AutoMutex autoSync(&queue.deadlineSync);
+		queue.deadlineTasks.push_back(task);
+		std::push_heap(queue.deadlineTasks.begin(), queue.deadlineTasks.end(), _laterDeadline);
+		queue.deadlineSize.store(queue.deadlineTasks.size(), std::memory_order_relaxed);
+	} else {
+		queue.tasks.push(task);
+	}
+}
+
+void WorkerThreadManager::add(WorkerTaskInterface *task, const ETaskPriority::ETaskPriority priority,
+	const uint64_t deadlineUs)
+{
+	task->_deadline = deadlineUs ? _nowNs() + deadlineUs * 1000 : 0;
+	_push(task, priority);
+	_notify();
+}
+
+void WorkerThreadManager::addBatch(WorkerTaskInterface * const *tasks, const size_t count,
+	const ETaskPriority::ETaskPriority priority)
+{
+	// the NORMAL batches of a worker, e.g. the chunks of parallelFor, are run by it in the LIFO order and are
+	// stolen by the other workers
+	WorkerThread *thread = _currentThread;
+	bool toDeque = (priority == ETaskPriority::NORMAL) && thread && (thread->manager() == this);
+	for (size_t i = 0; i < count; i++) {
+		tasks[i]->_deadline = 0;
+		if (toDeque)
+			thread->tasks().push(tasks[i]);
+		else
+			_push(tasks[i], priority);
+	}
+	_notify();
+}
+
+void WorkerThreadManager::_notify()
+{
+	// pairs with the fence of _park, either the worker sees the task or the sleeping worker is seen here.
+	// A searching worker wakes the next one when it finds a task, so only one wake up is in flight
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (!_searching.load(std::memory_order_relaxed) && _sleeping.load(std::memory_order_relaxed))
+		_wake(1);
+}
+
+void WorkerThreadManager::_wake(const int count)
+{
+	_wakeEpoch.fetch_add(1, std::memory_order_release);
+	futexWake(&_wakeEpoch, count);
 }
 
 void WorkerThreadManager::stopAndWait()
 {
+	_stopped = true;
 	for (auto thread = _threads.begin(); thread != _threads.end(); thread++) {
 		(*thread)->stop();
 	}
-	_threadCond.broadcastSignalToAll();
+	_wake(INT_MAX);
 	for (auto thread = _threads.begin(); thread != _threads.end(); thread++) {
 		(*thread)->waitMe();
 	}	
 }
 
+WorkerTaskInterface *WorkerThreadManager::_findTask(WorkerThread *thread, uint32_t &random)
+{
+	WorkerTaskInterface *task = thread->tasks().pop();
+	if (task)
+		return task;
+	task = _popQueues(random);
+	if (task)
+		return task;
+	size_t threadsCount = _threadsCount.load(std::memory_order_acquire);
+	if (!threadsCount) // the first workers start before they are added
+		return NULL;
+	size_t start = nextRandom(random) % threadsCount;
+	for (size_t i = 0; i < threadsCount; i++) {
+		WorkerThread *victim = _threads[(start + i) % threadsCount].get();
+		if (victim == thread)
+			continue;
+		task = victim->tasks().steal();
+		if (task)
+			return task;
+	}
+	return NULL;
+}
+
+WorkerTaskInterface *WorkerThreadManager::_popPriority(PriorityQueue &queue)
+{
+	// a task without a deadline is taken after the burst of the deadline tasks, the burst is counted without
+	// the lock, so the workers can take a few more deadline tasks in a row
+	WorkerTaskInterface *task;
+	if (queue.deadlineBurst.load(std::memory_order_relaxed) >= DEADLINE_BURST) {
+		task = queue.tasks.pop();
+		if (task) {
+			queue.deadlineBurst.store(0, std::memory_order_relaxed);
+			return task;
+		}
+	}
+	if (queue.deadlineSize.load(std::memory_order_relaxed)) {
+		AutoMutex autoSync(&queue.deadlineSync);
+		if (!queue.deadlineTasks.empty()) {
+			std::pop_heap(queue.deadlineTasks.begin(), queue.deadlineTasks.end(), _laterDeadline);
+			task = queue.deadlineTasks.back();
+			queue.deadlineTasks.pop_back();
+			queue.deadlineSize.store(queue.deadlineTasks.size(), std::memory_order_relaxed);
+			queue.deadlineBurst.fetch_add(1, std::memory_order_relaxed);
+			return task;
+		}
+	}
+	task = queue.tasks.pop();
+	if (task)
+		queue.deadlineBurst.store(0, std::memory_order_relaxed);
+	return task;
+}
+
+WorkerTaskInterface *WorkerThreadManager::_popQueues(uint32_t &random)
+{
+	while (true) {
+		// the queue of the weighted random choice is tried first, then the others in the order of the priorities
+		uint32_t choice = nextRandom(random) % _weightsSum.load(std::memory_order_relaxed);
+		size_t chosen = 0;
+		while ((chosen + 1 < ETaskPriority::MAX_TASK_PRIORITY)
+			&& (choice >= _queues[chosen].weight.load(std::memory_order_relaxed))) {
+			choice -= _queues[chosen].weight.load(std::memory_order_relaxed);
+			chosen++;
+		}
+		bool expired = false;
+		for (size_t i = 0; i <= ETaskPriority::MAX_TASK_PRIORITY; i++) {
+			size_t priority = i ? i - 1 : chosen;
+			if (i && (priority == chosen))
+				continue;
+			PriorityQueue &queue = _queues[priority];
+			if (queue.empty())
+				continue;
+			WorkerTaskInterface *task = _popPriority(queue);
+			if (!task)
+				continue;
+			uint64_t now = _nowNs();
+			if (task->_deadline && (now > task->_deadline)) {
+				queue.expired.fetch_add(1, std::memory_order_relaxed);
+				task->expireTask();
+				expired = true;
+				break;
+			}
+			uint64_t waitNs = (now > task->_addTime) ? now - task->_addTime : 0;
+			queue.waitNs.fetch_add(waitNs, std::memory_order_relaxed);
+			uint64_t maxWaitNs = queue.maxWaitNs.load(std::memory_order_relaxed);
+			while ((waitNs > maxWaitNs) && !queue.maxWaitNs.compare_exchange_weak(maxWaitNs, waitNs))
+				;
+			queue.done.fetch_add(1, std::memory_order_relaxed);
+			return task;
+		}
+		if (!expired)
+			return NULL;
+	}
+}
+
+bool WorkerThreadManager::_hasTasks() const
+{
+	for (size_t i = 0; i < ETaskPriority::MAX_TASK_PRIORITY; i++) {
+		if (!_queues[i].empty())
+			return true;
+	}
+	size_t threadsCount = _threadsCount.load(std::memory_order_acquire);
+	for (size_t i = 0; i < threadsCount; i++) {
+		if (!_threads[i]->tasks().empty())
+			return true;
+	}
+	return false;
+}
+
+void WorkerThreadManager::_park(WorkerThread *thread)
+{
+	uint32_t epoch = _wakeEpoch.load(std::memory_order_acquire);
+	_sleeping.fetch_add(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (!_hasTasks() && !thread->isStopped()) {
+		Rcu::offline();
+		futexWait(&_wakeEpoch, epoch);
+		Rcu::online();
+	}
+	_sleeping.fetch_sub(1, std::memory_order_relaxed);
+}
+
 void WorkerThreadManager::doTasks(WorkerThread *thread)
 {
+	_currentThread = thread;
+	// the tasks read the RcuPtr objects without locks, the worker is quiescent between the tasks
+	Rcu::registerThread();
+	uint32_t random = reinterpret_cast<uintptr_t>(thread) | 1;
+	bool searching = false; // the worker has been woken up for the new tasks
+	// the worker yields a few times before it sleeps, the futex wait and wake cost more than a short task
+	static const uint32_t SEARCH_ROUNDS = 4;
 	while (true) {
 		if (thread->isStopped()) {
+			Rcu::unregisterThread();
 			return;
 		}
-		_sync.lock();
-		if (_tasks.empty()) {
-			_sync.unLock();
-			_threadCond.waitSignal();
+		WorkerTaskInterface *task = _findTask(thread, random);
+		for (uint32_t round = 1; !task && (round < SEARCH_ROUNDS) && !thread->isStopped(); round++) {
+			sched_yield();
+			task = _findTask(thread, random);
+		}
+		if (searching) {
+			searching = false;
+			// the last searching worker which has found a task wakes the next one for the rest of the tasks
+			if ((_searching.fetch_sub(1) == 1) && task && _sleeping.load() && _hasTasks())
+				_wake(1);
+		}
+		if (!task) {
+			_park(thread);
+			_searching.fetch_add(1);
+			searching = true;
 			continue;
 		}
-		auto task = _tasks.front();
-		_tasks.pop_front();
-		_sync.unLock();
-		
 		task->doTask();
+		Rcu::quiescent();
 	}
 }
 
@@ -80,4 +540,4 @@ WorkerThread::~WorkerThread()
 void WorkerThread::run()
 {
 	_manager->doTasks(this);
-}
\ No newline at end of file
+}
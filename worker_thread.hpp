@@ -12,24 +12,252 @@
 // Description: Worker thread classes
 ///////////////////////////////////////////////////////////////////////////////
 
-#include <list>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <vector>
 #include <memory>
 #include "thread.hpp"
 #include "mutex.hpp"
-#include "cond_mutex.hpp"
+#include "exception.hpp"
 
 
 namespace fl {
 	namespace threads {
 
+		namespace ETaskPriority
+		{
+			enum ETaskPriority : uint8_t
+			{
+				HIGH, // latency sensitive work, e.g. the async handlers of the requests
+				NORMAL,
+				LOW, // background jobs, e.g. reindexing and cleanups
+				MAX_TASK_PRIORITY,
+			};
+		};
+
 		class WorkerTaskInterface
 		{
 		public:
+			WorkerTaskInterface()
+				: _addTime(0), _deadline(0)
+			{
+			}
 			virtual void doTask() = 0;
+			// is called instead of doTask when the deadline of the task has passed before its start
+			virtual void expireTask()
+			{
+			}
 			virtual ~WorkerTaskInterface()
 			{
 			}
+		private:
+			friend class WorkerThreadManager;
+			uint64_t _addTime; // monotonic ns of the add to a priority queue
+			uint64_t _deadline; // monotonic ns, 0 is no deadline
+		};
+
+		// the hot atomics are kept on their own cache lines by padding members, the workers and the managers are
+		// created by new, which doesn't take the alignment of over aligned types
+		static const size_t CACHE_LINE_SIZE = 64;
+
+		// Chase-Lev deque of the tasks of one worker: the owner pushes and pops at the bottom without locks,
+		// the other workers steal from the top. The buffer grows by the owner, the old buffers are kept till
+		// the destruction as the stealing threads can still read them
+		class WorkStealingDeque
+		{
+		public:
+			WorkStealingDeque();
+			~WorkStealingDeque();
+			// the owner thread only
+			void push(WorkerTaskInterface *task);
+			WorkerTaskInterface *pop();
+			// any thread, returns NULL if the deque is empty or another thread has taken the task
+			WorkerTaskInterface *steal();
+			bool empty() const
+			{
+				return _top.load(std::memory_order_relaxed) >= _bottom.load(std::memory_order_relaxed);
+			}
+		private:
+			struct Buffer
+			{
+				Buffer(const int64_t size);
+				WorkerTaskInterface *get(const int64_t index) const
+				{
+					return tasks[index & mask].load(std::memory_order_relaxed);
+				}
+				void put(const int64_t index, WorkerTaskInterface *task)
+				{
+					tasks[index & mask].store(task, std::memory_order_relaxed);
+				}
+				int64_t size;
+				int64_t mask;
+				std::unique_ptr<std::atomic<WorkerTaskInterface*>[]> tasks;
+			};
+			Buffer *_grow(Buffer *buffer, const int64_t bottom, const int64_t top);
+
+			static const int64_t INITIAL_SIZE = 256;
+			char _topPadding[CACHE_LINE_SIZE];
+			std::atomic<int64_t> _top;
+			char _bottomPadding[CACHE_LINE_SIZE - sizeof(std::atomic<int64_t>)];
+			std::atomic<int64_t> _bottom;
+			std::atomic<Buffer*> _buffer;
+			std::vector<std::unique_ptr<Buffer>> _buffers;
+		};
+
+		// Lock free multi producer multi consumer queue of the tasks which are added from outside of the workers.
+		// The tasks which don't fit the ring wait in the overflow list
+		class TaskQueue
+		{
+		public:
+			TaskQueue(const uint32_t size = DEFAULT_SIZE);
+			void push(WorkerTaskInterface *task);
+			WorkerTaskInterface *pop();
+			bool empty() const
+			{
+				return (_pushPos.load(std::memory_order_relaxed) == _popPos.load(std::memory_order_relaxed))
+					&& !_overflowSize.load(std::memory_order_relaxed);
+			}
+			static const uint32_t DEFAULT_SIZE = 64 * 1024;
+		private:
+			bool _tryPush(WorkerTaskInterface *task);
+			WorkerTaskInterface *_tryPop();
+
+			struct Cell
+			{
+				std::atomic<uint64_t> sequence;
+				WorkerTaskInterface *task;
+			};
+			std::unique_ptr<Cell[]> _cells;
+			uint64_t _mask;
+			char _pushPosPadding[CACHE_LINE_SIZE];
+			std::atomic<uint64_t> _pushPos;
+			char _popPosPadding[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+			std::atomic<uint64_t> _popPos;
+			char _overflowSizePadding[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+			std::atomic<size_t> _overflowSize;
+			Mutex _overflowSync;
+			std::deque<WorkerTaskInterface*> _overflow;
+		};
+
+		// Counter of the unfinished tasks, wait returns when it gets to zero. A worker thread runs the other tasks
+		// while it waits and sleeps on the futex for short periods when there are none, the other threads sleep
+		// on the futex. The waiting thread can destroy the latch right after wait: the last countDown doesn't read
+		// or write the latch after the count gets to zero, but its futex wake can come after the destruction.
+		// Such a wake only gives a spurious wake up to a futex which has taken the address, the futex waiters
+		// of the library check their state after each wake up
+		class WorkerLatch
+		{
+		public:
+			WorkerLatch(const uint32_t count)
+				: _state(count)
+			{
+			}
+			void countDown(const uint32_t count = 1);
+			bool done() const
+			{
+				return (_state.load(std::memory_order_acquire) & COUNT_MASK) == 0;
+			}
+			void wait();
+		private:
+			friend class WorkerThreadManager;
+			// sleeps on the futex till the count gets to zero or the timeout, NULL is no timeout
+			void _sleep(const struct timespec *timeout);
+			static const uint32_t WAITING = 0x80000000; // a thread sleeps on the futex
+			static const uint32_t COUNT_MASK = ~WAITING;
+			std::atomic<uint32_t> _state;
+		};
+
+		class WorkerTaskExpired : public fl::exceptions::Error
+		{
+		public:
+			WorkerTaskExpired(const char *what)
+				: fl::exceptions::Error(what)
+			{
+			}
+		};
+
+		// Task with the result of a function, the owner keeps it till get or ready. The exceptions of the function
+		// are thrown by get, WorkerTaskExpired is thrown when the deadline has passed before the start
+		template <class T>
+		class WorkerFuture : public WorkerTaskInterface
+		{
+		public:
+			WorkerFuture(std::function<T()> func)
+				: _func(func), _latch(1)
+			{
+			}
+			virtual void doTask()
+			{
+				try {
+					_value = _func();
+				} catch (...) {
+					_exception = std::current_exception();
+				}
+				_latch.countDown();
+			}
+			virtual void expireTask()
+			{
+				_exception = std::make_exception_ptr(WorkerTaskExpired("The deadline of the task has passed"));
+				_latch.countDown();
+			}
+			bool ready() const
+			{
+				return _latch.done();
+			}
+			T &get()
+			{
+				_latch.wait();
+				if (_exception)
+					std::rethrow_exception(_exception);
+				return _value;
+			}
+		private:
+			std::function<T()> _func;
+			T _value;
+			std::exception_ptr _exception;
+			WorkerLatch _latch;
+		};
+
+		template <>
+		class WorkerFuture<void> : public WorkerTaskInterface
+		{
+		public:
+			WorkerFuture(std::function<void()> func)
+				: _func(func), _latch(1)
+			{
+			}
+			virtual void doTask()
+			{
+				try {
+					_func();
+				} catch (...) {
+					_exception = std::current_exception();
+				}
+				_latch.countDown();
+			}
+			virtual void expireTask()
+			{
+				_exception = std::make_exception_ptr(WorkerTaskExpired("The deadline of the task has passed"));
+				_latch.countDown();
+			}
+			bool ready() const
+			{
+				return _latch.done();
+			}
+			void get()
+			{
+				_latch.wait();
+				if (_exception)
+					std::rethrow_exception(_exception);
+			}
+		private:
+			std::function<void()> _func;
+			std::exception_ptr _exception;
+			WorkerLatch _latch;
 		};
 
 		class WorkerThread : public Thread
@@ -39,39 +267,218 @@ namespace fl {
 			virtual ~WorkerThread();
 			void stop()
 			{
-				_stopped = true;
+				_stopped.store(true);
 			}
 			const bool isStopped() const
 			{
-				return _stopped;
+				return _stopped.load(std::memory_order_relaxed);
+			}
+			WorkStealingDeque &tasks()
+			{
+				return _tasks;
+			}
+			class WorkerThreadManager *manager() const
+			{
+				return _manager;
 			}
 		private:
 			virtual void run();
 			class WorkerThreadManager *_manager;
-			bool _stopped;
+			std::atomic<bool> _stopped;
+			WorkStealingDeque _tasks;
 		};
 
+		// Each worker runs the tasks of its own deque, then the tasks of the priority queues and then steals from
+		// the other workers. The NORMAL batches which are added from a worker, e.g. the chunks of parallelFor, go
+		// to its deque and they are run in the LIFO order by it, the other tasks go to the priority queues.
+		// The priority queue is chosen by the weights of the priorities among the non empty ones, its tasks with
+		// deadlines are taken in the earliest deadline first order before the other ones, which are taken in the
+		// FIFO order. After DEADLINE_BURST deadline tasks in a row a task without a deadline is taken, so a stream
+		// of the deadline tasks doesn't starve them. The idle workers sleep on a futex
 		class WorkerThreadManager
 		{
 		public:
 			static const size_t USER_LOAD_THREAD_STACK_SIZE = 100000;
 			WorkerThreadManager(const size_t countThreads, const size_t workerThreadStackSize = USER_LOAD_THREAD_STACK_SIZE);
-			void add(WorkerTaskInterface *task);
+			~WorkerThreadManager();
+			// deadlineUs is the time from now the task should be started in, the later tasks are expired
+			// with expireTask instead of doTask. 0 is no deadline
+			void add(WorkerTaskInterface *task, const ETaskPriority::ETaskPriority priority = ETaskPriority::NORMAL,
+				const uint64_t deadlineUs = 0);
+			// adds the tasks with one wake up of a worker, a NORMAL batch of a worker goes to its deque
+			void addBatch(WorkerTaskInterface * const *tasks, const size_t count,
+				const ETaskPriority::ETaskPriority priority = ETaskPriority::NORMAL);
+			static const uint32_t DEADLINE_BURST = 16;
+			// the share of the workers a priority gets when all of the priorities have tasks, 0 is taken as 1
+			void setWeight(const ETaskPriority::ETaskPriority priority, const uint32_t weight);
+
+			// the counters of the priority queues, the tasks of the deques of the workers aren't there
+			struct PriorityStats
+			{
+				uint64_t added;
+				uint64_t done; // the started tasks
+				uint64_t expired;
+				uint64_t depth; // the tasks in the queue
+				uint64_t averageWaitNs; // from the add to the start
+				uint64_t maxWaitNs;
+			};
+			PriorityStats stats(const ETaskPriority::ETaskPriority priority) const;
+
+			// calls func(from, to) for the chunks of grain elements of [begin, end) on the workers, the calling
+			// thread runs the first chunk and waits for the rest. The first exception of func is thrown after
+			// all chunks are done
+			template <class TFunc>
+			void parallelFor(const size_t begin, const size_t end, const size_t grain, TFunc func);
+			// reduces the results of map(from, to) of the chunks with reduce(result, chunkResult) in the order of
+			// the chunks, identity is the start of the result and of the chunks
+			template <class T, class TMap, class TReduce>
+			T parallelReduce(const size_t begin, const size_t end, const size_t grain, const T &identity, TMap map,
+				TReduce reduce);
+
+			// runs the tasks of the manager of the current worker thread till the latch is done, returns false
+			// if the current thread isn't a worker. After HELP_EMPTY_ROUNDS searches without tasks the thread
+			// sleeps on the latch and looks for the new tasks every HELP_SLEEP_NS
+			static bool helpWhile(WorkerLatch &latch);
+			static const uint32_t HELP_EMPTY_ROUNDS = 64;
+			static const long HELP_SLEEP_NS = 1000000;
 
 			void doTasks(WorkerThread *thread);
+			// the tasks which haven't been started are left in the queues
 			void stopAndWait();
 		private:
-			typedef std::list<WorkerTaskInterface*> TWorkerTaskInterfaceVector;
-			TWorkerTaskInterfaceVector _tasks;
+			template <class TFunc>
+			class RangeTask : public WorkerTaskInterface
+			{
+			public:
+				virtual void doTask()
+				{
+					try {
+						(*func)(from, to);
+					} catch (...) {
+						if (!failed->exchange(true))
+							*exception = std::current_exception();
+					}
+					latch->countDown();
+				}
+				TFunc *func;
+				size_t from;
+				size_t to;
+				WorkerLatch *latch;
+				std::atomic<bool> *failed;
+				std::exception_ptr *exception;
+			};
 
-			Mutex _sync;
+			struct PriorityQueue
+			{
+				PriorityQueue()
+					: weight(1), deadlineSize(0), deadlineBurst(0), added(0), done(0), expired(0), waitNs(0), maxWaitNs(0)
+				{
+				}
+				TaskQueue tasks; // the tasks without deadlines
+				std::atomic<uint32_t> weight;
+				Mutex deadlineSync;
+				std::vector<WorkerTaskInterface*> deadlineTasks; // heap by the deadlines
+				std::atomic<size_t> deadlineSize;
+				std::atomic<uint32_t> deadlineBurst; // the deadline tasks taken in a row
+				char addedPadding[CACHE_LINE_SIZE];
+				std::atomic<uint64_t> added;
+				char donePadding[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+				std::atomic<uint64_t> done;
+				std::atomic<uint64_t> expired;
+				std::atomic<uint64_t> waitNs;
+				std::atomic<uint64_t> maxWaitNs;
+				char endPadding[CACHE_LINE_SIZE - 4 * sizeof(std::atomic<uint64_t>)]; // from the next queue
+				bool empty() const
+				{
+					return tasks.empty() && !deadlineSize.load(std::memory_order_relaxed);
+				}
+			};
+			static uint64_t _nowNs();
+			// the order of the heap of the deadline tasks
+			static bool _laterDeadline(const WorkerTaskInterface *a, const WorkerTaskInterface *b);
+			void _push(WorkerTaskInterface *task, const ETaskPriority::ETaskPriority priority);
+			void _notify();
+			WorkerTaskInterface *_popPriority(PriorityQueue &queue);
+			WorkerTaskInterface *_popQueues(uint32_t &random);
+			WorkerTaskInterface *_findTask(WorkerThread *thread, uint32_t &random);
+			bool _hasTasks() const;
+			void _park(WorkerThread *thread);
+			void _wake(const int count);
 
-			CondMutex _threadCond;
+			PriorityQueue _queues[ETaskPriority::MAX_TASK_PRIORITY];
+			std::atomic<uint32_t> _weightsSum;
+			char _wakeEpochPadding[CACHE_LINE_SIZE];
+			std::atomic<uint32_t> _wakeEpoch; // the futex of the sleeping workers
+			char _sleepingPadding[CACHE_LINE_SIZE - sizeof(std::atomic<uint32_t>)];
+			std::atomic<uint32_t> _sleeping;
+			std::atomic<uint32_t> _searching; // the woken workers which haven't found a task yet
+			bool _stopped;
 
 			typedef std::unique_ptr<WorkerThread> TUserLoadThreadPtr;
 			typedef std::vector<TUserLoadThreadPtr> TUserLoadThreadPtrVector;
-			TUserLoadThreadPtrVector _threads;
+			TUserLoadThreadPtrVector _threads; // the space is reserved, the started workers steal from each other
+			std::atomic<size_t> _threadsCount;
+
+			static __thread WorkerThread *_currentThread;
+			static __thread uint32_t _helpRandom;
 		};
+
+		template <class TFunc>
+		void WorkerThreadManager::parallelFor(const size_t begin, const size_t end, const size_t grain, TFunc func)
+		{
+			if (begin >= end)
+				return;
+			size_t step = grain ? grain : 1;
+			size_t chunks = (end - begin - 1) / step + 1;
+			if (chunks == 1) {
+				func(begin, end);
+				return;
+			}
+			WorkerLatch latch(chunks - 1);
+			std::atomic<bool> failed(false);
+			std::exception_ptr exception;
+			std::vector<RangeTask<TFunc>> tasks(chunks - 1);
+			std::vector<WorkerTaskInterface*> batch(chunks - 1);
+			for (size_t chunk = 1; chunk < chunks; chunk++) {
+				RangeTask<TFunc> &task = tasks[chunk - 1];
+				task.func = &func;
+				task.from = begin + chunk * step;
+				task.to = std::min(end, task.from + step);
+				task.latch = &latch;
+				task.failed = &failed;
+				task.exception = &exception;
+				batch[chunk - 1] = &task;
+			}
+			// the last chunks are added first, the deque of a worker gives the first ones to its owner
+			std::reverse(batch.begin(), batch.end());
+			addBatch(&batch[0], batch.size());
+			try {
+				func(begin, begin + step);
+			} catch (...) {
+				if (!failed.exchange(true))
+					exception = std::current_exception();
+			}
+			latch.wait();
+			if (exception)
+				std::rethrow_exception(exception);
+		}
+
+		template <class T, class TMap, class TReduce>
+		T WorkerThreadManager::parallelReduce(const size_t begin, const size_t end, const size_t grain, const T &identity,
+			TMap map, TReduce reduce)
+		{
+			size_t step = grain ? grain : 1;
+			if (begin >= end)
+				return identity;
+			std::vector<T> results((end - begin - 1) / step + 1, identity);
+			parallelFor(begin, end, step, [&](const size_t from, const size_t to) {
+				results[(from - begin) / step] = map(from, to);
+			});
+			T result = identity;
+			for (auto chunkResult = results.begin(); chunkResult != results.end(); chunkResult++)
+				result = reduce(result, *chunkResult);
+			return result;
+		}
 	};
 };
 